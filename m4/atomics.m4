@@ -0,0 +1,74 @@
+# serial 1
+
+dnl Check for C11 atomics and thread-local storage.
+dnl
+dnl Provides RRA_C_ATOMICS, which checks whether the compiler supports the
+dnl C11 <stdatomic.h> interface (including linking code that uses it, since
+dnl some platforms need a separate library) and sets HAVE_C11_ATOMICS if so,
+dnl and RRA_C_THREAD_LOCAL, which checks for a storage class for thread-local
+dnl variables.  The latter tries the C11 _Thread_local keyword and then the
+dnl older GCC __thread extension, sets HAVE_THREAD_LOCAL if either works, and
+dnl defines THREAD_LOCAL to the keyword that was found.
+dnl
+dnl The canonical version of this file is maintained in the rra-c-util
+dnl package, available at <https://www.eyrie.org/~eagle/software/rra-c-util/>.
+dnl
+dnl Written by Russ Allbery <eagle@eyrie.org>
+dnl Copyright 2024 Russ Allbery <eagle@eyrie.org>
+dnl
+dnl This file is free software; the authors give unlimited permission to copy
+dnl and/or distribute it, with or without modifications, as long as this
+dnl notice is preserved.
+dnl
+dnl SPDX-License-Identifier: FSFULLR
+
+AC_DEFUN([_RRA_C_ATOMICS_SOURCE], [[
+#include <stdatomic.h>
+#include <stddef.h>
+
+static atomic_ulong counter;
+static _Atomic(void *) pointer;
+
+int
+main(void) {
+    void *expected = NULL;
+
+    atomic_fetch_add_explicit(&counter, 1, memory_order_relaxed);
+    atomic_compare_exchange_strong(&pointer, &expected, &counter);
+    return atomic_load(&counter) == 1 ? 0 : 1;
+}
+]])
+
+AC_DEFUN([RRA_C_ATOMICS],
+[AC_CACHE_CHECK([for C11 atomics], [rra_cv_c_atomics],
+    [AC_LINK_IFELSE([AC_LANG_SOURCE([_RRA_C_ATOMICS_SOURCE])],
+        [rra_cv_c_atomics=yes],
+        [rra_cv_c_atomics=no])])
+ AS_IF([test x"$rra_cv_c_atomics" = xyes],
+    [AC_DEFINE([HAVE_C11_ATOMICS], 1,
+        [Define if the compiler supports C11 atomics.])])])
+
+AC_DEFUN([_RRA_C_THREAD_LOCAL_SOURCE], [[
+static $1 int value;
+
+int
+main(void) {
+    value = 1;
+    return value == 1 ? 0 : 1;
+}
+]])
+
+AC_DEFUN([RRA_C_THREAD_LOCAL],
+[AC_CACHE_CHECK([for thread-local storage], [rra_cv_c_thread_local],
+    [rra_cv_c_thread_local=no
+     for rra_keyword in _Thread_local __thread ; do
+        AC_LINK_IFELSE(
+            [AC_LANG_SOURCE([_RRA_C_THREAD_LOCAL_SOURCE([$rra_keyword])])],
+            [rra_cv_c_thread_local="$rra_keyword"
+             break])
+     done])
+ AS_IF([test x"$rra_cv_c_thread_local" != xno],
+    [AC_DEFINE([HAVE_THREAD_LOCAL], 1,
+        [Define if the compiler supports thread-local storage.])
+     AC_DEFINE_UNQUOTED([THREAD_LOCAL], [$rra_cv_c_thread_local],
+        [Define to the storage class for thread-local variables.])])])
@@ -0,0 +1,206 @@
+/*
+ * Arena (region) allocator for PAM modules.
+ *
+ * This is a version of util/arena.c that returns NULL on memory allocation
+ * failure instead of calling xmalloc_error_handler, since a PAM module has to
+ * return an error to its caller rather than exiting.  Memory is carved out of
+ * blocks allocated with malloc, each at least the block size given to
+ * arena_new, by advancing an offset into the most recent block.  Every
+ * allocation is aligned suitably for any type.  When the current block
+ * doesn't have enough room, a new block is allocated and the remaining space
+ * in the old block is abandoned.  Allocations larger than the block size get
+ * a block of their own.
+ *
+ * The canonical version of this file is maintained in the rra-c-util package,
+ * which can be found at <https://www.eyrie.org/~eagle/software/rra-c-util/>.
+ *
+ * Written by Russ Allbery <eagle@eyrie.org>
+ * Copyright 2024 Russ Allbery <eagle@eyrie.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <config.h>
+#include <portable/system.h>
+
+#include <errno.h>
+
+#include <pam-util/arena.h>
+
+/*
+ * Used to determine the alignment of arena allocations, which must be
+ * suitable for any type the caller may store.
+ */
+union arena_align {
+    long double ld;
+    long long ll;
+    double d;
+    void *p;
+    void (*f)(void);
+};
+#define ARENA_ALIGN sizeof(union arena_align)
+
+/* Round a size up to the arena alignment, saturating on overflow. */
+#define ARENA_ROUND(s)                  \
+    (((s) > SIZE_MAX - ARENA_ALIGN)     \
+         ? SIZE_MAX - ARENA_ALIGN + 1   \
+         : ((s) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1))
+
+/*
+ * A block of memory from which allocations are made.  Blocks are kept in a
+ * singly-linked list with the most recent first.  The data starts at
+ * ARENA_HEADER bytes from the start of the block to preserve alignment.
+ */
+struct arena_block {
+    struct arena_block *next;
+    size_t size; /* Usable size of the block, excluding the header. */
+    size_t used; /* Bytes already handed out. */
+};
+#define ARENA_HEADER ARENA_ROUND(sizeof(struct arena_block))
+#define ARENA_DATA(b) ((char *) (b) + ARENA_HEADER)
+
+struct arena {
+    struct arena_block *current; /* Block used for allocations. */
+    size_t block_size;           /* Minimum size of new blocks. */
+};
+
+
+/*
+ * Create a new arena.  Returns NULL if memory allocation fails.
+ */
+struct arena *
+arena_new(size_t block_size)
+{
+    struct arena *arena;
+
+    arena = malloc(sizeof(struct arena));
+    if (arena == NULL)
+        return NULL;
+    arena->current = NULL;
+    if (block_size == 0)
+        block_size = ARENA_BLOCK_SIZE;
+    arena->block_size = ARENA_ROUND(block_size);
+    return arena;
+}
+
+
+/*
+ * Free an arena.  Any pointers into the arena become invalid.
+ */
+void
+arena_free(struct arena *arena)
+{
+    struct arena_block *block, *next;
+
+    if (arena == NULL)
+        return;
+    for (block = arena->current; block != NULL; block = next) {
+        next = block->next;
+        free(block);
+    }
+    free(arena);
+}
+
+
+/*
+ * Allocate memory from an arena, allocating a new block if needed.  Returns
+ * NULL with errno set if memory allocation fails.
+ */
+void *
+arena_alloc(struct arena *arena, size_t size)
+{
+    struct arena_block *block;
+    size_t data_size, total;
+    void *p;
+
+    size = ARENA_ROUND(size > 0 ? size : 1);
+    block = arena->current;
+    if (block == NULL || block->size - block->used < size) {
+        data_size = (size > arena->block_size) ? size : arena->block_size;
+        total = data_size + ARENA_HEADER;
+        if (total < data_size) {
+            errno = ENOMEM;
+            return NULL;
+        }
+        block = malloc(total);
+        if (block == NULL)
+            return NULL;
+        block->size = data_size;
+        block->used = 0;
+        block->next = arena->current;
+        arena->current = block;
+    }
+    p = ARENA_DATA(block) + block->used;
+    block->used += size;
+    return p;
+}
+
+
+void *
+arena_calloc(struct arena *arena, size_t n, size_t size)
+{
+    void *p;
+
+    if (size > 0 && n > SIZE_MAX / size) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    p = arena_alloc(arena, n * size);
+    if (p != NULL)
+        memset(p, 0, n * size);
+    return p;
+}
+
+
+char *
+arena_strdup(struct arena *arena, const char *s)
+{
+    char *p;
+    size_t len;
+
+    len = strlen(s) + 1;
+    p = arena_alloc(arena, len);
+    if (p != NULL)
+        memcpy(p, s, len);
+    return p;
+}
+
+
+/*
+ * As with strndup, don't assume that the source string is nul-terminated.
+ */
+char *
+arena_strndup(struct arena *arena, const char *s, size_t size)
+{
+    const char *p;
+    size_t length;
+    char *copy;
+
+    for (p = s; (size_t) (p - s) < size && *p != '\0'; p++)
+        ;
+    length = p - s;
+    copy = arena_alloc(arena, length + 1);
+    if (copy == NULL)
+        return NULL;
+    memcpy(copy, s, length);
+    copy[length] = '\0';
+    return copy;
+}
@@ -0,0 +1,98 @@
+/*
+ * Prototypes for the arena (region) allocator.
+ *
+ * An arena hands out memory from large blocks by bumping a pointer, and all
+ * memory allocated from an arena is freed at once by arena_free rather than
+ * individually.  Each pam_args struct has an arena that is freed with it,
+ * which holds the configuration values set by the option parsing code and
+ * anything else that should live as long as the PAM arguments.
+ *
+ * This is based on the util/arena.c library, but that library uses xmalloc
+ * routines to exit the program if memory allocation fails.  This is a
+ * modified version of the arena library that instead returns NULL on failure
+ * to allocate memory, allowing the caller to do appropriate recovery.
+ *
+ * Only the portions of the arena library used by PAM modules are
+ * implemented.
+ *
+ * The canonical version of this file is maintained in the rra-c-util package,
+ * which can be found at <https://www.eyrie.org/~eagle/software/rra-c-util/>.
+ *
+ * Written by Russ Allbery <eagle@eyrie.org>
+ * Copyright 2024 Russ Allbery <eagle@eyrie.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef PAM_UTIL_ARENA_H
+#define PAM_UTIL_ARENA_H 1
+
+#include <config.h>
+#include <portable/macros.h>
+
+#include <stddef.h>
+
+/*
+ * The block size used if zero is passed to arena_new.  PAM modules allocate
+ * much less than most users of util/arena.c, so the blocks are smaller.
+ */
+#define ARENA_BLOCK_SIZE 1024
+
+/* Opaque struct holding the arena state. */
+struct arena;
+
+BEGIN_DECLS
+
+/* Default to a hidden visibility for all util functions. */
+#pragma GCC visibility push(hidden)
+
+/* Free an arena and all memory allocated from it. */
+void arena_free(struct arena *);
+
+/*
+ * Create a new, empty arena that allocates memory in blocks of the given
+ * size, or ARENA_BLOCK_SIZE if the size is zero.  No memory is allocated for
+ * blocks until the first allocation from the arena.  Returns NULL on memory
+ * allocation failure.
+ */
+struct arena *arena_new(size_t block_size)
+    __attribute__((__warn_unused_result__, __malloc__(arena_free)));
+
+/*
+ * Allocate memory from an arena.  These behave like the corresponding libc
+ * functions, returning NULL with errno set on memory allocation failure, but
+ * the memory must not be passed to free or realloc.  It is freed when the
+ * arena is freed.
+ */
+void *arena_alloc(struct arena *, size_t size)
+    __attribute__((__alloc_size__(2), __nonnull__));
+void *arena_calloc(struct arena *, size_t n, size_t size)
+    __attribute__((__alloc_size__(2, 3), __nonnull__));
+char *arena_strdup(struct arena *, const char *) __attribute__((__nonnull__));
+char *arena_strndup(struct arena *, const char *, size_t size)
+    __attribute__((__nonnull__));
+
+/* Undo default visibility change. */
+#pragma GCC visibility pop
+
+END_DECLS
+
+#endif /* !PAM_UTIL_ARENA_H */
@@ -48,14 +48,32 @@
 
 #include <errno.h>
 
+#include <pam-util/arena.h>
 #include <pam-util/args.h>
 #include <pam-util/logging.h>
+#include <pam-util/timing.h>
+
+/* Used for unused parameters to silence gcc warnings. */
+#define UNUSED __attribute__((__unused__))
+
+/*
+ * A cached pam_args struct and what's needed to check and free it.  The
+ * struct and the copy of the arguments are allocated from the arena of the
+ * cached pam_args struct.
+ */
+struct args_cache {
+    struct pam_args *args;
+    int argc;
+    char **argv;
+    void (*config_free)(struct pam_config *);
+};
 
 
 /*
  * Allocate a new pam_args struct and return it, or NULL on memory allocation
  * or Kerberos initialization failure.  If HAVE_KRB5 is defined, we also
- * allocate a Kerberos context.
+ * allocate a Kerberos context.  The arena doesn't allocate any blocks until
+ * it's first used, so creating it is cheap.
  */
 struct pam_args *
 putil_args_new(pam_handle_t *pamh, int flags)
@@ -70,16 +88,26 @@ putil_args_new(pam_handle_t *pamh, int flags)
         putil_crit(NULL, "cannot allocate memory: %s", strerror(errno));
         return NULL;
     }
+    args->arena = arena_new(0);
+    if (args->arena == NULL) {
+        putil_crit(NULL, "cannot allocate memory: %s", strerror(errno));
+        free(args);
+        return NULL;
+    }
     args->pamh = pamh;
     args->silent = ((flags & PAM_SILENT) == PAM_SILENT);
+    putil_timing_init(args);
 
 #ifdef HAVE_KRB5
+    putil_timing_phase_start(args, PUTIL_PHASE_KRB5);
     if (issetugid())
         status = krb5_init_secure_context(&args->ctx);
     else
         status = krb5_init_context(&args->ctx);
+    putil_timing_phase_end(args, PUTIL_PHASE_KRB5);
     if (status != 0) {
         putil_err_krb5(args, status, "cannot create Kerberos context");
+        arena_free(args->arena);
         free(args);
         return NULL;
     }
@@ -94,12 +122,106 @@ putil_args_new(pam_handle_t *pamh, int flags)
 void
 putil_args_free(struct pam_args *args)
 {
-    if (args == NULL)
+    if (args == NULL || args->cached)
         return;
 #ifdef HAVE_KRB5
     free(args->realm);
     if (args->ctx != NULL)
         krb5_free_context(args->ctx);
 #endif
+    arena_free(args->arena);
     free(args);
 }
+
+
+/*
+ * Free a cached pam_args struct.  Called by PAM when the handle is closed or
+ * the data is replaced.  The cache struct is in the arena of the pam_args
+ * struct, so freeing that must come last.
+ */
+static void
+cache_cleanup(pam_handle_t *pamh UNUSED, void *data, int status UNUSED)
+{
+    struct args_cache *cache = data;
+    struct pam_args *args = cache->args;
+
+    args->cached = false;
+    if (args->config != NULL && cache->config_free != NULL)
+        cache->config_free(args->config);
+    args->config = NULL;
+    putil_args_free(args);
+}
+
+
+/*
+ * Return the pam_args struct cached in the PAM handle under name if it was
+ * configured from the same arguments, updating the settings that depend on
+ * the PAM flags.  Returns NULL if there is no usable cached struct.
+ */
+struct pam_args *
+putil_args_cache_get(pam_handle_t *pamh, const char *name, int flags,
+                     int argc, const char *argv[])
+{
+    const void *data = NULL;
+    const struct args_cache *cache;
+    struct pam_args *args;
+    int i;
+
+    if (pam_get_data(pamh, name, (void *) &data) != PAM_SUCCESS)
+        return NULL;
+    cache = data;
+    if (cache == NULL || cache->argc != argc)
+        return NULL;
+    for (i = 0; i < argc; i++)
+        if (strcmp(cache->argv[i], argv[i]) != 0)
+            return NULL;
+    args = cache->args;
+    args->silent = ((flags & PAM_SILENT) == PAM_SILENT);
+    args->user = NULL;
+    putil_timing_init(args);
+    return args;
+}
+
+
+/*
+ * Cache a configured pam_args struct in its PAM handle under name, along with
+ * a copy of the arguments it was configured from.  Returns false on failure,
+ * in which case the caller still owns the struct.  Anything allocated from
+ * the arena before a failure is freed with the struct.
+ */
+bool
+putil_args_cache_set(struct pam_args *args, const char *name, int argc,
+                     const char *argv[],
+                     void (*config_free)(struct pam_config *))
+{
+    struct args_cache *cache;
+    int i, status;
+
+    if (args->cached)
+        return true;
+    cache = arena_calloc(args->arena, 1, sizeof(struct args_cache));
+    if (cache == NULL)
+        goto fail;
+    cache->args = args;
+    cache->config_free = config_free;
+    cache->argc = argc;
+    cache->argv = arena_calloc(args->arena, (size_t) argc + 1, sizeof(char *));
+    if (cache->argv == NULL)
+        goto fail;
+    for (i = 0; i < argc; i++) {
+        cache->argv[i] = arena_strdup(args->arena, argv[i]);
+        if (cache->argv[i] == NULL)
+            goto fail;
+    }
+    status = pam_set_data(args->pamh, name, cache, cache_cleanup);
+    if (status != PAM_SUCCESS) {
+        putil_err_pam(args, status, "cannot cache PAM arguments");
+        return false;
+    }
+    args->cached = true;
+    return true;
+
+fail:
+    putil_crit(args, "cannot allocate memory: %s", strerror(errno));
+    return false;
+}
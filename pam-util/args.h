@@ -47,7 +47,10 @@
 #include <portable/pam.h>
 #include <portable/stdbool.h>
 
+#include <pam-util/timing.h>
+
 /* Opaque struct from the PAM utility perspective. */
+struct arena;
 struct pam_config;
 
 struct pam_args {
@@ -56,6 +59,11 @@ struct pam_args {
     bool debug;                /* Log debugging information. */
     bool silent;               /* Do not pass text to the application. */
     const char *user;          /* User being authenticated. */
+    bool cached;               /* Owned by the PAM handle, see below. */
+    struct arena *arena;       /* Memory freed with the struct. */
+    bool timing;               /* Log and record timing of each call. */
+    const char *metrics;       /* Path to the metrics file, if any. */
+    struct putil_timing times; /* Timing of the current call. */
 
 #ifdef HAVE_KRB5
     krb5_context ctx; /* Context for Kerberos operations. */
@@ -71,11 +79,41 @@ BEGIN_DECLS
 /*
  * Allocate and free the pam_args struct.  We assume that user is a pointer to
  * a string maintained elsewhere and don't free it here.  config must be freed
- * separately by the caller.
+ * separately by the caller.  The values of borrowed options from krb5.conf
+ * are allocated from the arena member and are freed with the struct.
  */
 struct pam_args *putil_args_new(pam_handle_t *, int flags);
 void putil_args_free(struct pam_args *);
 
+/*
+ * Optionally cache a configured pam_args struct in the PAM handle so that
+ * later PAM calls with the same handle can reuse it, including its parsed
+ * configuration and Kerberos context.  name is the PAM data name under which
+ * to store it and should be unique to the module.
+ *
+ * putil_args_cache_get returns the cached struct if there is one and it was
+ * configured from the same arguments, and otherwise returns NULL.  Only
+ * the silent setting depends on the PAM flags, so a cached struct is reused
+ * with new flags and its silent setting updated.  The user member is reset to
+ * NULL.
+ *
+ * putil_args_cache_set stores a fully configured struct in the PAM handle,
+ * replacing (and freeing) any previously cached struct with that name.  It
+ * takes the arguments the configuration was parsed from and a function to
+ * free the config member, which is called when the PAM handle is closed.  On
+ * success, the cached member is set to true and the struct belongs to the PAM
+ * handle: putil_args_free() does nothing to it, and the caller must not free
+ * the config member.  Returns false if the struct could not be cached, in
+ * which case the caller still owns it.
+ */
+struct pam_args *putil_args_cache_get(pam_handle_t *, const char *name,
+                                      int flags, int argc, const char *argv[])
+    __attribute__((__nonnull__(1, 2)));
+bool putil_args_cache_set(struct pam_args *, const char *name, int argc,
+                          const char *argv[],
+                          void (*config_free)(struct pam_config *))
+    __attribute__((__nonnull__(1, 2)));
+
 /* Undo default visibility change. */
 #pragma GCC visibility pop
 
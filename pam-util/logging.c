@@ -74,66 +74,145 @@ static const struct {
 
 
 /*
- * Utility function to format a message into newly allocated memory, reporting
- * an error via syslog if vasprintf fails.
+ * Size of the buffer on the stack into which log messages are formatted.
+ * Longer messages are formatted into memory allocated with malloc.
  */
-static char *__attribute__((__format__(printf, 1, 0)))
-format(const char *fmt, va_list args)
-{
-    char *msg;
+#define MESSAGE_BUFSIZ 1024
 
-    if (vasprintf(&msg, fmt, args) < 0) {
-        syslog(LOG_CRIT | LOG_AUTHPRIV, "vasprintf failed: %m");
-        return NULL;
-    }
-    return msg;
-}
+/*
+ * A log message being formatted.  text points either to buffer or, once the
+ * message has outgrown it, to allocated memory.
+ */
+struct message {
+    char *text;
+    size_t length;
+    size_t size;
+    char buffer[MESSAGE_BUFSIZ];
+};
 
 
 /*
- * Log wrapper function that adds the user.  Log a message with the given
- * priority, prefixed by (user <user>) with the account name being
- * authenticated if known.
+ * Returns whether a message at the given priority would be logged, so that
+ * messages that would be discarded are never formatted.  Debug messages are
+ * only logged if debugging is enabled, and nothing is logged for priorities
+ * excluded from the syslog mask.
  */
-static void __attribute__((__format__(printf, 3, 0)))
-log_vplain(struct pam_args *pargs, int priority, const char *fmt, va_list args)
+static bool
+log_enabled(struct pam_args *pargs, int priority)
 {
-    char *msg;
-
     if (priority == LOG_DEBUG && (pargs == NULL || !pargs->debug))
+        return false;
+    return (setlogmask(0) & LOG_MASK(priority)) != 0;
+}
+
+
+/*
+ * Append formatted text to a log message.  If the message no longer fits in
+ * its buffer, move it to allocated memory and format the new text again.  If
+ * memory allocation fails, the message is truncated.
+ */
+static void __attribute__((__format__(printf, 2, 0)))
+message_vappend(struct message *msg, const char *fmt, va_list args)
+{
+    va_list args_copy;
+    char *text;
+    size_t size;
+    int status;
+
+    va_copy(args_copy, args);
+    status = vsnprintf(msg->text + msg->length, msg->size - msg->length, fmt,
+                       args_copy);
+    va_end(args_copy);
+    if (status < 0)
+        return;
+    if ((size_t) status < msg->size - msg->length) {
+        msg->length += (size_t) status;
         return;
-    if (pargs != NULL && pargs->user != NULL) {
-        msg = format(fmt, args);
-        if (msg == NULL)
-            return;
-        pam_syslog(pargs->pamh, priority, "(user %s) %s", pargs->user, msg);
-        free(msg);
-    } else if (pargs != NULL) {
-        pam_vsyslog(pargs->pamh, priority, fmt, args);
+    }
+    size = msg->length + (size_t) status + 1;
+    if (msg->text == msg->buffer) {
+        text = malloc(size);
+        if (text != NULL)
+            memcpy(text, msg->buffer, msg->length);
     } else {
-        msg = format(fmt, args);
-        if (msg == NULL)
-            return;
-        syslog(priority | LOG_AUTHPRIV, "%s", msg);
-        free(msg);
+        text = realloc(msg->text, size);
+    }
+    if (text == NULL) {
+        syslog(LOG_CRIT | LOG_AUTHPRIV, "cannot allocate memory: %m");
+        msg->length = msg->size - 1;
+        return;
     }
+    msg->text = text;
+    msg->size = size;
+    vsnprintf(msg->text + msg->length, msg->size - msg->length, fmt, args);
+    msg->length += (size_t) status;
 }
 
 
 /*
- * Wrapper around log_vplain with variadic arguments.
+ * Wrapper around message_vappend with variadic arguments.
  */
-static void __attribute__((__format__(printf, 3, 4)))
-log_plain(struct pam_args *pargs, int priority, const char *fmt, ...)
+static void __attribute__((__format__(printf, 2, 3)))
+message_append(struct message *msg, const char *fmt, ...)
 {
     va_list args;
 
     va_start(args, fmt);
-    log_vplain(pargs, priority, fmt, args);
+    message_vappend(msg, fmt, args);
     va_end(args);
 }
 
 
+/*
+ * Start a new log message, prefixed by (user <user>) with the account name
+ * being authenticated if known.
+ */
+static void
+message_start(struct message *msg, struct pam_args *pargs)
+{
+    msg->text = msg->buffer;
+    msg->length = 0;
+    msg->size = sizeof(msg->buffer);
+    msg->buffer[0] = '\0';
+    if (pargs != NULL && pargs->user != NULL)
+        message_append(msg, "(user %s) ", pargs->user);
+}
+
+
+/*
+ * Log a message with the given priority, using pam_syslog if we have PAM
+ * arguments and syslog otherwise, and then free it.
+ */
+static void
+message_send(struct pam_args *pargs, int priority, struct message *msg)
+{
+    if (pargs != NULL)
+        pam_syslog(pargs->pamh, priority, "%s", msg->text);
+    else
+        syslog(priority | LOG_AUTHPRIV, "%s", msg->text);
+    if (msg->text != msg->buffer)
+        free(msg->text);
+}
+
+
+/*
+ * Log wrapper function that adds the user.  Log a message with the given
+ * priority, prefixed by (user <user>) with the account name being
+ * authenticated if known.
+ */
+static void __attribute__((__format__(printf, 3, 0)))
+log_vplain(struct pam_args *pargs, int priority, const char *fmt, va_list args)
+{
+    struct message msg;
+
+    if (!log_enabled(pargs, priority))
+        return;
+    message_start(&msg, pargs);
+    message_vappend(&msg, fmt, args);
+    message_send(pargs, priority, &msg);
+}
+
+
 /*
  * Log wrapper function for reporting a PAM error.  Log a message with the
  * given priority, prefixed by (user <user>) with the account name being
@@ -145,21 +224,15 @@ static void __attribute__((__format__(printf, 4, 0)))
 log_pam(struct pam_args *pargs, int priority, int status, const char *fmt,
         va_list args)
 {
-    char *msg;
+    struct message msg;
 
-    if (priority == LOG_DEBUG && (pargs == NULL || !pargs->debug))
-        return;
-    msg = format(fmt, args);
-    if (msg == NULL)
+    if (!log_enabled(pargs, priority))
         return;
-    if (pargs == NULL)
-        log_plain(NULL, priority, "%s", msg);
-    else if (status == PAM_SUCCESS)
-        log_plain(pargs, priority, "%s", msg);
-    else
-        log_plain(pargs, priority, "%s: %s", msg,
-                  pam_strerror(pargs->pamh, status));
-    free(msg);
+    message_start(&msg, pargs);
+    message_vappend(&msg, fmt, args);
+    if (pargs != NULL && status != PAM_SUCCESS)
+        message_append(&msg, ": %s", pam_strerror(pargs->pamh, status));
+    message_send(pargs, priority, &msg);
 }
 
 
@@ -203,40 +276,23 @@ LOG_FUNCTION(debug,  LOG_DEBUG)
 void
 putil_log_entry(struct pam_args *pargs, const char *func, int flags)
 {
-    size_t i, length, offset;
-    char *out = NULL, *nout;
+    struct message msg;
+    const char *separator = " (";
+    size_t i;
 
-    if (!pargs->debug)
+    if (!log_enabled(pargs, LOG_DEBUG))
         return;
-    if (flags != 0)
-        for (i = 0; i < ARRAY_SIZE(FLAGS); i++) {
-            if (!(flags & FLAGS[i].flag))
-                continue;
-            if (out == NULL) {
-                out = strdup(FLAGS[i].name);
-                if (out == NULL)
-                    break;
-            } else {
-                length = strlen(FLAGS[i].name);
-                nout = realloc(out, strlen(out) + length + 2);
-                if (nout == NULL) {
-                    free(out);
-                    out = NULL;
-                    break;
-                }
-                out = nout;
-                offset = strlen(out);
-                out[offset] = '|';
-                memcpy(out + offset + 1, FLAGS[i].name, length);
-                out[offset + 1 + length] = '\0';
-            }
-        }
-    if (out == NULL)
-        pam_syslog(pargs->pamh, LOG_DEBUG, "%s: entry", func);
-    else {
-        pam_syslog(pargs->pamh, LOG_DEBUG, "%s: entry (%s)", func, out);
-        free(out);
+    message_start(&msg, NULL);
+    message_append(&msg, "%s: entry", func);
+    for (i = 0; i < ARRAY_SIZE(FLAGS); i++) {
+        if (!(flags & FLAGS[i].flag))
+            continue;
+        message_append(&msg, "%s%s", separator, FLAGS[i].name);
+        separator = "|";
     }
+    if (separator[0] == '|')
+        message_append(&msg, ")");
+    message_send(pargs, LOG_DEBUG, &msg);
 }
 
 
@@ -249,35 +305,36 @@ putil_log_entry(struct pam_args *pargs, const char *func, int flags)
 void __attribute__((__format__(printf, 2, 3)))
 putil_log_failure(struct pam_args *pargs, const char *fmt, ...)
 {
-    char *msg;
+    struct message msg;
     va_list args;
     const char *ruser = NULL;
     const char *rhost = NULL;
     const char *tty = NULL;
     const char *name = NULL;
 
+    if (!log_enabled(pargs, LOG_NOTICE))
+        return;
     if (pargs->user != NULL)
         name = pargs->user;
+    message_start(&msg, NULL);
     va_start(args, fmt);
-    msg = format(fmt, args);
+    message_vappend(&msg, fmt, args);
     va_end(args);
-    if (msg == NULL)
-        return;
     pam_get_item(pargs->pamh, PAM_RUSER, (PAM_CONST void **) &ruser);
     pam_get_item(pargs->pamh, PAM_RHOST, (PAM_CONST void **) &rhost);
     pam_get_item(pargs->pamh, PAM_TTY, (PAM_CONST void **) &tty);
 
     /* clang-format off */
-    pam_syslog(pargs->pamh, LOG_NOTICE, "%s; logname=%s uid=%ld euid=%ld"
-               " tty=%s ruser=%s rhost=%s", msg,
-               (name  != NULL) ? name  : "",
-               (long) getuid(), (long) geteuid(),
-               (tty   != NULL) ? tty   : "",
-               (ruser != NULL) ? ruser : "",
-               (rhost != NULL) ? rhost : "");
+    message_append(&msg, "; logname=%s uid=%ld euid=%ld tty=%s ruser=%s"
+                   " rhost=%s",
+                   (name  != NULL) ? name  : "",
+                   (long) getuid(), (long) geteuid(),
+                   (tty   != NULL) ? tty   : "",
+                   (ruser != NULL) ? ruser : "",
+                   (rhost != NULL) ? rhost : "");
     /* clang-format on */
 
-    free(msg);
+    message_send(pargs, LOG_NOTICE, &msg);
 }
 
 
@@ -298,23 +355,19 @@ __attribute__((__format__(printf, 4, 0))) static void
 log_krb5(struct pam_args *pargs, int priority, int status, const char *fmt,
          va_list args)
 {
-    char *msg;
-    const char *k5_msg = NULL;
+    struct message msg;
+    const char *k5_msg;
 
-    if (priority == LOG_DEBUG && (pargs == NULL || !pargs->debug))
-        return;
-    msg = format(fmt, args);
-    if (msg == NULL)
+    if (!log_enabled(pargs, priority))
         return;
+    message_start(&msg, pargs);
+    message_vappend(&msg, fmt, args);
     if (pargs != NULL && pargs->ctx != NULL) {
         k5_msg = krb5_get_error_message(pargs->ctx, status);
-        log_plain(pargs, priority, "%s: %s", msg, k5_msg);
-    } else {
-        log_plain(pargs, priority, "%s", msg);
-    }
-    free(msg);
-    if (k5_msg != NULL)
+        message_append(&msg, ": %s", k5_msg);
         krb5_free_error_message(pargs->ctx, k5_msg);
+    }
+    message_send(pargs, priority, &msg);
 }
 
 
@@ -43,6 +43,9 @@
 #include <stddef.h>
 #include <syslog.h>
 
+#include <pam-util/metrics.h>
+#include <pam-util/timing.h>
+
 /* Forward declarations to avoid extra includes. */
 struct pam_args;
 
@@ -112,14 +115,24 @@ END_DECLS
 #    endif
 #endif
 
-/* Macros to record entry and exit from the main PAM functions. */
+/*
+ * Macros to record entry and exit from the main PAM functions, logging them
+ * if debugging is enabled, timing the call if timing is enabled, and counting
+ * it in the metrics file if one is configured.
+ */
 #define ENTRY(args, flags)                              \
     do {                                                \
+        if (args->timing)                               \
+            putil_timing_start(args);                   \
         if (args->debug)                                \
             putil_log_entry((args), __func__, (flags)); \
     } while (0)
 #define EXIT(args, pamret)                                                \
     do {                                                                  \
+        if (args != NULL && args->timing)                                 \
+            putil_timing_end((args), __func__, (pamret));                 \
+        if (args != NULL && args->metrics != NULL)                        \
+            putil_metrics_record((args), __func__, (pamret));             \
         if (args != NULL && args->debug)                                  \
             pam_syslog(                                                   \
                 (args)->pamh, LOG_DEBUG, "%s: exit (%s)", __func__,       \
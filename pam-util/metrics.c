@@ -0,0 +1,310 @@
+/*
+ * PAM call metrics in a shared memory-mapped file.
+ *
+ * The file holds a header followed by a fixed table of counters for each PAM
+ * entry point, so it never needs to be reorganized and a new file is just
+ * zeroes.  The first process to record to it sets the magic number, which
+ * also encodes the size of the counters so that a reader or writer built
+ * with a different size refuses to use it.  Every counter is an atomic
+ * unsigned long in the shared mapping, updated with relaxed atomic adds,
+ * since nothing depends on the order in which other processes see them.
+ *
+ * The canonical version of this file is maintained in the rra-c-util package,
+ * which can be found at <https://www.eyrie.org/~eagle/software/rra-c-util/>.
+ *
+ * Written by Russ Allbery <eagle@eyrie.org>
+ * Copyright 2024 Russ Allbery <eagle@eyrie.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <config.h>
+#include <portable/system.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#ifdef HAVE_PTHREAD
+#    include <pthread.h>
+#endif
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include <pam-util/args.h>
+#include <pam-util/logging.h>
+#include <pam-util/metrics.h>
+#include <pam-util/timing.h>
+
+/* Used for unused parameters to silence gcc warnings. */
+#define UNUSED __attribute__((__unused__))
+
+#ifndef O_CLOEXEC
+#    define O_CLOEXEC 0
+#endif
+#ifndef O_NOFOLLOW
+#    define O_NOFOLLOW 0
+#endif
+
+/* The names of the PAM functions, in the order of the table in the file. */
+const char *const putil_metrics_functions[PUTIL_METRICS_FUNCTIONS] = {
+    "pam_sm_authenticate", "pam_sm_setcred",       "pam_sm_acct_mgmt",
+    "pam_sm_open_session", "pam_sm_close_session", "pam_sm_chauthtok",
+};
+
+#ifdef PUTIL_METRICS_ENABLED
+
+/* Identifies a metrics file, including the size of the counters. */
+#    define METRICS_MAGIC \
+        (0x504d5400UL | (unsigned long) sizeof(atomic_ulong))
+
+/* The counters for one PAM function. */
+struct metrics_function {
+    atomic_ulong codes[PUTIL_METRICS_CODES];
+    atomic_ulong total;
+    atomic_ulong histogram[PUTIL_TIMING_BUCKETS];
+};
+
+/* The layout of the file. */
+struct metrics_file {
+    atomic_ulong magic;
+    struct metrics_function functions[PUTIL_METRICS_FUNCTIONS];
+};
+
+/* Seconds to wait before trying again to open a file that failed. */
+#    define METRICS_RETRY 60
+
+/*
+ * The file mapped by this process and its path, and the last path that
+ * couldn't be opened and when, protected by a lock so that the mapping isn't
+ * replaced while another thread is recording.
+ */
+static struct metrics_file *metrics_map = NULL;
+static char *metrics_path = NULL;
+static char *metrics_failed_path = NULL;
+static time_t metrics_failed_time = 0;
+
+#    ifdef HAVE_PTHREAD
+static pthread_mutex_t metrics_lock = PTHREAD_MUTEX_INITIALIZER;
+#        define LOCK()   pthread_mutex_lock(&metrics_lock)
+#        define UNLOCK() pthread_mutex_unlock(&metrics_lock)
+#    else
+#        define LOCK()   /* empty */
+#        define UNLOCK() /* empty */
+#    endif
+
+
+/*
+ * Open and map a metrics file, creating it or extending it to the right size
+ * if needed.  If writable is false, open it read-only and fail if it's too
+ * short.  Returns NULL and sets errno on failure.
+ */
+static struct metrics_file *
+metrics_open(const char *path, bool writable)
+{
+    struct metrics_file *file;
+    struct stat st;
+    int fd, oerrno;
+    unsigned long magic;
+    int flags = O_CLOEXEC | O_NOFOLLOW;
+
+    if (writable)
+        fd = open(path, O_RDWR | O_CREAT | flags, 0644);
+    else
+        fd = open(path, O_RDONLY | flags);
+    if (fd < 0)
+        return NULL;
+    if (fstat(fd, &st) < 0)
+        goto fail;
+    if (!S_ISREG(st.st_mode)) {
+        errno = EINVAL;
+        goto fail;
+    }
+    if ((size_t) st.st_size < sizeof(struct metrics_file)) {
+        if (!writable) {
+            errno = EINVAL;
+            goto fail;
+        }
+        if (ftruncate(fd, sizeof(struct metrics_file)) < 0)
+            goto fail;
+    }
+    file = mmap(NULL, sizeof(struct metrics_file),
+                writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd,
+                0);
+    if (file == MAP_FAILED)
+        goto fail;
+    close(fd);
+
+    /* A new file is all zeroes, so claim it.  Otherwise, check the magic. */
+    magic = 0;
+    if (writable)
+        atomic_compare_exchange_strong(&file->magic, &magic, METRICS_MAGIC);
+    else
+        magic = atomic_load(&file->magic);
+    if (magic != 0 && magic != METRICS_MAGIC) {
+        munmap(file, sizeof(struct metrics_file));
+        errno = EINVAL;
+        return NULL;
+    }
+    return file;
+
+fail:
+    oerrno = errno;
+    close(fd);
+    errno = oerrno;
+    return NULL;
+}
+
+
+/*
+ * Map the metrics file at the given path for writing, replacing the current
+ * mapping if it's for a different path.  Must be called with the lock held.
+ * Returns NULL on failure after reporting the error.  If a path can't be
+ * opened, don't try it again for METRICS_RETRY seconds, so that the error
+ * isn't reported for every call.
+ */
+static struct metrics_file *
+metrics_get(struct pam_args *args, const char *path)
+{
+    struct metrics_file *file;
+    struct timespec now;
+    char *copy;
+
+    if (metrics_path != NULL && strcmp(metrics_path, path) == 0)
+        return metrics_map;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (metrics_failed_path != NULL && strcmp(metrics_failed_path, path) == 0
+        && now.tv_sec - metrics_failed_time < METRICS_RETRY)
+        return NULL;
+    copy = strdup(path);
+    file = (copy == NULL) ? NULL : metrics_open(path, true);
+    if (file == NULL) {
+        putil_err(args, "cannot open metrics file %s: %s", path,
+                  strerror(errno));
+        free(metrics_failed_path);
+        metrics_failed_path = copy;
+        metrics_failed_time = now.tv_sec;
+        return NULL;
+    }
+    if (metrics_map != NULL)
+        munmap(metrics_map, sizeof(struct metrics_file));
+    free(metrics_path);
+    metrics_map = file;
+    metrics_path = copy;
+    return file;
+}
+
+
+/*
+ * Record a call to a PAM function.
+ */
+void
+putil_metrics_record(struct pam_args *args, const char *func, int pamret)
+{
+    struct metrics_function *counters;
+    struct metrics_file *file;
+    unsigned long usec, value;
+    size_t i, code, bucket;
+
+    if (args->metrics == NULL)
+        return;
+    for (i = 0; i < PUTIL_METRICS_FUNCTIONS; i++)
+        if (strcmp(func, putil_metrics_functions[i]) == 0)
+            break;
+    if (i == PUTIL_METRICS_FUNCTIONS)
+        return;
+    usec = putil_timing_elapsed(args);
+    code = (pamret >= 0 && pamret < PUTIL_METRICS_CODES - 1)
+               ? (size_t) pamret
+               : PUTIL_METRICS_CODES - 1;
+    for (bucket = 0, value = usec;
+         value >= 2 && bucket < PUTIL_TIMING_BUCKETS - 1; bucket++)
+        value >>= 1;
+
+    LOCK();
+    file = metrics_get(args, args->metrics);
+    if (file != NULL) {
+        counters = &file->functions[i];
+        atomic_fetch_add_explicit(&counters->codes[code], 1,
+                                  memory_order_relaxed);
+        atomic_fetch_add_explicit(&counters->total, usec,
+                                  memory_order_relaxed);
+        atomic_fetch_add_explicit(&counters->histogram[bucket], 1,
+                                  memory_order_relaxed);
+    }
+    UNLOCK();
+}
+
+
+/*
+ * Read the metrics from a file.
+ */
+bool
+putil_metrics_read(const char *path, struct putil_metrics *metrics)
+{
+    struct metrics_file *file;
+    struct metrics_function *counters;
+    struct putil_metrics_function *function;
+    size_t i, j;
+
+    memset(metrics, 0, sizeof(*metrics));
+    file = metrics_open(path, false);
+    if (file == NULL)
+        return false;
+    for (i = 0; i < PUTIL_METRICS_FUNCTIONS; i++) {
+        counters = &file->functions[i];
+        function = &metrics->functions[i];
+        function->name = putil_metrics_functions[i];
+        for (j = 0; j < PUTIL_METRICS_CODES; j++) {
+            function->codes[j] = atomic_load_explicit(&counters->codes[j],
+                                                      memory_order_relaxed);
+            function->calls += function->codes[j];
+        }
+        function->total =
+            atomic_load_explicit(&counters->total, memory_order_relaxed);
+        for (j = 0; j < PUTIL_TIMING_BUCKETS; j++)
+            function->histogram[j] = atomic_load_explicit(
+                &counters->histogram[j], memory_order_relaxed);
+    }
+    munmap(file, sizeof(struct metrics_file));
+    return true;
+}
+
+#else /* !PUTIL_METRICS_ENABLED */
+
+/*
+ * Without lock-free atomics, updates from different processes could be lost,
+ * so don't keep metrics at all.
+ */
+void
+putil_metrics_record(struct pam_args *args UNUSED, const char *func UNUSED,
+                     int pamret UNUSED)
+{
+}
+
+bool
+putil_metrics_read(const char *path UNUSED,
+                   struct putil_metrics *metrics UNUSED)
+{
+    errno = ENOSYS;
+    return false;
+}
+
+#endif /* !PUTIL_METRICS_ENABLED */
@@ -0,0 +1,127 @@
+/*
+ * Interface to PAM call metrics in a shared memory-mapped file.
+ *
+ * PAM modules run inside short-lived processes, so metrics can't be kept in
+ * memory and scraped.  Instead, if the metrics member of the pam_args struct
+ * is set to the path of a file (normally under /run), EXIT counts each call
+ * by PAM function and return code and adds its duration to a histogram in
+ * that file.  Counters are updated with atomic operations on a shared
+ * mapping, so any number of processes can record to the same file, and it
+ * can be read at any time with putil_metrics_read() or the pam-metrics
+ * program.
+ *
+ * Recording requires C11 atomics that are always lock-free for unsigned long,
+ * since a lock couldn't be shared with other processes through the mapping.
+ * Without them, putil_metrics_record does nothing and putil_metrics_read
+ * fails with ENOSYS.  PUTIL_METRICS_ENABLED is defined if metrics work.
+ *
+ * The canonical version of this file is maintained in the rra-c-util package,
+ * which can be found at <https://www.eyrie.org/~eagle/software/rra-c-util/>.
+ *
+ * Written by Russ Allbery <eagle@eyrie.org>
+ * Copyright 2024 Russ Allbery <eagle@eyrie.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef PAM_UTIL_METRICS_H
+#define PAM_UTIL_METRICS_H 1
+
+#include <config.h>
+#include <portable/macros.h>
+#include <portable/stdbool.h>
+
+#ifdef HAVE_C11_ATOMICS
+#    include <stdatomic.h>
+#endif
+
+#include <pam-util/timing.h>
+
+#if defined(HAVE_C11_ATOMICS) && ATOMIC_LONG_LOCK_FREE == 2
+#    define PUTIL_METRICS_ENABLED 1
+#endif
+
+/* Forward declarations to avoid extra includes. */
+struct pam_args;
+
+/*
+ * The number of return codes counted separately.  Return codes at or above
+ * the last one are all counted in the last one.
+ */
+#define PUTIL_METRICS_CODES 32
+
+/*
+ * The number of PAM functions for which metrics are kept: the six pam_sm_*
+ * module entry points, in the order of putil_metrics_functions.
+ */
+#define PUTIL_METRICS_FUNCTIONS 6
+
+/*
+ * Metrics for one PAM function.  The histogram uses the same buckets as
+ * putil_timing_stats.
+ */
+struct putil_metrics_function {
+    const char *name;
+    unsigned long calls;                     /* Total of codes. */
+    unsigned long codes[PUTIL_METRICS_CODES]; /* Calls by return code. */
+    unsigned long total;                     /* Total microseconds. */
+    unsigned long histogram[PUTIL_TIMING_BUCKETS];
+};
+
+/* All of the metrics in a file. */
+struct putil_metrics {
+    struct putil_metrics_function functions[PUTIL_METRICS_FUNCTIONS];
+};
+
+BEGIN_DECLS
+
+/* Default to a hidden visibility for all internal functions. */
+#pragma GCC visibility push(hidden)
+
+/* The names of the PAM functions for which metrics are kept. */
+extern const char *const putil_metrics_functions[PUTIL_METRICS_FUNCTIONS];
+
+/*
+ * Count a call to the named PAM function with the given return code in the
+ * metrics file named by the metrics member of the pam_args struct, along with
+ * the time since the call started.  Normally called by EXIT.  The file is
+ * created if necessary and is mapped for the rest of the life of the process
+ * or until the path changes.  Calls to functions other than the pam_sm_*
+ * entry points are ignored.  Errors are reported with putil_err once per
+ * process and then ignored.
+ */
+void putil_metrics_record(struct pam_args *, const char *func, int pamret)
+    __attribute__((__nonnull__));
+
+/*
+ * Read the metrics from a file into the provided struct.  Returns false and
+ * sets errno on failure, including EINVAL if the file isn't a metrics file
+ * from this version of the code.
+ */
+bool putil_metrics_read(const char *path, struct putil_metrics *)
+    __attribute__((__nonnull__));
+
+/* Undo default visibility change. */
+#pragma GCC visibility pop
+
+END_DECLS
+
+#endif /* !PAM_UTIL_METRICS_H */
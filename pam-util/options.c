@@ -41,7 +41,13 @@
 #include <portable/system.h>
 
 #include <errno.h>
+#ifdef HAVE_PTHREAD
+#    include <pthread.h>
+#endif
+#include <sys/stat.h>
+#include <time.h>
 
+#include <pam-util/arena.h>
 #include <pam-util/args.h>
 #include <pam-util/logging.h>
 #include <pam-util/options.h>
@@ -56,10 +62,11 @@
  * type system lurk here.
  */
 /* clang-format off */
-#define CONF_BOOL(c, o)   (bool *)          (void *)((char *) (c) + (o))
-#define CONF_NUMBER(c, o) (long *)          (void *)((char *) (c) + (o))
-#define CONF_STRING(c, o) (char **)         (void *)((char *) (c) + (o))
-#define CONF_LIST(c, o)   (struct vector **)(void *)((char *) (c) + (o))
+#define CONF_BOOL(c, o)    (bool *)          (void *)((char *) (c) + (o))
+#define CONF_NUMBER(c, o)  (long *)          (void *)((char *) (c) + (o))
+#define CONF_STRING(c, o)  (char **)         (void *)((char *) (c) + (o))
+#define CONF_LIST(c, o)    (struct vector **)(void *)((char *) (c) + (o))
+#define CONF_BSTRING(c, o) (const char **)   (void *)((char *) (c) + (o))
 /* clang-format on */
 
 /*
@@ -74,6 +81,19 @@
 #endif
 /* clang-format on */
 
+/*
+ * Protects the process-wide krb5.conf snapshots and option indexes if POSIX
+ * threads are available.
+ */
+#ifdef HAVE_PTHREAD
+static pthread_mutex_t options_lock = PTHREAD_MUTEX_INITIALIZER;
+#    define LOCK()   pthread_mutex_lock(&options_lock)
+#    define UNLOCK() pthread_mutex_unlock(&options_lock)
+#else
+#    define LOCK()   /* empty */
+#    define UNLOCK() /* empty */
+#endif
+
 
 /*
  * Set a vector argument to its default.  This needs to do a deep copy of the
@@ -103,7 +123,7 @@ copy_default_list(struct pam_args *args, struct vector **setting,
 
 /*
  * Set a vector argument to a default based on a string.  Takes the PAM
- * argument struct,t he pointer into which to store the vector, and the
+ * argument struct, the pointer into which to store the vector, and the
  * default string.  Returns true if the default was set correctly and false on
  * memory allocation failure, which is also reported with putil_crit().
  */
@@ -126,6 +146,42 @@ default_list_string(struct pam_args *args, struct vector **setting,
 }
 
 
+/*
+ * Copy a string into the arena of the PAM arguments.  Returns NULL on memory
+ * allocation failure, which is also reported with putil_crit().
+ */
+static char *
+arena_string(struct pam_args *args, const char *value)
+{
+    char *result;
+
+    result = arena_strdup(args->arena, value);
+    if (result == NULL)
+        putil_crit(args, "cannot allocate memory: %s", strerror(errno));
+    return result;
+}
+
+
+/*
+ * Split a string on comma, space, and tab into a vector allocated from the
+ * arena of the PAM arguments.  Returns NULL on memory allocation failure,
+ * which is also reported with putil_crit().  A partial result is left in the
+ * arena to be freed with it.
+ */
+static struct vector *
+arena_list(struct pam_args *args, const char *value)
+{
+    struct vector *result;
+
+    result = vector_new_arena(args->arena);
+    if (result != NULL)
+        result = vector_split_multi(value, " \t,", result);
+    if (result == NULL)
+        putil_crit(args, "cannot allocate vector: %s", strerror(errno));
+    return result;
+}
+
+
 /*
  * Set the defaults for the PAM configuration.  Takes the PAM arguments, an
  * option table defined as above, and the number of entries in the table.  The
@@ -151,6 +207,7 @@ putil_args_defaults(struct pam_args *args, const struct option options[],
         long *tp;
 #endif
         char **sp;
+        const char **csp;
         struct vector **vp;
 
         switch (options[opt].type) {
@@ -189,6 +246,29 @@ putil_args_defaults(struct pam_args *args, const struct option options[],
             if (!default_list_string(args, vp, options[opt].defaults.string))
                 return false;
             break;
+        case TYPE_BSTRING:
+        case TYPE_BLIST:
+            csp = CONF_BSTRING(args->config, options[opt].location);
+            *csp = options[opt].defaults.string;
+            break;
+        case TYPE_ASTRING:
+            sp = CONF_STRING(args->config, options[opt].location);
+            *sp = NULL;
+            if (options[opt].defaults.string != NULL) {
+                *sp = arena_string(args, options[opt].defaults.string);
+                if (*sp == NULL)
+                    return false;
+            }
+            break;
+        case TYPE_ALIST:
+            vp = CONF_LIST(args->config, options[opt].location);
+            *vp = NULL;
+            if (options[opt].defaults.string != NULL) {
+                *vp = arena_list(args, options[opt].defaults.string);
+                if (*vp == NULL)
+                    return false;
+            }
+            break;
         }
     }
     return true;
@@ -197,15 +277,291 @@ putil_args_defaults(struct pam_args *args, const struct option options[],
 
 #ifdef HAVE_KRB5
 /*
- * Load a boolean option from Kerberos appdefaults.  Takes the PAM argument
- * struct, the section name, the realm, the option, and the result location.
+ * Snapshots of krb5.conf appdefaults settings.
+ *
+ * Every krb5_appdefault_* call walks the parsed profile for each of the
+ * places a setting may be found, and a PAM module does this for every option
+ * on every PAM call.  Instead, keep a process-wide snapshot of the results
+ * for each section and realm, and reuse it until krb5.conf changes.  Only the
+ * lookups are cached; values are still parsed on every call so that errors
+ * are reported each time.
+ *
+ * The Kerberos libraries provide no portable way to enumerate [appdefaults],
+ * so snapshots are filled in as options are looked up.  They are all thrown
+ * away if KRB5_CONFIG changes or if the device, inode, size, or modification
+ * time of any of the files it names changes.  That only catches the common
+ * cases: files pulled in with include or includedir directives, build-time
+ * default profile paths other than /etc/krb5.conf, and the profile used by
+ * secure contexts (which ignore KRB5_CONFIG) aren't checked.  Snapshots are
+ * therefore also thrown away once they're APPDEFAULT_TTL seconds old, so any
+ * change is seen within that time.
+ */
+
+/* The most krb5.conf files checked and the hash buckets per snapshot. */
+#    define APPDEFAULT_FILES   8
+#    define APPDEFAULT_BUCKETS 32
+
+/* Used if KRB5_CONFIG isn't set or is ignored. */
+#    define APPDEFAULT_CONFIG "/etc/krb5.conf"
+
+/* The most seconds for which a snapshot is used. */
+#    define APPDEFAULT_TTL 60
+
+/* The result of looking up one option. */
+struct appdefault_value {
+    struct appdefault_value *next;
+    char *option;
+    bool is_boolean;
+    bool set;     /* False if the option isn't in krb5.conf. */
+    bool boolean; /* Value of boolean options. */
+    char *string; /* Value of other options. */
+};
+
+/* The options looked up for one section and realm. */
+struct appdefault_snapshot {
+    struct appdefault_snapshot *next;
+    char *section;
+    char *realm; /* NULL if there is no realm. */
+    struct appdefault_value *buckets[APPDEFAULT_BUCKETS];
+};
+
+/* Identity of a krb5.conf file, used to notice changes. */
+struct appdefault_file {
+    bool exists;
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    time_t mtime;
+};
+
+/* The snapshots and the krb5.conf files they were taken from. */
+static struct appdefault_snapshot *appdefault_snapshots = NULL;
+static char *appdefault_config = NULL;
+static struct appdefault_file appdefault_files[APPDEFAULT_FILES];
+static time_t appdefault_time = 0;
+static bool appdefault_valid = false;
+
+
+/*
+ * Free all of the snapshots.
+ */
+static void
+appdefault_clear(void)
+{
+    struct appdefault_snapshot *snapshot;
+    struct appdefault_value *value;
+    size_t i;
+
+    while (appdefault_snapshots != NULL) {
+        snapshot = appdefault_snapshots;
+        appdefault_snapshots = snapshot->next;
+        for (i = 0; i < APPDEFAULT_BUCKETS; i++)
+            while (snapshot->buckets[i] != NULL) {
+                value = snapshot->buckets[i];
+                snapshot->buckets[i] = value->next;
+                free(value->option);
+                free(value->string);
+                free(value);
+            }
+        free(snapshot->section);
+        free(snapshot->realm);
+        free(snapshot);
+    }
+}
+
+
+/*
+ * Check whether the krb5.conf files have changed or the snapshots have
+ * expired and discard the snapshots if so.  KRB5_CONFIG is ignored if
+ * putil_args_new() would have created a secure context.  If memory
+ * allocation fails, the snapshots are not used until the next check.  Must be
+ * called with the lock held.
+ */
+static void
+appdefault_check(void)
+{
+    struct appdefault_file files[APPDEFAULT_FILES];
+    struct stat st;
+    struct timespec now;
+    const char *config = NULL;
+    char *copy, *path, *saveptr;
+    size_t i;
+
+    if (!issetugid())
+        config = getenv("KRB5_CONFIG");
+    if (config == NULL)
+        config = APPDEFAULT_CONFIG;
+    copy = strdup(config);
+    if (copy == NULL) {
+        appdefault_clear();
+        appdefault_valid = false;
+        return;
+    }
+    memset(files, 0, sizeof(files));
+    path = strtok_r(copy, ":", &saveptr);
+    for (i = 0; i < APPDEFAULT_FILES && path != NULL; i++) {
+        if (stat(path, &st) == 0) {
+            files[i].exists = true;
+            files[i].dev = st.st_dev;
+            files[i].ino = st.st_ino;
+            files[i].size = st.st_size;
+            files[i].mtime = st.st_mtime;
+        }
+        path = strtok_r(NULL, ":", &saveptr);
+    }
+    free(copy);
+
+    /* Compare field by field, since the structs may contain padding. */
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (appdefault_valid && now.tv_sec - appdefault_time < APPDEFAULT_TTL
+        && strcmp(config, appdefault_config) == 0) {
+        for (i = 0; i < APPDEFAULT_FILES; i++)
+            if (files[i].exists != appdefault_files[i].exists
+                || files[i].dev != appdefault_files[i].dev
+                || files[i].ino != appdefault_files[i].ino
+                || files[i].size != appdefault_files[i].size
+                || files[i].mtime != appdefault_files[i].mtime)
+                break;
+        if (i == APPDEFAULT_FILES)
+            return;
+    }
+    appdefault_clear();
+    free(appdefault_config);
+    appdefault_config = strdup(config);
+    appdefault_valid = (appdefault_config != NULL);
+    appdefault_time = now.tv_sec;
+    memcpy(appdefault_files, files, sizeof(files));
+}
+
+
+/*
+ * Hash an option name with FNV-1a.
+ */
+static size_t
+appdefault_hash(const char *option)
+{
+    const unsigned char *p;
+    unsigned long hash = 2166136261UL;
+
+    for (p = (const unsigned char *) option; *p != '\0'; p++)
+        hash = ((hash ^ *p) * 16777619UL) & 0xffffffffUL;
+    return hash % APPDEFAULT_BUCKETS;
+}
+
+
+/*
+ * Find the snapshot for a section and realm.  If create is true, create it if
+ * it doesn't exist.  Returns NULL if the snapshot wasn't found or couldn't be
+ * created, or if the snapshots can't be used.  Must be called with the lock
+ * held.
+ */
+static struct appdefault_snapshot *
+appdefault_snapshot(const char *section, const char *realm, bool create)
+{
+    struct appdefault_snapshot *snapshot;
+
+    if (!appdefault_valid)
+        return NULL;
+    for (snapshot = appdefault_snapshots; snapshot != NULL;
+         snapshot = snapshot->next) {
+        if (strcmp(snapshot->section, section) != 0)
+            continue;
+        if (realm == NULL ? snapshot->realm == NULL
+                          : snapshot->realm != NULL
+                                && strcmp(snapshot->realm, realm) == 0)
+            return snapshot;
+    }
+    if (!create)
+        return NULL;
+    snapshot = calloc(1, sizeof(struct appdefault_snapshot));
+    if (snapshot == NULL)
+        return NULL;
+    snapshot->section = strdup(section);
+    snapshot->realm = (realm == NULL) ? NULL : strdup(realm);
+    if (snapshot->section == NULL
+        || (realm != NULL && snapshot->realm == NULL)) {
+        free(snapshot->section);
+        free(snapshot->realm);
+        free(snapshot);
+        return NULL;
+    }
+    snapshot->next = appdefault_snapshots;
+    appdefault_snapshots = snapshot;
+    return snapshot;
+}
+
+
+/*
+ * Find the saved result of looking up an option.  Returns NULL if it hasn't
+ * been looked up yet.  Must be called with the lock held.
+ */
+static const struct appdefault_value *
+appdefault_find(const char *section, const char *realm, const char *option,
+                bool is_boolean)
+{
+    struct appdefault_snapshot *snapshot;
+    struct appdefault_value *value;
+
+    snapshot = appdefault_snapshot(section, realm, false);
+    if (snapshot == NULL)
+        return NULL;
+    value = snapshot->buckets[appdefault_hash(option)];
+    for (; value != NULL; value = value->next)
+        if (value->is_boolean == is_boolean
+            && strcmp(value->option, option) == 0)
+            return value;
+    return NULL;
+}
+
+
+/*
+ * Save the result of looking up an option.  string is NULL if the option
+ * isn't set or is a boolean.  If memory allocation fails, the result isn't
+ * saved and the option will be looked up again next time.  Must be called
+ * with the lock held.
+ */
+static void
+appdefault_save(const char *section, const char *realm, const char *option,
+                bool is_boolean, bool set, bool boolean, const char *string)
+{
+    struct appdefault_snapshot *snapshot;
+    struct appdefault_value *value;
+    size_t bucket;
+
+    snapshot = appdefault_snapshot(section, realm, true);
+    if (snapshot == NULL)
+        return;
+    value = calloc(1, sizeof(struct appdefault_value));
+    if (value == NULL)
+        return;
+    value->option = strdup(option);
+    value->string = (string == NULL) ? NULL : strdup(string);
+    if (value->option == NULL || (string != NULL && value->string == NULL)) {
+        free(value->option);
+        free(value->string);
+        free(value);
+        return;
+    }
+    value->is_boolean = is_boolean;
+    value->set = set;
+    value->boolean = boolean;
+    bucket = appdefault_hash(option);
+    value->next = snapshot->buckets[bucket];
+    snapshot->buckets[bucket] = value;
+}
+
+
+/*
+ * Look up a boolean option in Kerberos appdefaults.  Takes the PAM argument
+ * struct, the section name, the realm, the option, and the default value, and
+ * returns the setting or the default.
  *
  * The stupidity of rewriting the realm argument into a krb5_data is required
  * by MIT Kerberos.
  */
-static void
-default_boolean(struct pam_args *args, const char *section, const char *realm,
-                const char *opt, bool *result)
+static bool
+lookup_boolean(struct pam_args *args, const char *section, const char *realm,
+               const char *opt, bool defval)
 {
     int tmp;
 #    ifdef HAVE_KRB5_REALM
@@ -229,24 +585,27 @@ default_boolean(struct pam_args *args, const char *section, const char *realm,
      * Heimdal version takes a krb5_boolean *, so hope that Heimdal always
      * defines krb5_boolean to int or this will require more portability work.
      */
-    krb5_appdefault_boolean(args->ctx, section, rdata, opt, *result, &tmp);
-    *result = tmp;
+    krb5_appdefault_boolean(args->ctx, section, rdata, opt, defval, &tmp);
+    return tmp;
 }
 
 
 /*
- * Load a number option from Kerberos appdefaults.  Takes the PAM argument
- * struct, the section name, the realm, the option, and the result location.
- * The native interface doesn't support numbers, so we actually read a string
- * and then convert.
+ * Look up a string option in Kerberos appdefaults.  Takes the PAM argument
+ * struct, the section name, the realm, and the option, and returns the value
+ * in newly allocated memory or NULL if it isn't set.
+ *
+ * This requires an annoying workaround because one cannot specify a default
+ * value of NULL with MIT Kerberos, since MIT Kerberos unconditionally calls
+ * strdup on the default value.  There's also no way to determine if memory
+ * allocation failed while parsing or while setting the default value, so we
+ * don't return an error code.
  */
-static void
-default_number(struct pam_args *args, const char *section, const char *realm,
-               const char *opt, long *result)
+static char *
+lookup_string(struct pam_args *args, const char *section, const char *realm,
+              const char *opt)
 {
-    char *tmp = NULL;
-    char *end;
-    long value;
+    char *value = NULL;
 #    ifdef HAVE_KRB5_REALM
     krb5_const_realm rdata = realm;
 #    else
@@ -263,8 +622,86 @@ default_number(struct pam_args *args, const char *section, const char *realm,
     }
 #    endif
 
-    krb5_appdefault_string(args->ctx, section, rdata, opt, "", &tmp);
-    if (tmp != NULL && tmp[0] != '\0') {
+    krb5_appdefault_string(args->ctx, section, rdata, opt, "", &value);
+    if (value != NULL && value[0] == '\0') {
+        free(value);
+        value = NULL;
+    }
+    return value;
+}
+
+
+/*
+ * Get a string option from the snapshot, looking it up and saving the result
+ * if it isn't there.  Returns the value in newly allocated memory or NULL if
+ * it isn't set.
+ */
+static char *
+appdefault_string(struct pam_args *args, const char *section,
+                  const char *realm, const char *opt)
+{
+    const struct appdefault_value *value;
+    char *result = NULL;
+
+    LOCK();
+    value = appdefault_find(section, realm, opt, false);
+    if (value == NULL) {
+        result = lookup_string(args, section, realm, opt);
+        appdefault_save(section, realm, opt, false, result != NULL, false,
+                        result);
+    } else if (value->set)
+        result = strdup(value->string);
+    UNLOCK();
+    return result;
+}
+
+
+/*
+ * Load a boolean option from Kerberos appdefaults.  Takes the PAM argument
+ * struct, the section name, the realm, the option, and the result location.
+ *
+ * Whether the option is set can't be determined directly, so look it up with
+ * both possible defaults.  If the results differ, the option isn't set (or
+ * isn't a valid boolean).
+ */
+static void
+default_boolean(struct pam_args *args, const char *section, const char *realm,
+                const char *opt, bool *result)
+{
+    const struct appdefault_value *value;
+    bool if_false, if_true;
+
+    LOCK();
+    value = appdefault_find(section, realm, opt, true);
+    if (value == NULL) {
+        if_false = lookup_boolean(args, section, realm, opt, false);
+        if_true = lookup_boolean(args, section, realm, opt, true);
+        appdefault_save(section, realm, opt, true, if_false == if_true,
+                        if_false, NULL);
+        if (if_false == if_true)
+            *result = if_false;
+    } else if (value->set)
+        *result = value->boolean;
+    UNLOCK();
+}
+
+
+/*
+ * Load a number option from Kerberos appdefaults.  Takes the PAM argument
+ * struct, the section name, the realm, the option, and the result location.
+ * The native interface doesn't support numbers, so we actually read a string
+ * and then convert.
+ */
+static void
+default_number(struct pam_args *args, const char *section, const char *realm,
+               const char *opt, long *result)
+{
+    char *tmp;
+    char *end;
+    long value;
+
+    tmp = appdefault_string(args, section, realm, opt);
+    if (tmp != NULL) {
         errno = 0;
         value = strtol(tmp, &end, 10);
         if (errno != 0 || *end != '\0')
@@ -287,27 +724,12 @@ static void
 default_time(struct pam_args *args, const char *section, const char *realm,
              const char *opt, krb5_deltat *result)
 {
-    char *tmp = NULL;
+    char *tmp;
     krb5_deltat value;
     krb5_error_code retval;
-#    ifdef HAVE_KRB5_REALM
-    krb5_const_realm rdata = realm;
-#    else
-    krb5_data realm_struct;
-    const krb5_data *rdata;
 
-    if (realm == NULL)
-        rdata = NULL;
-    else {
-        rdata = &realm_struct;
-        realm_struct.magic = KV5M_DATA;
-        realm_struct.data = (void *) realm;
-        realm_struct.length = (unsigned int) strlen(realm);
-    }
-#    endif
-
-    krb5_appdefault_string(args->ctx, section, rdata, opt, "", &tmp);
-    if (tmp != NULL && tmp[0] != '\0') {
+    tmp = appdefault_string(args, section, realm, opt);
+    if (tmp != NULL) {
         retval = krb5_string_to_deltat(tmp, &value);
         if (retval != 0)
             putil_err(args, "invalid time in krb5.conf setting for %s: %s",
@@ -322,43 +744,18 @@ default_time(struct pam_args *args, const char *section, const char *realm,
 /*
  * Load a string option from Kerberos appdefaults.  Takes the PAM argument
  * struct, the section name, the realm, the option, and the result location.
- *
- * This requires an annoying workaround because one cannot specify a default
- * value of NULL with MIT Kerberos, since MIT Kerberos unconditionally calls
- * strdup on the default value.  There's also no way to determine if memory
- * allocation failed while parsing or while setting the default value, so we
- * don't return an error code.
  */
 static void
 default_string(struct pam_args *args, const char *section, const char *realm,
                const char *opt, char **result)
 {
-    char *value = NULL;
-#    ifdef HAVE_KRB5_REALM
-    krb5_const_realm rdata = realm;
-#    else
-    krb5_data realm_struct;
-    const krb5_data *rdata;
-
-    if (realm == NULL)
-        rdata = NULL;
-    else {
-        rdata = &realm_struct;
-        realm_struct.magic = KV5M_DATA;
-        realm_struct.data = (void *) realm;
-        realm_struct.length = (unsigned int) strlen(realm);
-    }
-#    endif
+    char *value;
 
-    krb5_appdefault_string(args->ctx, section, rdata, opt, "", &value);
+    value = appdefault_string(args, section, realm, opt);
     if (value != NULL) {
-        if (value[0] == '\0')
-            free(value);
-        else {
-            if (*result != NULL)
-                free(*result);
-            *result = value;
-        }
+        if (*result != NULL)
+            free(*result);
+        *result = value;
     }
 }
 
@@ -394,6 +791,83 @@ default_list(struct pam_args *args, const char *section, const char *realm,
 }
 
 
+/*
+ * Load an arena string option from Kerberos appdefaults.  Takes the PAM
+ * arguments, the section name, the realm, the option, and the result
+ * location.  The value is copied into the arena of the PAM arguments so that
+ * the configuration need not free it.
+ *
+ * We may fail here due to memory allocation problems, in which case we return
+ * false to indicate that PAM setup should abort.
+ */
+static bool
+default_astring(struct pam_args *args, const char *section,
+                const char *realm, const char *opt, char **result)
+{
+    char *tmp, *value;
+
+    tmp = appdefault_string(args, section, realm, opt);
+    if (tmp == NULL)
+        return true;
+    value = arena_string(args, tmp);
+    free(tmp);
+    if (value == NULL)
+        return false;
+    *result = value;
+    return true;
+}
+
+
+/*
+ * Load an arena list option from Kerberos appdefaults.  Takes the PAM
+ * arguments, the section name, the realm, the option, and the result
+ * location.  The vector is allocated from the arena of the PAM arguments.
+ *
+ * We may fail here due to memory allocation problems, in which case we return
+ * false to indicate that PAM setup should abort.
+ */
+static bool
+default_alist(struct pam_args *args, const char *section, const char *realm,
+              const char *opt, struct vector **result)
+{
+    char *tmp;
+    struct vector *value;
+
+    tmp = appdefault_string(args, section, realm, opt);
+    if (tmp == NULL)
+        return true;
+    value = arena_list(args, tmp);
+    free(tmp);
+    if (value == NULL)
+        return false;
+    *result = value;
+    return true;
+}
+
+
+/*
+ * Load a borrowed string or list option from Kerberos appdefaults.  Takes the
+ * PAM arguments, the section name, the realm, the option, and the result
+ * location.  The value is kept in the arena of the PAM arguments, as for an
+ * arena string.
+ *
+ * We may fail here due to memory allocation problems, in which case we return
+ * false to indicate that PAM setup should abort.
+ */
+static bool
+default_borrowed(struct pam_args *args, const char *section,
+                 const char *realm, const char *opt, const char **result)
+{
+    char *value = NULL;
+
+    if (!default_astring(args, section, realm, opt, &value))
+        return false;
+    if (value != NULL)
+        *result = value;
+    return true;
+}
+
+
 /*
  * The public interface for getting configuration information from krb5.conf.
  * Takes the PAM arguments, the krb5.conf section, the options specification,
@@ -402,9 +876,9 @@ default_list(struct pam_args *args, const char *section, const char *realm,
  * and, for every option where krb5_config is true, see if it's set in the
  * Kerberos configuration.
  *
- * This looks obviously slow, but there haven't been any reports of problems
- * and there's no better interface.  But if you wonder where the cycles in
- * your computer are getting wasted, well, here's one place.
+ * The settings are taken from the snapshot for this section and realm where
+ * possible, so check first whether krb5.conf has changed.  All of this is
+ * timed as the Kerberos phase of the call.
  */
 bool
 putil_args_krb5(struct pam_args *args, const char *section,
@@ -413,6 +887,12 @@ putil_args_krb5(struct pam_args *args, const char *section,
     size_t i;
     char *realm;
     bool free_realm = false;
+    bool okay = true;
+
+    putil_timing_phase_start(args, PUTIL_PHASE_KRB5);
+    LOCK();
+    appdefault_check();
+    UNLOCK();
 
     /* Having no local realm may be intentional, so don't report an error. */
     if (args->realm != NULL)
@@ -449,13 +929,32 @@ putil_args_krb5(struct pam_args *args, const char *section,
         case TYPE_STRLIST:
             if (!default_list(args, section, realm, opt->name,
                               CONF_LIST(args->config, opt->location)))
-                return false;
+                okay = false;
+            break;
+        case TYPE_BSTRING:
+        case TYPE_BLIST:
+            if (!default_borrowed(args, section, realm, opt->name,
+                                  CONF_BSTRING(args->config, opt->location)))
+                okay = false;
+            break;
+        case TYPE_ASTRING:
+            if (!default_astring(args, section, realm, opt->name,
+                                 CONF_STRING(args->config, opt->location)))
+                okay = false;
+            break;
+        case TYPE_ALIST:
+            if (!default_alist(args, section, realm, opt->name,
+                               CONF_LIST(args->config, opt->location)))
+                okay = false;
             break;
         }
+        if (!okay)
+            break;
     }
     if (free_realm)
         krb5_free_default_realm(args->ctx, realm);
-    return true;
+    putil_timing_phase_end(args, PUTIL_PHASE_KRB5);
+    return okay;
 }
 
 #else /* !HAVE_KRB5 */
@@ -504,22 +1003,301 @@ option_compare(const void *key, const void *member)
 }
 
 
+/*
+ * Indexes of option tables.
+ *
+ * Rather than binary searching the option table for every argument, the
+ * first call to putil_args_parse() with a table builds a perfect hash of its
+ * option names.  Finding an option is then one pass over the argument, which
+ * both hashes the name and finds the '=', and one comparison.  The hash has
+ * two levels: the hash of the name picks a bucket, and each bucket has a
+ * displacement chosen so that each name in it lands in an empty slot.  If no
+ * displacement works for some bucket, which should only happen if the table
+ * has duplicate names, the table is searched with bsearch as before.
+ *
+ * Indexes are kept for the life of the process and are found by the address
+ * and length of the option table.  The option in a slot is always compared
+ * with the argument, and anything not found in the index is looked up with
+ * bsearch, so an index for a table that has since changed only costs time.
+ */
+
+/* The most displacements tried for a bucket before giving up. */
+#define INDEX_MAX_DISPLACEMENT 65536
+
+/* A perfect hash of the names in an option table. */
+struct option_index {
+    struct option_index *next;
+    const struct option *options;
+    size_t optlen;
+    size_t nbuckets;             /* 0 if no perfect hash could be found. */
+    size_t mask;                 /* Number of slots minus one. */
+    unsigned long *displacement; /* Displacement for each bucket. */
+    size_t *slots;               /* Index into options plus one, or 0. */
+    size_t *lengths;             /* Length of each option name. */
+};
+
+/* The option indexes built so far. */
+static struct option_index *option_indexes = NULL;
+
+
+/*
+ * Hash an option name with FNV-1a, stopping at the end of the string or at
+ * the first '='.  Stores the length of the name in length.
+ */
+static unsigned long
+index_hash(const char *name, size_t *length)
+{
+    const unsigned char *p;
+    unsigned long hash = 2166136261UL;
+
+    for (p = (const unsigned char *) name; *p != '\0' && *p != '='; p++)
+        hash = ((hash ^ *p) * 16777619UL) & 0xffffffffUL;
+    *length = (size_t) (p - (const unsigned char *) name);
+    return hash;
+}
+
+
+/*
+ * Return the slot for a name hash with a given displacement, before masking.
+ * This mixes the hash with the finalizer from MurmurHash3 so that each
+ * displacement scatters the names in a bucket differently.
+ */
+static size_t
+index_slot(unsigned long hash, unsigned long displacement)
+{
+    hash = (hash ^ (displacement * 0x9e3779b9UL)) & 0xffffffffUL;
+    hash ^= hash >> 16;
+    hash = (hash * 0x85ebca6bUL) & 0xffffffffUL;
+    hash ^= hash >> 13;
+    hash = (hash * 0xc2b2ae35UL) & 0xffffffffUL;
+    hash ^= hash >> 16;
+    return (size_t) hash;
+}
+
+
+/*
+ * Find a displacement for one bucket that puts each of its names in an empty
+ * slot, and fill in those slots.  Takes the index, the name hashes, the
+ * bucket, and scratch space for the slot of each option.  Returns false if no
+ * displacement worked.
+ */
+static bool
+index_place(struct option_index *index, const unsigned long *hashes,
+            size_t bucket, size_t *scratch)
+{
+    unsigned long displacement;
+    size_t i, j;
+    bool okay;
+
+    for (displacement = 0; displacement < INDEX_MAX_DISPLACEMENT;
+         displacement++) {
+        okay = true;
+        for (i = 0; i < index->optlen && okay; i++) {
+            if (hashes[i] % index->nbuckets != bucket)
+                continue;
+            scratch[i] = index_slot(hashes[i], displacement) & index->mask;
+            if (index->slots[scratch[i]] != 0)
+                okay = false;
+            for (j = 0; j < i && okay; j++)
+                if (hashes[j] % index->nbuckets == bucket
+                    && scratch[j] == scratch[i])
+                    okay = false;
+        }
+        if (!okay)
+            continue;
+        for (i = 0; i < index->optlen; i++)
+            if (hashes[i] % index->nbuckets == bucket)
+                index->slots[scratch[i]] = i + 1;
+        index->displacement[bucket] = displacement;
+        return true;
+    }
+    return false;
+}
+
+
+/*
+ * Free an option index.
+ */
+static void
+index_free(struct option_index *index)
+{
+    free(index->displacement);
+    free(index->slots);
+    free(index->lengths);
+    free(index);
+}
+
+
+/*
+ * Build the index for an option table.  Buckets with the most names are
+ * placed first, while the most slots are still empty.  Returns NULL on memory
+ * allocation failure.  If no perfect hash was found, returns an index with no
+ * buckets so that the work isn't repeated.
+ */
+static struct option_index *
+index_build(const struct option options[], size_t optlen)
+{
+    struct option_index *index;
+    unsigned long *hashes = NULL;
+    size_t *counts = NULL;
+    size_t *scratch = NULL;
+    size_t i, size, max, nslots;
+
+    index = calloc(1, sizeof(struct option_index));
+    if (index == NULL)
+        return NULL;
+    index->options = options;
+    index->optlen = optlen;
+    if (optlen == 0)
+        return index;
+    index->nbuckets = optlen / 2 + 1;
+    for (nslots = 1; nslots < optlen * 2; nslots *= 2)
+        ;
+    index->mask = nslots - 1;
+    index->displacement = calloc(index->nbuckets, sizeof(unsigned long));
+    index->slots = calloc(nslots, sizeof(size_t));
+    index->lengths = calloc(optlen, sizeof(size_t));
+    hashes = calloc(optlen, sizeof(unsigned long));
+    counts = calloc(index->nbuckets, sizeof(size_t));
+    scratch = calloc(optlen, sizeof(size_t));
+    if (index->displacement == NULL || index->slots == NULL
+        || index->lengths == NULL || hashes == NULL || counts == NULL
+        || scratch == NULL)
+        goto fail;
+
+    /* Hash the names and count the names in each bucket. */
+    max = 0;
+    for (i = 0; i < optlen; i++) {
+        hashes[i] = index_hash(options[i].name, &index->lengths[i]);
+        counts[hashes[i] % index->nbuckets]++;
+        if (counts[hashes[i] % index->nbuckets] > max)
+            max = counts[hashes[i] % index->nbuckets];
+    }
+
+    /* Place the buckets, largest first. */
+    for (size = max; size > 0; size--)
+        for (i = 0; i < index->nbuckets; i++)
+            if (counts[i] == size && !index_place(index, hashes, i, scratch)) {
+                index->nbuckets = 0;
+                goto done;
+            }
+
+done:
+    free(hashes);
+    free(counts);
+    free(scratch);
+    return index;
+
+fail:
+    free(hashes);
+    free(counts);
+    free(scratch);
+    index_free(index);
+    return NULL;
+}
+
+
+/*
+ * Return the index for an option table, building it if necessary.  Returns
+ * NULL if the index couldn't be built.  Must be called with the lock held.
+ */
+static const struct option_index *
+index_get(const struct option options[], size_t optlen)
+{
+    struct option_index *index;
+
+    for (index = option_indexes; index != NULL; index = index->next)
+        if (index->options == options && index->optlen == optlen)
+            return index;
+    index = index_build(options, optlen);
+    if (index == NULL)
+        return NULL;
+    index->next = option_indexes;
+    option_indexes = index;
+    return index;
+}
+
+
+/*
+ * Free the krb5.conf snapshots and the option indexes.  pam-util is linked
+ * statically into each PAM module, and libpam unloads modules when the PAM
+ * handle is closed, so without this a long-lived PAM client would leak both
+ * caches each time it loaded the module again.  Run when the module is
+ * unloaded or the process exits, on compilers that support destructors.
+ */
+static void __attribute__((__destructor__))
+putil_args_cleanup(void)
+{
+    struct option_index *index;
+
+    LOCK();
+#ifdef HAVE_KRB5
+    appdefault_clear();
+    free(appdefault_config);
+    appdefault_config = NULL;
+    appdefault_valid = false;
+#endif
+    while (option_indexes != NULL) {
+        index = option_indexes;
+        option_indexes = index->next;
+        index_free(index);
+    }
+    UNLOCK();
+}
+
+
+/*
+ * When running the test suite, count the options found with the index so
+ * that the tests can check that it's being used.
+ */
+#if TESTING
+extern unsigned long putil_args_index_hits;
+unsigned long putil_args_index_hits = 0;
+#endif
+
+
+/*
+ * Find an option in an index.  Takes the index, the argument, and the hash
+ * and length of its name as returned by index_hash.  Returns NULL if the
+ * option isn't found.
+ */
+static const struct option *
+index_find(const struct option_index *index, const char *arg, size_t length,
+           unsigned long hash)
+{
+    size_t bucket, slot, n;
+    const char *name;
+
+    if (index->nbuckets == 0)
+        return NULL;
+    bucket = hash % index->nbuckets;
+    slot = index_slot(hash, index->displacement[bucket]) & index->mask;
+    n = index->slots[slot];
+    if (n == 0 || index->lengths[n - 1] != length)
+        return NULL;
+    name = index->options[n - 1].name;
+    if (strncmp(name, arg, length) != 0 || name[length] != '\0')
+        return NULL;
+#if TESTING
+    putil_args_index_hits++;
+#endif
+    return &index->options[n - 1];
+}
+
+
 /*
  * Given a PAM argument, convert the value portion of the argument to a
  * boolean and store it in the provided location.  If the value is missing,
  * that's equivalent to a true value.  If the value is invalid, report an
  * error and leave the location unchanged.
  */
-static void
-convert_boolean(struct pam_args *args, const char *arg, bool *setting)
+void
+putil_args_convert_boolean(struct pam_args *args, const char *arg,
+                           const char *value, bool *setting)
 {
-    const char *value;
-
-    value = strchr(arg, '=');
     if (value == NULL)
         *setting = true;
     else {
-        value++;
         /* clang-format off */
         if      (   strcasecmp(value, "true") == 0
                  || strcasecmp(value, "yes")  == 0
@@ -543,20 +1321,19 @@ convert_boolean(struct pam_args *args, const char *arg, bool *setting)
  * and store it in the provided location.  If the value is missing or isn't a
  * number, report an error and leave the location unchanged.
  */
-static void
-convert_number(struct pam_args *args, const char *arg, long *setting)
+void
+putil_args_convert_number(struct pam_args *args, const char *arg,
+                          const char *value, long *setting)
 {
-    const char *value;
     char *end;
     long result;
 
-    value = strchr(arg, '=');
-    if (value == NULL || value[1] == '\0') {
+    if (value == NULL || value[0] == '\0') {
         putil_err(args, "value missing for option %s", arg);
         return;
     }
     errno = 0;
-    result = strtol(value + 1, &end, 10);
+    result = strtol(value, &end, 10);
     if (errno != 0 || *end != '\0') {
         putil_err(args, "invalid number in setting: %s", arg);
         return;
@@ -572,19 +1349,18 @@ convert_number(struct pam_args *args, const char *arg, long *setting)
  * leave the location unchanged.
  */
 #ifdef HAVE_KRB5
-static void
-convert_time(struct pam_args *args, const char *arg, krb5_deltat *setting)
+void
+putil_args_convert_time(struct pam_args *args, const char *arg,
+                        const char *value, krb5_deltat *setting)
 {
-    const char *value;
     krb5_deltat result;
     krb5_error_code retval;
 
-    value = strchr(arg, '=');
-    if (value == NULL || value[1] == '\0') {
+    if (value == NULL || value[0] == '\0') {
         putil_err(args, "value missing for option %s", arg);
         return;
     }
-    retval = krb5_string_to_deltat((char *) value + 1, &result);
+    retval = krb5_string_to_deltat((char *) value, &result);
     if (retval != 0)
         putil_err(args, "bad time value in setting: %s", arg);
     else
@@ -593,10 +1369,11 @@ convert_time(struct pam_args *args, const char *arg, krb5_deltat *setting)
 
 #else /* HAVE_KRB5 */
 
-static void
-convert_time(struct pam_args *args, const char *arg, long *setting)
+void
+putil_args_convert_time(struct pam_args *args, const char *arg,
+                        const char *value, long *setting)
 {
-    convert_number(args, arg, setting);
+    putil_args_convert_number(args, arg, value, setting);
 }
 
 #endif /* !HAVE_KRB5 */
@@ -609,18 +1386,17 @@ convert_time(struct pam_args *args, const char *arg, long *setting)
  * non-fatal error.  If memory allocation fails, return false, since PAM setup
  * should abort.
  */
-static bool
-convert_string(struct pam_args *args, const char *arg, char **setting)
+bool
+putil_args_convert_string(struct pam_args *args, const char *arg,
+                          const char *value, char **setting)
 {
-    const char *value;
     char *result;
 
-    value = strchr(arg, '=');
     if (value == NULL) {
         putil_err(args, "value missing for option %s", arg);
         return true;
     }
-    result = strdup(value + 1);
+    result = strdup(value);
     if (result == NULL) {
         putil_crit(args, "cannot allocate memory: %s", strerror(errno));
         return false;
@@ -638,18 +1414,17 @@ convert_string(struct pam_args *args, const char *arg, char **setting)
  * non-fatal error.  If memory allocation fails, return false, since PAM setup
  * should abort.
  */
-static bool
-convert_list(struct pam_args *args, const char *arg, struct vector **setting)
+bool
+putil_args_convert_list(struct pam_args *args, const char *arg,
+                        const char *value, struct vector **setting)
 {
-    const char *value;
     struct vector *result;
 
-    value = strchr(arg, '=');
     if (value == NULL) {
         putil_err(args, "value missing for option %s", arg);
         return true;
     }
-    result = vector_split_multi(value + 1, " \t,", NULL);
+    result = vector_split_multi(value, " \t,", NULL);
     if (result == NULL) {
         putil_crit(args, "cannot allocate vector: %s", strerror(errno));
         return false;
@@ -660,6 +1435,92 @@ convert_list(struct pam_args *args, const char *arg, struct vector **setting)
 }
 
 
+/*
+ * Given a PAM argument, store a pointer to its value portion in the provided
+ * location for a borrowed string or list.  If the value is missing, report an
+ * error and leave the location unchanged.
+ */
+void
+putil_args_convert_borrowed(struct pam_args *args, const char *arg,
+                            const char *value, const char **setting)
+{
+    if (value == NULL) {
+        putil_err(args, "value missing for option %s", arg);
+        return;
+    }
+    *setting = value;
+}
+
+
+/*
+ * Given a PAM argument, copy the value portion of the argument into the arena
+ * of the PAM arguments and store it in the provided location.  If the value
+ * is missing, report an error and leave the location unchanged, returning
+ * true since that's a non-fatal error.  If memory allocation fails, return
+ * false, since PAM setup should abort.
+ */
+bool
+putil_args_convert_astring(struct pam_args *args, const char *arg,
+                           const char *value, char **setting)
+{
+    char *result;
+
+    if (value == NULL) {
+        putil_err(args, "value missing for option %s", arg);
+        return true;
+    }
+    result = arena_string(args, value);
+    if (result == NULL)
+        return false;
+    *setting = result;
+    return true;
+}
+
+
+/*
+ * Given a PAM argument, split the value portion of the argument into a vector
+ * allocated from the arena of the PAM arguments and store it in the provided
+ * location.  Missing values and memory allocation failures are handled as
+ * for putil_args_convert_astring().
+ */
+bool
+putil_args_convert_alist(struct pam_args *args, const char *arg,
+                         const char *value, struct vector **setting)
+{
+    struct vector *result;
+
+    if (value == NULL) {
+        putil_err(args, "value missing for option %s", arg);
+        return true;
+    }
+    result = arena_list(args, value);
+    if (result == NULL)
+        return false;
+    *setting = result;
+    return true;
+}
+
+
+/*
+ * Walk the elements of a borrowed list, stopping at the end of the string.
+ */
+bool
+putil_list_next(const char **list, const char **element, size_t *length)
+{
+    const char *p = *list;
+
+    p += strspn(p, " \t,");
+    if (*p == '\0') {
+        *list = p;
+        return false;
+    }
+    *element = p;
+    *length = strcspn(p, " \t,");
+    *list = p + *length;
+    return true;
+}
+
+
 /*
  * Parse the PAM arguments.  Takes the PAM argument struct, the argument count
  * and vector, the option table, and the number of elements in the option
@@ -678,40 +1539,76 @@ putil_args_parse(struct pam_args *args, int argc, const char *argv[],
 {
     int i;
     const struct option *option;
+    const struct option_index *index;
+    const char *value;
+    unsigned long hash;
+    size_t length;
+
+    LOCK();
+    index = index_get(options, optlen);
+    UNLOCK();
 
     /*
-     * Second pass: find each option we were given and set the corresponding
-     * configuration parameter.
+     * Find each option we were given, using the index if it could be built,
+     * and set the corresponding configuration parameter.
      */
     for (i = 0; i < argc; i++) {
-        option = bsearch(argv[i], options, optlen, sizeof(struct option),
-                         option_compare);
+        hash = index_hash(argv[i], &length);
+        option = NULL;
+        if (index != NULL)
+            option = index_find(index, argv[i], length, hash);
+        if (option == NULL)
+            option = bsearch(argv[i], options, optlen, sizeof(struct option),
+                             option_compare);
         if (option == NULL) {
             putil_err(args, "unknown option %s", argv[i]);
             continue;
         }
+        value = (argv[i][length] == '=') ? argv[i] + length + 1 : NULL;
         switch (option->type) {
         case TYPE_BOOLEAN:
-            convert_boolean(args, argv[i],
-                            CONF_BOOL(args->config, option->location));
+            putil_args_convert_boolean(
+                args, argv[i], value,
+                CONF_BOOL(args->config, option->location));
             break;
         case TYPE_NUMBER:
-            convert_number(args, argv[i],
-                           CONF_NUMBER(args->config, option->location));
+            putil_args_convert_number(
+                args, argv[i], value,
+                CONF_NUMBER(args->config, option->location));
             break;
         case TYPE_TIME:
-            convert_time(args, argv[i],
-                         CONF_TIME(args->config, option->location));
+            putil_args_convert_time(args, argv[i], value,
+                                    CONF_TIME(args->config, option->location));
             break;
         case TYPE_STRING:
-            if (!convert_string(args, argv[i],
-                                CONF_STRING(args->config, option->location)))
+            if (!putil_args_convert_string(
+                    args, argv[i], value,
+                    CONF_STRING(args->config, option->location)))
                 return false;
             break;
         case TYPE_LIST:
         case TYPE_STRLIST:
-            if (!convert_list(args, argv[i],
-                              CONF_LIST(args->config, option->location)))
+            if (!putil_args_convert_list(
+                    args, argv[i], value,
+                    CONF_LIST(args->config, option->location)))
+                return false;
+            break;
+        case TYPE_BSTRING:
+        case TYPE_BLIST:
+            putil_args_convert_borrowed(
+                args, argv[i], value,
+                CONF_BSTRING(args->config, option->location));
+            break;
+        case TYPE_ASTRING:
+            if (!putil_args_convert_astring(
+                    args, argv[i], value,
+                    CONF_STRING(args->config, option->location)))
+                return false;
+            break;
+        case TYPE_ALIST:
+            if (!putil_args_convert_alist(
+                    args, argv[i], value,
+                    CONF_LIST(args->config, option->location)))
                 return false;
             break;
         }
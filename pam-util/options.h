@@ -48,6 +48,7 @@
 #include <stddef.h>
 
 /* Forward declarations to avoid additional includes. */
+struct pam_args;
 struct vector;
 
 /*
@@ -63,7 +64,11 @@ enum type {
     TYPE_TIME,
     TYPE_STRING,
     TYPE_LIST,
-    TYPE_STRLIST
+    TYPE_STRLIST,
+    TYPE_BSTRING,
+    TYPE_BLIST,
+    TYPE_ASTRING,
+    TYPE_ALIST
 };
 
 /*
@@ -86,6 +91,26 @@ enum type {
  * Times take their default from defaults.number.  The difference between time
  * and number is in the parsing of a user-supplied value and the type of the
  * stored attribute.
+ *
+ * Strings and lists are copied into newly allocated memory that the caller
+ * must free with free and vector_free when freeing the configuration.
+ *
+ * Borrowed strings and lists (TYPE_BSTRING and TYPE_BLIST) are stored as
+ * const char * and are not copied.  They point into the PAM arguments, into
+ * the default in the option table, or, for values from krb5.conf, into the
+ * arena of the pam_args struct, so they must not be modified or freed and are
+ * valid for as long as both the PAM arguments and the pam_args struct.  A
+ * borrowed list is the unsplit string; walk its elements with
+ * putil_list_next().  Both take their default from defaults.string.
+ *
+ * Arena strings and lists (TYPE_ASTRING and TYPE_ALIST) are stored as char *
+ * and struct vector * like strings and lists, but are copied into the arena
+ * of the pam_args struct and are freed with it, so the configuration free
+ * function must not free them.  A list made with vector_new_arena() is
+ * ignored by vector_free(), so existing free functions can be kept as they
+ * are when switching a list option to TYPE_ALIST.  Both take their default
+ * from defaults.string, and a replaced value stays in the arena until the
+ * pam_args struct is freed.
  */
 struct option {
     const char *name;
@@ -112,6 +137,10 @@ struct option {
 #define STRING(def)  TYPE_STRING,  {     0,     0, (def),  NULL }
 #define LIST(def)    TYPE_LIST,    {     0,     0,  NULL, (def) }
 #define STRLIST(def) TYPE_STRLIST, {     0,     0, (def),  NULL }
+#define BSTRING(def) TYPE_BSTRING, {     0,     0, (def),  NULL }
+#define BLIST(def)   TYPE_BLIST,   {     0,     0, (def),  NULL }
+#define ASTRING(def) TYPE_ASTRING, {     0,     0, (def),  NULL }
+#define ALIST(def)   TYPE_ALIST,   {     0,     0, (def),  NULL }
 /* clang-format on */
 
 /*
@@ -165,6 +194,10 @@ bool putil_args_defaults(struct pam_args *, const struct option options[],
  * function.  If that's done based on a configuration option, one may need to
  * pre-parse the configuration options.
  *
+ * The settings found are saved for each section and realm and reused by later
+ * calls, in any thread, until the krb5.conf files change.  Files included from
+ * krb5.conf are not checked for changes.
+ *
  * Returns true on success and false on an error.  An error return should be
  * considered fatal.  Errors will already be reported using putil_crit*() or
  * putil_err*() as appropriate.  If Kerberos is not available, returns without
@@ -190,12 +223,69 @@ bool putil_args_krb5(struct pam_args *, const char *section,
  * function.  If options should be retrieved from krb5.conf, call
  * putil_args_krb5() first, before calling this function.
  *
+ * The first call with a given option table builds an index of the option
+ * names that is kept for the life of the process, so option tables should
+ * normally be static.
+ *
  * putil_args_defaults() should be called before this function.
  */
 bool putil_args_parse(struct pam_args *, int argc, const char *argv[],
                       const struct option options[], size_t optlen)
     __attribute__((__nonnull__));
 
+/*
+ * Convert the value of a single PAM argument and store it in the provided
+ * location.  These are used by putil_args_parse() and by the parsers that
+ * pam-util/options-gen generates.  Each takes the PAM arguments, the full
+ * argument (used in error messages), the value after the '=' or NULL if there
+ * was no '=', and the location.
+ *
+ * Invalid or missing values are reported with putil_err() and leave the
+ * location unchanged.  The functions that return a bool return false only on
+ * memory allocation failure, which is reported with putil_crit() and should
+ * be considered fatal.
+ */
+void putil_args_convert_boolean(struct pam_args *, const char *arg,
+                                const char *value, bool *)
+    __attribute__((__nonnull__(1, 2, 4)));
+void putil_args_convert_number(struct pam_args *, const char *arg,
+                               const char *value, long *)
+    __attribute__((__nonnull__(1, 2, 4)));
+#ifdef HAVE_KRB5
+void putil_args_convert_time(struct pam_args *, const char *arg,
+                             const char *value, krb5_deltat *)
+    __attribute__((__nonnull__(1, 2, 4)));
+#else
+void putil_args_convert_time(struct pam_args *, const char *arg,
+                             const char *value, long *)
+    __attribute__((__nonnull__(1, 2, 4)));
+#endif
+bool putil_args_convert_string(struct pam_args *, const char *arg,
+                               const char *value, char **)
+    __attribute__((__nonnull__(1, 2, 4)));
+bool putil_args_convert_list(struct pam_args *, const char *arg,
+                             const char *value, struct vector **)
+    __attribute__((__nonnull__(1, 2, 4)));
+void putil_args_convert_borrowed(struct pam_args *, const char *arg,
+                                 const char *value, const char **)
+    __attribute__((__nonnull__(1, 2, 4)));
+bool putil_args_convert_astring(struct pam_args *, const char *arg,
+                                const char *value, char **)
+    __attribute__((__nonnull__(1, 2, 4)));
+bool putil_args_convert_alist(struct pam_args *, const char *arg,
+                              const char *value, struct vector **)
+    __attribute__((__nonnull__(1, 2, 4)));
+
+/*
+ * Walk the elements of a borrowed list without copying it.  Takes a pointer
+ * to the current position in the list, which should initially be the list,
+ * and stores the start and length of the next element in element and length.
+ * Elements are separated by any number of spaces, tabs, and commas, as with
+ * other lists.  Returns false when there are no more elements.
+ */
+bool putil_list_next(const char **list, const char **element, size_t *length)
+    __attribute__((__nonnull__));
+
 /* Undo default visibility change. */
 #pragma GCC visibility pop
 
@@ -0,0 +1,113 @@
+/*
+ * Print the PAM call metrics from a metrics file.
+ *
+ * Usage: pam-metrics <path>
+ *
+ * Prints the metrics recorded by putil_metrics_record() in the Prometheus
+ * text format, so that the output can be served by a node exporter textfile
+ * collector or read directly.  Only functions that have been called are
+ * included.  Durations are in microseconds, and the histogram buckets are
+ * cumulative as Prometheus expects.
+ *
+ * The canonical version of this file is maintained in the rra-c-util package,
+ * which can be found at <https://www.eyrie.org/~eagle/software/rra-c-util/>.
+ *
+ * Written by Russ Allbery <eagle@eyrie.org>
+ * Copyright 2024 Russ Allbery <eagle@eyrie.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <config.h>
+#include <portable/system.h>
+
+#include <errno.h>
+
+#include <pam-util/metrics.h>
+
+
+/*
+ * Print the call counts by return code for one PAM function.
+ */
+static void
+print_calls(const struct putil_metrics_function *function)
+{
+    size_t i;
+
+    for (i = 0; i < PUTIL_METRICS_CODES; i++)
+        if (function->codes[i] != 0)
+            printf("pam_calls_total{function=\"%s\",code=\"%lu\"} %lu\n",
+                   function->name, (unsigned long) i, function->codes[i]);
+}
+
+
+/*
+ * Print the duration histogram for one PAM function.
+ */
+static void
+print_duration(const struct putil_metrics_function *function)
+{
+    unsigned long count;
+    size_t i;
+
+    for (count = 0, i = 0; i < PUTIL_TIMING_BUCKETS - 1; i++) {
+        count += function->histogram[i];
+        printf("pam_duration_usec_bucket{function=\"%s\",le=\"%lu\"} %lu\n",
+               function->name, (2UL << i) - 1, count);
+    }
+    printf("pam_duration_usec_bucket{function=\"%s\",le=\"+Inf\"} %lu\n",
+           function->name, function->calls);
+    printf("pam_duration_usec_sum{function=\"%s\"} %lu\n", function->name,
+           function->total);
+    printf("pam_duration_usec_count{function=\"%s\"} %lu\n", function->name,
+           function->calls);
+}
+
+
+int
+main(int argc, char *argv[])
+{
+    struct putil_metrics metrics;
+    size_t i;
+
+    if (argc != 2) {
+        fprintf(stderr, "Usage: pam-metrics <path>\n");
+        exit(1);
+    }
+    if (!putil_metrics_read(argv[1], &metrics)) {
+        fprintf(stderr, "pam-metrics: cannot read %s: %s\n", argv[1],
+                strerror(errno));
+        exit(1);
+    }
+    printf("# TYPE pam_calls_total counter\n");
+    for (i = 0; i < PUTIL_METRICS_FUNCTIONS; i++)
+        print_calls(&metrics.functions[i]);
+    printf("# TYPE pam_duration_usec histogram\n");
+    for (i = 0; i < PUTIL_METRICS_FUNCTIONS; i++)
+        if (metrics.functions[i].calls > 0)
+            print_duration(&metrics.functions[i]);
+    if (fflush(stdout) != 0 || ferror(stdout)) {
+        fprintf(stderr, "pam-metrics: cannot write output: %s\n",
+                strerror(errno));
+        exit(1);
+    }
+    exit(0);
+}
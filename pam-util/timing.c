@@ -0,0 +1,284 @@
+/*
+ * Timing of PAM module calls.
+ *
+ * The start of each PAM call is recorded when its pam_args struct is created
+ * or taken from the cache, before the module parses its options.  If the
+ * options turn on timing, ENTRY charges the time up to that point to the
+ * options phase, EXIT logs the whole call, and both are added to
+ * process-wide statistics for that PAM function.
+ *
+ * The canonical version of this file is maintained in the rra-c-util package,
+ * which can be found at <https://www.eyrie.org/~eagle/software/rra-c-util/>.
+ *
+ * Written by Russ Allbery <eagle@eyrie.org>
+ * Copyright 2024 Russ Allbery <eagle@eyrie.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <config.h>
+#include <portable/pam.h>
+#include <portable/system.h>
+
+#ifdef HAVE_PTHREAD
+#    include <pthread.h>
+#endif
+#include <syslog.h>
+#include <time.h>
+
+#include <pam-util/args.h>
+#include <pam-util/timing.h>
+
+/* The statistics are shared by all threads. */
+#ifdef HAVE_PTHREAD
+static pthread_mutex_t timing_lock = PTHREAD_MUTEX_INITIALIZER;
+#    define LOCK()   pthread_mutex_lock(&timing_lock)
+#    define UNLOCK() pthread_mutex_unlock(&timing_lock)
+#else
+#    define LOCK()   /* empty */
+#    define UNLOCK() /* empty */
+#endif
+
+/* The key used in the log record for each phase. */
+static const char *const PHASES[PUTIL_PHASE_MAX] = {"options", "krb5"};
+
+/*
+ * Room for one phase in a timing record: a space, the name, an equal sign,
+ * and the digits of an unsigned long.
+ */
+#define PHASE_LENGTH 48
+
+/*
+ * Statistics for each PAM function, found by name.  Names that don't fit are
+ * logged but not counted.
+ */
+static struct {
+    char name[32];
+    struct putil_timing_stats stats;
+} timing_functions[PUTIL_TIMING_FUNCTIONS];
+static size_t timing_count = 0;
+
+
+/*
+ * Return the microseconds between two times.
+ */
+static unsigned long
+elapsed(const struct timespec *start, const struct timespec *end)
+{
+    unsigned long usec;
+
+    usec = (unsigned long) (end->tv_sec - start->tv_sec) * 1000000UL;
+    usec += (unsigned long) ((end->tv_nsec - start->tv_nsec) / 1000);
+    return usec;
+}
+
+
+/*
+ * Add a finished call to the statistics for its function.  Must be called
+ * with the lock held.
+ */
+static void
+record_call(const char *func, const struct putil_timing *times,
+            unsigned long usec, bool success)
+{
+    struct putil_timing_stats *stats = NULL;
+    unsigned long value;
+    size_t bucket = 0;
+    size_t i;
+
+    if (strlen(func) >= sizeof(timing_functions[0].name))
+        return;
+    for (i = 0; i < timing_count; i++)
+        if (strcmp(timing_functions[i].name, func) == 0) {
+            stats = &timing_functions[i].stats;
+            break;
+        }
+    if (stats == NULL) {
+        if (timing_count == PUTIL_TIMING_FUNCTIONS)
+            return;
+        strcpy(timing_functions[timing_count].name, func);
+        stats = &timing_functions[timing_count].stats;
+        timing_count++;
+    }
+    stats->calls++;
+    if (!success)
+        stats->failures++;
+    stats->total += usec;
+    for (i = 0; i < PUTIL_PHASE_MAX; i++)
+        stats->phases[i] += times->phases[i];
+    for (value = usec; value >= 2 && bucket < PUTIL_TIMING_BUCKETS - 1;) {
+        value >>= 1;
+        bucket++;
+    }
+    stats->histogram[bucket]++;
+}
+
+
+/*
+ * Record the start of a PAM call.  Called whenever a pam_args struct is
+ * created or reused, since that happens before options are parsed.
+ */
+void
+putil_timing_init(struct pam_args *args)
+{
+    memset(&args->times, 0, sizeof(args->times));
+    clock_gettime(CLOCK_MONOTONIC, &args->times.start);
+}
+
+
+/*
+ * Called by ENTRY.  The module has now parsed its options, so if timing is
+ * enabled, charge everything so far other than Kerberos calls to the options
+ * phase.
+ */
+void
+putil_timing_start(struct pam_args *args)
+{
+    struct timespec now;
+    unsigned long usec, krb5;
+
+    if (!args->timing)
+        return;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    usec = elapsed(&args->times.start, &now);
+    krb5 = args->times.phases[PUTIL_PHASE_KRB5];
+    args->times.phases[PUTIL_PHASE_OPTIONS] = (usec > krb5) ? usec - krb5 : 0;
+}
+
+
+/*
+ * Called by EXIT.  Log a record of the call and add it to the statistics.
+ */
+void
+putil_timing_end(struct pam_args *args, const char *func, int pamret)
+{
+    struct timespec now;
+    unsigned long usec;
+    char phases[PUTIL_PHASE_MAX * PHASE_LENGTH + 1];
+    size_t i, length;
+    int status;
+    const char *result;
+
+    if (!args->timing)
+        return;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    usec = elapsed(&args->times.start, &now);
+    phases[0] = '\0';
+    for (length = 0, i = 0; i < PUTIL_PHASE_MAX; i++) {
+        status = snprintf(phases + length, sizeof(phases) - length, " %s=%lu",
+                          PHASES[i], args->times.phases[i]);
+        if (status < 0 || (size_t) status >= sizeof(phases) - length)
+            break;
+        length += (size_t) status;
+    }
+    if (pamret == PAM_SUCCESS)
+        result = "success";
+    else if (pamret == PAM_IGNORE)
+        result = "ignore";
+    else
+        result = "failure";
+    pam_syslog(args->pamh, LOG_INFO, "timing func=%s user=%s result=%s"
+               " usec=%lu%s", func, (args->user != NULL) ? args->user : "",
+               result, usec, phases);
+
+    LOCK();
+    record_call(func, &args->times, usec, pamret == PAM_SUCCESS);
+    UNLOCK();
+    memset(args->times.phases, 0, sizeof(args->times.phases));
+}
+
+
+/*
+ * Return the microseconds since the start of the current call.
+ */
+unsigned long
+putil_timing_elapsed(const struct pam_args *args)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return elapsed(&args->times.start, &now);
+}
+
+
+/*
+ * Mark the start of a phase.  This is done even if timing isn't enabled,
+ * since phases entered while parsing options start before that's known.
+ */
+void
+putil_timing_phase_start(struct pam_args *args, enum putil_timing_phase phase)
+{
+    clock_gettime(CLOCK_MONOTONIC, &args->times.phase_start[phase]);
+}
+
+
+/*
+ * Mark the end of a phase and add the time since its start to its total.
+ * Does nothing if the phase wasn't started.
+ */
+void
+putil_timing_phase_end(struct pam_args *args, enum putil_timing_phase phase)
+{
+    struct timespec now;
+    struct timespec *start = &args->times.phase_start[phase];
+
+    if (start->tv_sec == 0 && start->tv_nsec == 0)
+        return;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    args->times.phases[phase] += elapsed(start, &now);
+    start->tv_sec = 0;
+    start->tv_nsec = 0;
+}
+
+
+/*
+ * Copy the statistics for a PAM function.
+ */
+bool
+putil_timing_stats(const char *func, struct putil_timing_stats *stats)
+{
+    size_t i;
+    bool found = false;
+
+    memset(stats, 0, sizeof(*stats));
+    LOCK();
+    for (i = 0; i < timing_count; i++)
+        if (strcmp(timing_functions[i].name, func) == 0) {
+            *stats = timing_functions[i].stats;
+            found = true;
+            break;
+        }
+    UNLOCK();
+    return found;
+}
+
+
+/*
+ * Discard all statistics.
+ */
+void
+putil_timing_reset(void)
+{
+    LOCK();
+    memset(timing_functions, 0, sizeof(timing_functions));
+    timing_count = 0;
+    UNLOCK();
+}
@@ -0,0 +1,147 @@
+/*
+ * Interface to timing of PAM module calls.
+ *
+ * When timing is enabled in the pam_args struct, the ENTRY and EXIT macros
+ * record how long each PAM module function takes and log a record of each
+ * call with the time spent in it and in any phases (such as parsing options
+ * or talking to the KDC) marked with putil_timing_phase_start() and
+ * putil_timing_phase_end().  Durations are also accumulated, per function,
+ * into process-wide statistics for long-lived processes.
+ *
+ * The canonical version of this file is maintained in the rra-c-util package,
+ * which can be found at <https://www.eyrie.org/~eagle/software/rra-c-util/>.
+ *
+ * Written by Russ Allbery <eagle@eyrie.org>
+ * Copyright 2024 Russ Allbery <eagle@eyrie.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef PAM_UTIL_TIMING_H
+#define PAM_UTIL_TIMING_H 1
+
+#include <config.h>
+#include <portable/macros.h>
+#include <portable/stdbool.h>
+
+#include <time.h>
+
+/* Forward declarations to avoid extra includes. */
+struct pam_args;
+
+/* The phases of a PAM call whose time is recorded separately. */
+enum putil_timing_phase {
+    PUTIL_PHASE_OPTIONS, /* Setup before ENTRY other than Kerberos calls. */
+    PUTIL_PHASE_KRB5,    /* Kerberos library calls. */
+    PUTIL_PHASE_MAX
+};
+
+/*
+ * The number of buckets in the duration histogram.  Bucket 0 counts calls
+ * that took under 2 microseconds, bucket n counts calls that took at least
+ * 2^n and less than 2^(n+1) microseconds, and the last bucket also counts
+ * anything slower.
+ */
+#define PUTIL_TIMING_BUCKETS 32
+
+/* The most PAM functions for which statistics are kept. */
+#define PUTIL_TIMING_FUNCTIONS 8
+
+/* Timing of the current PAM call, kept in the pam_args struct. */
+struct putil_timing {
+    struct timespec start;
+    struct timespec phase_start[PUTIL_PHASE_MAX];
+    unsigned long phases[PUTIL_PHASE_MAX]; /* Microseconds in each phase. */
+};
+
+/* Statistics for one PAM function. */
+struct putil_timing_stats {
+    unsigned long calls;                   /* Number of calls. */
+    unsigned long failures;                /* Calls not returning success. */
+    unsigned long total;                   /* Total microseconds. */
+    unsigned long phases[PUTIL_PHASE_MAX]; /* Total microseconds per phase. */
+    unsigned long histogram[PUTIL_TIMING_BUCKETS];
+};
+
+BEGIN_DECLS
+
+/* Default to a hidden visibility for all internal functions. */
+#pragma GCC visibility push(hidden)
+
+/*
+ * Record the start of a PAM call.  Called by putil_args_new() and
+ * putil_args_cache_get(), so that the time spent parsing options, which
+ * happens before timing is known to be enabled, is included.
+ */
+void putil_timing_init(struct pam_args *) __attribute__((__nonnull__));
+
+/*
+ * Start and finish timing a PAM call.  These are normally called by the ENTRY
+ * and EXIT macros.  putil_timing_start charges the time since
+ * putil_timing_init(), less the time in Kerberos calls, to the options phase.
+ * putil_timing_end logs a record of the call at LOG_INFO, of the form (on one
+ * line):
+ *
+ *     timing func=<func> user=<user> result=<result> usec=<total>
+ *         options=<usec> ...
+ *
+ * with one key for each phase, and adds the call to the statistics for that
+ * function.  Both do nothing unless timing is enabled in the pam_args
+ * struct.
+ */
+void putil_timing_start(struct pam_args *) __attribute__((__nonnull__));
+void putil_timing_end(struct pam_args *, const char *func, int pamret)
+    __attribute__((__nonnull__));
+
+/* Return the microseconds since the start of the current PAM call. */
+unsigned long putil_timing_elapsed(const struct pam_args *)
+    __attribute__((__nonnull__));
+
+/*
+ * Mark the start and end of a phase of the current PAM call.  Time between
+ * them is added to the time for that phase, so a phase may be entered more
+ * than once in a call.  The time is recorded even if timing isn't enabled,
+ * since it isn't known until options are parsed, but is only reported if it
+ * is.  putil_args_new() and putil_args_krb5() time their Kerberos calls;
+ * modules should time any Kerberos calls they make themselves.
+ */
+void putil_timing_phase_start(struct pam_args *, enum putil_timing_phase)
+    __attribute__((__nonnull__));
+void putil_timing_phase_end(struct pam_args *, enum putil_timing_phase)
+    __attribute__((__nonnull__));
+
+/*
+ * Copy the statistics for the named PAM function (such as
+ * pam_sm_authenticate) into the provided struct.  Returns false, and zeroes
+ * the struct, if there have been no timed calls to that function.
+ */
+bool putil_timing_stats(const char *func, struct putil_timing_stats *)
+    __attribute__((__nonnull__));
+
+/* Discard all statistics. */
+void putil_timing_reset(void);
+
+/* Undo default visibility change. */
+#pragma GCC visibility pop
+
+END_DECLS
+
+#endif /* !PAM_UTIL_TIMING_H */
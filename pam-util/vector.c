@@ -36,8 +36,24 @@
 #include <config.h>
 #include <portable/system.h>
 
+#include <errno.h>
+#include <fcntl.h>
+#ifdef HAVE_SPAWN_H
+#    include <spawn.h>
+#endif
+#include <sys/wait.h>
+
+#include <pam-util/arena.h>
 #include <pam-util/vector.h>
 
+/*
+ * posix_spawn requires an explicit environment.  unistd.h declares environ on
+ * some systems when extensions are enabled.
+ */
+#if defined(HAVE_POSIX_SPAWN) && !HAVE_DECL_ENVIRON
+extern char **environ;
+#endif
+
 
 /*
  * Allocate a new, empty vector.  Returns NULL if memory allocation fails.
@@ -48,12 +64,52 @@ vector_new(void)
     struct vector *vector;
 
     vector = calloc(1, sizeof(struct vector));
+    if (vector == NULL)
+        return NULL;
     vector->allocated = 1;
     vector->strings = calloc(1, sizeof(char *));
+    if (vector->strings == NULL) {
+        free(vector);
+        return NULL;
+    }
+    return vector;
+}
+
+
+/*
+ * Allocate a new, empty vector from an arena.  Returns NULL if memory
+ * allocation fails.
+ */
+struct vector *
+vector_new_arena(struct arena *arena)
+{
+    struct vector *vector;
+
+    vector = arena_calloc(arena, 1, sizeof(struct vector));
+    if (vector == NULL)
+        return NULL;
+    vector->arena = arena;
+    vector->allocated = 1;
+    vector->strings = arena_calloc(arena, 1, sizeof(char *));
+    if (vector->strings == NULL)
+        return NULL;
     return vector;
 }
 
 
+/*
+ * Copy a string for storage in a vector, using the arena of the vector if it
+ * has one.  Returns NULL if memory allocation fails.
+ */
+static char *
+vector_strndup(struct vector *vector, const char *string, size_t length)
+{
+    if (vector->arena != NULL)
+        return arena_strndup(vector->arena, string, length);
+    return strndup(string, length);
+}
+
+
 /*
  * Allocate a new vector that's a copy of an existing vector.  Returns NULL if
  * memory allocation fails.
@@ -65,40 +121,106 @@ vector_copy(const struct vector *old)
     size_t i;
 
     vector = vector_new();
+    if (vector == NULL)
+        return NULL;
     if (!vector_resize(vector, old->count)) {
         vector_free(vector);
         return NULL;
     }
-    vector->count = old->count;
     for (i = 0; i < old->count; i++) {
         vector->strings[i] = strdup(old->strings[i]);
         if (vector->strings[i] == NULL) {
             vector_free(vector);
             return NULL;
         }
+        vector->count++;
     }
     return vector;
 }
 
 
 /*
- * Resize a vector (using reallocarray to resize the table).  Return false if
- * memory allocation fails.
+ * Allocate a new vector that's a copy of an existing vector, copying all of
+ * the strings into a single block that becomes the pool of the new vector.
+ * This takes two allocations no matter how many strings there are.  Returns
+ * NULL if memory allocation fails.
+ */
+struct vector *
+vector_copy_pooled(const struct vector *old)
+{
+    struct vector *vector;
+    size_t i, length, total;
+    char *p;
+
+    vector = vector_new();
+    if (vector == NULL)
+        return NULL;
+    if (!vector_resize(vector, old->count))
+        goto fail;
+    for (total = 0, i = 0; i < old->count; i++)
+        total += strlen(old->strings[i]) + 1;
+    if (total > 0) {
+        vector->pool = malloc(total);
+        if (vector->pool == NULL)
+            goto fail;
+    }
+    for (p = vector->pool, i = 0; i < old->count; i++) {
+        length = strlen(old->strings[i]) + 1;
+        memcpy(p, old->strings[i], length);
+        vector->strings[i] = p;
+        p += length;
+    }
+    vector->count = old->count;
+    vector->pooled = old->count;
+    return vector;
+
+fail:
+    vector_free(vector);
+    return NULL;
+}
+
+
+/*
+ * Free the strings in a vector starting at the given index and reduce the
+ * count to that index.  Strings in the pool are freed with the pool, and
+ * strings in an arena are freed with the arena, so neither is freed here.
+ */
+static void
+vector_truncate(struct vector *vector, size_t start)
+{
+    size_t i;
+
+    if (vector->arena == NULL)
+        for (i = start; i < vector->count; i++)
+            if (i >= vector->pooled)
+                free(vector->strings[i]);
+    vector->count = start;
+    if (vector->pooled > start)
+        vector->pooled = start;
+}
+
+
+/*
+ * Resize a vector (using reallocarray to resize the table, or by copying it
+ * to new space for a vector allocated from an arena).  Return false if memory
+ * allocation fails.
  */
 bool
 vector_resize(struct vector *vector, size_t size)
 {
-    size_t i;
     char **strings;
 
-    if (vector->count > size) {
-        for (i = size; i < vector->count; i++)
-            free(vector->strings[i]);
-        vector->count = size;
-    }
+    if (vector->count > size)
+        vector_truncate(vector, size);
     if (size == 0)
         size = 1;
-    strings = reallocarray(vector->strings, size, sizeof(char *));
+    if (vector->arena == NULL)
+        strings = reallocarray(vector->strings, size, sizeof(char *));
+    else {
+        strings = arena_calloc(vector->arena, size, sizeof(char *));
+        if (strings != NULL)
+            memcpy(strings, vector->strings, vector->count * sizeof(char *));
+    }
     if (strings == NULL)
         return false;
     vector->strings = strings;
@@ -107,10 +229,26 @@ vector_resize(struct vector *vector, size_t size)
 }
 
 
+/*
+ * Grow the table of a full vector by doubling its size, so that filling a
+ * vector one string at a time only takes a logarithmic number of resizes.
+ * Return false if memory allocation fails.
+ */
+static bool
+vector_grow(struct vector *vector)
+{
+    if (vector->allocated > SIZE_MAX / 2) {
+        errno = ENOMEM;
+        return false;
+    }
+    return vector_resize(vector, vector->allocated * 2);
+}
+
+
 /*
  * Add a new string to the vector, resizing the vector as necessary.  The
- * vector is resized an element at a time; if a lot of resizes are expected,
- * vector_resize should be called explicitly with a more suitable size.
+ * table doubles in size whenever it fills; if the final size is known,
+ * vector_resize can still be called first to allocate exactly that much.
  * Return false if memory allocation fails.
  */
 bool
@@ -119,9 +257,9 @@ vector_add(struct vector *vector, const char *string)
     size_t next = vector->count;
 
     if (vector->count == vector->allocated)
-        if (!vector_resize(vector, vector->allocated + 1))
+        if (!vector_grow(vector))
             return false;
-    vector->strings[next] = strdup(string);
+    vector->strings[next] = vector_strndup(vector, string, strlen(string));
     if (vector->strings[next] == NULL)
         return false;
     vector->count++;
@@ -135,22 +273,20 @@ vector_add(struct vector *vector, const char *string)
 void
 vector_clear(struct vector *vector)
 {
-    size_t i;
-
-    for (i = 0; i < vector->count; i++)
-        if (vector->strings[i] != NULL)
-            free(vector->strings[i]);
-    vector->count = 0;
+    vector_truncate(vector, 0);
+    free(vector->pool);
+    vector->pool = NULL;
 }
 
 
 /*
- * Free a vector completely.
+ * Free a vector completely.  A vector allocated from an arena is freed with
+ * the arena instead.
  */
 void
 vector_free(struct vector *vector)
 {
-    if (vector == NULL)
+    if (vector == NULL || vector->arena != NULL)
         return;
     vector_clear(vector);
     free(vector->strings);
@@ -175,33 +311,6 @@ vector_reuse(struct vector *vector)
 }
 
 
-/*
- * Given a string and a set of separators expressed as a string, count the
- * number of strings that it will split into when splitting on those
- * separators.
- */
-static size_t
-split_multi_count(const char *string, const char *seps)
-{
-    const char *p;
-    size_t count;
-
-    if (*string == '\0')
-        return 0;
-    for (count = 1, p = string + 1; *p != '\0'; p++)
-        if (strchr(seps, *p) != NULL && strchr(seps, p[-1]) == NULL)
-            count++;
-
-    /*
-     * If the string ends in separators, we've overestimated the number of
-     * strings by one.
-     */
-    if (strchr(seps, p[-1]) != NULL)
-        count--;
-    return count;
-}
-
-
 /*
  * Given a string, split it at any of the provided separators to form a
  * vector, copying each string segment.  If the third argument isn't NULL,
@@ -209,12 +318,16 @@ split_multi_count(const char *string, const char *seps)
  * consecutive separators are considered a single separator.  Returns NULL on
  * memory allocation failure, after which the provided vector may only have
  * partial results.
+ *
+ * This is done in a single pass over the string, growing the vector as
+ * needed, and separators are recognized with a table indexed by character
+ * rather than by searching seps for every character.
  */
 struct vector *
 vector_split_multi(const char *string, const char *seps, struct vector *vector)
 {
+    bool separator[UCHAR_MAX + 1];
     const char *p, *start;
-    size_t i, count;
     bool created = false;
 
     if (vector == NULL)
@@ -223,27 +336,32 @@ vector_split_multi(const char *string, const char *seps, struct vector *vector)
     if (vector == NULL)
         return NULL;
 
-    count = split_multi_count(string, seps);
-    if (vector->allocated < count && !vector_resize(vector, count))
-        goto fail;
-
-    vector->count = 0;
-    for (start = string, p = string, i = 0; *p != '\0'; p++)
-        if (strchr(seps, *p) != NULL) {
-            if (start != p) {
-                vector->strings[i] = strndup(start, (size_t) (p - start));
-                if (vector->strings[i] == NULL)
+    /* Build the separator table.  The nul character ends the last string. */
+    memset(separator, 0, sizeof(separator));
+    for (p = seps; *p != '\0'; p++)
+        separator[(unsigned char) *p] = true;
+    separator[0] = true;
+
+    /* Copy each string when the separator after it is found. */
+    for (start = NULL, p = string;; p++) {
+        if (!separator[(unsigned char) *p]) {
+            if (start == NULL)
+                start = p;
+            continue;
+        }
+        if (start != NULL) {
+            if (vector->count == vector->allocated)
+                if (!vector_grow(vector))
                     goto fail;
-                i++;
-                vector->count++;
-            }
-            start = p + 1;
+            vector->strings[vector->count] =
+                vector_strndup(vector, start, (size_t) (p - start));
+            if (vector->strings[vector->count] == NULL)
+                goto fail;
+            vector->count++;
+            start = NULL;
         }
-    if (start != p) {
-        vector->strings[i] = strndup(start, (size_t) (p - start));
-        if (vector->strings[i] == NULL)
-            goto fail;
-        vector->count++;
+        if (*p == '\0')
+            break;
     }
     return vector;
 
@@ -287,3 +405,175 @@ vector_exec_env(const char *path, struct vector *vector,
     vector->strings[vector->count] = NULL;
     return execve(path, (char *const *) vector->strings, (char *const *) env);
 }
+
+
+#ifdef HAVE_POSIX_SPAWN
+
+/*
+ * Helper function for vector_spawn that does the work once the argument list
+ * is NULL-terminated.  Translate the file descriptor actions into posix_spawn
+ * file actions and start the child.  posix_spawn returns an error code
+ * rather than setting errno, so convert.
+ */
+static pid_t
+spawn(const char *path, char *const argv[], const char *const env[],
+      const struct vector_fd_action actions[], size_t count)
+{
+    posix_spawn_file_actions_t file_actions;
+    pid_t pid;
+    size_t i;
+    int status;
+
+    status = posix_spawn_file_actions_init(&file_actions);
+    if (status != 0) {
+        errno = status;
+        return -1;
+    }
+    for (i = 0; i < count && status == 0; i++)
+        switch (actions[i].type) {
+        case VECTOR_FD_DUP2:
+            status = posix_spawn_file_actions_adddup2(
+                &file_actions, actions[i].fd, actions[i].target);
+            break;
+        case VECTOR_FD_CLOSE:
+            status = posix_spawn_file_actions_addclose(&file_actions,
+                                                       actions[i].fd);
+            break;
+        default:
+            status = EINVAL;
+            break;
+        }
+    if (status == 0) {
+        if (env == NULL)
+            env = (const char *const *) environ;
+        status = posix_spawn(&pid, path, &file_actions, NULL, argv,
+                             (char *const *) env);
+    }
+    posix_spawn_file_actions_destroy(&file_actions);
+    if (status != 0) {
+        errno = status;
+        return -1;
+    }
+    return pid;
+}
+
+#else /* !HAVE_POSIX_SPAWN */
+
+/*
+ * Set or clear the close-on-exec flag on a file descriptor.  util/fdflag.c
+ * isn't available to PAM modules, so this is a minimal version.
+ */
+static bool
+close_exec(int fd, bool flag)
+{
+    int oflag;
+
+    oflag = fcntl(fd, F_GETFD, 0);
+    if (oflag < 0)
+        return false;
+    oflag = flag ? (oflag | FD_CLOEXEC) : (oflag & ~FD_CLOEXEC);
+    return fcntl(fd, F_SETFD, oflag) == 0;
+}
+
+
+/*
+ * Helper function for vector_spawn when posix_spawn isn't available.  Fork,
+ * perform the file descriptor actions, and exec.  Failure in the child is
+ * reported back to the parent via a close-on-exec pipe so that we can return
+ * -1 with the correct errno as posix_spawn would.
+ */
+static pid_t
+spawn(const char *path, char *const argv[], const char *const env[],
+      const struct vector_fd_action actions[], size_t count)
+{
+    int fds[2];
+    int error, oerrno;
+    size_t i;
+    ssize_t status;
+    pid_t pid;
+
+    if (pipe(fds) < 0)
+        return -1;
+    if (!close_exec(fds[1], true)) {
+        oerrno = errno;
+        close(fds[0]);
+        close(fds[1]);
+        errno = oerrno;
+        return -1;
+    }
+    pid = fork();
+    if (pid < 0) {
+        oerrno = errno;
+        close(fds[0]);
+        close(fds[1]);
+        errno = oerrno;
+        return -1;
+    }
+
+    /* In the child, do the file descriptor actions and run the program. */
+    if (pid == 0) {
+        close(fds[0]);
+        for (i = 0; i < count; i++) {
+            if (actions[i].type == VECTOR_FD_DUP2) {
+                if (actions[i].fd == actions[i].target) {
+                    if (!close_exec(actions[i].fd, false))
+                        break;
+                } else if (dup2(actions[i].fd, actions[i].target) < 0)
+                    break;
+            } else if (actions[i].type == VECTOR_FD_CLOSE) {
+                if (close(actions[i].fd) < 0)
+                    break;
+            } else {
+                errno = EINVAL;
+                break;
+            }
+        }
+        if (i == count) {
+            if (env == NULL)
+                execv(path, argv);
+            else
+                execve(path, argv, (char *const *) env);
+        }
+        error = errno;
+        do
+            status = write(fds[1], &error, sizeof(error));
+        while (status < 0 && errno == EINTR);
+        _exit(127);
+    }
+
+    /*
+     * In the parent, wait for the pipe to be closed by exec or for the child
+     * to report an error.
+     */
+    close(fds[1]);
+    do
+        status = read(fds[0], &error, sizeof(error));
+    while (status < 0 && errno == EINTR);
+    close(fds[0]);
+    if (status == sizeof(error)) {
+        waitpid(pid, NULL, 0);
+        errno = error;
+        return -1;
+    }
+    return pid;
+}
+
+#endif /* !HAVE_POSIX_SPAWN */
+
+
+/*
+ * Given a vector, a path to a program, the environment, and a list of file
+ * descriptor actions, run that program in a new process with the vector as
+ * its arguments.  This requires adding a NULL terminator to the vector, just
+ * as with vector_exec.  Returns the process ID of the child or -1 on error.
+ */
+pid_t
+vector_spawn(const char *path, struct vector *vector, const char *const env[],
+             const struct vector_fd_action actions[], size_t count)
+{
+    if (vector->allocated == vector->count)
+        if (!vector_resize(vector, vector->count + 1))
+            return -1;
+    vector->strings[vector->count] = NULL;
+    return spawn(path, (char *const *) vector->strings, env, actions, count);
+}
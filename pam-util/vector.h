@@ -40,11 +40,45 @@
 #include <portable/stdbool.h>
 
 #include <stddef.h>
+#include <sys/types.h>
 
+/*
+ * Vectors must be created with vector_new or vector_new_arena, not built by
+ * hand, so that all of the members are initialized.  If arena is not NULL,
+ * the vector, its strings, and its array of strings are all allocated from
+ * that arena and are freed with it, so its strings must not be freed or
+ * replaced directly.
+ *
+ * Otherwise, strings are allocated separately with malloc and the caller may
+ * free or replace them, except that the first pooled strings of a vector made
+ * by vector_copy_pooled point into pool, a single block holding all of them
+ * that is freed as a whole.  Those strings must not be freed or replaced
+ * directly.
+ */
+struct arena;
 struct vector {
     size_t count;
     size_t allocated;
     char **strings;
+    struct arena *arena;
+    char *pool;
+    size_t pooled;
+};
+
+/*
+ * An action to perform on file descriptors in the child process before
+ * running the program with vector_spawn.  VECTOR_FD_DUP2 duplicates fd onto
+ * target, and VECTOR_FD_CLOSE closes fd (target is ignored).  Actions are
+ * performed in the order given.
+ */
+enum vector_fd_type {
+    VECTOR_FD_DUP2,
+    VECTOR_FD_CLOSE
+};
+struct vector_fd_action {
+    enum vector_fd_type type;
+    int fd;
+    int target;
 };
 
 BEGIN_DECLS
@@ -58,6 +92,14 @@ void vector_free(struct vector *);
 /* Create a new, empty vector.  Returns NULL on memory allocation failure. */
 struct vector *vector_new(void) __attribute__((__malloc__(vector_free)));
 
+/*
+ * Create a new, empty vector allocated from an arena.  All memory used by the
+ * vector, including the copies of strings added to it, comes from the arena
+ * and is freed with it, so vector_free does nothing for such a vector.
+ * Returns NULL on memory allocation failure.
+ */
+struct vector *vector_new_arena(struct arena *) __attribute__((__nonnull__));
+
 /*
  * Create a new vector that's a copy of an existing vector.  Returns NULL on
  * memory allocation failure.
@@ -66,8 +108,17 @@ struct vector *vector_copy(const struct vector *)
     __attribute__((__malloc__(vector_free), __nonnull__));
 
 /*
- * Add a string to a vector.  Resizes the vector if necessary.  Returns false
- * on failure to allocate memory.
+ * Create a new vector that's a copy of an existing vector, with all of its
+ * strings copied into the pool of the new vector instead of allocated one at
+ * a time.  The copied strings must not be freed or replaced directly.
+ * Returns NULL on memory allocation failure.
+ */
+struct vector *vector_copy_pooled(const struct vector *)
+    __attribute__((__malloc__(vector_free), __nonnull__));
+
+/*
+ * Add a string to a vector.  Resizes the vector if necessary, doubling the
+ * size of the array of strings.  Returns false on failure to allocate memory.
  */
 bool vector_add(struct vector *, const char *string)
     __attribute__((__nonnull__));
@@ -82,16 +133,18 @@ bool vector_resize(struct vector *, size_t size) __attribute__((__nonnull__));
 /*
  * Reset the number of elements to zero, freeing all of the strings for a
  * regular vector, but not freeing the strings array (to cut down on memory
- * allocations if the vector will be reused).
+ * allocations if the vector will be reused).  The strings of a vector
+ * allocated from an arena are left in the arena.
  */
 void vector_clear(struct vector *) __attribute__((__nonnull__));
 
 /*
  * Split functions build a vector from a string.  vector_split_multi splits on
  * a set of characters.  If the vector argument is NULL, a new vector is
- * allocated; otherwise, the provided one is reused.  Returns NULL on memory
- * allocation failure, after which the provided vector may have been modified
- * to only have partial results.
+ * allocated; otherwise, the provided one is reused, along with its arena if
+ * it was allocated from one.  Returns NULL on memory allocation failure,
+ * after which the provided vector may have been modified to only have
+ * partial results.
  *
  * Empty strings will yield zero-length vectors.  Adjacent delimiters are
  * treated as a single delimiter by vector_split_multi.  Any leading or
@@ -113,6 +166,19 @@ int vector_exec(const char *path, struct vector *)
 int vector_exec_env(const char *path, struct vector *, const char *const env[])
     __attribute__((__nonnull__));
 
+/*
+ * Run the given program with the vector as its arguments in a new process,
+ * using posix_spawn if available so that the PAM-using process doesn't have
+ * to be forked.  env is the environment for the program, or NULL to pass the
+ * current environment.  The count file descriptor actions in actions are
+ * performed in the child before the program is run.  Returns the process ID
+ * of the child, or -1 with errno set on failure, including failure to run
+ * the program.  The caller is responsible for waiting for the child.
+ */
+pid_t vector_spawn(const char *path, struct vector *, const char *const env[],
+                   const struct vector_fd_action actions[], size_t count)
+    __attribute__((__nonnull__(1, 2)));
+
 /* Undo default visibility change. */
 #pragma GCC visibility pop
 
@@ -2,8 +2,9 @@
  * Portability wrapper around <sys/uio.h>.
  *
  * Provides a definition of the iovec struct for platforms that don't have it
- * (primarily Windows).  Currently, the corresponding readv and writev
- * functions are not provided or prototyped here.
+ * (primarily Windows) and IOV_MAX for platforms that don't define it.
+ * Currently, the corresponding readv and writev functions are not provided
+ * or prototyped here.
  *
  * The canonical version of this file is maintained in the rra-c-util package,
  * which can be found at <https://www.eyrie.org/~eagle/software/rra-c-util/>.
@@ -23,6 +24,7 @@
 #ifndef PORTABLE_UIO_H
 #define PORTABLE_UIO_H 1
 
+#include <limits.h>
 #include <sys/types.h>
 
 /* remctl.h provides its own definition of this struct on Windows. */
@@ -35,4 +37,17 @@ struct iovec {
 };
 #endif
 
+/*
+ * The maximum number of iovec structs that can be passed to writev.  Linux
+ * only defines UIO_MAXIOV in some configurations, and 16 is the POSIX
+ * minimum.
+ */
+#ifndef IOV_MAX
+#    ifdef UIO_MAXIOV
+#        define IOV_MAX UIO_MAXIOV
+#    else
+#        define IOV_MAX 16
+#    endif
+#endif
+
 #endif /* !PORTABLE_UIO_H */
@@ -0,0 +1,29 @@
+# Option specification used to test pam-util/options-gen.
+#
+# Options are deliberately not in sorted order, since the generator sorts
+# them.  The generated code is written to tests/pam-util/example-options.c
+# and tests/pam-util/example-options.h.
+#
+# Written by Russ Allbery <eagle@eyrie.org>
+# Copyright 2024 Russ Allbery <eagle@eyrie.org>
+#
+# Copying and distribution of this file, with or without modification, are
+# permitted in any medium without royalty provided the copyright notice and
+# this notice are preserved.  This file is offered as-is, without any
+# warranty.
+#
+# SPDX-License-Identifier: FSFAP
+
+prefix example
+
+option program     string  krb5
+option debug       boolean krb5
+option cells       list    krb5
+option expires     time    krb5 10
+option ignore_root boolean -    true
+option minimum_uid number  krb5
+option realms      blist   -    "EXAMPLE.COM,EXAMPLE.ORG"
+option ccache      bstring -    "/tmp/krb5cc"
+option banner      string  -    "Kerberos"
+option keytab      astring -    "/etc/krb5.keytab"
+option domains     alist   -
@@ -0,0 +1,150 @@
+/*
+ * PAM utility arena allocator test suite.
+ *
+ * The canonical version of this file is maintained in the rra-c-util package,
+ * which can be found at <https://www.eyrie.org/~eagle/software/rra-c-util/>.
+ *
+ * Written by Russ Allbery <eagle@eyrie.org>
+ * Copyright 2024 Russ Allbery <eagle@eyrie.org>
+ *
+ * Copying and distribution of this file, with or without modification, are
+ * permitted in any medium without royalty provided the copyright notice and
+ * this notice are preserved.  This file is offered as-is, without any
+ * warranty.
+ *
+ * SPDX-License-Identifier: FSFAP
+ */
+
+#include <config.h>
+#include <portable/system.h>
+
+#include <errno.h>
+
+#include <pam-util/arena.h>
+#include <pam-util/vector.h>
+#include <tests/tap/basic.h>
+
+
+int
+main(void)
+{
+    struct arena *arena;
+    struct vector *vector, *split;
+    char *one, *two, *big;
+    char *strings[100];
+    char expected[64];
+    size_t i;
+    volatile size_t huge = SIZE_MAX;
+    volatile size_t zero = 0;
+    int *numbers;
+    bool okay;
+    const char buffer[] = "some\0string";
+
+    plan(31);
+
+    /* Basic allocation and string copying. */
+    arena = arena_new(0);
+    ok(arena != NULL, "arena_new returns an arena");
+    one = arena_strdup(arena, "hello");
+    is_string("hello", one, "arena_strdup");
+    two = arena_strndup(arena, "hello world", 5);
+    is_string("hello", two, "arena_strndup");
+    ok(one != two, "...and returns distinct memory");
+    two = arena_strndup(arena, buffer, sizeof(buffer));
+    is_string("some", two, "arena_strndup stops at nul");
+
+    /* Allocations must be aligned for any type. */
+    one = arena_alloc(arena, 1);
+    numbers = arena_alloc(arena, 10 * sizeof(int));
+    ok(((uintptr_t) one % sizeof(long double)) == 0, "arena_alloc alignment");
+    ok(((uintptr_t) numbers % sizeof(long double)) == 0, "...second alloc");
+    numbers = arena_calloc(arena, 10, sizeof(int));
+    okay = true;
+    for (i = 0; i < 10; i++)
+        if (numbers[i] != 0)
+            okay = false;
+    ok(okay, "arena_calloc zeroes memory");
+
+    /*
+     * Sizes that can't be allocated fail instead of wrapping.  huge is
+     * volatile so that the compiler doesn't warn about the constant sizes.
+     */
+    errno = 0;
+    ok(arena_calloc(arena, huge / 2, 4) == NULL, "arena_calloc overflow");
+    is_int(ENOMEM, errno, "...with the right errno");
+    errno = 0;
+    ok(arena_alloc(arena, huge) == NULL, "arena_alloc of SIZE_MAX");
+    is_int(ENOMEM, errno, "...with the right errno");
+    arena_free(arena);
+
+    /* Fill several blocks and make sure nothing overlaps. */
+    arena = arena_new(128);
+    for (i = 0; i < 100; i++) {
+        snprintf(expected, sizeof(expected), "string %lu of a long list",
+                 (unsigned long) i);
+        strings[i] = arena_strdup(arena, expected);
+    }
+    okay = true;
+    for (i = 0; i < 100; i++) {
+        snprintf(expected, sizeof(expected), "string %lu of a long list",
+                 (unsigned long) i);
+        if (strings[i] == NULL || strcmp(expected, strings[i]) != 0)
+            okay = false;
+    }
+    ok(okay, "many allocations across small blocks");
+    arena_free(arena);
+
+    /* Allocations larger than the block size get their own block. */
+    arena = arena_new(64);
+    one = arena_strdup(arena, "small");
+    big = arena_alloc(arena, 1000);
+    memset(big, 'x', 999);
+    big[999] = '\0';
+    two = arena_strdup(arena, "after");
+    is_int(999, strlen(big), "large allocation");
+    is_string("small", one, "...and earlier string is intact");
+    is_string("after", two, "...and later string is intact");
+
+    /*
+     * Zero-sized allocations still return unique pointers.  zero is volatile
+     * so that the compiler doesn't warn about the constant size.
+     */
+    one = arena_alloc(arena, zero);
+    two = arena_alloc(arena, zero);
+    ok(one != two, "zero-sized allocations are distinct");
+    arena_free(arena);
+
+    /* Vectors can be allocated from an arena. */
+    arena = arena_new(64);
+    vector = vector_new_arena(arena);
+    ok(vector != NULL, "vector_new_arena");
+    ok(vector_add(vector, "foo"), "vector_add to an arena vector");
+    okay = true;
+    for (i = 0; i < 40; i++) {
+        snprintf(expected, sizeof(expected), "%lu", (unsigned long) i);
+        if (!vector_add(vector, expected))
+            okay = false;
+    }
+    ok(okay, "...repeatedly");
+    is_int(41, vector->count, "...with the right count");
+    is_string("foo", vector->strings[0], "...and first string");
+    is_string("39", vector->strings[40], "...and last string");
+    ok(vector_resize(vector, 2), "vector_resize of an arena vector");
+    is_int(2, vector->count, "...with the right count");
+    is_string("0", vector->strings[1], "...and strings");
+    split = vector_split_multi(",a, b,,c ", ", ", vector);
+    ok(split == vector, "vector_split_multi reuses an arena vector");
+    is_int(3, vector->count, "...with the right count");
+    is_string("c", vector->strings[2], "...and strings");
+    vector_clear(vector);
+    is_int(0, vector->count, "vector_clear of an arena vector");
+
+    /* Freeing an arena vector does nothing; freeing the arena frees it. */
+    vector_free(vector);
+    arena_free(arena);
+
+    /* Freeing NULL is allowed. */
+    arena_free(NULL);
+    ok(true, "arena_free of NULL");
+    return 0;
+}
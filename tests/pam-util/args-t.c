@@ -37,15 +37,36 @@
 #include <tests/fakepam/pam.h>
 #include <tests/tap/basic.h>
 
+/* A stand-in for the configuration struct of a PAM module. */
+struct pam_config {
+    int value;
+};
+
+/* The number of times config_free has been called. */
+static int config_frees = 0;
+
+
+/*
+ * Free a configuration struct, counting the calls.
+ */
+static void
+config_free(struct pam_config *config)
+{
+    config_frees++;
+    free(config);
+}
+
 
 int
 main(void)
 {
     pam_handle_t *pamh;
     struct pam_conv conv = {NULL, NULL};
-    struct pam_args *args;
+    struct pam_args *args, *cached;
+    const char *argv[] = {"debug", "minimum_uid=1000"};
+    const char *argv_other[] = {"debug", "minimum_uid=2000"};
 
-    plan(12);
+    plan(25);
 
     if (pam_start("test", NULL, &conv, &pamh) != PAM_SUCCESS)
         sysbail("Fake PAM initialization failed");
@@ -80,7 +101,43 @@ main(void)
     putil_args_free(NULL);
     ok(1, "Freeing a NULL args struct works");
 
+    /* Caching the args struct in the PAM handle. */
+    ok(putil_args_cache_get(pamh, "test-args", 0, 2, argv) == NULL,
+       "Nothing cached initially");
+    args = putil_args_new(pamh, 0);
+    if (args == NULL)
+        bail("cannot create args struct");
+    args->config = bcalloc(1, sizeof(struct pam_config));
+    args->config->value = 1;
+    ok(putil_args_cache_set(args, "test-args", 2, argv, config_free),
+       "Caching the args struct");
+    ok(args->cached, "...and it is marked as cached");
+    putil_args_free(args);
+    cached = putil_args_cache_get(pamh, "test-args", PAM_SILENT, 2, argv);
+    ok(cached == args, "...and it is returned with the same arguments");
+    is_int(1, args->config->value, "...with its configuration");
+    is_int(true, args->silent, "...and silent updated from the flags");
+    ok(putil_args_cache_get(pamh, "test-args", 0, 1, argv) == NULL,
+       "...but not with fewer arguments");
+    ok(putil_args_cache_get(pamh, "test-args", 0, 2, argv_other) == NULL,
+       "...or different arguments");
+    ok(putil_args_cache_get(pamh, "other", 0, 2, argv) == NULL,
+       "...or under a different name");
+
+    /* Replacing the cached struct frees the old one. */
+    args = putil_args_new(pamh, 0);
+    if (args == NULL)
+        bail("cannot create args struct");
+    args->config = bcalloc(1, sizeof(struct pam_config));
+    args->config->value = 2;
+    ok(putil_args_cache_set(args, "test-args", 2, argv_other, config_free),
+       "Caching a new args struct");
+    is_int(1, config_frees, "...frees the old configuration");
+    cached = putil_args_cache_get(pamh, "test-args", 0, 2, argv_other);
+    ok(cached == args, "...and the new struct is returned");
+
     pam_end(pamh, 0);
+    is_int(2, config_frees, "Closing the PAM handle frees the configuration");
 
     return 0;
 }
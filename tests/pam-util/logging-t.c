@@ -94,13 +94,14 @@ main(void)
     struct pam_args *args;
     struct pam_conv conv = {NULL, NULL};
     char *expected;
+    char *long_msg;
     struct output *seen;
 #ifdef HAVE_KRB5
     krb5_error_code code;
     krb5_principal princ;
 #endif
 
-    plan(27);
+    plan(37);
 
     if (pam_start("test", NULL, &conv, &pamh) != PAM_SUCCESS)
         sysbail("Fake PAM initialization failed");
@@ -126,6 +127,56 @@ main(void)
     TEST_PAM(putil_debug_pam, PAM_SUCCESS, LOG_DEBUG, "putil_debug_pam ok");
     args->debug = false;
 
+    /* Messages longer than the stack buffer, with the user prefix. */
+    long_msg = bcalloc(1, 4000);
+    memset(long_msg, 'x', 3999);
+    args->user = "alice";
+    putil_err(args, "%s", long_msg);
+    basprintf(&expected, "(user alice) %s", long_msg);
+    seen = pam_output();
+    is_string(expected, seen->lines[0].line, "long message with user");
+    pam_output_free(seen);
+    free(expected);
+    putil_crit_pam(args, PAM_SYSTEM_ERR, "%s", long_msg);
+    basprintf(&expected, "(user alice) %s: %s", long_msg,
+              pam_strerror(args->pamh, PAM_SYSTEM_ERR));
+    seen = pam_output();
+    is_string(expected, seen->lines[0].line, "long PAM error with user");
+    pam_output_free(seen);
+    free(expected);
+    putil_notice(args, "%s", "short");
+    seen = pam_output();
+    is_string("(user alice) short", seen->lines[0].line, "short with user");
+    pam_output_free(seen);
+    args->user = NULL;
+    free(long_msg);
+
+    /* Nothing is logged for priorities excluded by the syslog mask. */
+    setlogmask(LOG_UPTO(LOG_CRIT));
+    putil_err(args, "%s", "masked");
+    ok(pam_output() == NULL, "putil_err masked");
+    putil_err_pam(args, PAM_SYSTEM_ERR, "%s", "masked");
+    ok(pam_output() == NULL, "putil_err_pam masked");
+    TEST(putil_crit, LOG_CRIT, "putil_crit with mask");
+    setlogmask(LOG_UPTO(LOG_DEBUG));
+
+    /* Function entry, which only logs with debug on. */
+    putil_log_entry(args, "pam_sm_authenticate", PAM_SILENT);
+    ok(pam_output() == NULL, "putil_log_entry without debug on");
+    args->debug = true;
+    putil_log_entry(args, "pam_sm_authenticate", 0);
+    seen = pam_output();
+    is_string("pam_sm_authenticate: entry", seen->lines[0].line,
+              "putil_log_entry");
+    pam_output_free(seen);
+    putil_log_entry(args, "pam_sm_setcred",
+                    PAM_SILENT | PAM_DELETE_CRED | PAM_REFRESH_CRED);
+    seen = pam_output();
+    is_string("pam_sm_setcred: entry (delete|refresh|silent)",
+              seen->lines[0].line, "putil_log_entry with flags");
+    pam_output_free(seen);
+    args->debug = false;
+
 #ifdef HAVE_KRB5
     TEST_KRB5(putil_crit_krb5, LOG_CRIT, "putil_crit_krb5");
     TEST_KRB5(putil_err_krb5, LOG_ERR, "putil_err_krb5");
@@ -136,7 +187,7 @@ main(void)
     TEST_KRB5(putil_debug_krb5, LOG_DEBUG, "putil_debug_krb5");
     args->debug = false;
 #else
-    skip_block(4, "not built with Kerberos support");
+    skip_block(7, "not built with Kerberos support");
 #endif
 
     putil_args_free(args);
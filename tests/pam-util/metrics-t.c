@@ -0,0 +1,225 @@
+/*
+ * Test suite for PAM call metrics.
+ *
+ * The canonical version of this file is maintained in the rra-c-util package,
+ * which can be found at <https://www.eyrie.org/~eagle/software/rra-c-util/>.
+ *
+ * Written by Russ Allbery <eagle@eyrie.org>
+ * Copyright 2024 Russ Allbery <eagle@eyrie.org>
+ *
+ * Copying and distribution of this file, with or without modification, are
+ * permitted in any medium without royalty provided the copyright notice and
+ * this notice are preserved.  This file is offered as-is, without any
+ * warranty.
+ *
+ * SPDX-License-Identifier: FSFAP
+ */
+
+#include <config.h>
+#include <portable/pam.h>
+#include <portable/system.h>
+
+#include <errno.h>
+#include <sys/wait.h>
+
+#include <pam-util/args.h>
+#include <pam-util/logging.h>
+#include <pam-util/metrics.h>
+#include <tests/fakepam/pam.h>
+#include <tests/tap/basic.h>
+#include <tests/tap/string.h>
+
+/* The number of processes recording at once and the calls each makes. */
+#define CHILDREN 4
+#define CALLS    1000
+
+/* The argument struct used by the fake module function. */
+static struct pam_args *module_args = NULL;
+
+
+/*
+ * A fake PAM module function that fails if given any arguments.  It has the
+ * name of a real entry point so that EXIT records it.
+ */
+int
+pam_sm_authenticate(pam_handle_t *pamh UNUSED, int flags, int argc,
+                    const char **argv UNUSED)
+{
+    int status = (argc == 0) ? PAM_SUCCESS : PAM_AUTH_ERR;
+
+    ENTRY(module_args, flags);
+    EXIT(module_args, status);
+    return status;
+}
+
+
+/*
+ * Return the total number of calls recorded in a metrics file, or 0 if it
+ * can't be read.
+ */
+static unsigned long
+total_calls(const char *path)
+{
+    struct putil_metrics metrics;
+    unsigned long total = 0;
+    size_t i;
+
+    if (!putil_metrics_read(path, &metrics))
+        return 0;
+    for (i = 0; i < PUTIL_METRICS_FUNCTIONS; i++)
+        total += metrics.functions[i].calls;
+    return total;
+}
+
+
+/*
+ * Write a file of the given size filled with garbage.
+ */
+static void
+write_garbage(const char *path, size_t size)
+{
+    char *data;
+    FILE *file;
+
+    data = bmalloc(size);
+    memset(data, 'x', size);
+    file = fopen(path, "w");
+    if (file == NULL)
+        sysbail("cannot create %s", path);
+    if (fwrite(data, size, 1, file) != 1 || fclose(file) != 0)
+        sysbail("cannot write to %s", path);
+    free(data);
+}
+
+
+int
+main(void)
+{
+    pam_handle_t *pamh;
+    struct pam_conv conv = {NULL, NULL};
+    struct putil_metrics metrics;
+    struct putil_metrics_function *function;
+    struct output *seen;
+    char *tmpdir, *path, *garbage, *missing;
+    const char *argv[] = {"fail", NULL};
+    unsigned long total;
+    pid_t child;
+    size_t i, j;
+    int status;
+
+#ifndef PUTIL_METRICS_ENABLED
+    skip_all("metrics require lock-free C11 atomics");
+#endif
+
+    plan(24);
+
+    if (pam_start("test", NULL, &conv, &pamh) != PAM_SUCCESS)
+        sysbail("Fake PAM initialization failed");
+    module_args = putil_args_new(pamh, 0);
+    if (module_args == NULL)
+        bail("cannot create PAM argument struct");
+    tmpdir = test_tmpdir();
+    basprintf(&path, "%s/metrics", tmpdir);
+    basprintf(&garbage, "%s/garbage", tmpdir);
+    basprintf(&missing, "%s/missing/metrics", tmpdir);
+    unlink(path);
+
+    /* Nothing is recorded without a metrics file. */
+    pam_sm_authenticate(pamh, 0, 0, NULL);
+    ok(access(path, F_OK) < 0, "No metrics file without metrics set");
+    ok(!putil_metrics_read(path, &metrics), "...and it can't be read");
+    is_int(ENOENT, errno, "...with the right error");
+
+    /* Record some successes and a failure through EXIT. */
+    module_args->metrics = path;
+    pam_sm_authenticate(pamh, 0, 0, NULL);
+    pam_sm_authenticate(pamh, 0, 0, NULL);
+    pam_sm_authenticate(pamh, 0, 1, argv);
+    ok(putil_metrics_read(path, &metrics), "Read metrics");
+    function = &metrics.functions[0];
+    is_string("pam_sm_authenticate", function->name, "...function name");
+    is_int(3, function->calls, "...calls");
+    is_int(2, function->codes[PAM_SUCCESS], "...successes");
+    is_int(1, function->codes[PAM_AUTH_ERR], "...failures");
+    for (total = 0, i = 0; i < PUTIL_TIMING_BUCKETS; i++)
+        total += function->histogram[i];
+    is_int(3, total, "...histogram");
+    is_int(3, total_calls(path), "...and no other calls");
+
+    /* Other functions are ignored and large codes share the last counter. */
+    putil_metrics_record(module_args, "some_function", PAM_SUCCESS);
+    is_int(3, total_calls(path), "Other functions are ignored");
+    putil_metrics_record(module_args, "pam_sm_setcred", 1000);
+    putil_metrics_record(module_args, "pam_sm_setcred", -1);
+    ok(putil_metrics_read(path, &metrics), "Read metrics again");
+    function = &metrics.functions[1];
+    is_string("pam_sm_setcred", function->name, "...function name");
+    is_int(2, function->codes[PUTIL_METRICS_CODES - 1], "...large codes");
+
+    /* Several processes can record at the same time without losing counts. */
+    for (i = 0; i < CHILDREN; i++) {
+        child = fork();
+        if (child < 0)
+            sysbail("unable to fork");
+        else if (child == 0) {
+            for (j = 0; j < CALLS; j++)
+                putil_metrics_record(module_args, "pam_sm_acct_mgmt",
+                                     PAM_SUCCESS);
+            _exit(0);
+        }
+    }
+    for (i = 0; i < CHILDREN; i++)
+        if (wait(&status) < 0 || status != 0)
+            bail("child failed");
+    ok(putil_metrics_read(path, &metrics), "Read concurrent metrics");
+    is_int(CHILDREN * CALLS, metrics.functions[2].codes[PAM_SUCCESS],
+           "...no calls lost");
+
+    /* Files that aren't metrics files are rejected. */
+    write_garbage(garbage, 16);
+    ok(!putil_metrics_read(garbage, &metrics), "Short file is rejected");
+    is_int(EINVAL, errno, "...with the right error");
+    write_garbage(garbage, 64 * 1024);
+    ok(!putil_metrics_read(garbage, &metrics), "Garbage file is rejected");
+    is_int(EINVAL, errno, "...with the right error");
+
+    /* Recording to a bad file reports an error only once for each file. */
+    module_args->metrics = garbage;
+    pam_sm_authenticate(pamh, 0, 0, NULL);
+    pam_sm_authenticate(pamh, 0, 0, NULL);
+    seen = pam_output();
+    if (seen == NULL)
+        ok_block(2, false, "No error output");
+    else {
+        is_int(1, seen->count, "One error for a bad file");
+        ok(strncmp(seen->lines[0].line, "cannot open metrics file ",
+                   strlen("cannot open metrics file "))
+               == 0,
+           "...with the right message");
+    }
+    pam_output_free(seen);
+    module_args->metrics = missing;
+    pam_sm_authenticate(pamh, 0, 0, NULL);
+    seen = pam_output();
+    ok(seen != NULL && seen->count == 1,
+       "...but another bad file is reported");
+    pam_output_free(seen);
+
+    /* The original file is still used and wasn't affected. */
+    module_args->metrics = path;
+    pam_sm_authenticate(pamh, 0, 0, NULL);
+    is_int(3 + 2 + CHILDREN * CALLS + 1, total_calls(path),
+           "Original file still recorded");
+
+    /* Clean up. */
+    module_args->metrics = NULL;
+    unlink(path);
+    unlink(garbage);
+    free(path);
+    free(garbage);
+    free(missing);
+    test_tmpdir_free(tmpdir);
+    putil_args_free(module_args);
+    pam_end(pamh, 0);
+    return 0;
+}
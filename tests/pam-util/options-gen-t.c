@@ -0,0 +1,184 @@
+/*
+ * Test suite for generated PAM option parsing.
+ *
+ * Checks the code generated by pam-util/options-gen from tests/data/
+ * options.spec, both directly and against putil_args_parse() with the
+ * generated option table.
+ *
+ * The canonical version of this file is maintained in the rra-c-util package,
+ * which can be found at <https://www.eyrie.org/~eagle/software/rra-c-util/>.
+ *
+ * Written by Russ Allbery <eagle@eyrie.org>
+ * Copyright 2024 Russ Allbery <eagle@eyrie.org>
+ *
+ * Copying and distribution of this file, with or without modification, are
+ * permitted in any medium without royalty provided the copyright notice and
+ * this notice are preserved.  This file is offered as-is, without any
+ * warranty.
+ *
+ * SPDX-License-Identifier: FSFAP
+ */
+
+#include <config.h>
+#include <portable/pam.h>
+#include <portable/system.h>
+
+#include <syslog.h>
+
+#include <pam-util/args.h>
+#include <pam-util/options.h>
+#include <pam-util/vector.h>
+#include <tests/fakepam/pam.h>
+#include <tests/pam-util/example-options.h>
+#include <tests/tap/basic.h>
+#include <tests/tap/string.h>
+
+
+/*
+ * Parse a single argument with the generated parser and check the error that
+ * it reports.
+ */
+static void
+test_error(struct pam_args *args, const char *arg, const char *expected)
+{
+    const char *argv[1];
+    struct output *seen;
+
+    argv[0] = arg;
+    ok(example_args_parse(args, 1, argv), "Parse of %s", arg);
+    seen = pam_output();
+    if (seen == NULL)
+        ok_block(2, false, "...no error output");
+    else {
+        is_int(LOG_ERR, seen->lines[0].priority, "...priority for %s", arg);
+        is_string(expected, seen->lines[0].line, "...error for %s", arg);
+    }
+    pam_output_free(seen);
+}
+
+
+int
+main(void)
+{
+    pam_handle_t *pamh;
+    struct pam_args *args;
+    struct pam_conv conv = {NULL, NULL};
+    struct pam_config *generated, *table;
+    bool sorted;
+    size_t i;
+#ifdef HAVE_KRB5
+    const char *expires = "expires=1d";
+#else
+    const char *expires = "expires=86400";
+#endif
+    const char *argv_all[] = {"cells=stanford.edu,ir.stanford.edu",
+                              "debug",
+                              NULL,
+                              "ignore_root=false",
+                              "minimum_uid=1000",
+                              "program=/bin/true",
+                              "program=/bin/false",
+                              "banner=Welcome",
+                              "ccache=FILE:/tmp/cc",
+                              "realms=A.ORG B.ORG",
+                              "keytab=FILE:/tmp/keytab",
+                              "domains=a.org, b.org"};
+
+    if (pam_start("test", NULL, &conv, &pamh) != PAM_SUCCESS)
+        sysbail("cannot create pam_handle_t");
+    args = putil_args_new(pamh, 0);
+    if (args == NULL)
+        bail("cannot create PAM argument struct");
+    argv_all[2] = expires;
+
+    plan(44);
+
+    /* The generated table is sorted. */
+    is_int(11, example_optlen, "Option table length");
+    sorted = true;
+    for (i = 1; i < example_optlen; i++)
+        if (strcmp(example_options[i - 1].name, example_options[i].name) >= 0)
+            sorted = false;
+    ok(sorted, "...and is sorted");
+
+    /* Defaults come from the generated table. */
+    args->config = bcalloc(1, sizeof(struct pam_config));
+    ok(putil_args_defaults(args, example_options, example_optlen),
+       "Setting the defaults");
+    generated = args->config;
+    is_string("Kerberos", generated->banner, "...banner default");
+    is_string("/tmp/krb5cc", generated->ccache, "...ccache default");
+    ok(generated->cells == NULL, "...cells default");
+    is_int(false, generated->debug, "...debug default");
+    ok(generated->domains == NULL, "...domains default");
+    is_int(10, generated->expires, "...expires default");
+    is_int(true, generated->ignore_root, "...ignore_root default");
+    is_string("/etc/krb5.keytab", generated->keytab, "...keytab default");
+    is_int(0, generated->minimum_uid, "...minimum_uid default");
+    ok(generated->program == NULL, "...program default");
+    is_string("EXAMPLE.COM,EXAMPLE.ORG", generated->realms,
+              "...realms default");
+
+    /* Parse everything with the generated parser. */
+    ok(example_args_parse(args, (int) ARRAY_SIZE(argv_all), argv_all),
+       "Parse of full argv");
+    ok(pam_output() == NULL, "...with no output");
+    is_string("Welcome", generated->banner, "...banner is set");
+    is_string("FILE:/tmp/cc", generated->ccache, "...ccache is set");
+    if (generated->cells == NULL)
+        ok_block(2, false, "...cells is set");
+    else {
+        is_int(2, generated->cells->count, "...with two cells");
+        is_string("ir.stanford.edu", generated->cells->strings[1],
+                  "...second is ir.stanford.edu");
+    }
+    is_int(true, generated->debug, "...debug is set");
+    if (generated->domains == NULL)
+        ok_block(2, false, "...domains is set");
+    else {
+        is_int(2, generated->domains->count, "...with two domains");
+        ok(generated->domains->arena == args->arena, "...in the args arena");
+    }
+    is_int(86400, generated->expires, "...expires is set");
+    is_int(false, generated->ignore_root, "...ignore_root is set");
+    is_string("FILE:/tmp/keytab", generated->keytab, "...keytab is set");
+    is_int(1000, generated->minimum_uid, "...minimum_uid is set");
+    is_string("/bin/false", generated->program, "...last program wins");
+    is_string("A.ORG B.ORG", generated->realms, "...realms is set");
+
+    /* The same arguments give the same results with putil_args_parse. */
+    args->config = bcalloc(1, sizeof(struct pam_config));
+    putil_args_defaults(args, example_options, example_optlen);
+    ok(putil_args_parse(args, (int) ARRAY_SIZE(argv_all), argv_all,
+                        example_options, example_optlen),
+       "Parse with the generated table");
+    table = args->config;
+    ok(strcmp(generated->banner, table->banner) == 0
+           && strcmp(generated->program, table->program) == 0
+           && strcmp(generated->realms, table->realms) == 0
+           && strcmp(generated->ccache, table->ccache) == 0
+           && strcmp(generated->keytab, table->keytab) == 0
+           && generated->domains->count == table->domains->count
+           && generated->cells->count == table->cells->count
+           && generated->debug == table->debug
+           && generated->expires == table->expires
+           && generated->ignore_root == table->ignore_root
+           && generated->minimum_uid == table->minimum_uid,
+       "...matches the generated parser");
+    example_config_free(table);
+
+    /* Errors, including names that share a prefix or length with options. */
+    args->config = generated;
+    test_error(args, "debugging", "unknown option debugging");
+    test_error(args, "debu", "unknown option debu");
+    test_error(args, "cellsx=foo", "unknown option cellsx=foo");
+    test_error(args, "debug=maybe", "invalid boolean in setting: debug=maybe");
+    is_int(true, generated->debug, "...debug unchanged");
+
+    /* Clean up. */
+    example_config_free(generated);
+    args->config = NULL;
+    putil_args_free(args);
+    pam_end(pamh, 0);
+    return 0;
+}
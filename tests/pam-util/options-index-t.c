@@ -0,0 +1,206 @@
+/*
+ * Test suite for PAM option lookups with a large option table.
+ *
+ * putil_args_parse() finds options using an index built the first time it
+ * sees an option table.  Check lookups with a table large enough to exercise
+ * the index, using a count of the options found with the index kept by the
+ * testing build of pam-util/options.c, and time parsing of long argument
+ * lists if AUTHOR_TESTING is set.
+ *
+ * The canonical version of this file is maintained in the rra-c-util package,
+ * which can be found at <https://www.eyrie.org/~eagle/software/rra-c-util/>.
+ *
+ * Written by Russ Allbery <eagle@eyrie.org>
+ * Copyright 2024 Russ Allbery <eagle@eyrie.org>
+ *
+ * Copying and distribution of this file, with or without modification, are
+ * permitted in any medium without royalty provided the copyright notice and
+ * this notice are preserved.  This file is offered as-is, without any
+ * warranty.
+ *
+ * SPDX-License-Identifier: FSFAP
+ */
+
+#include <config.h>
+#include <portable/pam.h>
+#include <portable/system.h>
+
+#include <syslog.h>
+#include <time.h>
+
+#include <pam-util/args.h>
+#include <pam-util/options.h>
+#include <tests/fakepam/pam.h>
+#include <tests/tap/basic.h>
+#include <tests/tap/string.h>
+
+/* The number of options in the table, and the arguments in the benchmark. */
+#define OPTIONS   64
+#define ARGUMENTS 10000
+#define ROUNDS    100
+
+/* The configuration struct, with a boolean and a number for each option. */
+struct pam_config {
+    bool flags[OPTIONS];
+    long numbers[OPTIONS];
+};
+
+/* Option names, built at runtime. */
+static char names[OPTIONS][16];
+
+/* The number of options found with the index, from pam-util/options.c. */
+extern unsigned long putil_args_index_hits;
+
+
+/*
+ * Build an option table with OPTIONS options named option00 and so forth.
+ * Even-numbered options are booleans and odd-numbered options are numbers.
+ */
+static void
+build_options(struct option *options)
+{
+    size_t i;
+
+    memset(options, 0, OPTIONS * sizeof(struct option));
+    for (i = 0; i < OPTIONS; i++) {
+        snprintf(names[i], sizeof(names[i]), "option%02lu", (unsigned long) i);
+        options[i].name = names[i];
+        if (i % 2 == 0) {
+            options[i].type = TYPE_BOOLEAN;
+            options[i].location = offsetof(struct pam_config, flags)
+                                  + i * sizeof(bool);
+        } else {
+            options[i].type = TYPE_NUMBER;
+            options[i].location = offsetof(struct pam_config, numbers)
+                                  + i * sizeof(long);
+        }
+    }
+}
+
+
+/*
+ * Check that parsing an argument reports it as an unknown option.
+ */
+static void
+test_unknown(struct pam_args *args, const struct option *options,
+             size_t optlen, const char *arg)
+{
+    const char *argv[1];
+    struct output *seen;
+    char *expected;
+
+    argv[0] = arg;
+    ok(putil_args_parse(args, 1, argv, options, optlen), "Parse of %s", arg);
+    seen = pam_output();
+    basprintf(&expected, "unknown option %s", arg);
+    if (seen == NULL)
+        ok(false, "...no error output");
+    else
+        is_string(expected, seen->lines[0].line, "...error for %s", arg);
+    free(expected);
+    pam_output_free(seen);
+}
+
+
+int
+main(void)
+{
+    pam_handle_t *pamh;
+    struct pam_args *args;
+    struct pam_conv conv = {NULL, NULL};
+    struct option options[OPTIONS];
+    struct option duplicates[3];
+    const char **argv;
+    char **strings;
+    struct timespec start, end;
+    size_t i;
+    bool okay;
+    double seconds;
+
+    if (pam_start("test", NULL, &conv, &pamh) != PAM_SUCCESS)
+        sysbail("cannot create pam_handle_t");
+    args = putil_args_new(pamh, 0);
+    if (args == NULL)
+        bail("cannot create PAM argument struct");
+    args->config = bcalloc(1, sizeof(struct pam_config));
+
+    plan(17);
+
+    /* Set every option, twice so that the second pass reuses the index. */
+    build_options(options);
+    strings = bcalloc(OPTIONS, sizeof(char *));
+    argv = bcalloc(OPTIONS, sizeof(char *));
+    for (i = 0; i < OPTIONS; i++) {
+        if (i % 2 == 0)
+            basprintf(&strings[i], "%s", names[i]);
+        else
+            basprintf(&strings[i], "%s=%lu", names[i], (unsigned long) i * 10);
+        argv[i] = strings[i];
+    }
+    ok(putil_args_parse(args, OPTIONS, argv, options, OPTIONS),
+       "Parse of all options");
+    for (okay = true, i = 0; i < OPTIONS; i++)
+        if (i % 2 == 0 ? !args->config->flags[i]
+                       : args->config->numbers[i] != (long) i * 10)
+            okay = false;
+    ok(okay, "...and all values are correct");
+    ok(pam_output() == NULL, "...and no output");
+    is_int(OPTIONS, (long) putil_args_index_hits,
+           "...and all were found by index");
+    memset(args->config, 0, sizeof(struct pam_config));
+    ok(putil_args_parse(args, OPTIONS, argv, options, OPTIONS),
+       "Parse of all options again");
+    for (okay = true, i = 0; i < OPTIONS; i++)
+        if (i % 2 == 0 ? !args->config->flags[i]
+                       : args->config->numbers[i] != (long) i * 10)
+            okay = false;
+    ok(okay, "...and all values are correct");
+    is_int(OPTIONS * 2, (long) putil_args_index_hits, "...and found by index");
+
+    /* Names that are prefixes or extensions of options are not found. */
+    test_unknown(args, options, OPTIONS, "option0");
+    test_unknown(args, options, OPTIONS, "option000=1");
+    test_unknown(args, options, OPTIONS, "=1");
+    is_int(OPTIONS * 2, (long) putil_args_index_hits,
+           "...and none found by index");
+
+    /* A table with duplicate names still works. */
+    memcpy(duplicates, options, sizeof(duplicates));
+    duplicates[1] = duplicates[0];
+    argv[0] = "option00=false";
+    args->config->flags[0] = true;
+    ok(putil_args_parse(args, 1, argv, duplicates, 3),
+       "Parse with duplicate options");
+    is_int(false, args->config->flags[0], "...and value is correct");
+
+    /* Time parsing a long argument list if requested. */
+    for (i = 0; i < OPTIONS; i++)
+        free(strings[i]);
+    free(strings);
+    free(argv);
+    if (getenv("AUTHOR_TESTING") == NULL)
+        skip("benchmark only run for author");
+    else {
+        argv = bcalloc(ARGUMENTS, sizeof(char *));
+        for (i = 0; i < ARGUMENTS; i++)
+            argv[i] = (i % 2 == 0) ? "option62=yes" : "option63=12345";
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (i = 0; i < ROUNDS; i++)
+            if (!putil_args_parse(args, ARGUMENTS, argv, options, OPTIONS))
+                break;
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        is_int(ROUNDS, i, "Parse of long argument lists");
+        seconds = (double) (end.tv_sec - start.tv_sec)
+                  + (double) (end.tv_nsec - start.tv_nsec) / 1e9;
+        diag("%d options: %.1f ns per argument", OPTIONS,
+             seconds * 1e9 / ((double) ROUNDS * ARGUMENTS));
+        free(argv);
+    }
+
+    /* Clean up. */
+    free(args->config);
+    args->config = NULL;
+    putil_args_free(args);
+    pam_end(pamh, 0);
+    return 0;
+}
@@ -70,6 +70,36 @@ static struct option options[] = {
 };
 static const size_t optlen = sizeof(options) / sizeof(options[0]);
 
+/* A configuration struct and rules for borrowed options. */
+struct borrowed_config {
+    const char *cells;
+    const char *program;
+};
+
+#define B(name) (#name), offsetof(struct borrowed_config, name)
+
+static struct option borrowed_options[] = {
+    {B(cells),   true, BLIST(NULL)         },
+    {B(program), true, BSTRING("/bin/echo")},
+};
+static const size_t borrowed_optlen =
+    sizeof(borrowed_options) / sizeof(borrowed_options[0]);
+
+/* A configuration struct and rules for options kept in the args arena. */
+struct arena_config {
+    struct vector *cells;
+    char *program;
+};
+
+#define A(name) (#name), offsetof(struct arena_config, name)
+
+static struct option arena_options[] = {
+    {A(cells),   true, ALIST("foo.com bar.com")},
+    {A(program), true, ASTRING(NULL)           },
+};
+static const size_t arena_optlen =
+    sizeof(arena_options) / sizeof(arena_options[0]);
+
 /*
  * A macro used to parse the various ways of spelling booleans.  This reuses
  * the argv_bool variable, setting it to the first value provided and then
@@ -131,6 +161,29 @@ config_free(struct pam_config *config)
 }
 
 
+#ifdef HAVE_KRB5
+/*
+ * Write a krb5.conf file with the given minimum_uid and debug settings for
+ * the testing section.
+ */
+static void
+write_krb5_conf(const char *path, long minimum_uid, bool debug)
+{
+    FILE *file;
+
+    file = fopen(path, "w");
+    if (file == NULL)
+        sysbail("cannot create %s", path);
+    fprintf(file, "[appdefaults]\n    testing = {\n");
+    fprintf(file, "        minimum_uid = %ld\n", minimum_uid);
+    fprintf(file, "        debug = %s\n", debug ? "true" : "false");
+    fprintf(file, "    }\n");
+    if (fclose(file) == EOF)
+        sysbail("cannot write to %s", path);
+}
+#endif
+
+
 int
 main(void)
 {
@@ -151,7 +204,7 @@ main(void)
                               "ignore_root",
                               "minimum_uid=1000",
                               "program=/bin/true"};
-    char *krb5conf;
+    char *krb5conf, *tmpdir, *path, *newpath;
 #else
     const char *argv_all[] = {"cells=stanford.edu,ir.stanford.edu",
                               "debug",
@@ -160,6 +213,14 @@ main(void)
                               "minimum_uid=1000",
                               "program=/bin/true"};
 #endif
+    struct borrowed_config bconfig;
+    struct arena_config aconfig;
+    const char *argv_borrowed[] = {"cells=foo.com, bar.com,,baz.com",
+                                   "program=/bin/true"};
+    const char *argv_missing[] = {"program"};
+    const char *list, *element;
+    size_t length;
+    char elements[BUFSIZ];
 
     if (pam_start("test", NULL, &conv, &pamh) != PAM_SUCCESS)
         sysbail("cannot create pam_handle_t");
@@ -167,7 +228,7 @@ main(void)
     if (args == NULL)
         bail("cannot create PAM argument struct");
 
-    plan(161);
+    plan(193);
 
     /* First, check just the defaults. */
     args->config = config_new();
@@ -327,6 +388,69 @@ main(void)
     config_free(args->config);
     args->config = NULL;
 
+    /* Borrowed strings and lists point to their defaults or the arguments. */
+    memset(&bconfig, 0, sizeof(bconfig));
+    args->config = (struct pam_config *) (void *) &bconfig;
+    status = putil_args_defaults(args, borrowed_options, borrowed_optlen);
+    ok(status, "Setting borrowed defaults");
+    ok(bconfig.program == borrowed_options[1].defaults.string,
+       "...program points to the default");
+    ok(bconfig.cells == NULL, "...cells default");
+    status = putil_args_parse(args, 2, argv_borrowed, borrowed_options,
+                              borrowed_optlen);
+    ok(status, "Parse of borrowed options");
+    ok(bconfig.cells == argv_borrowed[0] + strlen("cells="),
+       "...cells points to the argument");
+    ok(bconfig.program == argv_borrowed[1] + strlen("program="),
+       "...program points to the argument");
+    elements[0] = '\0';
+    list = bconfig.cells;
+    while (putil_list_next(&list, &element, &length)) {
+        if (elements[0] != '\0')
+            strcat(elements, "|");
+        strncat(elements, element, length);
+    }
+    is_string("foo.com|bar.com|baz.com", elements, "...list elements");
+    list = " ,\t, ";
+    ok(!putil_list_next(&list, &element, &length), "Empty borrowed list");
+    status = putil_args_parse(args, 1, argv_missing, borrowed_options,
+                              borrowed_optlen);
+    seen = pam_output();
+    if (seen == NULL)
+        ok_block(2, false, "...no error output");
+    else {
+        is_int(LOG_ERR, seen->lines[0].priority, "...priority for program");
+        is_string("value missing for option program", seen->lines[0].line,
+                  "...error for program");
+    }
+    pam_output_free(seen);
+    args->config = NULL;
+
+    /* Arena strings and lists are allocated from the args arena. */
+    memset(&aconfig, 0, sizeof(aconfig));
+    args->config = (struct pam_config *) (void *) &aconfig;
+    status = putil_args_defaults(args, arena_options, arena_optlen);
+    ok(status, "Setting arena defaults");
+    ok(aconfig.program == NULL, "...program default");
+    if (aconfig.cells == NULL)
+        ok_block(2, false, "...cells default");
+    else {
+        is_int(2, aconfig.cells->count, "...cells default");
+        ok(aconfig.cells->arena == args->arena, "...in the args arena");
+    }
+    status = putil_args_parse(args, 2, argv_borrowed, arena_options,
+                              arena_optlen);
+    ok(status, "Parse of arena options");
+    is_string("/bin/true", aconfig.program, "...program");
+    if (aconfig.cells == NULL)
+        ok_block(2, false, "...cells");
+    else {
+        is_int(3, aconfig.cells->count, "...cells");
+        is_string("baz.com", aconfig.cells->strings[2], "...third cell");
+    }
+    vector_free(aconfig.cells);
+    args->config = NULL;
+
 #ifdef HAVE_KRB5
 
     /* Test for Kerberos krb5.conf option parsing. */
@@ -442,11 +566,74 @@ main(void)
     config_free(args->config);
     args->config = NULL;
 
+    /* Borrowed options from krb5.conf are kept in the args arena. */
+    memset(&bconfig, 0, sizeof(bconfig));
+    args->config = (struct pam_config *) (void *) &bconfig;
+    status = putil_args_krb5(args, "testing", borrowed_options,
+                             borrowed_optlen);
+    ok(status, "Borrowed options from krb5.conf");
+    is_string("bar.com foo.com", bconfig.cells, "...cells");
+    is_string("echo /bin/true", bconfig.program, "...program");
+    ok(args->arena != NULL, "...and are stored in the args arena");
+    args->config = NULL;
+
+    /* So are arena options from krb5.conf. */
+    memset(&aconfig, 0, sizeof(aconfig));
+    args->config = (struct pam_config *) (void *) &aconfig;
+    status = putil_args_krb5(args, "testing", arena_options, arena_optlen);
+    ok(status, "Arena options from krb5.conf");
+    is_string("echo /bin/true", aconfig.program, "...program");
+    if (aconfig.cells == NULL)
+        ok_block(2, false, "...cells");
+    else {
+        is_int(2, aconfig.cells->count, "...cells");
+        ok(aconfig.cells->arena == args->arena, "...in the args arena");
+    }
+    args->config = NULL;
+
+    /* Replacing krb5.conf discards the saved settings. */
+    tmpdir = test_tmpdir();
+    basprintf(&path, "%s/krb5.conf", tmpdir);
+    basprintf(&newpath, "%s/krb5.conf.new", tmpdir);
+    write_krb5_conf(path, 500, true);
+    if (setenv("KRB5_CONFIG", path, 1) < 0)
+        sysbail("cannot set KRB5_CONFIG");
+    krb5_free_context(args->ctx);
+    if (krb5_init_context(&args->ctx) != 0)
+        bail("cannot parse temporary krb5.conf file");
+    args->config = config_new();
+    status = putil_args_krb5(args, "testing", options, optlen);
+    ok(status, "Options from temporary krb5.conf");
+    is_int(500, args->config->minimum_uid, "...minimum_uid");
+    is_int(true, args->config->debug, "...debug");
+    config_free(args->config);
+    args->config = config_new();
+    putil_args_krb5(args, "testing", options, optlen);
+    is_int(500, args->config->minimum_uid, "...minimum_uid again");
+    config_free(args->config);
+    write_krb5_conf(newpath, 600, false);
+    if (rename(newpath, path) < 0)
+        sysbail("cannot rename %s to %s", newpath, path);
+    krb5_free_context(args->ctx);
+    if (krb5_init_context(&args->ctx) != 0)
+        bail("cannot parse temporary krb5.conf file");
+    args->config = config_new();
+    args->config->debug = true;
+    putil_args_krb5(args, "testing", options, optlen);
+    is_int(600, args->config->minimum_uid, "...minimum_uid after replacing");
+    is_int(false, args->config->debug, "...debug after replacing");
+    config_free(args->config);
+    args->config = NULL;
+    unlink(path);
+    free(path);
+    free(newpath);
+    test_tmpdir_free(tmpdir);
+
     test_file_path_free(krb5conf);
 
 #else /* !HAVE_KRB5 */
 
-    skip_block(37, "Kerberos support not configured");
+    skip_block(54, "Kerberos support not configured");
 
 #endif
 
@@ -0,0 +1,175 @@
+/*
+ * Test suite for timing of PAM module calls.
+ *
+ * The canonical version of this file is maintained in the rra-c-util package,
+ * which can be found at <https://www.eyrie.org/~eagle/software/rra-c-util/>.
+ *
+ * Written by Russ Allbery <eagle@eyrie.org>
+ * Copyright 2024 Russ Allbery <eagle@eyrie.org>
+ *
+ * Copying and distribution of this file, with or without modification, are
+ * permitted in any medium without royalty provided the copyright notice and
+ * this notice are preserved.  This file is offered as-is, without any
+ * warranty.
+ *
+ * SPDX-License-Identifier: FSFAP
+ */
+
+#include <config.h>
+#include <portable/pam.h>
+#include <portable/system.h>
+
+#include <syslog.h>
+#include <time.h>
+
+#include <pam-util/args.h>
+#include <pam-util/logging.h>
+#include <pam-util/timing.h>
+#include <tests/fakepam/pam.h>
+#include <tests/tap/basic.h>
+#include <tests/tap/string.h>
+
+/* How long the fake Kerberos phase of a call sleeps, in microseconds. */
+#define SLEEP_USEC 20000
+
+
+/*
+ * A fake PAM module function that spends some time in the Kerberos phase and
+ * returns the provided status.
+ */
+static int
+timed_call(struct pam_args *args, int status)
+{
+    struct timespec delay = {0, SLEEP_USEC * 1000};
+
+    ENTRY(args, 0);
+    putil_timing_phase_start(args, PUTIL_PHASE_KRB5);
+    nanosleep(&delay, NULL);
+    putil_timing_phase_end(args, PUTIL_PHASE_KRB5);
+    EXIT(args, status);
+    return status;
+}
+
+
+int
+main(void)
+{
+    pam_handle_t *pamh;
+    struct pam_args *args;
+    struct pam_conv conv = {NULL, NULL};
+    struct putil_timing_stats stats;
+    struct output *seen;
+    struct timespec delay = {0, SLEEP_USEC * 1000};
+    unsigned long usec, options, krb5, total;
+    char user[32], result[32];
+    const char *prefix = "timing func=timed_call user= result=failure usec=";
+    size_t i;
+
+    plan(24);
+
+    if (pam_start("test", NULL, &conv, &pamh) != PAM_SUCCESS)
+        sysbail("Fake PAM initialization failed");
+    args = putil_args_new(pamh, 0);
+    if (args == NULL)
+        bail("cannot create PAM argument struct");
+
+    /* Nothing is logged or recorded without timing enabled. */
+    timed_call(args, PAM_SUCCESS);
+    ok(pam_output() == NULL, "No output without timing");
+    ok(!putil_timing_stats("timed_call", &stats), "...and no statistics");
+    is_int(0, stats.calls, "...and the statistics are zeroed");
+
+    /* A timed call logs a record with the phases. */
+    args->timing = true;
+    args->user = "alice";
+    putil_timing_init(args);
+    timed_call(args, PAM_SUCCESS);
+    seen = pam_output();
+    if (seen == NULL)
+        ok_block(6, false, "No timing output");
+    else {
+        is_int(LOG_INFO, seen->lines[0].priority, "Timing record priority");
+        is_int(5,
+               sscanf(seen->lines[0].line,
+                      "timing func=timed_call user=%31s result=%31s usec=%lu"
+                      " options=%lu krb5=%lu",
+                      user, result, &usec, &options, &krb5),
+               "...format");
+        is_string("alice", user, "...user");
+        is_string("success", result, "...result");
+        ok(krb5 >= SLEEP_USEC, "...Kerberos phase (%lu)", krb5);
+        ok(usec >= options + krb5, "...total covers the phases (%lu)", usec);
+    }
+    pam_output_free(seen);
+
+    /* A failure, with debugging also enabled. */
+    args->debug = true;
+    args->user = NULL;
+    putil_timing_init(args);
+    timed_call(args, PAM_AUTH_ERR);
+    seen = pam_output();
+    if (seen == NULL || seen->count != 3)
+        ok_block(3, false, "Debug and timing output");
+    else {
+        is_string("timed_call: entry", seen->lines[0].line, "...entry");
+        ok(strncmp(seen->lines[1].line, prefix, strlen(prefix)) == 0,
+           "...timing record");
+        is_string("timed_call: exit (failure)", seen->lines[2].line,
+                  "...exit");
+    }
+    pam_output_free(seen);
+    args->debug = false;
+
+    /* Statistics are kept for both calls. */
+    ok(putil_timing_stats("timed_call", &stats), "Statistics found");
+    is_int(2, stats.calls, "...calls");
+    is_int(1, stats.failures, "...failures");
+    ok(stats.phases[PUTIL_PHASE_KRB5] >= 2 * SLEEP_USEC,
+       "...Kerberos phase total");
+    ok(stats.total >= stats.phases[PUTIL_PHASE_KRB5], "...total");
+    for (total = 0, i = 0; i < PUTIL_TIMING_BUCKETS; i++)
+        total += stats.histogram[i];
+    is_int(2, total, "...histogram");
+    ok(!putil_timing_stats("pam_sm_authenticate", &stats),
+       "No statistics for other functions");
+
+    /* Ending a phase that was never started does nothing. */
+    putil_timing_phase_end(args, PUTIL_PHASE_KRB5);
+    is_int(0, args->times.phases[PUTIL_PHASE_KRB5], "Unstarted phase");
+
+    /* Statistics can be reset. */
+    putil_timing_reset();
+    ok(!putil_timing_stats("timed_call", &stats), "Statistics reset");
+
+    /*
+     * Kerberos calls made while parsing options happen before it's known
+     * whether timing is enabled, but are still counted in the Kerberos phase
+     * and not in the options phase.
+     */
+    args->timing = false;
+    putil_timing_init(args);
+    putil_timing_phase_start(args, PUTIL_PHASE_KRB5);
+    nanosleep(&delay, NULL);
+    putil_timing_phase_end(args, PUTIL_PHASE_KRB5);
+    args->timing = true;
+    timed_call(args, PAM_SUCCESS);
+    seen = pam_output();
+    if (seen == NULL)
+        ok_block(3, false, "No timing output");
+    else {
+        is_int(3,
+               sscanf(seen->lines[0].line,
+                      "timing func=timed_call user= result=success usec=%lu"
+                      " options=%lu krb5=%lu",
+                      &usec, &options, &krb5),
+               "Timing record with Kerberos calls before ENTRY");
+        ok(krb5 >= 2 * SLEEP_USEC, "...Kerberos phase (%lu)", krb5);
+        ok(options < SLEEP_USEC, "...not in options phase (%lu)", options);
+    }
+    pam_output_free(seen);
+    putil_timing_reset();
+
+    putil_args_free(args);
+    pam_end(pamh, 0);
+    return 0;
+}
@@ -1,6 +1,12 @@
 /*
  * PAM utility vector library test suite.
  *
+ * Also includes a benchmark comparing vector_add and vector_split_multi to the
+ * way they used to work (growing the table one element at a time and counting
+ * the strings in a separate pass) and vector_copy_pooled to vector_copy,
+ * which is only run if AUTHOR_TESTING is set since the results are only
+ * informational.
+ *
  * The canonical version of this file is maintained in the rra-c-util package,
  * which can be found at <https://www.eyrie.org/~eagle/software/rra-c-util/>.
  *
@@ -20,12 +26,161 @@
 #include <config.h>
 #include <portable/system.h>
 
+#include <errno.h>
 #include <sys/wait.h>
+#include <time.h>
 
 #include <pam-util/vector.h>
 #include <tests/tap/basic.h>
 #include <tests/tap/string.h>
 
+/* Number of strings used by the benchmark and how many times to repeat it. */
+#define BENCH_STRINGS 1000
+#define BENCH_LOOPS   1000
+
+
+/*
+ * Return the number of seconds since the given start time.
+ */
+static double
+elapsed(const struct timespec *start)
+{
+    struct timespec end;
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (double) (end.tv_sec - start->tv_sec)
+           + (double) (end.tv_nsec - start->tv_nsec) / 1000000000.0;
+}
+
+
+/*
+ * Add a string to a vector the way vector_add used to, growing the table one
+ * element at a time.
+ */
+static void
+old_add(struct vector *vector, const char *string)
+{
+    if (vector->count == vector->allocated)
+        if (!vector_resize(vector, vector->allocated + 1))
+            sysbail("cannot allocate memory");
+    if (!vector_add(vector, string))
+        sysbail("cannot allocate memory");
+}
+
+
+/*
+ * Split a string the way vector_split_multi used to: count the strings in one
+ * pass, searching seps for every character, and then allocate each string
+ * separately in a second pass.
+ */
+static void
+old_split(const char *string, const char *seps, struct vector *vector)
+{
+    const char *p, *start;
+    size_t count = 0;
+
+    vector_clear(vector);
+    for (p = string; *p != '\0'; p++)
+        if (strchr(seps, *p) == NULL
+            && (p == string || strchr(seps, p[-1]) != NULL))
+            count++;
+    if (vector->allocated < count && !vector_resize(vector, count))
+        sysbail("cannot allocate memory");
+    for (start = string, p = string;; p++)
+        if (*p == '\0' || strchr(seps, *p) != NULL) {
+            if (p != start)
+                vector->strings[vector->count++] =
+                    bstrndup(start, (size_t) (p - start));
+            if (*p == '\0')
+                break;
+            start = p + 1;
+        }
+}
+
+
+/*
+ * Time the old and new ways of adding and splitting vectors and the two ways
+ * of copying them, and report the results.
+ */
+static void
+benchmark(void)
+{
+    struct vector *vector, *source, *copy;
+    struct timespec start;
+    double add[2], dup[2], split[2];
+    char number[32];
+    char *string;
+    size_t i, j;
+
+    source = vector_new();
+    string = bmalloc(BENCH_STRINGS * strlen("string, ") + 1);
+    string[0] = '\0';
+    for (i = 0; i < BENCH_STRINGS; i++) {
+        snprintf(number, sizeof(number), "%lu", (unsigned long) i);
+        if (!vector_add(source, number))
+            sysbail("cannot allocate memory");
+        strcat(string, "string, ");
+    }
+
+    /* Build vectors a string at a time. */
+    for (i = 0; i < 2; i++) {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (j = 0; j < BENCH_LOOPS * BENCH_STRINGS; j++) {
+            if (j % BENCH_STRINGS == 0) {
+                if (j > 0)
+                    vector_free(vector);
+                vector = vector_new();
+                if (vector == NULL)
+                    sysbail("cannot allocate memory");
+            }
+            if (i == 0)
+                old_add(vector, source->strings[j % BENCH_STRINGS]);
+            else if (!vector_add(vector, source->strings[j % BENCH_STRINGS]))
+                sysbail("cannot allocate memory");
+        }
+        vector_free(vector);
+        add[i] = elapsed(&start);
+    }
+
+    /* Copy vectors. */
+    for (i = 0; i < 2; i++) {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (j = 0; j < BENCH_LOOPS; j++) {
+            if (i == 0)
+                copy = vector_copy(source);
+            else
+                copy = vector_copy_pooled(source);
+            if (copy == NULL)
+                sysbail("cannot allocate memory");
+            vector_free(copy);
+        }
+        dup[i] = elapsed(&start);
+    }
+
+    /* Split strings, reusing the same vector. */
+    vector = vector_new();
+    for (i = 0; i < 2; i++) {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (j = 0; j < BENCH_LOOPS; j++)
+            if (i == 0)
+                old_split(string, ", ", vector);
+            else if (vector_split_multi(string, ", ", vector) == NULL)
+                sysbail("cannot allocate memory");
+        split[i] = elapsed(&start);
+    }
+    vector_free(vector);
+
+    diag("%d strings, %d loops", BENCH_STRINGS, BENCH_LOOPS);
+    diag("vector_add:         %.3fs (old %.3fs)", add[1], add[0]);
+    diag("vector_copy_pooled: %.3fs (vector_copy %.3fs)", dup[1], dup[0]);
+    diag("vector_split_multi: %.3fs (old %.3fs)", split[1], split[0]);
+    ok(true, "vector_add speedup %.2fx", add[0] / add[1]);
+    ok(true, "vector_copy_pooled speedup %.2fx", dup[0] / dup[1]);
+    ok(true, "vector_split_multi speedup %.2fx", split[0] / split[1]);
+    vector_free(source);
+    free(string);
+}
+
 
 int
 main(void)
@@ -34,10 +189,15 @@ main(void)
     char *command, *string;
     const char *env[2];
     pid_t child;
-    size_t i;
+    size_t i, allocated;
+    bool okay;
+    int fds[2], status;
+    ssize_t length;
+    char output[32];
+    struct vector_fd_action actions[3];
     const char cstring[] = "This is a\ttest.  ";
 
-    plan(60);
+    plan(94);
 
     vector = vector_new();
     ok(vector != NULL, "vector_new returns non-NULL");
@@ -98,18 +258,72 @@ main(void)
     is_string("foo", vector->strings[0], "...first string");
     is_string("bar", vector->strings[1], "...second string");
     is_string("baz", vector->strings[2], "...third string");
+    free(vector->strings[1]);
+    vector->strings[1] = bstrdup("new");
+    is_string("new", vector->strings[1], "...and can be replaced");
     ovector = vector;
+    allocated = vector->allocated;
     vector = vector_split_multi("", ", ", vector);
     ok(vector != NULL, "reuse of vector doesn't return NULL");
     ok(vector == ovector, "...and reuses the same vector pointer");
     is_int(0, vector->count, "vector_split_multi reuse with empty string");
-    is_int(3, vector->allocated, "...and doesn't free allocation");
+    is_int(allocated, vector->allocated, "...and doesn't free allocation");
     vector = vector_split_multi(",,,  foo,   ", ", ", vector);
     ok(vector != NULL, "reuse of vector doesn't return NULL");
     is_int(1, vector->count, "vector_split_multi with extra separators");
     is_string("foo", vector->strings[0], "...first string");
     vector = vector_split_multi(", ,  ", ", ", vector);
     is_int(0, vector->count, "vector_split_multi with only separators");
+    vector = vector_split_multi("a b", " ", vector);
+    ok(vector_add(vector, "c"), "vector_add after vector_split_multi");
+    is_int(3, vector->count, "...and the count is right");
+    is_string("c", vector->strings[2], "...and the string is right");
+    ok(vector_resize(vector, 1), "vector_resize after vector_split_multi");
+    is_string("a", vector->strings[0], "...and the string is right");
+    vector_free(vector);
+
+    /* The table doubles in size as strings are added. */
+    vector = vector_new();
+    okay = true;
+    for (i = 0; i < 100; i++) {
+        basprintf(&string, "%lu", (unsigned long) i);
+        if (!vector_add(vector, string))
+            okay = false;
+        free(string);
+    }
+    ok(okay, "vector_add of many strings");
+    is_int(100, vector->count, "...with the right count");
+    is_int(128, vector->allocated, "...and the allocation doubles");
+
+    /* Copies allocate each string, so the strings can be replaced. */
+    copy = vector_copy(vector);
+    ok(copy != NULL, "vector_copy of many strings");
+    if (copy == NULL)
+        bail("vector_copy returned NULL");
+    is_int(100, copy->allocated, "...with an exact allocation");
+    is_string("99", copy->strings[99], "...and the last string is right");
+    free(copy->strings[99]);
+    copy->strings[99] = bstrdup("new");
+    is_string("new", copy->strings[99], "...and can be replaced");
+    vector_free(copy);
+
+    /* Pooled copies put the strings in one block but can be modified. */
+    copy = vector_copy_pooled(vector);
+    ok(copy != NULL, "vector_copy_pooled of many strings");
+    if (copy == NULL)
+        bail("vector_copy_pooled returned NULL");
+    is_int(100, copy->allocated, "...with an exact allocation");
+    ok(copy->strings[11] == copy->strings[10] + strlen("10") + 1,
+       "...and strings in one block");
+    is_string("99", copy->strings[99], "...and the last string is right");
+    ok(vector_add(copy, "extra"), "vector_add to a copy");
+    is_string("extra", copy->strings[100], "...and the string is right");
+    ok(vector_resize(copy, 50), "vector_resize of a copy");
+    is_string("49", copy->strings[49], "...and the string is right");
+    ovector = vector_split_multi("one two", " ", copy);
+    ok(ovector == copy, "vector_split_multi reuses a copy");
+    is_string("two", copy->strings[1], "...and the string is right");
+    vector_free(copy);
     vector_free(vector);
 
     vector = vector_new();
@@ -145,5 +359,56 @@ main(void)
     vector_free(vector);
     free(string);
 
+    vector = vector_new();
+    ok(vector_add(vector, "/bin/sh"), "vector_add succeeds");
+    ok(vector_add(vector, "-c"), "vector_add succeeds");
+    ok(vector_add(vector, "echo \"$GREETING\""), "vector_add succeeds");
+    env[0] = "GREETING=hello";
+    env[1] = NULL;
+    if (pipe(fds) < 0)
+        sysbail("unable to create pipe");
+    actions[0].type = VECTOR_FD_DUP2;
+    actions[0].fd = fds[1];
+    actions[0].target = STDOUT_FILENO;
+    actions[1].type = VECTOR_FD_CLOSE;
+    actions[1].fd = fds[0];
+    actions[2].type = VECTOR_FD_CLOSE;
+    actions[2].fd = fds[1];
+    child = vector_spawn("/bin/sh", vector, env, actions, 3);
+    ok(child > 0, "vector_spawn returns a process ID");
+    close(fds[1]);
+    length = read(fds[0], output, sizeof(output) - 1);
+    output[length < 0 ? 0 : length] = '\0';
+    close(fds[0]);
+    is_string("hello\n", output, "...with the right output");
+    if (child > 0)
+        waitpid(child, &status, 0);
+    else
+        status = -1;
+    is_int(0, status, "...and the right exit status");
+    /*
+     * Failure to run the program should be reported to the caller, but POSIX
+     * allows posix_spawn to succeed and have the child exit with status 127
+     * instead, so accept either.
+     */
+    errno = 0;
+    child = vector_spawn("/nonexistent", vector, NULL, NULL, 0);
+    if (child < 0) {
+        ok(true, "vector_spawn of nonexistent program fails");
+        is_int(ENOENT, errno, "...with the right errno");
+    } else {
+        ok(waitpid(child, &status, 0) == child,
+           "vector_spawn of nonexistent program fails");
+        ok(WIFEXITED(status) && WEXITSTATUS(status) == 127,
+           "...with exit status 127");
+    }
+    vector_free(vector);
+
+    /* Benchmark against the old behavior if requested. */
+    if (getenv("AUTHOR_TESTING") == NULL)
+        skip_block(3, "benchmark only run for author");
+    else
+        benchmark();
+
     return 0;
 }
@@ -0,0 +1,200 @@
+/*
+ * Test suite for the durable append-only log.
+ *
+ * The canonical version of this file is maintained in the rra-c-util package,
+ * which can be found at <https://www.eyrie.org/~eagle/software/rra-c-util/>.
+ *
+ * Written by Russ Allbery <eagle@eyrie.org>
+ * Copyright 2024 Russ Allbery <eagle@eyrie.org>
+ *
+ * Copying and distribution of this file, with or without modification, are
+ * permitted in any medium without royalty provided the copyright notice and
+ * this notice are preserved.  This file is offered as-is, without any
+ * warranty.
+ *
+ * SPDX-License-Identifier: FSFAP
+ */
+
+#include <config.h>
+#include <portable/system.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#ifdef HAVE_PTHREAD
+#    include <pthread.h>
+#endif
+#include <sys/stat.h>
+
+#include <tests/tap/basic.h>
+#include <tests/tap/string.h>
+#include <util/appendlog.h>
+
+/* Number of threads and records per thread. */
+#define THREADS 8
+#define RECORDS 200
+
+/* Length of each record written by the threads, including the newline. */
+#define RECORD_LENGTH 10
+
+#ifdef HAVE_PTHREAD
+
+/* Data passed to each thread. */
+struct thread_data {
+    struct appendlog *log;
+    int id;
+    bool okay;
+};
+
+
+/*
+ * Append RECORDS records of the form "tNN-NNNNN\n" to the log.
+ */
+static void *
+append_thread(void *arg)
+{
+    struct thread_data *data = arg;
+    char record[RECORD_LENGTH + 1];
+    int i;
+
+    data->okay = true;
+    for (i = 0; i < RECORDS; i++) {
+        snprintf(record, sizeof(record), "t%02u-%05u\n",
+                 (unsigned int) data->id % 100U, (unsigned int) i % 100000U);
+        if (appendlog_append(data->log, record, RECORD_LENGTH) < 0)
+            data->okay = false;
+    }
+    return NULL;
+}
+
+
+/*
+ * Check that a file contains every record from every thread, intact and in
+ * order for each thread.
+ */
+static bool
+check_records(const char *path)
+{
+    char *contents, *p;
+    int next[THREADS] = {0};
+    int fd, id, n;
+    size_t offset, size;
+    ssize_t status;
+
+    size = THREADS * RECORDS * RECORD_LENGTH;
+    contents = bcalloc(1, size + 1);
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+        sysbail("cannot open %s", path);
+    status = read(fd, contents, size + 1);
+    close(fd);
+    if (status != (ssize_t) size) {
+        free(contents);
+        return false;
+    }
+    for (offset = 0; offset < size; offset += RECORD_LENGTH) {
+        p = contents + offset;
+        if (sscanf(p, "t%02d-%05d\n", &id, &n) != 2 || p[9] != '\n')
+            break;
+        if (id < 0 || id >= THREADS || n != next[id])
+            break;
+        next[id]++;
+    }
+    free(contents);
+    return offset == size;
+}
+
+#endif /* HAVE_PTHREAD */
+
+
+int
+main(void)
+{
+    struct appendlog *log;
+    struct appendlog_stats stats;
+    struct stat st;
+    char *tmpdir, *path;
+    char buffer[BUFSIZ];
+    unsigned long total;
+    ssize_t length;
+    int fd, i;
+#ifdef HAVE_PTHREAD
+    pthread_t threads[THREADS];
+    struct thread_data data[THREADS];
+    bool okay;
+#endif
+
+    plan(13);
+
+    tmpdir = test_tmpdir();
+    basprintf(&path, "%s/appendlog", tmpdir);
+    unlink(path);
+
+    /* Basic appends. */
+    errno = 0;
+    ok(appendlog_open("/nonexistent/log") == NULL,
+       "open in missing directory");
+    is_int(ENOENT, errno, "...with ENOENT");
+    log = appendlog_open(path);
+    ok(log != NULL, "open");
+    is_int(0, appendlog_append(log, "one\n", 4), "append");
+    is_int(0, appendlog_append(log, "two\n", 4), "append again");
+    appendlog_stats(log, &stats);
+    ok(stats.records == 2 && stats.commits == 2, "statistics");
+    for (total = 0, i = 0; i < APPENDLOG_BUCKETS; i++)
+        total += stats.latency[i];
+    is_int(2, total, "...and histogram");
+    is_int(0, appendlog_close(log), "close");
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+        sysbail("cannot open %s", path);
+    length = read(fd, buffer, sizeof(buffer) - 1);
+    close(fd);
+    buffer[length < 0 ? 0 : length] = '\0';
+    is_string("one\ntwo\n", buffer, "log contents");
+
+    /* Concurrent appends are batched. */
+#ifdef HAVE_PTHREAD
+    unlink(path);
+    log = appendlog_open(path);
+    if (log == NULL)
+        sysbail("cannot open %s", path);
+    for (i = 0; i < THREADS; i++) {
+        data[i].log = log;
+        data[i].id = i;
+        if (pthread_create(&threads[i], NULL, append_thread, &data[i]) != 0)
+            sysbail("cannot create thread");
+    }
+    okay = true;
+    for (i = 0; i < THREADS; i++) {
+        pthread_join(threads[i], NULL);
+        if (!data[i].okay)
+            okay = false;
+    }
+    ok(okay, "concurrent appends succeed");
+    appendlog_stats(log, &stats);
+    is_int(THREADS * RECORDS, stats.records, "...and are all counted");
+    diag("%lu records in %lu commits", stats.records, stats.commits);
+    appendlog_close(log);
+    ok(check_records(path), "...and all are written intact and in order");
+#else
+    skip_block(3, "POSIX threads not available");
+#endif
+
+    /* Write errors are reported. */
+    if (stat("/dev/full", &st) < 0)
+        skip("/dev/full not available");
+    else {
+        log = appendlog_open("/dev/full");
+        if (log == NULL)
+            sysbail("cannot open /dev/full");
+        errno = 0;
+        is_int(-1, appendlog_append(log, "x\n", 2), "append to full device");
+        appendlog_close(log);
+    }
+
+    /* Clean up. */
+    unlink(path);
+    free(path);
+    test_tmpdir_free(tmpdir);
+    return 0;
+}
@@ -0,0 +1,155 @@
+/*
+ * arena test suite.
+ *
+ * The canonical version of this file is maintained in the rra-c-util package,
+ * which can be found at <https://www.eyrie.org/~eagle/software/rra-c-util/>.
+ *
+ * Written by Russ Allbery <eagle@eyrie.org>
+ * Copyright 2024 Russ Allbery <eagle@eyrie.org>
+ *
+ * Copying and distribution of this file, with or without modification, are
+ * permitted in any medium without royalty provided the copyright notice and
+ * this notice are preserved.  This file is offered as-is, without any
+ * warranty.
+ *
+ * SPDX-License-Identifier: FSFAP
+ */
+
+#include <config.h>
+#include <portable/system.h>
+
+#include <tests/tap/basic.h>
+#include <util/arena.h>
+
+
+/*
+ * Test arena_vasprintf.  Wrapper needed to generate the va_list.
+ */
+static void __attribute__((__format__(printf, 3, 4)))
+test_vasprintf(struct arena *arena, char **result, const char *format, ...)
+{
+    va_list args;
+
+    va_start(args, format);
+    arena_vasprintf(arena, result, format, args);
+    va_end(args);
+}
+
+
+int
+main(void)
+{
+    struct arena *arena;
+    struct arena_mark mark;
+    char *one, *two, *three, *big;
+    char *strings[100];
+    size_t i;
+    volatile size_t zero = 0;
+    int *numbers;
+    bool okay;
+    const char buffer[] = "some\0string";
+
+    plan(26);
+
+    /* Basic allocation and string copying. */
+    arena = arena_new(0);
+    ok(arena != NULL, "arena_new returns an arena");
+    one = arena_strdup(arena, "hello");
+    is_string("hello", one, "arena_strdup");
+    two = arena_strndup(arena, "hello world", 5);
+    is_string("hello", two, "arena_strndup");
+    ok(one != two, "...and returns distinct memory");
+    three = arena_strndup(arena, buffer, sizeof(buffer));
+    is_string("some", three, "arena_strndup stops at nul");
+    arena_asprintf(arena, &three, "%s %d", "number", 42);
+    is_string("number 42", three, "arena_asprintf");
+    test_vasprintf(arena, &three, "%s-%s", one, two);
+    is_string("hello-hello", three, "arena_vasprintf");
+    is_string("hello", one, "...and earlier allocations are intact");
+
+    /* Allocations must be aligned for any type. */
+    one = arena_alloc(arena, 1);
+    numbers = arena_alloc(arena, 10 * sizeof(int));
+    ok(((uintptr_t) one % sizeof(long double)) == 0, "arena_alloc alignment");
+    ok(((uintptr_t) numbers % sizeof(long double)) == 0, "...second alloc");
+    numbers = arena_calloc(arena, 10, sizeof(int));
+    okay = true;
+    for (i = 0; i < 10; i++)
+        if (numbers[i] != 0)
+            okay = false;
+    ok(okay, "arena_calloc zeroes memory");
+
+    /* Fill several blocks and make sure nothing overlaps. */
+    arena_free(arena);
+    arena = arena_new(128);
+    for (i = 0; i < 100; i++)
+        arena_asprintf(arena, &strings[i], "string %lu of a long list",
+                       (unsigned long) i);
+    okay = true;
+    for (i = 0; i < 100; i++) {
+        char expected[64];
+
+        snprintf(expected, sizeof(expected), "string %lu of a long list",
+                 (unsigned long) i);
+        if (strcmp(expected, strings[i]) != 0)
+            okay = false;
+    }
+    ok(okay, "many allocations across small blocks");
+    arena_free(arena);
+
+    /* Allocations larger than the block size get their own block. */
+    arena = arena_new(64);
+    one = arena_strdup(arena, "small");
+    big = arena_alloc(arena, 1000);
+    memset(big, 'x', 999);
+    big[999] = '\0';
+    two = arena_strdup(arena, "after");
+    is_int(999, strlen(big), "large allocation");
+    is_string("small", one, "...and earlier string is intact");
+    is_string("after", two, "...and later string is intact");
+    arena_asprintf(arena, &three, "%s%s", big, big);
+    is_int(1998, strlen(three), "arena_asprintf larger than block size");
+
+    /* Marks release only what was allocated after them. */
+    arena_reset(arena);
+    one = arena_strdup(arena, "kept");
+    arena_mark(arena, &mark);
+    two = arena_strdup(arena, "released");
+    big = arena_alloc(arena, 1000);
+    arena_release(arena, &mark);
+    is_string("kept", one, "arena_release keeps earlier allocations");
+    two = arena_strdup(arena, "new");
+    is_string("new", two, "...and allows new allocations");
+    ok(two != one, "...placed after the kept data");
+    is_string("kept", one, "...without overwriting kept data");
+
+    /* A mark taken on an empty arena releases everything. */
+    arena_free(arena);
+    arena = arena_new(0);
+    arena_mark(arena, &mark);
+    one = arena_strdup(arena, "first");
+    arena_release(arena, &mark);
+    two = arena_strdup(arena, "second");
+    ok(one == two, "arena_release to empty mark reuses the block");
+    is_string("second", two, "...with the right contents");
+
+    /* arena_reset reuses the remaining block. */
+    arena_reset(arena);
+    one = arena_strdup(arena, "again");
+    ok(one == two, "arena_reset reuses the block");
+    is_string("again", one, "...with the right contents");
+
+    /*
+     * Zero-sized allocations still return unique pointers.  zero is volatile
+     * so that the compiler doesn't warn about the constant size.
+     */
+    one = arena_alloc(arena, zero);
+    two = arena_alloc(arena, zero);
+    ok(one != two, "zero-sized allocations are distinct");
+    arena_free(arena);
+
+    /* Freeing NULL is allowed. */
+    arena_free(NULL);
+    ok(true, "arena_free of NULL");
+    return 0;
+}
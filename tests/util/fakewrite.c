@@ -56,6 +56,15 @@ int write_interrupt = false;
  */
 bool write_fail = false;
 
+/* The number of calls to any of the write functions. */
+unsigned long write_calls = 0;
+
+/*
+ * If write_discard is true, all writes succeed completely without storing
+ * the data, for measuring how many calls are made for a lot of data.
+ */
+bool write_discard = false;
+
 
 /*
  * Accept a write request and write only the first 32 bytes of it into
@@ -66,6 +75,9 @@ fake_write(int fd UNUSED, const void *data, size_t n)
 {
     size_t total, left;
 
+    write_calls++;
+    if (write_discard)
+        return n;
     if (write_fail)
         return 0;
     if (write_interrupt && (write_interrupt++ % 2) == 0) {
@@ -96,6 +108,9 @@ fake_pwrite(int fd UNUSED, const void *data, size_t n, off_t offset)
 {
     size_t total, left;
 
+    write_calls++;
+    if (write_discard)
+        return n;
     if (write_fail)
         return 0;
     if (write_interrupt && (write_interrupt++ % 2) == 0) {
@@ -116,8 +131,9 @@ fake_pwrite(int fd UNUSED, const void *data, size_t n, off_t offset)
 
 
 /*
- * Accept an xwrite request and write only the first 32 bytes of it into
- * write_buffer (or as much as will fit), returning the amount written.
+ * Accept a writev request and write only the first 32 bytes of it into
+ * write_buffer (or as much as will fit), returning the amount written.  Fail
+ * with EINVAL if given more than IOV_MAX entries, like the real writev.
  */
 ssize_t
 fake_writev(int fd UNUSED, const struct iovec *iov, int iovcnt)
@@ -125,12 +141,22 @@ fake_writev(int fd UNUSED, const struct iovec *iov, int iovcnt)
     int i;
     size_t left, n, total;
 
+    write_calls++;
+    if (write_discard) {
+        for (total = 0, i = 0; i < iovcnt; i++)
+            total += iov[i].iov_len;
+        return total;
+    }
     if (write_fail)
         return 0;
     if (write_interrupt && (write_interrupt++ % 2) == 0) {
         errno = EINTR;
         return -1;
     }
+    if (iovcnt > IOV_MAX) {
+        errno = EINVAL;
+        return -1;
+    }
     left = sizeof(write_buffer) - write_offset;
     if (left > 32)
         left = 32;
@@ -56,6 +56,12 @@ extern int write_interrupt;
 /* If true, all write or writev calls will return 0. */
 extern bool write_fail;
 
+/* The number of calls to any of the fake functions. */
+extern unsigned long write_calls;
+
+/* If true, all writes succeed completely and the data is discarded. */
+extern bool write_discard;
+
 END_DECLS
 
 #endif /* !TESTS_UTIL_FAKEWRITE_H */
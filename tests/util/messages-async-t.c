@@ -0,0 +1,345 @@
+/*
+ * Test suite for asynchronous message handlers.
+ *
+ * The canonical version of this file is maintained in the rra-c-util package,
+ * which can be found at <https://www.eyrie.org/~eagle/software/rra-c-util/>.
+ *
+ * Written by Russ Allbery <eagle@eyrie.org>
+ * Copyright 2024 Russ Allbery <eagle@eyrie.org>
+ *
+ * Copying and distribution of this file, with or without modification, are
+ * permitted in any medium without royalty provided the copyright notice and
+ * this notice are preserved.  This file is offered as-is, without any
+ * warranty.
+ *
+ * SPDX-License-Identifier: FSFAP
+ */
+
+#include <config.h>
+#include <portable/system.h>
+
+#include <errno.h>
+#ifdef HAVE_PTHREAD
+#    include <pthread.h>
+#endif
+
+#include <tests/tap/basic.h>
+#include <util/messages-async.h>
+#include <util/messages.h>
+#include <util/xmalloc.h>
+
+/* Maximum number of messages recorded. */
+#define MAX_MESSAGES 200
+
+/* Threads logging while the writer is stopped, and messages from each. */
+#define THREADS         4
+#define THREAD_MESSAGES 1000
+
+/* Messages seen by record_handler, with their lengths and errors. */
+static char *messages[MAX_MESSAGES];
+static size_t lengths[MAX_MESSAGES];
+static int errors[MAX_MESSAGES];
+static size_t count = 0;
+
+/*
+ * If gated is set, gate_handler reports that it has been called by writing to
+ * the entered pipe and then waits for a byte on the release pipe.
+ */
+static bool gated = false;
+static int entered[2];
+static int release[2];
+
+/* If set, nested_handler logs this many more messages from the writer. */
+static size_t nested = 0;
+
+/* Messages seen by count_handler, which may be called by several threads. */
+#ifdef HAVE_PTHREAD
+static pthread_mutex_t counted_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+static unsigned long counted = 0;
+
+
+/*
+ * Record a message.  Only called from one thread at a time.
+ */
+static void __attribute__((__format__(printf, 2, 0)))
+record_handler(size_t len, const char *fmt, va_list args, int err)
+{
+    if (count >= MAX_MESSAGES)
+        return;
+    xvasprintf(&messages[count], fmt, args);
+    lengths[count] = len;
+    errors[count] = err;
+    count++;
+}
+
+
+/*
+ * Record a message, first waiting for permission if gated is set.
+ */
+static void __attribute__((__format__(printf, 2, 0)))
+gate_handler(size_t len, const char *fmt, va_list args, int err)
+{
+    char c = 'x';
+
+    if (gated) {
+        if (write(entered[1], &c, 1) != 1)
+            sysbail("cannot write to pipe");
+        if (read(release[0], &c, 1) != 1)
+            sysbail("cannot read from pipe");
+    }
+    record_handler(len, fmt, args, err);
+}
+
+
+/*
+ * Count a message.  May be called from several threads at once.
+ */
+static void
+count_handler(size_t len UNUSED, const char *fmt UNUSED, va_list args UNUSED,
+              int err UNUSED)
+{
+#ifdef HAVE_PTHREAD
+    pthread_mutex_lock(&counted_lock);
+#endif
+    counted++;
+#ifdef HAVE_PTHREAD
+    pthread_mutex_unlock(&counted_lock);
+#endif
+}
+
+
+/* Asynchronous versions of the handlers. */
+static void __attribute__((__format__(printf, 2, 0)))
+record_async(size_t len, const char *fmt, va_list args, int err)
+{
+    message_async_vlog(record_handler, len, fmt, args, err);
+}
+
+static void __attribute__((__format__(printf, 2, 0)))
+gate_async(size_t len, const char *fmt, va_list args, int err)
+{
+    message_async_vlog(gate_handler, len, fmt, args, err);
+}
+
+static void __attribute__((__format__(printf, 2, 0)))
+count_async(size_t len, const char *fmt, va_list args, int err)
+{
+    message_async_vlog(count_handler, len, fmt, args, err);
+}
+
+
+/*
+ * Queue a message for the given handler directly with message_async_vlog.
+ */
+static void __attribute__((__format__(printf, 2, 3)))
+async_log(message_handler_func handler, const char *fmt, ...)
+{
+    va_list args;
+    int length;
+
+    va_start(args, fmt);
+    length = vsnprintf(NULL, 0, fmt, args);
+    va_end(args);
+    if (length < 0)
+        sysbail("cannot format message");
+    va_start(args, fmt);
+    message_async_vlog(handler, (size_t) length, fmt, args, 0);
+    va_end(args);
+}
+
+
+/*
+ * Record a message and, if nested is set, log more messages from the writer
+ * thread, more than fit in the queue.
+ */
+static void __attribute__((__format__(printf, 2, 0)))
+nested_handler(size_t len, const char *fmt, va_list args, int err)
+{
+    size_t i, n = nested;
+
+    record_handler(len, fmt, args, err);
+    nested = 0;
+    for (i = 0; i < n; i++)
+        async_log(record_handler, "nested %lu", (unsigned long) i);
+}
+
+
+#ifdef HAVE_PTHREAD
+/*
+ * Log messages through count_async.  Run in several threads while the main
+ * thread stops the writer.
+ */
+static void *
+count_thread(void *data UNUSED)
+{
+    size_t i;
+
+    for (i = 0; i < THREAD_MESSAGES; i++)
+        warn("message %lu", (unsigned long) i);
+    return NULL;
+}
+#endif
+
+
+/*
+ * Free the recorded messages and reset the count.
+ */
+static void
+reset_messages(void)
+{
+    size_t i;
+
+    for (i = 0; i < count; i++)
+        free(messages[i]);
+    count = 0;
+}
+
+
+int
+main(void)
+{
+    char buffer[32];
+    char *message;
+    size_t i;
+    bool okay;
+#ifdef HAVE_PTHREAD
+    pthread_t threads[THREADS];
+#endif
+
+    if (!message_async_start(0, MESSAGE_ASYNC_DROP)) {
+        if (errno == ENOSYS)
+            skip_all("asynchronous logging not supported");
+        sysbail("cannot start writer thread");
+    }
+    plan(21);
+
+    /* Messages are passed to the handler in order with their errors. */
+    ok(!message_async_start(0, MESSAGE_ASYNC_DROP), "cannot start twice");
+    is_int(EBUSY, errno, "...with EBUSY");
+    message_handlers_warn(1, record_async);
+    for (i = 0; i < 100; i++) {
+        errno = (int) i;
+        if (i % 2 == 0)
+            warn("message %lu", (unsigned long) i);
+        else
+            syswarn("message %lu", (unsigned long) i);
+    }
+    message_async_flush();
+    is_int(100, count, "all messages written");
+    okay = (count == 100);
+    for (i = 0; okay && i < 100; i++) {
+        snprintf(buffer, sizeof(buffer), "message %lu", (unsigned long) i);
+        if (strcmp(buffer, messages[i]) != 0 || lengths[i] != strlen(buffer))
+            okay = false;
+        if (errors[i] != (i % 2 == 0 ? 0 : (int) i))
+            okay = false;
+    }
+    ok(okay, "...in order with the correct length and error");
+    reset_messages();
+
+    /* Long messages are not truncated. */
+    message = xmalloc(2001);
+    memset(message, 'a', 2000);
+    message[2000] = '\0';
+    warn("%s", message);
+    message_async_flush();
+    is_int(1, count, "long message written");
+    is_string(message, count == 1 ? messages[0] : NULL, "...intact");
+    free(message);
+    reset_messages();
+
+    /*
+     * Dropping messages when the queue is full.  The slot of the message
+     * being written isn't free until its handler returns, so while the
+     * handler is blocked, a queue with two slots has room for one more.
+     */
+    message_async_stop();
+    if (pipe(entered) < 0 || pipe(release) < 0)
+        sysbail("cannot create pipes");
+    ok(message_async_start(2, MESSAGE_ASYNC_DROP), "restart with two slots");
+    message_handlers_warn(1, gate_async);
+    gated = true;
+    warn("first");
+    if (read(entered[0], buffer, 1) != 1)
+        sysbail("cannot read from pipe");
+    warn("second");
+    for (i = 0; i < 5; i++)
+        warn("dropped");
+    is_int(5, message_async_dropped(), "messages dropped when full");
+    if (write(release[1], "xx", 2) != 2)
+        sysbail("cannot write to pipe");
+    message_async_flush();
+    gated = false;
+    is_int(2, count, "queued messages written");
+    is_string("first", count > 0 ? messages[0] : NULL, "...first");
+    is_string("second", count > 1 ? messages[1] : NULL, "...second");
+    if (read(entered[0], buffer, 1) != 1)
+        sysbail("cannot read from pipe");
+    reset_messages();
+
+    /* Blocking when the queue is full. */
+    message_async_stop();
+    ok(message_async_start(2, MESSAGE_ASYNC_BLOCK), "restart blocking");
+    message_handlers_warn(1, record_async);
+    for (i = 0; i < 150; i++)
+        warn("message %lu", (unsigned long) i);
+    message_async_flush();
+    is_int(0, message_async_dropped(), "no messages dropped when blocking");
+    is_int(150, count, "all messages written");
+    okay = (count == 150);
+    for (i = 0; okay && i < 150; i++) {
+        snprintf(buffer, sizeof(buffer), "message %lu", (unsigned long) i);
+        if (strcmp(buffer, messages[i]) != 0)
+            okay = false;
+    }
+    ok(okay, "...in order");
+    reset_messages();
+
+    /*
+     * A handler on the writer thread logging to a full queue calls the
+     * handler directly instead of waiting for itself.
+     */
+    message_async_stop();
+    ok(message_async_start(2, MESSAGE_ASYNC_BLOCK), "restart for nesting");
+    nested = 5;
+    async_log(nested_handler, "outer");
+    message_async_flush();
+    is_int(6, count, "nested messages from the writer thread written");
+    reset_messages();
+
+    /* Stopping while other threads are logging loses no messages. */
+#ifdef HAVE_PTHREAD
+    message_async_stop();
+    ok(message_async_start(2, MESSAGE_ASYNC_BLOCK), "restart for stop");
+    message_handlers_warn(1, count_async);
+    for (i = 0; i < THREADS; i++)
+        if (pthread_create(&threads[i], NULL, count_thread, NULL) != 0)
+            sysbail("cannot create thread");
+    message_async_stop();
+    for (i = 0; i < THREADS; i++)
+        pthread_join(threads[i], NULL);
+    is_int(THREADS * THREAD_MESSAGES, counted,
+           "stop while logging loses no messages");
+    message_handlers_warn(1, record_async);
+    if (!message_async_start(0, MESSAGE_ASYNC_BLOCK))
+        sysbail("cannot restart writer thread");
+#else
+    skip_block(2, "POSIX threads not available");
+#endif
+
+    /* After stopping, messages are logged synchronously. */
+    message_async_stop();
+    warn("synchronous");
+    is_int(1, count, "synchronous after stop");
+    is_string("synchronous", count == 1 ? messages[0] : NULL, "...message");
+    reset_messages();
+
+    /* Clean up. */
+    message_handlers_reset();
+    close(entered[0]);
+    close(entered[1]);
+    close(release[0]);
+    close(release[1]);
+    return 0;
+}
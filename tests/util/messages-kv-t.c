@@ -0,0 +1,215 @@
+/*
+ * Test suite for structured key/value event logging.
+ *
+ * The canonical version of this file is maintained in the rra-c-util package,
+ * which can be found at <https://www.eyrie.org/~eagle/software/rra-c-util/>.
+ *
+ * Written by Russ Allbery <eagle@eyrie.org>
+ * Copyright 2024 Russ Allbery <eagle@eyrie.org>
+ *
+ * Copying and distribution of this file, with or without modification, are
+ * permitted in any medium without royalty provided the copyright notice and
+ * this notice are preserved.  This file is offered as-is, without any
+ * warranty.
+ *
+ * SPDX-License-Identifier: FSFAP
+ */
+
+#include <config.h>
+#include <portable/socket.h>
+#include <portable/socket-unix.h>
+#include <portable/system.h>
+
+#include <errno.h>
+
+#include <tests/tap/basic.h>
+#include <tests/tap/process.h>
+#include <tests/tap/string.h>
+#include <util/macros.h>
+#include <util/messages-kv.h>
+
+/* Number of times a field value was computed. */
+static int computed = 0;
+
+
+/*
+ * Return a string value, counting the call.
+ */
+static const char *
+compute(void)
+{
+    computed++;
+    return "value";
+}
+
+
+/*
+ * A handler that counts events and prints the number of fields.
+ */
+static void
+count_handler(enum message_level level, const char *message,
+              const struct message_kv *fields UNUSED, size_t count)
+{
+    printf("%d %s %lu\n", (int) level, message, (unsigned long) count);
+}
+
+
+static void
+test_logfmt(void *data UNUSED)
+{
+    message_handlers_event(1, message_event_logfmt);
+    message_event(MESSAGE_WARNING, "connection failed", 6,
+                  kv_string("host", "example.com"), kv_int("port", -25),
+                  kv_uint("bytes", 10), kv_bool("tls", true),
+                  kv_string("note", "has \"quotes\" and space"),
+                  kv_string("empty", ""));
+    message_handlers_event_reset();
+}
+
+static void
+test_logfmt_keys(void *data UNUSED)
+{
+    message_handlers_event(1, message_event_logfmt);
+    message_event(MESSAGE_NOTICE, "keys", 4, kv_int("two words", 1),
+                  kv_int("a=\"b\"\n", 2), kv_int("", 3), kv_int(NULL, 4));
+    message_handlers_event_reset();
+}
+
+static void
+test_json(void *data UNUSED)
+{
+    message_handlers_event(1, message_event_json);
+    message_event(MESSAGE_ERR, "bad \"input\"", 6,
+                  kv_string("host", "example.com"), kv_int("port", 25),
+                  kv_double("ratio", 1.5), kv_string("nothing", NULL),
+                  kv_string("lines", "a\nb\001"), kv_bool(NULL, true));
+    message_handlers_event_reset();
+}
+
+static void
+test_filter(void *data UNUSED)
+{
+    struct message_kv fields[2];
+    enum message_level old;
+
+    message_event(MESSAGE_CRIT, "no handlers", 0);
+    message_handlers_event(1, count_handler);
+    message_event(MESSAGE_DEBUG, "debug", 1, kv_int("n", 1));
+    message_event(MESSAGE_INFO, "info", 1, kv_int("n", 1));
+    old = message_event_level(MESSAGE_WARNING);
+    printf("%d\n", (int) old);
+    message_event(MESSAGE_NOTICE, "notice", 0);
+    message_event(MESSAGE_WARNING, "warning", 0);
+    fields[0] = kv_int("a", 1);
+    fields[1] = kv_int("b", 2);
+    message_eventv(MESSAGE_ERR, "array", fields, 2);
+    message_eventv(MESSAGE_INFO, "array", fields, 2);
+    message_handlers_event(2, count_handler, count_handler);
+    message_event(MESSAGE_ERR, "twice", 0);
+    message_handlers_event(0);
+    message_event(MESSAGE_CRIT, "none", 0);
+    message_handlers_event_reset();
+}
+
+
+/*
+ * Create a datagram socket bound to path.
+ */
+static int
+make_server(const char *path)
+{
+    struct sockaddr_un addr;
+    int fd;
+
+    unlink(path);
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path))
+        bail("socket path %s too long", path);
+    memcpy(addr.sun_path, path, strlen(path) + 1);
+    fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+    if (fd < 0)
+        sysbail("cannot create socket");
+    if (bind(fd, (struct sockaddr *) &addr, (socklen_t) SUN_LEN(&addr)) < 0)
+        sysbail("cannot bind socket to %s", path);
+    return fd;
+}
+
+
+int
+main(void)
+{
+    char buffer[BUFSIZ];
+    char *tmpdir, *path;
+    const char binary[] = "MESSAGE=multi\nPRIORITY=6\nTEXT\n"
+                          "\003\000\000\000\000\000\000\000a\nb\n";
+    int fd;
+    ssize_t length;
+
+    plan(21);
+
+    /* Formatting handlers. */
+    is_function_output(test_logfmt, NULL, 0,
+                       "level=warning msg=\"connection failed\""
+                       " host=example.com port=-25 bytes=10 tls=true"
+                       " note=\"has \\\"quotes\\\" and space\" empty=\"\"\n",
+                       "logfmt");
+    is_function_output(test_logfmt_keys, NULL, 0,
+                       "level=notice msg=keys two_words=1 a__b__=2 _=3 _=4\n",
+                       "logfmt keys");
+    is_function_output(test_json, NULL, 0,
+                       "{\"level\":\"err\",\"msg\":\"bad \\\"input\\\"\","
+                       "\"host\":\"example.com\",\"port\":25,\"ratio\":1.5,"
+                       "\"nothing\":null,\"lines\":\"a\\nb\\u0001\","
+                       "\"_\":true}\n",
+                       "JSON");
+    is_function_output(test_filter, NULL, 0,
+                       "6 info 1\n6\n4 warning 0\n3 array 2\n"
+                       "3 twice 0\n3 twice 0\n",
+                       "filtering");
+
+    /* journald native protocol. */
+    tmpdir = test_tmpdir();
+    basprintf(&path, "%s/journal", tmpdir);
+    fd = make_server(path);
+    errno = 0;
+    ok(!message_event_journald_open("/nonexistent/socket"),
+       "open of nonexistent socket fails");
+    ok(errno == ENOENT, "...with ENOENT");
+    ok(message_event_journald_open(path), "open");
+    message_handlers_event(1, message_event_journald);
+    message_event(MESSAGE_WARNING, "hello", 5, kv_string("host", "example"),
+                  kv_int("port", 25), kv_string("_private.data", "x"),
+                  kv_string("123", "dropped"), kv_string(NULL, "dropped"));
+    length = recv(fd, buffer, sizeof(buffer) - 1, 0);
+    buffer[length < 0 ? 0 : length] = '\0';
+    is_string("MESSAGE=hello\nPRIORITY=4\nHOST=example\nPORT=25\n"
+              "PRIVATE_DATA=x\n",
+              buffer, "journald fields");
+    message_event(MESSAGE_INFO, "multi", 1, kv_string("text", "a\nb"));
+    length = recv(fd, buffer, sizeof(buffer), 0);
+    is_int(sizeof(binary) - 1, length, "journald binary field length");
+    ok(memcmp(buffer, binary, sizeof(binary) - 1) == 0, "...and contents");
+
+    /* Field values are computed by the caller, but nothing else is done. */
+    message_event_level(MESSAGE_NOTICE);
+    message_event(MESSAGE_INFO, "filtered", 1, kv_string("v", compute()));
+    is_int(1, computed, "arguments to filtered events are still evaluated");
+    ok(recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT) < 0,
+       "...but nothing is sent");
+
+    /* Nothing is sent after close. */
+    message_event_level(MESSAGE_INFO);
+    message_event_journald_close();
+    message_event(MESSAGE_WARNING, "closed", 0);
+    ok(recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT) < 0,
+       "nothing sent after close");
+
+    /* Clean up. */
+    message_handlers_event_reset();
+    close(fd);
+    unlink(path);
+    free(path);
+    test_tmpdir_free(tmpdir);
+    return 0;
+}
@@ -0,0 +1,157 @@
+/*
+ * Test suite for rate-limited message handlers.
+ *
+ * The canonical version of this file is maintained in the rra-c-util package,
+ * which can be found at <https://www.eyrie.org/~eagle/software/rra-c-util/>.
+ *
+ * Written by Russ Allbery <eagle@eyrie.org>
+ * Copyright 2024 Russ Allbery <eagle@eyrie.org>
+ *
+ * Copying and distribution of this file, with or without modification, are
+ * permitted in any medium without royalty provided the copyright notice and
+ * this notice are preserved.  This file is offered as-is, without any
+ * warranty.
+ *
+ * SPDX-License-Identifier: FSFAP
+ */
+
+#include <config.h>
+#include <portable/system.h>
+
+#include <errno.h>
+#include <time.h>
+
+#include <tests/tap/basic.h>
+#include <tests/tap/process.h>
+#include <util/macros.h>
+#include <util/messages-ratelimit.h>
+#include <util/messages.h>
+
+
+/*
+ * A handler that prints the length and the message to standard output, used
+ * to check that rate limiting works with any handler.
+ */
+static void __attribute__((__format__(printf, 2, 0)))
+print_handler(size_t len, const char *fmt, va_list args, int err)
+{
+    printf("%lu %d ", (unsigned long) len, err);
+    vprintf(fmt, args);
+    printf("\n");
+}
+
+static void __attribute__((__format__(printf, 2, 0)))
+print_limited(size_t len, const char *fmt, va_list args, int err)
+{
+    message_ratelimit_vlog(print_handler, len, fmt, args, err);
+}
+
+
+static void
+test_burst(void *data UNUSED)
+{
+    int i;
+
+    message_ratelimit_config(3, 1000000);
+    message_handlers_warn(1, message_log_ratelimit_stderr);
+    for (i = 0; i < 10; i++)
+        warn("repeated %d", 1);
+    warn("different");
+    message_ratelimit_flush();
+    warn("repeated %d", 1);
+}
+
+static void
+test_refill(void *data UNUSED)
+{
+    struct timespec delay = {0, 600000000};
+    int i;
+
+    message_ratelimit_config(1, 500);
+    message_handlers_warn(1, message_log_ratelimit_stderr);
+    for (i = 0; i < 5; i++)
+        warn("refill");
+    nanosleep(&delay, NULL);
+    warn("refill");
+    warn("refill");
+    message_ratelimit_flush();
+}
+
+static void
+test_handler(void *data UNUSED)
+{
+    int i;
+
+    message_ratelimit_config(2, 1000000);
+    message_handlers_warn(1, print_limited);
+    for (i = 0; i < 4; i++)
+        warn("custom");
+    message_ratelimit_flush();
+    errno = EPERM;
+    for (i = 0; i < 4; i++)
+        syswarn("custom");
+    message_ratelimit_flush();
+}
+
+static void
+test_format(void *data UNUSED)
+{
+    int i;
+
+    message_ratelimit_config(2, 1000000);
+    message_handlers_warn(1, message_log_ratelimit_stderr);
+    for (i = 0; i < 5; i++)
+        warn("client %d sent garbage", i);
+    message_ratelimit_flush();
+    for (i = 0; i < 3; i++)
+        warn("%s", "first");
+    for (i = 0; i < 2; i++)
+        warn("%s", "second");
+    message_ratelimit_flush();
+}
+
+static void
+test_disabled(void *data UNUSED)
+{
+    int i;
+
+    message_ratelimit_config(0, 1000);
+    message_handlers_warn(1, message_log_ratelimit_stderr);
+    for (i = 0; i < 4; i++)
+        warn("unlimited");
+    message_ratelimit_flush();
+}
+
+
+int
+main(void)
+{
+    plan(5 * 3);
+
+    is_function_output(test_burst, NULL, 0,
+                       "repeated 1\nrepeated 1\nrepeated 1\ndifferent\n"
+                       "7 similar messages suppressed: repeated 1\n"
+                       "repeated 1\n",
+                       "burst and flush");
+    is_function_output(test_refill, NULL, 0,
+                       "refill\n4 similar messages suppressed: refill\n"
+                       "refill\n1 similar messages suppressed: refill\n",
+                       "refill");
+    is_function_output(test_handler, NULL, 0,
+                       "6 0 custom\n6 0 custom\n"
+                       "37 0 2 similar messages suppressed: custom\n"
+                       "6 1 custom\n6 1 custom\n"
+                       "37 1 2 similar messages suppressed: custom\n",
+                       "any handler");
+    is_function_output(test_format, NULL, 0,
+                       "client 0 sent garbage\nclient 1 sent garbage\n"
+                       "3 similar messages suppressed: client 1 sent"
+                       " garbage\n"
+                       "first\nfirst\nsecond\nsecond\n"
+                       "1 similar messages suppressed: first\n",
+                       "keyed on format");
+    is_function_output(test_disabled, NULL, 0,
+                       "unlimited\nunlimited\nunlimited\nunlimited\n",
+                       "disabled");
+    return 0;
+}
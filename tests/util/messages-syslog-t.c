@@ -0,0 +1,272 @@
+/*
+ * Test suite for datagram syslog message handlers.
+ *
+ * Uses a local datagram socket in a temporary directory in place of
+ * /dev/log.
+ *
+ * The canonical version of this file is maintained in the rra-c-util package,
+ * which can be found at <https://www.eyrie.org/~eagle/software/rra-c-util/>.
+ *
+ * Written by Russ Allbery <eagle@eyrie.org>
+ * Copyright 2024 Russ Allbery <eagle@eyrie.org>
+ *
+ * Copying and distribution of this file, with or without modification, are
+ * permitted in any medium without royalty provided the copyright notice and
+ * this notice are preserved.  This file is offered as-is, without any
+ * warranty.
+ *
+ * SPDX-License-Identifier: FSFAP
+ */
+
+#include <config.h>
+#include <portable/socket.h>
+#include <portable/socket-unix.h>
+#include <portable/system.h>
+
+#include <ctype.h>
+#include <errno.h>
+#include <syslog.h>
+
+#include <tests/tap/basic.h>
+#include <tests/tap/string.h>
+#include <util/messages-async.h>
+#include <util/messages-syslog.h>
+#include <util/messages.h>
+
+/* Priority of warnings logged to LOG_DAEMON. */
+#define PRI_WARNING (LOG_DAEMON | LOG_WARNING)
+
+
+/*
+ * Create a datagram socket bound to path, removing any existing file.
+ */
+static int
+make_server(const char *path)
+{
+    struct sockaddr_un addr;
+    int fd;
+
+    unlink(path);
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path))
+        bail("socket path %s too long", path);
+    memcpy(addr.sun_path, path, strlen(path) + 1);
+    fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+    if (fd < 0)
+        sysbail("cannot create socket");
+    if (bind(fd, (struct sockaddr *) &addr, (socklen_t) SUN_LEN(&addr)) < 0)
+        sysbail("cannot bind socket to %s", path);
+    return fd;
+}
+
+
+/*
+ * Receive a message from the socket into buffer, nul-terminating it.  If wait
+ * is false, don't block.  Returns the length or -1 if there was no message.
+ */
+static ssize_t
+receive(int fd, char *buffer, size_t size, bool wait)
+{
+    ssize_t status;
+
+    status = recv(fd, buffer, size - 1, wait ? 0 : MSG_DONTWAIT);
+    if (status < 0) {
+        /*
+         * Written as two separate if statements because gcc with
+         * -Werror=logical-op warns about identical expressions, and EAGAIN
+         * and EWOULDBLOCK are the same number on Linux.
+         */
+        if (!wait && errno == EAGAIN)
+            return -1;
+        if (!wait && errno == EWOULDBLOCK)
+            return -1;
+        sysbail("cannot receive from socket");
+    }
+    buffer[status] = '\0';
+    return status;
+}
+
+
+/*
+ * Check that buffer starts with an RFC 3164 timestamp, such as
+ * "Jan  1 00:00:00 ".
+ */
+static bool
+is_rfc3164_stamp(const char *p)
+{
+    return isupper((unsigned char) p[0]) && islower((unsigned char) p[1])
+           && islower((unsigned char) p[2]) && p[3] == ' '
+           && isdigit((unsigned char) p[5]) && p[6] == ' ' && p[9] == ':'
+           && p[12] == ':' && isdigit((unsigned char) p[14]) && p[15] == ' ';
+}
+
+
+/*
+ * Check that buffer starts with an RFC 5424 timestamp, like
+ * "2024-01-01T00:00:00.000000Z".
+ */
+static bool
+is_rfc5424_stamp(const char *p)
+{
+    return isdigit((unsigned char) p[0]) && p[4] == '-' && p[7] == '-'
+           && p[10] == 'T' && p[13] == ':' && p[16] == ':' && p[19] == '.'
+           && isdigit((unsigned char) p[25]) && p[26] == 'Z';
+}
+
+
+/* Asynchronous version of message_log_dgram_warning. */
+static void __attribute__((__format__(printf, 2, 0)))
+async_warning(size_t len, const char *fmt, va_list args, int err)
+{
+    message_async_vlog(message_log_dgram_warning, len, fmt, args, err);
+}
+
+
+int
+main(void)
+{
+    char buffer[BUFSIZ * 4];
+    char expected[BUFSIZ];
+    char hostname[256];
+    char *tmpdir, *path, *message;
+    int fd;
+    size_t i;
+    ssize_t length;
+    bool okay;
+
+    plan(25);
+    tmpdir = test_tmpdir();
+    basprintf(&path, "%s/log", tmpdir);
+    fd = make_server(path);
+
+    /* Basic RFC 3164 messages. */
+    errno = 0;
+    ok(!message_syslog_open("/nonexistent/log", "test", LOG_DAEMON,
+                            MESSAGE_SYSLOG_RFC3164),
+       "open of nonexistent socket fails");
+    ok(errno == ENOENT, "...with ENOENT");
+    ok(message_syslog_open(path, "test", LOG_DAEMON, MESSAGE_SYSLOG_RFC3164),
+       "open");
+    message_handlers_warn(1, message_log_dgram_warning);
+    warn("hello %d", 1);
+    length = receive(fd, buffer, sizeof(buffer), true);
+    snprintf(expected, sizeof(expected), "<%d>", PRI_WARNING);
+    ok(strncmp(buffer, expected, strlen(expected)) == 0, "priority");
+    ok(is_rfc3164_stamp(buffer + strlen(expected)), "timestamp");
+    snprintf(expected, sizeof(expected), "test[%ld]: hello 1",
+             (long) getpid());
+    is_string(expected, buffer + length - strlen(expected), "message");
+    is_int(4 + 16 + strlen(expected), length, "...and nothing else");
+    errno = EPERM;
+    syswarn("failed");
+    length = receive(fd, buffer, sizeof(buffer), true);
+    snprintf(expected, sizeof(expected), "test[%ld]: failed: %s",
+             (long) getpid(), strerror(EPERM));
+    is_string(expected, buffer + length - strlen(expected), "syswarn");
+
+    /* Long messages are truncated. */
+    message = bmalloc(10001);
+    memset(message, 'a', 10000);
+    message[10000] = '\0';
+    warn("%s", message);
+    length = receive(fd, buffer, sizeof(buffer), true);
+    is_int(8191, length, "long message truncated");
+    ok(buffer[length - 1] == 'a', "...and ends with the message");
+    free(message);
+
+    /* RFC 5424 messages. */
+    ok(message_syslog_open(path, "test", LOG_DAEMON, MESSAGE_SYSLOG_RFC5424),
+       "reopen with RFC 5424");
+    warn("structured");
+    length = receive(fd, buffer, sizeof(buffer), true);
+    snprintf(expected, sizeof(expected), "<%d>1 ", PRI_WARNING);
+    ok(strncmp(buffer, expected, strlen(expected)) == 0, "RFC 5424 header");
+    ok(is_rfc5424_stamp(buffer + strlen(expected)), "RFC 5424 timestamp");
+    if (gethostname(hostname, sizeof(hostname)) < 0)
+        sysbail("cannot get hostname");
+    hostname[sizeof(hostname) - 1] = '\0';
+    snprintf(expected, sizeof(expected), " %s test %ld - - structured",
+             hostname, (long) getpid());
+    is_string(expected, buffer + strlen("<28>1 ") + 27, "RFC 5424 message");
+
+    /* Batching. */
+    message_syslog_batch(true);
+    warn("one");
+    warn("two");
+    ok(receive(fd, buffer, sizeof(buffer), false) < 0, "batched until flush");
+    message_syslog_flush();
+    receive(fd, buffer, sizeof(buffer), true);
+    ok(strstr(buffer, " - - one") != NULL, "first batched message");
+    receive(fd, buffer, sizeof(buffer), true);
+    ok(strstr(buffer, " - - two") != NULL, "second batched message");
+    for (i = 0; i < 10; i++)
+        warn("message %lu", (unsigned long) i);
+    okay = true;
+    for (i = 0; i < 8; i++)
+        if (receive(fd, buffer, sizeof(buffer), false) < 0)
+            okay = false;
+    ok(okay, "full batch sent without flush");
+    ok(receive(fd, buffer, sizeof(buffer), false) < 0, "...and no more");
+    message_syslog_batch(false);
+    okay = true;
+    for (i = 8; i < 10; i++) {
+        snprintf(expected, sizeof(expected), "message %lu", (unsigned long) i);
+        if (receive(fd, buffer, sizeof(buffer), false) < 0)
+            okay = false;
+        else if (strcmp(buffer + strlen(buffer) - strlen(expected), expected))
+            okay = false;
+    }
+    ok(okay, "rest sent in order when batching turned off");
+
+    /* Reconnect if the syslog daemon is restarted. */
+    close(fd);
+    fd = make_server(path);
+    warn("reconnected");
+    length = receive(fd, buffer, sizeof(buffer), false);
+    ok(length > 0 && strstr(buffer, "reconnected") != NULL,
+       "reconnect after restart");
+
+    /* Batching with the asynchronous writer, flushed when it is idle. */
+    if (!message_async_start(0, MESSAGE_ASYNC_BLOCK))
+        skip_block(3, "asynchronous logging not supported");
+    else {
+        message_async_idle(message_syslog_flush);
+        message_syslog_batch(true);
+        message_handlers_warn(1, async_warning);
+        for (i = 0; i < 10; i++)
+            warn("async %lu", (unsigned long) i);
+        message_async_stop();
+        okay = true;
+        for (i = 0; i < 10; i++) {
+            snprintf(expected, sizeof(expected), "async %lu",
+                     (unsigned long) i);
+            if (receive(fd, buffer, sizeof(buffer), false) < 0)
+                okay = false;
+            else if (strcmp(buffer + strlen(buffer) - strlen(expected),
+                            expected))
+                okay = false;
+        }
+        ok(okay, "asynchronous messages sent by idle flush");
+        ok(receive(fd, buffer, sizeof(buffer), false) < 0, "...and no more");
+        message_async_idle(NULL);
+        message_syslog_batch(false);
+        message_handlers_warn(1, message_log_dgram_warning);
+        warn("after async");
+        ok(receive(fd, buffer, sizeof(buffer), false) > 0,
+           "synchronous after stop");
+    }
+
+    /* Nothing is sent after close. */
+    message_syslog_close();
+    warn("closed");
+    ok(receive(fd, buffer, sizeof(buffer), false) < 0, "nothing after close");
+
+    /* Clean up. */
+    message_handlers_reset();
+    close(fd);
+    unlink(path);
+    free(path);
+    test_tmpdir_free(tmpdir);
+    return 0;
+}
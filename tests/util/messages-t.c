@@ -35,6 +35,9 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#ifdef HAVE_PTHREAD
+#    include <pthread.h>
+#endif
 #include <sys/stat.h>
 #include <sys/wait.h>
 
@@ -44,6 +47,9 @@
 #include <util/messages.h>
 #include <util/xmalloc.h>
 
+/* The number of retired handler tables not yet freed, from util/messages.c. */
+size_t message_tables_retired(void);
+
 
 /*
  * Test functions.
@@ -242,6 +248,115 @@ test24(void *data UNUSED)
     notice("third");
 }
 
+static void
+test25(void *data UNUSED)
+{
+    char message[2001];
+
+    memset(message, 'a', sizeof(message) - 1);
+    message[sizeof(message) - 1] = '\0';
+    message_handlers_warn(1, log_msg);
+    warn("%s%s", message, "b");
+}
+
+/* Count of evaluations of argument. */
+static int evaluated = 0;
+
+static int
+argument(void)
+{
+    evaluated++;
+    return 1;
+}
+
+static void
+test27(void *data UNUSED)
+{
+    printf("%d\n", DEBUG_ENABLED(MESSAGE_DEBUG_ALL));
+    message_handlers_debug(1, message_log_stdout);
+    debug_category(2, "two");
+    message_debug_disable(2);
+    printf("%d\n", DEBUG_ENABLED(2));
+    debug_category(2, "hidden %d", argument());
+    debug_category(4, "four");
+    debug("plain");
+    message_debug_disable(MESSAGE_DEBUG_ALL);
+    debug("plain hidden");
+    message_debug_enable(2);
+    debug_category(2, "two again");
+    message_handlers_debug(0);
+    debug_category(2, "no handlers");
+    printf("%d %d\n", DEBUG_ENABLED(2), evaluated);
+}
+
+#if defined(HAVE_PTHREAD) && defined(HAVE_C11_ATOMICS)
+
+/* Number of logging threads and messages logged by each. */
+#    define THREADS  4
+#    define MESSAGES 10000
+
+/* Counts of messages seen by each of two handlers. */
+static pthread_mutex_t count_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned long count_one = 0;
+static unsigned long count_two = 0;
+
+static void
+count_handler_one(size_t len UNUSED, const char *format UNUSED,
+                  va_list args UNUSED, int error UNUSED)
+{
+    pthread_mutex_lock(&count_lock);
+    count_one++;
+    pthread_mutex_unlock(&count_lock);
+}
+
+static void
+count_handler_two(size_t len UNUSED, const char *format UNUSED,
+                  va_list args UNUSED, int error UNUSED)
+{
+    pthread_mutex_lock(&count_lock);
+    count_two++;
+    pthread_mutex_unlock(&count_lock);
+}
+
+static void *
+warn_thread(void *data UNUSED)
+{
+    unsigned long i;
+
+    for (i = 0; i < MESSAGES; i++)
+        warn("message %lu", i);
+    return NULL;
+}
+
+/*
+ * Log from several threads while swapping handlers in the main thread.  Each
+ * message should be seen by exactly one of the handlers.
+ */
+static void
+test26(void *data UNUSED)
+{
+    pthread_t threads[THREADS];
+    size_t i;
+
+    message_handlers_warn(1, count_handler_one);
+    for (i = 0; i < THREADS; i++)
+        if (pthread_create(&threads[i], NULL, warn_thread, NULL) != 0)
+            sysdie("cannot create thread");
+    for (i = 0; i < 1000; i++)
+        if (i % 2 == 0)
+            message_handlers_warn(1, count_handler_two);
+        else
+            message_handlers_warn(1, count_handler_one);
+    for (i = 0; i < THREADS; i++)
+        pthread_join(threads[i], NULL);
+    message_handlers_warn(1, count_handler_one);
+    printf("%lu %lu\n", count_one + count_two,
+           (unsigned long) message_tables_retired());
+    message_handlers_reset();
+}
+
+#endif /* HAVE_PTHREAD && HAVE_C11_ATOMICS */
+
 
 /*
  * Given the intended status, intended message sans the appended strerror
@@ -270,7 +385,7 @@ main(void)
     char buff[32];
     char *output;
 
-    plan(24 * 3);
+    plan(27 * 3 + 3);
 
     is_function_output(test1, NULL, 0, "warning\n", "test1");
     is_function_output(test2, NULL, 1, "fatal\n", "test2");
@@ -310,5 +425,46 @@ main(void)
     is_function_output(test23, NULL, 0, "", "test23");
     is_function_output(test24, NULL, 0, "first\nthird\n", "test24");
 
+    /* Messages longer than the internal buffer are formatted on the heap. */
+    output = xmalloc(2000 + 10);
+    strcpy(output, "2001 0 ");
+    memset(output + strlen(output), 'a', 2000);
+    strcpy(output + 7 + 2000, "b\n");
+    is_function_output(test25, NULL, 0, output, "test25");
+    free(output);
+
+    /* Debug categories. */
+#if HAVE_C99_VAMACROS || HAVE_GNU_VAMACROS
+    is_function_output(test27, NULL, 0,
+                       "0\ntwo\n0\nfour\nplain\ntwo again\n0 0\n", "test27");
+#else
+    is_function_output(test27, NULL, 0,
+                       "0\ntwo\n0\nfour\nplain\ntwo again\n0 1\n", "test27");
+#endif
+
+    /*
+     * Handlers can be swapped while other threads are logging, and the
+     * replaced lists are freed once they're done.
+     */
+#if defined(HAVE_PTHREAD) && defined(HAVE_C11_ATOMICS)
+    xasprintf(&output, "%d 0\n", THREADS * MESSAGES);
+    is_function_output(test26, NULL, 0, output, "test26");
+    free(output);
+#else
+    skip_block(3, "threads or atomics not available");
+#endif
+
+    /* Replaced lists aren't freed while a list is in use. */
+    message_tables_hold();
+    message_handlers_warn(1, message_log_stderr);
+    message_handlers_warn(1, message_log_stderr);
+    message_handlers_warn(1, message_log_stderr);
+    is_int(2, message_tables_retired(), "Replaced lists kept while in use");
+    message_tables_release();
+    is_int(0, message_tables_retired(), "...and freed when released");
+    message_handlers_warn(1, message_log_stderr);
+    is_int(0, message_tables_retired(), "...or when replaced if not in use");
+    message_handlers_reset();
+
     return 0;
 }
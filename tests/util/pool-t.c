@@ -0,0 +1,272 @@
+/*
+ * pool test suite.
+ *
+ * Also includes a benchmark comparing the throughput of pool_get and pool_put
+ * to xcalloc and free from multiple threads, which is only run if
+ * AUTHOR_TESTING is set since the results are only informational.
+ *
+ * The canonical version of this file is maintained in the rra-c-util package,
+ * which can be found at <https://www.eyrie.org/~eagle/software/rra-c-util/>.
+ *
+ * Written by Russ Allbery <eagle@eyrie.org>
+ * Copyright 2024 Russ Allbery <eagle@eyrie.org>
+ *
+ * Copying and distribution of this file, with or without modification, are
+ * permitted in any medium without royalty provided the copyright notice and
+ * this notice are preserved.  This file is offered as-is, without any
+ * warranty.
+ *
+ * SPDX-License-Identifier: FSFAP
+ */
+
+#include <config.h>
+#include <portable/system.h>
+
+#ifdef HAVE_PTHREAD
+#    include <pthread.h>
+#endif
+#include <time.h>
+
+#include <tests/tap/basic.h>
+#include <util/buffer.h>
+#include <util/pool.h>
+#include <util/vector.h>
+#include <util/xmalloc.h>
+
+/* Size of test objects, number of threads, and iterations per thread. */
+#define OBJECT_SIZE 100
+#define THREADS     4
+#define ITERATIONS  10000
+#define BENCH_LOOPS 1000000
+
+#ifdef HAVE_PTHREAD
+
+/* Data passed to each thread. */
+struct thread_data {
+    struct pool *pool;
+    bool use_pool;
+    unsigned long loops;
+    bool okay;
+};
+
+
+/*
+ * Repeatedly get a set of objects, fill them with a pattern specific to this
+ * thread, and check the pattern before returning them.  Detects objects
+ * handed to two threads at once.
+ */
+static void *
+check_thread(void *arg)
+{
+    struct thread_data *data = arg;
+    unsigned char *objects[8];
+    unsigned char pattern = (unsigned char) (uintptr_t) data & 0xff;
+    size_t i, j, k;
+
+    data->okay = true;
+    for (i = 0; i < ITERATIONS; i++) {
+        for (j = 0; j < 8; j++) {
+            objects[j] = pool_get(data->pool);
+            memset(objects[j], pattern, OBJECT_SIZE);
+        }
+        for (j = 0; j < 8; j++) {
+            for (k = 0; k < OBJECT_SIZE; k++)
+                if (objects[j][k] != pattern)
+                    data->okay = false;
+            pool_put(data->pool, objects[j]);
+        }
+    }
+    return NULL;
+}
+
+
+/*
+ * Benchmark loop.  Allocate and free objects a few at a time, either from the
+ * pool or with xcalloc and free.
+ */
+static void *
+bench_thread(void *arg)
+{
+    struct thread_data *data = arg;
+    void *objects[4];
+    unsigned long i;
+    size_t j;
+
+    for (i = 0; i < data->loops; i++) {
+        for (j = 0; j < 4; j++)
+            if (data->use_pool)
+                objects[j] = pool_get(data->pool);
+            else
+                objects[j] = xcalloc(1, OBJECT_SIZE);
+        for (j = 0; j < 4; j++)
+            if (data->use_pool)
+                pool_put(data->pool, objects[j]);
+            else
+                free(objects[j]);
+    }
+    return NULL;
+}
+
+
+/*
+ * Run the given function in THREADS threads and wait for them to finish,
+ * returning the elapsed time in seconds.  Each thread gets its own data.
+ */
+static double
+run_threads(void *(*function)(void *), struct thread_data *data)
+{
+    pthread_t threads[THREADS];
+    struct timespec start, end;
+    size_t i;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < THREADS; i++)
+        if (pthread_create(&threads[i], NULL, function, &data[i]) != 0)
+            sysbail("cannot create thread");
+    for (i = 0; i < THREADS; i++)
+        pthread_join(threads[i], NULL);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (double) (end.tv_sec - start.tv_sec)
+           + (double) (end.tv_nsec - start.tv_nsec) / 1000000000.0;
+}
+
+#endif /* HAVE_PTHREAD */
+
+
+int
+main(void)
+{
+    struct pool *pool;
+    unsigned char *objects[100];
+    unsigned char *object;
+    struct buffer *buffer;
+    struct vector *vector;
+    struct cvector *cvector;
+    size_t i, j;
+    bool okay;
+#ifdef HAVE_PTHREAD
+    struct thread_data data[THREADS];
+    double pool_time, calloc_time;
+#endif
+
+    plan(17);
+
+    /* Basic get and put. */
+    pool = pool_new(OBJECT_SIZE);
+    ok(pool != NULL, "pool_new");
+    object = pool_get(pool);
+    okay = true;
+    for (i = 0; i < OBJECT_SIZE; i++)
+        if (object[i] != 0)
+            okay = false;
+    ok(okay, "pool_get returns zeroed memory");
+    memset(object, 'x', OBJECT_SIZE);
+    pool_put(pool, object);
+    ok(pool_get(pool) == object, "pool_put object is reused");
+    ok(object[0] == 0 && object[OBJECT_SIZE - 1] == 0, "...and zeroed");
+    pool_put(pool, object);
+    pool_put(pool, NULL);
+
+    /* Allocate enough objects to need several slabs and check for overlap. */
+    for (i = 0; i < 100; i++) {
+        objects[i] = pool_get(pool);
+        memset(objects[i], (int) i, OBJECT_SIZE);
+    }
+    okay = true;
+    for (i = 0; i < 100; i++) {
+        if (((uintptr_t) objects[i] % sizeof(void *)) != 0)
+            okay = false;
+        for (j = 0; j < OBJECT_SIZE; j++)
+            if (objects[i][j] != (unsigned char) i)
+                okay = false;
+    }
+    ok(okay, "many objects do not overlap and are aligned");
+    for (i = 0; i < 100; i++)
+        pool_put(pool, objects[i]);
+    okay = true;
+    for (i = 0; i < 100; i++) {
+        objects[i] = pool_get(pool);
+        for (j = 0; j < OBJECT_SIZE; j++)
+            if (objects[i][j] != 0)
+                okay = false;
+    }
+    ok(okay, "reused objects are zeroed");
+    pool_free(pool);
+
+    /* Pool-backed buffers. */
+    pool = pool_new(sizeof(struct buffer));
+    buffer = buffer_pool_get(pool);
+    is_int(0, buffer->size, "buffer_pool_get returns an empty buffer");
+    buffer_append(buffer, "test", 4);
+    is_int(4, buffer->left, "...which can be used normally");
+    buffer_pool_put(pool, buffer);
+    buffer = buffer_pool_get(pool);
+    is_int(0, buffer->left, "...and is empty after reuse");
+    buffer_pool_put(pool, buffer);
+    buffer_pool_put(pool, NULL);
+    pool_free(pool);
+
+    /* Pool-backed vectors. */
+    pool = pool_new(sizeof(struct vector));
+    vector = vector_pool_get(pool);
+    vector_add(vector, "one");
+    vector_add(vector, "two");
+    is_int(2, vector->count, "vector_pool_get returns a usable vector");
+    is_string("two", vector->strings[1], "...with the right contents");
+    vector_pool_put(pool, vector);
+    vector = vector_pool_get(pool);
+    is_int(0, vector->count, "...and is empty after reuse");
+    vector_pool_put(pool, vector);
+    pool_free(pool);
+    pool = pool_new(sizeof(struct cvector));
+    cvector = cvector_pool_get(pool);
+    cvector_add(cvector, "one");
+    is_int(1, cvector->count, "cvector_pool_get returns a usable vector");
+    cvector_pool_put(pool, cvector);
+    cvector_pool_put(pool, NULL);
+    pool_free(pool);
+
+#ifdef HAVE_PTHREAD
+    /* Check that objects are never handed out to two threads at once. */
+    pool = pool_new(OBJECT_SIZE);
+    for (i = 0; i < THREADS; i++)
+        data[i].pool = pool;
+    run_threads(check_thread, data);
+    okay = true;
+    for (i = 0; i < THREADS; i++)
+        if (!data[i].okay)
+            okay = false;
+    ok(okay, "objects are not shared between threads");
+    pool_free(pool);
+
+    /* Benchmark against xcalloc and free if requested. */
+    if (getenv("AUTHOR_TESTING") == NULL)
+        skip_block(3, "benchmark only run for author");
+    else {
+        pool = pool_new(OBJECT_SIZE);
+        for (i = 0; i < THREADS; i++) {
+            data[i].pool = pool;
+            data[i].loops = BENCH_LOOPS;
+            data[i].use_pool = true;
+        }
+        pool_time = run_threads(bench_thread, data);
+        for (i = 0; i < THREADS; i++)
+            data[i].use_pool = false;
+        calloc_time = run_threads(bench_thread, data);
+        pool_free(pool);
+        diag("%d threads, %d objects per loop, %d loops per thread", THREADS,
+             4, BENCH_LOOPS);
+        diag("pool:    %.3fs (%.1f million get/put per second)", pool_time,
+             THREADS * 4.0 * BENCH_LOOPS / pool_time / 1000000);
+        diag("xcalloc: %.3fs (%.1f million get/put per second)", calloc_time,
+             THREADS * 4.0 * BENCH_LOOPS / calloc_time / 1000000);
+        ok(pool_time > 0, "pool benchmark ran");
+        ok(calloc_time > 0, "xcalloc benchmark ran");
+        ok(true, "speedup %.2fx", calloc_time / pool_time);
+    }
+#else
+    skip_block(4, "POSIX threads not available");
+#endif
+
+    return 0;
+}
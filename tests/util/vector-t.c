@@ -20,6 +20,7 @@
 #include <config.h>
 #include <portable/system.h>
 
+#include <errno.h>
 #include <sys/wait.h>
 
 #include <tests/tap/basic.h>
@@ -36,6 +37,11 @@ main(void)
     char *command, *string;
     char *p;
     pid_t child;
+    int fds[2], status;
+    ssize_t length;
+    char output[32];
+    const char *env[2];
+    struct vector_fd_action actions[3];
     char empty[] = "";
     static const char cstring[] = "This is a\ttest.  ";
     static const char nulls1[] = "This\0is\0a\0test.";
@@ -43,7 +49,7 @@ main(void)
     static const char tabs[] = "test\t\ting\t";
 
     /* Set up the plan. */
-    plan(119);
+    plan(125);
 
     /* Be sure that freeing NULL doesn't cause a NULL pointer dereference. */
     vector_free(NULL);
@@ -356,6 +362,69 @@ main(void)
     cvector_free(cvector);
     free(command);
 
+    /*
+     * Test vector_spawn with a new environment, capturing the output of the
+     * child through a pipe set up with file descriptor actions.
+     */
+    vector = vector_new();
+    vector_add(vector, "/bin/sh");
+    vector_add(vector, "-c");
+    vector_add(vector, "echo \"$GREETING\"");
+    env[0] = "GREETING=hello";
+    env[1] = NULL;
+    if (pipe(fds) < 0)
+        sysbail("unable to create pipe");
+    actions[0].type = VECTOR_FD_DUP2;
+    actions[0].fd = fds[1];
+    actions[0].target = STDOUT_FILENO;
+    actions[1].type = VECTOR_FD_CLOSE;
+    actions[1].fd = fds[0];
+    actions[2].type = VECTOR_FD_CLOSE;
+    actions[2].fd = fds[1];
+    child = vector_spawn("/bin/sh", vector, env, actions, 3);
+    ok(child > 0, "vector_spawn returns a process ID");
+    close(fds[1]);
+    length = read(fds[0], output, sizeof(output) - 1);
+    output[length < 0 ? 0 : length] = '\0';
+    close(fds[0]);
+    is_string("hello\n", output, "...with the right output");
+    if (child > 0)
+        waitpid(child, &status, 0);
+    else
+        status = -1;
+    is_int(0, status, "...and the right exit status");
+
+    /*
+     * Failure to run the program should be reported to the caller, but POSIX
+     * allows posix_spawn to succeed and have the child exit with status 127
+     * instead, so accept either.
+     */
+    errno = 0;
+    child = vector_spawn("/nonexistent", vector, NULL, NULL, 0);
+    if (child < 0) {
+        ok(true, "vector_spawn of nonexistent program fails");
+        is_int(ENOENT, errno, "...with the right errno");
+    } else {
+        ok(waitpid(child, &status, 0) == child,
+           "vector_spawn of nonexistent program fails");
+        ok(WIFEXITED(status) && WEXITSTATUS(status) == 127,
+           "...with exit status 127");
+    }
+    vector_free(vector);
+
+    /* Test cvector_spawn, letting the child output the okay message. */
+    cvector = cvector_new();
+    cvector_add(cvector, "/bin/sh");
+    cvector_add(cvector, "-c");
+    basprintf(&command, "echo ok %lu - cvector_spawn", testnum++);
+    cvector_add(cvector, command);
+    child = cvector_spawn("/bin/sh", cvector, NULL, NULL, 0);
+    if (child < 0)
+        sysbail("unable to spawn /bin/sh");
+    waitpid(child, NULL, 0);
+    cvector_free(cvector);
+    free(command);
+
     /* All done. */
     return 0;
 }
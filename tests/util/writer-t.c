@@ -0,0 +1,169 @@
+/*
+ * Test suite for the buffered writer.
+ *
+ * Uses the fake write functions so that the number of write calls can be
+ * counted, including a comparison with calling xwrite for each record.
+ *
+ * The canonical version of this file is maintained in the rra-c-util package,
+ * which can be found at <https://www.eyrie.org/~eagle/software/rra-c-util/>.
+ *
+ * Written by Russ Allbery <eagle@eyrie.org>
+ * Copyright 2024 Russ Allbery <eagle@eyrie.org>
+ *
+ * Copying and distribution of this file, with or without modification, are
+ * permitted in any medium without royalty provided the copyright notice and
+ * this notice are preserved.  This file is offered as-is, without any
+ * warranty.
+ *
+ * SPDX-License-Identifier: FSFAP
+ */
+
+#include <config.h>
+#include <portable/system.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+
+#include <tests/tap/basic.h>
+#include <tests/tap/string.h>
+#include <tests/util/fakewrite.h>
+#include <util/writer.h>
+#include <util/xwrite.h>
+
+/* The number of records written by the benchmark. */
+#define RECORDS 100000
+
+
+/*
+ * Open /dev/null for a writer to close, since the writes themselves go to
+ * the fake functions.
+ */
+static int
+open_null(void)
+{
+    int fd;
+
+    fd = open("/dev/null", O_WRONLY);
+    if (fd < 0)
+        sysbail("cannot open /dev/null");
+    return fd;
+}
+
+
+/*
+ * Return the seconds elapsed since start.
+ */
+static double
+elapsed(const struct timespec *start)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) (now.tv_sec - start->tv_sec)
+           + (double) (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+
+int
+main(void)
+{
+    char data[256];
+    struct writer *writer, *small;
+    struct timespec start;
+    char *tmpdir, *path;
+    unsigned long calls;
+    double direct_time, writer_time;
+    int fd, i;
+
+    plan(22);
+
+    /* Count the writes. */
+    for (i = 0; i < 256; i++)
+        data[i] = (char) i;
+    write_discard = true;
+    writer = writer_new(open_null(), 64, 0, WRITER_SYNC_NONE);
+    for (i = 0; i < 6; i++)
+        if (writer_write(writer, data + i * 10, 10) != 10)
+            break;
+    is_int(0, write_calls, "small writes are buffered");
+    is_int(10, writer_write(writer, data + 60, 10), "write that doesn't fit");
+    is_int(1, write_calls, "...is written with the buffer in one call");
+    is_int(8, writer_write(writer, data + 70, 8), "small write");
+    is_int(1, write_calls, "...is buffered");
+    is_int(8, writer_flush(writer), "flush");
+    is_int(2, write_calls, "...writes the buffer");
+    is_int(0, writer_flush(writer), "flush with nothing buffered");
+    is_int(100, writer_write(writer, data, 100), "large write");
+    is_int(3, write_calls, "...is written directly");
+    small = writer_new(open_null(), 64, 16, WRITER_SYNC_NONE);
+    writer_write(small, data, 10);
+    writer_write(small, data, 10);
+    is_int(4, write_calls, "writes once the threshold is reached");
+    is_int(0, writer_close(small), "close");
+    writer_free(writer);
+
+    /* Check the data written, with partial and interrupted writes. */
+    write_discard = false;
+    write_interrupt = 1;
+    write_offset = 0;
+    writer = writer_new(open_null(), 64, 0, WRITER_SYNC_NONE);
+    for (i = 0; i < 25; i++)
+        writer_write(writer, data + i * 10, 10);
+    writer_write(writer, data + 250, 6);
+    is_int(0, writer_close(writer), "close with buffered data");
+    ok(memcmp(data, write_buffer, 256) == 0, "...and the data is correct");
+    write_interrupt = 0;
+
+    /* Failures are remembered. */
+    write_fail = true;
+    writer = writer_new(open_null(), 64, 0, WRITER_SYNC_NONE);
+    writer_write(writer, data, 10);
+    errno = EINVAL;
+    is_int(-1, writer_flush(writer), "failed flush");
+    is_int(-1, writer_write(writer, data, 1), "...later writes fail");
+    is_int(EIO, errno, "...with the same error");
+    is_int(-1, writer_close(writer), "...and so does close");
+    write_fail = false;
+
+    /* Syncing after each flush. */
+    write_offset = 0;
+    tmpdir = test_tmpdir();
+    basprintf(&path, "%s/writer", tmpdir);
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0)
+        sysbail("cannot create %s", path);
+    writer = writer_new(fd, 0, 0, WRITER_SYNC_FLUSH);
+    writer_write(writer, data, 10);
+    is_int(10, writer_flush(writer), "flush with sync");
+    is_int(0, writer_close(writer), "close with sync");
+    unlink(path);
+    free(path);
+    test_tmpdir_free(tmpdir);
+
+    /* Compare with calling xwrite for each record if requested. */
+    if (getenv("AUTHOR_TESTING") == NULL)
+        skip_block(2, "benchmark only run for author");
+    else {
+        write_discard = true;
+        write_calls = 0;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (i = 0; i < RECORDS; i++)
+            xwrite(0, data, 16);
+        direct_time = elapsed(&start);
+        is_int(RECORDS, write_calls, "xwrite makes one call per record");
+        calls = write_calls;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        writer = writer_new(open_null(), 0, 0, WRITER_SYNC_NONE);
+        for (i = 0; i < RECORDS; i++)
+            writer_write(writer, data, 16);
+        writer_close(writer);
+        writer_time = elapsed(&start);
+        calls = write_calls - calls;
+        ok(calls <= RECORDS * 16 / (64 * 1024) + 1, "writer makes %lu calls",
+           calls);
+        diag("%d records: xwrite %.3fs, writer %.3fs", RECORDS, direct_time,
+             writer_time);
+    }
+    return 0;
+}
@@ -0,0 +1,201 @@
+/*
+ * Test suite for xmalloc allocation statistics.
+ *
+ * The canonical version of this file is maintained in the rra-c-util package,
+ * which can be found at <https://www.eyrie.org/~eagle/software/rra-c-util/>.
+ *
+ * Written by Russ Allbery <eagle@eyrie.org>
+ * Copyright 2024 Russ Allbery <eagle@eyrie.org>
+ *
+ * Copying and distribution of this file, with or without modification, are
+ * permitted in any medium without royalty provided the copyright notice and
+ * this notice are preserved.  This file is offered as-is, without any
+ * warranty.
+ *
+ * SPDX-License-Identifier: FSFAP
+ */
+
+#include <config.h>
+#include <portable/system.h>
+
+#ifdef HAVE_PTHREAD
+#    include <pthread.h>
+#endif
+#include <signal.h>
+
+#include <tests/tap/basic.h>
+#include <util/xmalloc.h>
+
+/* Number of threads run one after another and allocations in each. */
+#define THREADS       20
+#define THREAD_ALLOCS 5
+
+/* Line of the allocation in thread_alloc, set by the first thread. */
+static int line_thread;
+
+
+/*
+ * Find the statistics for a given line of this file in a list of sites,
+ * returning NULL if it isn't found.
+ */
+static const struct xmalloc_site *
+find_site(const struct xmalloc_site *sites, size_t count, int line)
+{
+    size_t i;
+
+    for (i = 0; i < count; i++)
+        if (sites[i].line == line && strcmp(sites[i].file, __FILE__) == 0)
+            return &sites[i];
+    return NULL;
+}
+
+
+/*
+ * Allocate memory a few times from one call site, recording the line.
+ */
+static void *
+thread_alloc(void *data UNUSED)
+{
+    size_t i;
+    char *p;
+
+    for (i = 0; i < THREAD_ALLOCS; i++) {
+        line_thread = __LINE__ + 1;
+        p = xmalloc(10);
+        free(p);
+    }
+    return NULL;
+}
+
+
+/*
+ * Read everything available from a file descriptor into a buffer and
+ * nul-terminate it.
+ */
+static void
+read_all(int fd, char *buffer, size_t size)
+{
+    ssize_t status;
+    size_t offset = 0;
+
+    do {
+        status = read(fd, buffer + offset, size - offset - 1);
+        if (status > 0)
+            offset += status;
+    } while (status > 0 && offset < size - 1);
+    buffer[offset] = '\0';
+}
+
+
+int
+main(void)
+{
+    struct xmalloc_site *sites;
+    const struct xmalloc_site *site;
+    size_t count, i;
+    char *p;
+    int fds[2], line_malloc, line_strdup, line_asprintf, line_disabled;
+    char expected[BUFSIZ], output[BUFSIZ * 4];
+#ifdef HAVE_PTHREAD
+    pthread_t thread;
+#endif
+
+    if (!xmalloc_stats_enable(true))
+        skip_all("allocation statistics not supported");
+    plan(16);
+
+    /* Allocate from a few call sites and check the results. */
+    for (i = 1; i <= 10; i++) {
+        line_malloc = __LINE__ + 1;
+        p = xmalloc(i * 10);
+        free(p);
+    }
+    for (i = 0; i < 3; i++) {
+        line_strdup = __LINE__ + 1;
+        p = xstrdup("hello");
+        free(p);
+    }
+    line_asprintf = __LINE__ + 1;
+    xasprintf(&p, "%s %d", "test", 1);
+    free(p);
+    xmalloc_stats_enable(false);
+    line_disabled = __LINE__ + 1;
+    p = xmalloc(1000);
+    free(p);
+    sites = xmalloc_stats(&count);
+    ok(count >= 3, "xmalloc_stats returns sites");
+    site = find_site(sites, count, line_malloc);
+    ok(site != NULL, "found xmalloc site");
+    if (site == NULL)
+        skip_block(3, "xmalloc site not found");
+    else {
+        is_int(10, site->calls, "...with the right number of calls");
+        is_int(550, site->bytes, "...and bytes");
+        is_int(100, site->largest, "...and largest allocation");
+    }
+    site = find_site(sites, count, line_strdup);
+    ok(site != NULL, "found xstrdup site");
+    if (site == NULL)
+        skip_block(2, "xstrdup site not found");
+    else {
+        is_int(3, site->calls, "...with the right number of calls");
+        is_int(18, site->bytes, "...and bytes");
+    }
+#if HAVE_C99_VAMACROS || HAVE_GNU_VAMACROS
+    site = find_site(sites, count, line_asprintf);
+    ok(site != NULL, "found xasprintf site");
+    if (site == NULL)
+        skip("xasprintf site not found");
+    else
+        is_int(7, site->bytes, "...with the right bytes");
+#else
+    skip_block(2, "xasprintf doesn't record the call site");
+#endif
+
+    /* Sites should be sorted by bytes and disabled calls not recorded. */
+    ok(sites[0].bytes >= sites[count - 1].bytes, "sites are sorted");
+    ok(find_site(sites, count, line_disabled) == NULL,
+       "allocations while disabled are not recorded");
+
+    /* Check the formatting of the report. */
+    site = find_site(sites, count, line_malloc);
+    snprintf(expected, sizeof(expected),
+             "%s:%d: 10 calls, 550 bytes, largest 100\n", __FILE__,
+             line_malloc);
+    if (pipe(fds) < 0)
+        sysbail("cannot create pipe");
+    xmalloc_stats_report(fds[1]);
+    close(fds[1]);
+    read_all(fds[0], output, sizeof(output));
+    close(fds[0]);
+    ok(strstr(output, expected) != NULL, "xmalloc_stats_report output");
+    free(sites);
+
+    /* The signal handler should produce the same line. */
+    if (pipe(fds) < 0)
+        sysbail("cannot create pipe");
+    ok(xmalloc_stats_signal(SIGUSR1, fds[1]), "xmalloc_stats_signal");
+    raise(SIGUSR1);
+    close(fds[1]);
+    read_all(fds[0], output, sizeof(output));
+    close(fds[0]);
+    ok(strstr(output, expected) != NULL, "...and signal report output");
+
+    /* Counts from threads that have exited are kept. */
+#ifdef HAVE_PTHREAD
+    xmalloc_stats_enable(true);
+    for (i = 0; i < THREADS; i++) {
+        if (pthread_create(&thread, NULL, thread_alloc, NULL) != 0)
+            sysbail("cannot create thread");
+        pthread_join(thread, NULL);
+    }
+    sites = xmalloc_stats(&count);
+    site = find_site(sites, count, line_thread);
+    is_int(THREADS * THREAD_ALLOCS, site == NULL ? 0 : site->calls,
+           "counts from exited threads are kept");
+    free(sites);
+#else
+    skip("POSIX threads not available");
+#endif
+    return 0;
+}
@@ -0,0 +1,111 @@
+/*
+ * Test suite for batched writes to real files.
+ *
+ * The xwrite-t test uses fake write functions, which means batches never use
+ * io_uring, so this test checks the io_uring code (where available) against
+ * a real file.
+ *
+ * The canonical version of this file is maintained in the rra-c-util package,
+ * which can be found at <https://www.eyrie.org/~eagle/software/rra-c-util/>.
+ *
+ * Written by Russ Allbery <eagle@eyrie.org>
+ * Copyright 2024 Russ Allbery <eagle@eyrie.org>
+ *
+ * Copying and distribution of this file, with or without modification, are
+ * permitted in any medium without royalty provided the copyright notice and
+ * this notice are preserved.  This file is offered as-is, without any
+ * warranty.
+ *
+ * SPDX-License-Identifier: FSFAP
+ */
+
+#include <config.h>
+#include <portable/system.h>
+#include <portable/uio.h>
+
+#include <errno.h>
+#include <fcntl.h>
+
+#include <tests/tap/basic.h>
+#include <tests/tap/string.h>
+#include <util/xwrite.h>
+
+
+/*
+ * Read the contents of a file into a buffer, returning the length read.
+ */
+static ssize_t
+read_file(const char *path, char *buffer, size_t size)
+{
+    int fd;
+    ssize_t length;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+        sysbail("cannot open %s", path);
+    length = read(fd, buffer, size);
+    close(fd);
+    return length;
+}
+
+
+int
+main(void)
+{
+    char data[256], buffer[512];
+    struct iovec iov[20];
+    struct xwrite_batch *batch;
+    char *tmpdir, *path;
+    int fd, i;
+
+    plan(9);
+
+    tmpdir = test_tmpdir();
+    basprintf(&path, "%s/xwrite-batch", tmpdir);
+    for (i = 0; i < 256; i++)
+        data[i] = (char) i;
+
+    /* Positional writes in reverse order, more than fit in the ring. */
+    fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0)
+        sysbail("cannot create %s", path);
+    batch = xwrite_batch_new(4);
+    for (i = 15; i >= 0; i--)
+        xwrite_batch_pwrite(batch, fd, data + i * 16, 16, i * 16);
+    is_int(256, xwrite_batch_submit(batch), "positional writes");
+    is_int(256, read_file(path, buffer, sizeof(buffer)), "...file length");
+    ok(memcmp(data, buffer, 256) == 0, "...and contents");
+
+    /* Writes at the file position are done in order. */
+    for (i = 0; i < 10; i++) {
+        iov[i * 2].iov_base = data + i * 25;
+        iov[i * 2].iov_len = 20;
+        iov[i * 2 + 1].iov_base = data + i * 25 + 20;
+        iov[i * 2 + 1].iov_len = 5;
+    }
+    for (i = 0; i < 10; i++)
+        xwrite_batch_writev(batch, fd, iov + i * 2, 2);
+    is_int(250, xwrite_batch_submit(batch), "writes at file position");
+    is_int(250, lseek(fd, 0, SEEK_CUR), "...file position");
+    is_int(256, read_file(path, buffer, sizeof(buffer)), "...file length");
+    ok(memcmp(data, buffer, 256) == 0, "...and contents");
+    close(fd);
+
+    /* A failed write at the file position stops later ones. */
+    fd = open(path, O_RDWR | O_TRUNC);
+    if (fd < 0)
+        sysbail("cannot open %s", path);
+    xwrite_batch_writev(batch, -1, iov, 2);
+    xwrite_batch_writev(batch, fd, iov + 2, 2);
+    is_int(-1, xwrite_batch_submit(batch), "failed write");
+    is_int(0, read_file(path, buffer, sizeof(buffer)),
+           "...stops later writes");
+    close(fd);
+
+    /* Clean up. */
+    xwrite_batch_free(batch);
+    unlink(path);
+    free(path);
+    test_tmpdir_free(tmpdir);
+    return 0;
+}
@@ -54,10 +54,12 @@ test_write(ssize_t status, int total, const char *name)
 int
 main(void)
 {
-    int i;
+    int i, count, n;
     struct iovec iov[4];
+    struct iovec *cursor, *bigiov;
+    struct xwrite_batch *batch;
 
-    plan(44);
+    plan(61);
 
     /* Test xwrite. */
     for (i = 0; i < 256; i++)
@@ -126,6 +128,55 @@ main(void)
         is_int(EINVAL, errno, "...with correct errno");
     }
 
+    /* Test xwritev_advance. */
+    iov[0].iov_base = data;
+    iov[0].iov_len = 10;
+    iov[1].iov_base = data + 10;
+    iov[1].iov_len = 0;
+    iov[2].iov_base = data + 10;
+    iov[2].iov_len = 5;
+    cursor = iov;
+    count = 3;
+    xwritev_advance(&cursor, &count, 4);
+    ok(cursor == iov && count == 3, "xwritev_advance within entry");
+    ok((char *) cursor->iov_base == data + 4 && cursor->iov_len == 6,
+       "...adjusts the entry");
+    xwritev_advance(&cursor, &count, 6);
+    ok(cursor == iov + 2 && count == 1, "xwritev_advance skips empty entries");
+    xwritev_advance(&cursor, &count, 5);
+    is_int(0, count, "xwritev_advance to the end");
+
+    /* Test xwritev_consume. */
+    write_interrupt = 1;
+    for (i = 0; i < 256; i++)
+        data[i] = (char) (i * 3);
+    iov[0].iov_base = data;
+    iov[0].iov_len = 100;
+    iov[1].iov_base = data + 100;
+    iov[1].iov_len = 0;
+    iov[2].iov_base = data + 100;
+    iov[2].iov_len = 156;
+    test_write(xwritev_consume(0, iov, 3), 256, "xwritev_consume interrupted");
+    write_offset = 0;
+    write_interrupt = 0;
+
+    /* Test arrays with more than IOV_MAX entries. */
+    n = IOV_MAX * 2;
+    bigiov = bcalloc(n, sizeof(struct iovec));
+    for (i = 0; i < 256; i++)
+        data[i] = (char) (i + 7);
+    for (i = 0; i < n; i++) {
+        bigiov[i].iov_base = data + (i * 256) / n;
+        bigiov[i].iov_len = ((i + 1) * 256) / n - (i * 256) / n;
+    }
+    test_write(xwritev(0, bigiov, n), 256, "xwritev with IOV_MAX * 2 entries");
+    write_offset = 0;
+    memset(write_buffer, 0, 256);
+    test_write(xwritev_consume(0, bigiov, n), 256,
+               "xwritev_consume with IOV_MAX * 2 entries");
+    write_offset = 0;
+    free(bigiov);
+
     /* Test xpwrite. */
     for (i = 0; i < 256; i++)
         data[i] = (char) i;
@@ -158,5 +209,35 @@ main(void)
     iov[0].iov_len = 0;
     test_write(xwritev(0, iov, 1), 0, "xwritev zero length with buffers");
 
+    /* Test batches, which always use the loops above in the test suite. */
+    write_fail = false;
+    write_offset = 0;
+    write_interrupt = 1;
+    batch = xwrite_batch_new(0);
+    is_int(0, xwrite_batch_submit(batch), "empty xwrite batch");
+    for (i = 0; i < 256; i++)
+        data[i] = (char) (255 - i);
+    xwrite_batch_pwrite(batch, 0, data + 192, 64, 192);
+    xwrite_batch_pwrite(batch, 0, data + 128, 64, 128);
+    iov[0].iov_base = data;
+    iov[0].iov_len = 100;
+    iov[1].iov_base = data + 100;
+    iov[1].iov_len = 20;
+    iov[2].iov_base = data + 120;
+    iov[2].iov_len = 8;
+    xwrite_batch_writev(batch, 0, iov, 2);
+    xwrite_batch_writev(batch, 0, iov + 2, 1);
+    test_write(xwrite_batch_submit(batch), 256, "xwrite batch");
+    write_interrupt = 0;
+    write_fail = true;
+    xwrite_batch_pwrite(batch, 0, data + 1, 255, 0);
+    xwrite_batch_writev(batch, 0, iov, 3);
+    test_write(xwrite_batch_submit(batch), -1, "xwrite batch fail");
+    write_fail = false;
+    xwrite_batch_writev(batch, 0, iov, -1);
+    is_int(-1, xwrite_batch_submit(batch), "xwrite batch with negative count");
+    is_int(EINVAL, errno, "...with correct errno");
+    xwrite_batch_free(batch);
+
     return 0;
 }
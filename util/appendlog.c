@@ -0,0 +1,274 @@
+/*
+ * Durable append-only log with group commit.
+ *
+ * Usage:
+ *
+ *     struct appendlog *log = appendlog_open("/var/log/audit");
+ *     if (appendlog_append(log, record, length) < 0)
+ *         sysdie("cannot log record");
+ *     appendlog_close(log);
+ *
+ * Writing and then calling fdatasync for each record makes every record wait
+ * for its own disk flush.  Here, a thread appending a record adds it to a
+ * pending batch.  If no batch is being written, that thread becomes the
+ * leader: it takes the whole pending batch, writes it with one xwritev and
+ * one fdatasync, and then marks every record in the batch done.  Other
+ * threads wait until their record is done, or until the previous batch is
+ * finished, at which point one of them leads the next batch.  The more
+ * threads are appending, the more records share each fdatasync.
+ *
+ * Each waiting thread's record and result are kept on its own stack, so
+ * nothing is copied or allocated per record except the iovec array for each
+ * batch, which is reused.
+ *
+ * Without POSIX threads, each record is written and synced on its own.
+ *
+ * The canonical version of this file is maintained in the rra-c-util package,
+ * which can be found at <https://www.eyrie.org/~eagle/software/rra-c-util/>.
+ *
+ * Written by Russ Allbery <eagle@eyrie.org>
+ * Copyright 2024 Russ Allbery <eagle@eyrie.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <config.h>
+#include <portable/system.h>
+#include <portable/uio.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#ifdef HAVE_PTHREAD
+#    include <pthread.h>
+#endif
+#include <time.h>
+
+#include <util/appendlog.h>
+#include <util/messages.h>
+#include <util/xmalloc.h>
+#include <util/xwrite.h>
+
+/* Use fsync if fdatasync isn't available. */
+#if !HAVE_DECL_FDATASYNC
+#    define fdatasync(fd) fsync(fd)
+#endif
+
+/* A record waiting to be written, on the stack of the appending thread. */
+struct appendlog_waiter {
+    struct appendlog_waiter *next;
+    const void *data;
+    size_t size;
+    struct timespec start;
+    bool done;
+    int error; /* errno value if the write failed, or 0. */
+};
+
+struct appendlog {
+    int fd;
+    struct appendlog_waiter *head; /* Pending batch, in order. */
+    struct appendlog_waiter *tail;
+    bool committing;   /* Whether a leader is writing a batch. */
+    struct iovec *iov; /* Reused by the leader for each batch. */
+    size_t iov_size;
+    struct appendlog_stats stats;
+#ifdef HAVE_PTHREAD
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+#endif
+};
+
+#ifdef HAVE_PTHREAD
+#    define LOCK(log)   pthread_mutex_lock(&(log)->lock)
+#    define UNLOCK(log) pthread_mutex_unlock(&(log)->lock)
+#else
+#    define LOCK(log)   /* empty */
+#    define UNLOCK(log) /* empty */
+#endif
+
+
+/*
+ * Open a log.
+ */
+struct appendlog *
+appendlog_open(const char *path)
+{
+    struct appendlog *log;
+    int fd;
+
+    fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0666);
+    if (fd < 0)
+        return NULL;
+    log = xcalloc(1, sizeof(struct appendlog));
+    log->fd = fd;
+#ifdef HAVE_PTHREAD
+    errno = pthread_mutex_init(&log->lock, NULL);
+    if (errno != 0)
+        sysdie("cannot initialize append log lock");
+    errno = pthread_cond_init(&log->cond, NULL);
+    if (errno != 0)
+        sysdie("cannot initialize append log condition");
+#endif
+    return log;
+}
+
+
+/*
+ * Close a log.
+ */
+int
+appendlog_close(struct appendlog *log)
+{
+    int status;
+
+    if (log == NULL)
+        return 0;
+    status = close(log->fd);
+#ifdef HAVE_PTHREAD
+    pthread_cond_destroy(&log->cond);
+    pthread_mutex_destroy(&log->lock);
+#endif
+    free(log->iov);
+    free(log);
+    return status;
+}
+
+
+/*
+ * Write and sync a batch of records, returning 0 or an errno value.  Called
+ * by the leader without the lock held.  The batch and the iovec array belong
+ * to the leader until committing is cleared.
+ */
+static int
+commit_batch(struct appendlog *log, struct appendlog_waiter *batch)
+{
+    struct appendlog_waiter *waiter;
+    size_t count = 0;
+
+    for (waiter = batch; waiter != NULL; waiter = waiter->next)
+        count++;
+    if (count > log->iov_size) {
+        log->iov = xreallocarray(log->iov, count, sizeof(struct iovec));
+        log->iov_size = count;
+    }
+    count = 0;
+    for (waiter = batch; waiter != NULL; waiter = waiter->next) {
+        log->iov[count].iov_base = (void *) waiter->data;
+        log->iov[count].iov_len = waiter->size;
+        count++;
+    }
+    errno = 0;
+    if (xwritev_consume(log->fd, log->iov, (int) count) < 0)
+        return (errno == 0) ? EIO : errno;
+    if (fdatasync(log->fd) < 0)
+        return errno;
+    return 0;
+}
+
+
+/*
+ * Record the latency of a record in the histogram.
+ */
+static void
+record_latency(struct appendlog_stats *stats, const struct timespec *start,
+               const struct timespec *end)
+{
+    unsigned long usec;
+    size_t bucket = 0;
+
+    usec = (unsigned long) (end->tv_sec - start->tv_sec) * 1000000UL;
+    usec += (unsigned long) ((end->tv_nsec - start->tv_nsec) / 1000);
+    while (usec >= 2 && bucket < APPENDLOG_BUCKETS - 1) {
+        usec >>= 1;
+        bucket++;
+    }
+    stats->latency[bucket]++;
+    stats->records++;
+}
+
+
+/*
+ * Append a record and wait for it to be durable, leading a batch if nobody
+ * else is.
+ */
+int
+appendlog_append(struct appendlog *log, const void *data, size_t size)
+{
+    struct appendlog_waiter self, *batch, *waiter;
+    struct timespec end;
+    int error;
+
+    memset(&self, 0, sizeof(self));
+    self.data = data;
+    self.size = size;
+    clock_gettime(CLOCK_MONOTONIC, &self.start);
+
+    LOCK(log);
+    if (log->tail == NULL)
+        log->head = &self;
+    else
+        log->tail->next = &self;
+    log->tail = &self;
+    while (!self.done) {
+        if (!log->committing) {
+            batch = log->head;
+            log->head = NULL;
+            log->tail = NULL;
+            log->committing = true;
+            UNLOCK(log);
+            error = commit_batch(log, batch);
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            LOCK(log);
+            log->stats.commits++;
+            for (waiter = batch; waiter != NULL; waiter = waiter->next) {
+                record_latency(&log->stats, &waiter->start, &end);
+                waiter->error = error;
+                waiter->done = true;
+            }
+            log->committing = false;
+#ifdef HAVE_PTHREAD
+            pthread_cond_broadcast(&log->cond);
+#endif
+        }
+#ifdef HAVE_PTHREAD
+        else
+            pthread_cond_wait(&log->cond, &log->lock);
+#endif
+    }
+    UNLOCK(log);
+
+    if (self.error != 0) {
+        errno = self.error;
+        return -1;
+    }
+    return 0;
+}
+
+
+/*
+ * Copy the statistics.
+ */
+void
+appendlog_stats(struct appendlog *log, struct appendlog_stats *stats)
+{
+    LOCK(log);
+    *stats = log->stats;
+    UNLOCK(log);
+}
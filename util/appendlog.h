@@ -0,0 +1,95 @@
+/*
+ * Prototypes for the durable append-only log.
+ *
+ * The canonical version of this file is maintained in the rra-c-util package,
+ * which can be found at <https://www.eyrie.org/~eagle/software/rra-c-util/>.
+ *
+ * Written by Russ Allbery <eagle@eyrie.org>
+ * Copyright 2024 Russ Allbery <eagle@eyrie.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef UTIL_APPENDLOG_H
+#define UTIL_APPENDLOG_H 1
+
+#include <config.h>
+#include <portable/macros.h>
+
+#include <stddef.h>
+
+/*
+ * The number of buckets in the latency histogram.  Bucket 0 counts records
+ * that became durable in under 2 microseconds, bucket n counts records that
+ * took at least 2^n and less than 2^(n+1) microseconds, and the last bucket
+ * also counts anything slower.
+ */
+#define APPENDLOG_BUCKETS 32
+
+/* Statistics for a log. */
+struct appendlog_stats {
+    unsigned long records; /* Records made durable (or failed). */
+    unsigned long commits; /* Number of write and fdatasync calls. */
+    unsigned long latency[APPENDLOG_BUCKETS];
+};
+
+/* Opaque struct for an append-only log. */
+struct appendlog;
+
+BEGIN_DECLS
+
+/* Default to a hidden visibility for all util functions. */
+#pragma GCC visibility push(hidden)
+
+/*
+ * Close a log, returning 0 on success or -1 with errno set.  There must not
+ * be any appends in progress.  Accepts NULL and does nothing.
+ */
+int appendlog_close(struct appendlog *);
+
+/*
+ * Open a log for appending, creating the file if it doesn't exist.  Returns
+ * NULL with errno set on failure.
+ */
+struct appendlog *appendlog_open(const char *path)
+    __attribute__((__nonnull__, __warn_unused_result__,
+                   __malloc__(appendlog_close)));
+
+/*
+ * Append a record to the log and wait until it's durable, returning 0 on
+ * success or -1 with errno set.  Records appended at the same time from
+ * different threads are written together with one write and one fdatasync.
+ * If writing a batch fails, all records in the batch fail with the same
+ * error, although some of them may have been written.
+ */
+int appendlog_append(struct appendlog *, const void *data, size_t size)
+    __attribute__((__nonnull__));
+
+/* Copy the current statistics for a log into the provided struct. */
+void appendlog_stats(struct appendlog *, struct appendlog_stats *)
+    __attribute__((__nonnull__));
+
+/* Undo default visibility change. */
+#pragma GCC visibility pop
+
+END_DECLS
+
+#endif /* UTIL_APPENDLOG_H */
@@ -0,0 +1,370 @@
+/*
+ * Arena (region) allocator with failure handling.
+ *
+ * Usage:
+ *
+ *      struct arena *arena;
+ *      struct arena_mark mark;
+ *      char *name, *message;
+ *
+ *      arena = arena_new(0);
+ *      name = arena_strdup(arena, "some string");
+ *      arena_mark(arena, &mark);
+ *      arena_asprintf(arena, &message, "hello %s", name);
+ *      arena_release(arena, &mark);
+ *      arena_reset(arena);
+ *      arena_free(arena);
+ *
+ * Memory is carved out of blocks allocated with malloc, each at least the
+ * block size given to arena_new, by advancing an offset into the most recent
+ * block.  Every allocation is aligned suitably for any type.  When the
+ * current block doesn't have enough room, a new block is allocated and the
+ * remaining space in the old block is abandoned.  Allocations larger than the
+ * block size get a block of their own.
+ *
+ * The allocation functions behave like the corresponding xmalloc functions:
+ * they never return NULL and instead call xmalloc_error_handler, retrying the
+ * allocation if it returns.  Memory from an arena must not be passed to free
+ * or realloc.  arena_reset frees everything at once and arena_mark and
+ * arena_release free everything allocated after a given point.
+ *
+ * The canonical version of this file is maintained in the rra-c-util package,
+ * which can be found at <https://www.eyrie.org/~eagle/software/rra-c-util/>.
+ *
+ * Written by Russ Allbery <eagle@eyrie.org>
+ * Copyright 2024 Russ Allbery <eagle@eyrie.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <config.h>
+#include <portable/system.h>
+
+#include <util/arena.h>
+#include <util/xmalloc.h>
+
+/*
+ * Used to determine the alignment of arena allocations, which must be
+ * suitable for any type the caller may store.
+ */
+union arena_align {
+    long double ld;
+    long long ll;
+    double d;
+    void *p;
+    void (*f)(void);
+};
+#define ARENA_ALIGN sizeof(union arena_align)
+
+/* Round a size up to the arena alignment, saturating on overflow. */
+#define ARENA_ROUND(s)                  \
+    (((s) > SIZE_MAX - ARENA_ALIGN)     \
+         ? SIZE_MAX - ARENA_ALIGN + 1   \
+         : ((s) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1))
+
+/*
+ * A block of memory from which allocations are made.  Blocks are kept in a
+ * singly-linked list with the most recent first.  The data starts at
+ * ARENA_HEADER bytes from the start of the block to preserve alignment.
+ */
+struct arena_block {
+    struct arena_block *next;
+    size_t size; /* Usable size of the block, excluding the header. */
+    size_t used; /* Bytes already handed out. */
+};
+#define ARENA_HEADER ARENA_ROUND(sizeof(struct arena_block))
+#define ARENA_DATA(b) ((char *) (b) + ARENA_HEADER)
+
+struct arena {
+    struct arena_block *current; /* Block used for allocations. */
+    size_t block_size;           /* Minimum size of new blocks. */
+};
+
+
+/*
+ * Create a new arena.  This uses the xmalloc functions and therefore also
+ * never fails.
+ */
+struct arena *
+arena_new(size_t block_size)
+{
+    struct arena *arena;
+
+    arena = xmalloc(sizeof(struct arena));
+    arena->current = NULL;
+    if (block_size == 0)
+        block_size = ARENA_BLOCK_SIZE;
+    arena->block_size = ARENA_ROUND(block_size);
+    return arena;
+}
+
+
+/*
+ * Free all blocks in a list up to but not including the given stopping point,
+ * which may be NULL to free the whole list.
+ */
+static void
+free_blocks(struct arena_block *block, const struct arena_block *stop)
+{
+    struct arena_block *next;
+
+    while (block != NULL && block != stop) {
+        next = block->next;
+        free(block);
+        block = next;
+    }
+}
+
+
+/*
+ * Free an arena.  Any pointers into the arena become invalid.
+ */
+void
+arena_free(struct arena *arena)
+{
+    if (arena == NULL)
+        return;
+    free_blocks(arena->current, NULL);
+    free(arena);
+}
+
+
+/*
+ * Free everything allocated from the arena, but keep the oldest block so that
+ * an arena that is reset after every request doesn't need to go back to
+ * malloc for each one.
+ */
+void
+arena_reset(struct arena *arena)
+{
+    struct arena_block *last;
+
+    if (arena->current == NULL)
+        return;
+    for (last = arena->current; last->next != NULL; last = last->next)
+        ;
+    free_blocks(arena->current, last);
+    last->used = 0;
+    arena->current = last;
+}
+
+
+/*
+ * Record the current allocation point of the arena.
+ */
+void
+arena_mark(struct arena *arena, struct arena_mark *mark)
+{
+    mark->block = arena->current;
+    mark->used = (arena->current == NULL) ? 0 : arena->current->used;
+}
+
+
+/*
+ * Free everything allocated since the mark was taken.  Since new blocks are
+ * always added to the front of the list, this means freeing blocks until we
+ * get back to the block that was current at the time of the mark and then
+ * restoring its offset.
+ */
+void
+arena_release(struct arena *arena, const struct arena_mark *mark)
+{
+    if (mark->block == NULL) {
+        arena_reset(arena);
+        return;
+    }
+    free_blocks(arena->current, mark->block);
+    arena->current = mark->block;
+    arena->current->used = mark->used;
+}
+
+
+/*
+ * Return the free space in the current block, or NULL if there is no current
+ * block, and store the number of available bytes in the provided length.
+ */
+static char *
+arena_space(struct arena *arena, size_t *length)
+{
+    struct arena_block *block = arena->current;
+
+    if (block == NULL) {
+        *length = 0;
+        return NULL;
+    }
+    *length = block->size - block->used;
+    return ARENA_DATA(block) + block->used;
+}
+
+
+/*
+ * The core allocation routine.  Returns memory of at least the given size
+ * from the current block, allocating a new block if needed.  The function
+ * name is passed to xmalloc_error_handler if malloc fails.
+ */
+static void *
+arena_get(struct arena *arena, size_t size, const char *function,
+          const char *file, int line)
+{
+    struct arena_block *block;
+    size_t data_size, total;
+    void *p;
+
+    size = ARENA_ROUND(size > 0 ? size : 1);
+    block = arena->current;
+    if (block == NULL || block->size - block->used < size) {
+        data_size = (size > arena->block_size) ? size : arena->block_size;
+        total = data_size + ARENA_HEADER;
+        if (total < data_size)
+            total = SIZE_MAX;
+        block = malloc(total);
+        while (block == NULL) {
+            xmalloc_error_handler(function, size, file, line);
+            block = malloc(total);
+        }
+        block->size = data_size;
+        block->used = 0;
+        block->next = arena->current;
+        arena->current = block;
+    }
+    p = ARENA_DATA(block) + block->used;
+    block->used += size;
+    return p;
+}
+
+
+void *
+x_arena_alloc(struct arena *arena, size_t size, const char *file, int line)
+{
+    return arena_get(arena, size, "arena_alloc", file, line);
+}
+
+
+void *
+x_arena_calloc(struct arena *arena, size_t n, size_t size, const char *file,
+               int line)
+{
+    void *p;
+
+    /* Force a malloc failure on overflow like calloc would. */
+    if (size > 0 && n > SIZE_MAX / size)
+        p = arena_get(arena, SIZE_MAX, "arena_calloc", file, line);
+    else
+        p = arena_get(arena, n * size, "arena_calloc", file, line);
+    memset(p, 0, n * size);
+    return p;
+}
+
+
+char *
+x_arena_strdup(struct arena *arena, const char *s, const char *file, int line)
+{
+    char *p;
+    size_t len;
+
+    len = strlen(s) + 1;
+    p = arena_get(arena, len, "arena_strdup", file, line);
+    memcpy(p, s, len);
+    return p;
+}
+
+
+/*
+ * As with x_strndup, don't assume that the source string is nul-terminated.
+ */
+char *
+x_arena_strndup(struct arena *arena, const char *s, size_t size,
+                const char *file, int line)
+{
+    const char *p;
+    size_t length;
+    char *copy;
+
+    for (p = s; (size_t) (p - s) < size && *p != '\0'; p++)
+        ;
+    length = p - s;
+    copy = arena_get(arena, length + 1, "arena_strndup", file, line);
+    memcpy(copy, s, length);
+    copy[length] = '\0';
+    return copy;
+}
+
+
+/*
+ * Format directly into the free space of the current block if the output
+ * fits, which avoids formatting twice in the common case.  Otherwise, use the
+ * length from the first attempt to allocate enough space and format again.
+ */
+void
+x_arena_vasprintf(struct arena *arena, char **strp, const char *fmt,
+                  va_list args, const char *file, int line)
+{
+    va_list args_copy;
+    char *space;
+    size_t length;
+    int status;
+
+    space = arena_space(arena, &length);
+    va_copy(args_copy, args);
+    status = vsnprintf(space, length, fmt, args_copy);
+    va_end(args_copy);
+    while (status < 0) {
+        xmalloc_error_handler("arena_vasprintf", 0, file, line);
+        space = arena_space(arena, &length);
+        va_copy(args_copy, args);
+        status = vsnprintf(space, length, fmt, args_copy);
+        va_end(args_copy);
+    }
+    if ((size_t) status < length) {
+        arena->current->used += ARENA_ROUND((size_t) status + 1);
+        *strp = space;
+        return;
+    }
+    *strp = arena_get(arena, (size_t) status + 1, "arena_vasprintf", file,
+                      line);
+    va_copy(args_copy, args);
+    vsnprintf(*strp, (size_t) status + 1, fmt, args_copy);
+    va_end(args_copy);
+}
+
+
+#if HAVE_C99_VAMACROS || HAVE_GNU_VAMACROS
+void
+x_arena_asprintf(struct arena *arena, char **strp, const char *file, int line,
+                 const char *fmt, ...)
+{
+    va_list args;
+
+    va_start(args, fmt);
+    x_arena_vasprintf(arena, strp, fmt, args, file, line);
+    va_end(args);
+}
+#else  /* !(HAVE_C99_VAMACROS || HAVE_GNU_VAMACROS) */
+void
+x_arena_asprintf(struct arena *arena, char **strp, const char *fmt, ...)
+{
+    va_list args;
+
+    va_start(args, fmt);
+    x_arena_vasprintf(arena, strp, fmt, args, __FILE__, __LINE__);
+    va_end(args);
+}
+#endif /* !(HAVE_C99_VAMACROS || HAVE_GNU_VAMACROS) */
@@ -0,0 +1,155 @@
+/*
+ * Prototypes for the arena (region) allocator.
+ *
+ * An arena hands out memory from large blocks by bumping a pointer, and all
+ * memory allocated from an arena is freed at once by arena_reset or
+ * arena_free rather than individually.  It is intended for short-lived
+ * processing, such as handling a single request, that makes many small
+ * allocations with the same lifetime.
+ *
+ * Arenas are not locked.  Each arena should only be used by one thread at a
+ * time; threads that need scratch memory should each create their own.
+ *
+ * The canonical version of this file is maintained in the rra-c-util package,
+ * which can be found at <https://www.eyrie.org/~eagle/software/rra-c-util/>.
+ *
+ * Written by Russ Allbery <eagle@eyrie.org>
+ * Copyright 2024 Russ Allbery <eagle@eyrie.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef UTIL_ARENA_H
+#define UTIL_ARENA_H 1
+
+#include <config.h>
+#include <portable/macros.h>
+
+#include <stdarg.h>
+#include <stddef.h>
+
+/* The block size used if zero is passed to arena_new. */
+#define ARENA_BLOCK_SIZE 8192
+
+/* Opaque struct holding the arena state. */
+struct arena;
+
+/*
+ * A saved allocation point in an arena, filled in by arena_mark and passed to
+ * arena_release.  The contents should be treated as opaque.
+ */
+struct arena_mark {
+    void *block;
+    size_t used;
+};
+
+/*
+ * The allocation functions are macros so that we can pick up the file and
+ * line number information for error messages, as with the xmalloc family.
+ * All of them call xmalloc_error_handler on failure and never return NULL.
+ */
+#define arena_alloc(a, size)  x_arena_alloc((a), (size), __FILE__, __LINE__)
+#define arena_strdup(a, p)    x_arena_strdup((a), (p), __FILE__, __LINE__)
+#define arena_vasprintf(a, p, f, args) \
+    x_arena_vasprintf((a), (p), (f), (args), __FILE__, __LINE__)
+#define arena_calloc(a, n, size) \
+    x_arena_calloc((a), (n), (size), __FILE__, __LINE__)
+#define arena_strndup(a, p, size) \
+    x_arena_strndup((a), (p), (size), __FILE__, __LINE__)
+
+/* See the comment in util/xmalloc.h about asprintf and variadic macros. */
+#ifdef HAVE_C99_VAMACROS
+#    define arena_asprintf(a, p, f, ...) \
+        x_arena_asprintf((a), (p), __FILE__, __LINE__, (f), __VA_ARGS__)
+#elif HAVE_GNU_VAMACROS
+#    define arena_asprintf(a, p, f, args...) \
+        x_arena_asprintf((a), (p), __FILE__, __LINE__, (f), args)
+#else
+#    define arena_asprintf x_arena_asprintf
+#endif
+
+BEGIN_DECLS
+
+/* Default to a hidden visibility for all util functions. */
+#pragma GCC visibility push(hidden)
+
+/* Free an arena and all memory allocated from it. */
+void arena_free(struct arena *);
+
+/*
+ * Create a new, empty arena that allocates memory in blocks of the given
+ * size, or ARENA_BLOCK_SIZE if the size is zero.  No memory is allocated for
+ * blocks until the first allocation from the arena.
+ */
+struct arena *arena_new(size_t block_size)
+    __attribute__((__warn_unused_result__, __malloc__(arena_free)));
+
+/*
+ * Free all memory allocated from the arena, invalidating every pointer into
+ * it.  One block is kept to satisfy subsequent allocations so that an arena
+ * reused for each request doesn't have to go back to malloc.
+ */
+void arena_reset(struct arena *) __attribute__((__nonnull__));
+
+/*
+ * Record the current allocation point of the arena in the provided mark.  A
+ * later call to arena_release with that mark frees everything allocated
+ * since, leaving earlier allocations intact.  Marks must be released in the
+ * reverse order that they were taken, and a mark is invalidated by releasing
+ * an earlier mark or by arena_reset.
+ */
+void arena_mark(struct arena *, struct arena_mark *)
+    __attribute__((__nonnull__));
+void arena_release(struct arena *, const struct arena_mark *)
+    __attribute__((__nonnull__));
+
+/*
+ * Last two arguments are always file and line number.  These are internal
+ * implementations that should not be called directly.
+ */
+void *x_arena_alloc(struct arena *, size_t, const char *, int)
+    __attribute__((__alloc_size__(2), __nonnull__));
+void *x_arena_calloc(struct arena *, size_t, size_t, const char *, int)
+    __attribute__((__alloc_size__(2, 3), __nonnull__));
+char *x_arena_strdup(struct arena *, const char *, const char *, int)
+    __attribute__((__nonnull__));
+char *x_arena_strndup(struct arena *, const char *, size_t, const char *, int)
+    __attribute__((__nonnull__));
+void x_arena_vasprintf(struct arena *, char **, const char *, va_list,
+                       const char *, int)
+    __attribute__((__nonnull__, __format__(printf, 3, 0)));
+
+/* asprintf special case. */
+#if HAVE_C99_VAMACROS || HAVE_GNU_VAMACROS
+void x_arena_asprintf(struct arena *, char **, const char *, int, const char *,
+                      ...)
+    __attribute__((__nonnull__, __format__(printf, 5, 6)));
+#else
+void x_arena_asprintf(struct arena *, char **, const char *, ...)
+    __attribute__((__nonnull__, __format__(printf, 3, 4)));
+#endif
+
+/* Undo default visibility change. */
+#pragma GCC visibility pop
+
+END_DECLS
+
+#endif /* UTIL_ARENA_H */
@@ -48,6 +48,7 @@
 #include <sys/stat.h>
 
 #include <util/buffer.h>
+#include <util/pool.h>
 #include <util/xmalloc.h>
 
 
@@ -74,6 +75,30 @@ buffer_free(struct buffer *buffer)
 }
 
 
+/*
+ * Allocate a new buffer from an object pool.  pool_get returns zeroed memory,
+ * so this is the same as buffer_new.
+ */
+struct buffer *
+buffer_pool_get(struct pool *pool)
+{
+    return pool_get(pool);
+}
+
+
+/*
+ * Free a buffer allocated from an object pool.
+ */
+void
+buffer_pool_put(struct pool *pool, struct buffer *buffer)
+{
+    if (buffer == NULL)
+        return;
+    free(buffer->data);
+    pool_put(pool, buffer);
+}
+
+
 /*
  * Resize a buffer to be at least as large as the provided second argument.
  * Resize buffers to multiples of 1KB to keep the number of reallocations to a
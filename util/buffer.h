@@ -50,6 +50,9 @@
 #include <stdarg.h>
 #include <sys/types.h>
 
+/* Forward declaration to avoid an include. */
+struct pool;
+
 struct buffer {
     size_t size; /* Total allocated length. */
     size_t used; /* Data already used. */
@@ -69,6 +72,18 @@ void buffer_free(struct buffer *);
 struct buffer *buffer_new(void)
     __attribute__((__warn_unused_result__, __malloc__(buffer_free)));
 
+/*
+ * Allocate a new buffer from an object pool created with pool_new for objects
+ * of size sizeof(struct buffer), and free a buffer obtained that way.  These
+ * avoid a malloc and free for the buffer struct for callers that create and
+ * discard buffers at a high rate.  The buffer data is still allocated
+ * normally.
+ */
+struct buffer *buffer_pool_get(struct pool *)
+    __attribute__((__nonnull__, __warn_unused_result__));
+void buffer_pool_put(struct pool *, struct buffer *)
+    __attribute__((__nonnull__(1)));
+
 /*
  * Resize a buffer to be at least as large as the provided size.  Invalidates
  * pointers into the buffer.
@@ -0,0 +1,536 @@
+/*
+ * Asynchronous message handlers.
+ *
+ * Usage:
+ *
+ *     message_async_start(0, MESSAGE_ASYNC_DROP);
+ *     message_handlers_warn(1, message_log_async_syslog_warning);
+ *     warn("this is written by a background thread");
+ *     message_async_stop();
+ *
+ * The message handlers in util/messages do their I/O on the calling thread,
+ * so a slow terminal or a stalled syslog socket delays the caller.  The
+ * handlers here instead format the message and add it to a bounded queue,
+ * and a background writer thread removes messages from the queue and passes
+ * them to the real handler.
+ *
+ * The queue is a ring of slots with per-slot sequence numbers, which allows
+ * any number of threads to add messages without locking while the single
+ * writer thread removes them.  Producers claim a slot by advancing the head
+ * with compare-and-swap, fill it in, and then publish it by updating its
+ * sequence number.  A mutex and condition variable are used only to wake the
+ * writer thread when it has gone to sleep on an empty queue.
+ *
+ * If the queue is full, the message is either dropped and counted or the
+ * caller waits for space, depending on the policy passed to
+ * message_async_start.  Messages that fit in a slot are copied into it;
+ * longer ones are copied into memory from malloc, or truncated if that fails.
+ *
+ * If the writer thread isn't running, or if threads or atomics aren't
+ * available, the asynchronous handlers call the real handler directly.  They
+ * also do so when waiting for space would never end: after the writer is
+ * stopped, or when a handler running on the writer thread logs to a full
+ * queue.
+ *
+ * Producers count themselves in async_producers while they may touch the
+ * queue, and message_async_stop waits for that count to drop to zero before
+ * freeing the queue, so other threads may keep logging while it runs.  It is
+ * not called at exit, since other threads may still be logging then, but
+ * message_async_flush is, so that queued messages are written.
+ *
+ * The canonical version of this file is maintained in the rra-c-util package,
+ * which can be found at <https://www.eyrie.org/~eagle/software/rra-c-util/>.
+ *
+ * Written by Russ Allbery <eagle@eyrie.org>
+ * Copyright 2024 Russ Allbery <eagle@eyrie.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <config.h>
+#include <portable/system.h>
+
+#include <errno.h>
+#if defined(HAVE_PTHREAD) && defined(HAVE_C11_ATOMICS)
+#    include <pthread.h>
+#    include <stdatomic.h>
+#    include <time.h>
+#    define MESSAGE_ASYNC 1
+#endif
+
+#include <util/macros.h>
+#include <util/messages-async.h>
+#include <util/messages.h>
+
+/* The default number of slots in the queue. */
+#define MESSAGE_ASYNC_SLOTS 256
+
+/* Messages up to this length (including the nul) are stored in the slot. */
+#define MESSAGE_ASYNC_TEXT 512
+
+
+#ifdef MESSAGE_ASYNC
+
+/*
+ * A slot in the queue.  A slot at position pos in the ring (counting without
+ * wrapping) is free for a producer when its sequence is pos, and holds a
+ * message for the writer when its sequence is pos + 1.
+ */
+struct async_slot {
+    atomic_size_t sequence;
+    message_handler_func handler;
+    int err;
+    size_t length;
+    char *message;
+    char text[MESSAGE_ASYNC_TEXT];
+};
+
+/* The queue and its configuration, set by message_async_start. */
+static struct async_slot *async_slots;
+static size_t async_mask;
+static enum message_async_policy async_policy;
+
+/* Next position for producers and for the writer. */
+static atomic_size_t async_head;
+static size_t async_tail;
+
+/* Counters for message_async_dropped and message_async_flush. */
+static atomic_ulong async_dropped;
+static atomic_ulong async_queued;
+static atomic_ulong async_written;
+
+/* Thread state and the mechanism for waking the writer. */
+static atomic_bool async_running;
+static atomic_size_t async_producers;
+static atomic_bool async_stopping;
+static atomic_bool async_waiting;
+static pthread_t async_thread;
+static pthread_mutex_t async_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t async_cond = PTHREAD_COND_INITIALIZER;
+static bool async_atexit = false;
+
+/* Called when the queue is empty, protected by async_lock. */
+static void (*async_idle)(void) = NULL;
+
+
+/*
+ * Call a handler with a format and arguments.  Used to pass an
+ * already-formatted message to a handler.
+ */
+static void __attribute__((__format__(printf, 4, 5)))
+async_call(message_handler_func handler, size_t len, int err, const char *fmt,
+           ...)
+{
+    va_list args;
+
+    va_start(args, fmt);
+    (*handler)(len, fmt, args, err);
+    va_end(args);
+}
+
+
+/*
+ * Wake the writer thread if it's asleep.  The sequentially consistent load of
+ * async_waiting pairs with the store in async_wait so that either the writer
+ * sees the new message or we see that it is waiting.
+ */
+static void
+async_wake(void)
+{
+    if (atomic_load(&async_waiting)) {
+        pthread_mutex_lock(&async_lock);
+        pthread_cond_signal(&async_cond);
+        pthread_mutex_unlock(&async_lock);
+    }
+}
+
+
+/*
+ * Try to add a message to the queue.  Returns false if the queue is full.
+ */
+static bool __attribute__((__format__(printf, 3, 0)))
+async_enqueue(message_handler_func handler, size_t len, const char *fmt,
+              va_list args, int err)
+{
+    struct async_slot *slot;
+    size_t pos, sequence;
+    va_list args_copy;
+    int status;
+
+    /* Claim a slot. */
+    pos = atomic_load_explicit(&async_head, memory_order_relaxed);
+    for (;;) {
+        slot = &async_slots[pos & async_mask];
+        sequence =
+            atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        if (sequence == pos) {
+            if (atomic_compare_exchange_weak_explicit(
+                    &async_head, &pos, pos + 1, memory_order_relaxed,
+                    memory_order_relaxed))
+                break;
+        } else if ((ptrdiff_t) (sequence - pos) < 0)
+            return false;
+        else
+            pos = atomic_load_explicit(&async_head, memory_order_relaxed);
+    }
+
+    /* Fill it in, falling back on a truncated message if malloc fails. */
+    slot->handler = handler;
+    slot->err = err;
+    slot->message = slot->text;
+    if (len >= sizeof(slot->text)) {
+        slot->message = malloc(len + 1);
+        if (slot->message == NULL) {
+            slot->message = slot->text;
+            len = sizeof(slot->text) - 1;
+        }
+    }
+    va_copy(args_copy, args);
+    status = vsnprintf(slot->message, len + 1, fmt, args_copy);
+    va_end(args_copy);
+    if (status < 0)
+        slot->message[0] = '\0';
+    slot->length = strlen(slot->message);
+
+    /* Publish it. */
+    atomic_store_explicit(&slot->sequence, pos + 1, memory_order_release);
+    atomic_fetch_add(&async_queued, 1);
+    return true;
+}
+
+
+/*
+ * Remove one message from the queue and pass it to its handler.  Only called
+ * from the writer thread.  Returns false if the queue was empty.
+ */
+static bool
+async_dequeue(void)
+{
+    struct async_slot *slot;
+    size_t sequence;
+
+    slot = &async_slots[async_tail & async_mask];
+    sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+    if (sequence != async_tail + 1)
+        return false;
+    async_call(slot->handler, slot->length, slot->err, "%s", slot->message);
+    if (slot->message != slot->text)
+        free(slot->message);
+    atomic_store_explicit(&slot->sequence, async_tail + async_mask + 1,
+                          memory_order_release);
+    async_tail++;
+    atomic_fetch_add(&async_written, 1);
+    return true;
+}
+
+
+/*
+ * Sleep until a producer wakes us.  Check the queue again after announcing
+ * that we're waiting to avoid missing a message added in between.
+ */
+static void
+async_wait(void)
+{
+    struct async_slot *slot;
+
+    pthread_mutex_lock(&async_lock);
+    atomic_store(&async_waiting, true);
+    slot = &async_slots[async_tail & async_mask];
+    if (atomic_load(&slot->sequence) != async_tail + 1
+        && !atomic_load(&async_stopping))
+        pthread_cond_wait(&async_cond, &async_lock);
+    atomic_store(&async_waiting, false);
+    pthread_mutex_unlock(&async_lock);
+}
+
+
+/*
+ * Call the idle function, if any.  Don't hold the lock while calling it so
+ * that producers waking the writer don't wait for it.
+ */
+static void
+async_call_idle(void)
+{
+    void (*idle)(void);
+
+    pthread_mutex_lock(&async_lock);
+    idle = async_idle;
+    pthread_mutex_unlock(&async_lock);
+    if (idle != NULL)
+        (*idle)();
+}
+
+
+/*
+ * The writer thread.  Write messages until asked to stop, and then write any
+ * that are left.  Call the idle function each time the queue is emptied.
+ */
+static void *
+async_writer(void *data UNUSED)
+{
+    bool busy = false;
+
+    for (;;) {
+        if (async_dequeue()) {
+            busy = true;
+            continue;
+        }
+        if (busy) {
+            async_call_idle();
+            busy = false;
+            continue;
+        }
+        if (atomic_load(&async_stopping))
+            break;
+        async_wait();
+    }
+    while (async_dequeue())
+        ;
+    async_call_idle();
+    return NULL;
+}
+
+
+/*
+ * Start the writer thread.
+ */
+bool
+message_async_start(size_t slots, enum message_async_policy policy)
+{
+    size_t size, i;
+
+    if (atomic_load(&async_running)) {
+        errno = EBUSY;
+        return false;
+    }
+    if (slots == 0)
+        slots = MESSAGE_ASYNC_SLOTS;
+    for (size = 2; size < slots; size *= 2)
+        ;
+    async_slots = calloc(size, sizeof(struct async_slot));
+    if (async_slots == NULL)
+        return false;
+    for (i = 0; i < size; i++)
+        atomic_init(&async_slots[i].sequence, i);
+    async_mask = size - 1;
+    async_policy = policy;
+    atomic_store(&async_head, 0);
+    async_tail = 0;
+    atomic_store(&async_dropped, 0);
+    atomic_store(&async_queued, 0);
+    atomic_store(&async_written, 0);
+    atomic_store(&async_stopping, false);
+    errno = pthread_create(&async_thread, NULL, async_writer, NULL);
+    if (errno != 0) {
+        free(async_slots);
+        async_slots = NULL;
+        return false;
+    }
+    if (!async_atexit) {
+        atexit(message_async_flush);
+        async_atexit = true;
+    }
+    atomic_store(&async_running, true);
+    return true;
+}
+
+
+/*
+ * Stop the writer thread after it writes all queued messages.  If called
+ * from the writer thread itself (such as by a handler calling die), just
+ * stop accepting new messages, since the thread can't be joined.
+ *
+ * Once async_running is false, new producers call their handlers directly,
+ * but producers that saw it true may still be adding messages, so wait for
+ * them before telling the writer to finish.  The sequentially consistent
+ * accesses pair with those in message_async_vlog.
+ */
+void
+message_async_stop(void)
+{
+    struct timespec delay = {0, 100000};
+
+    if (!atomic_load(&async_running))
+        return;
+    atomic_store(&async_running, false);
+    if (pthread_equal(pthread_self(), async_thread))
+        return;
+    while (atomic_load(&async_producers) > 0)
+        nanosleep(&delay, NULL);
+    pthread_mutex_lock(&async_lock);
+    atomic_store(&async_stopping, true);
+    pthread_cond_signal(&async_cond);
+    pthread_mutex_unlock(&async_lock);
+    pthread_join(async_thread, NULL);
+    free(async_slots);
+    async_slots = NULL;
+}
+
+
+/*
+ * Wait until all messages queued before this call have been written.  This is
+ * also called at exit.  The writer thread can't wait for itself, so if called
+ * from a handler (such as one calling exit), do nothing.
+ */
+void
+message_async_flush(void)
+{
+    struct timespec delay = {0, 1000000};
+    unsigned long queued;
+
+    if (!atomic_load(&async_running))
+        return;
+    if (pthread_equal(pthread_self(), async_thread))
+        return;
+    queued = atomic_load(&async_queued);
+    while (atomic_load(&async_written) < queued) {
+        pthread_mutex_lock(&async_lock);
+        pthread_cond_signal(&async_cond);
+        pthread_mutex_unlock(&async_lock);
+        nanosleep(&delay, NULL);
+    }
+}
+
+
+/*
+ * Return the number of dropped messages.
+ */
+unsigned long
+message_async_dropped(void)
+{
+    return atomic_load(&async_dropped);
+}
+
+
+/*
+ * Set the function called when the queue is empty.
+ */
+void
+message_async_idle(void (*idle)(void))
+{
+    pthread_mutex_lock(&async_lock);
+    async_idle = idle;
+    pthread_mutex_unlock(&async_lock);
+}
+
+
+/*
+ * Queue a message for the writer thread, applying the policy if the queue is
+ * full, or call the handler directly if the writer isn't running.  While
+ * blocking, fall back on calling the handler directly if the writer is
+ * stopped or if this is the writer thread, since otherwise nothing would
+ * empty the queue.
+ *
+ * Count this thread as a producer before checking whether the writer is
+ * running so that message_async_stop either sees the count or we see that the
+ * writer has been stopped.
+ */
+void
+message_async_vlog(message_handler_func handler, size_t len, const char *fmt,
+                   va_list args, int err)
+{
+    struct timespec delay = {0, 100000};
+
+    atomic_fetch_add(&async_producers, 1);
+    if (!atomic_load(&async_running)) {
+        atomic_fetch_sub(&async_producers, 1);
+        (*handler)(len, fmt, args, err);
+        return;
+    }
+    while (!async_enqueue(handler, len, fmt, args, err)) {
+        if (async_policy == MESSAGE_ASYNC_DROP) {
+            atomic_fetch_add(&async_dropped, 1);
+            atomic_fetch_sub(&async_producers, 1);
+            return;
+        }
+        if (!atomic_load(&async_running)
+            || pthread_equal(pthread_self(), async_thread)) {
+            atomic_fetch_sub(&async_producers, 1);
+            (*handler)(len, fmt, args, err);
+            return;
+        }
+        async_wake();
+        nanosleep(&delay, NULL);
+    }
+    async_wake();
+    atomic_fetch_sub(&async_producers, 1);
+}
+
+#else /* !MESSAGE_ASYNC */
+
+bool
+message_async_start(size_t slots UNUSED,
+                    enum message_async_policy policy UNUSED)
+{
+    errno = ENOSYS;
+    return false;
+}
+
+void
+message_async_stop(void)
+{
+}
+
+void
+message_async_flush(void)
+{
+}
+
+unsigned long
+message_async_dropped(void)
+{
+    return 0;
+}
+
+void
+message_async_idle(void (*idle)(void) UNUSED)
+{
+}
+
+void
+message_async_vlog(message_handler_func handler, size_t len, const char *fmt,
+                   va_list args, int err)
+{
+    (*handler)(len, fmt, args, err);
+}
+
+#endif /* !MESSAGE_ASYNC */
+
+
+/*
+ * Generate the asynchronous versions of the standard handlers.
+ */
+/* clang-format off */
+#define ASYNC_FUNCTION(name)                                                \
+    void                                                                    \
+    message_log_async_ ## name(size_t l, const char *f, va_list a, int e)   \
+    {                                                                       \
+        message_async_vlog(message_log_ ## name, l, f, a, e);               \
+    }
+ASYNC_FUNCTION(stdout)
+ASYNC_FUNCTION(stderr)
+ASYNC_FUNCTION(syslog_debug)
+ASYNC_FUNCTION(syslog_info)
+ASYNC_FUNCTION(syslog_notice)
+ASYNC_FUNCTION(syslog_warning)
+ASYNC_FUNCTION(syslog_err)
+ASYNC_FUNCTION(syslog_crit)
+/* clang-format on */
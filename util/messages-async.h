@@ -0,0 +1,127 @@
+/*
+ * Prototypes for asynchronous message handlers.
+ *
+ * The canonical version of this file is maintained in the rra-c-util package,
+ * which can be found at <https://www.eyrie.org/~eagle/software/rra-c-util/>.
+ *
+ * Written by Russ Allbery <eagle@eyrie.org>
+ * Copyright 2024 Russ Allbery <eagle@eyrie.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef UTIL_MESSAGES_ASYNC_H
+#define UTIL_MESSAGES_ASYNC_H 1
+
+#include <config.h>
+#include <portable/macros.h>
+#include <portable/stdbool.h>
+
+#include <stdarg.h>
+#include <stddef.h>
+
+#include <util/messages.h>
+
+/* What to do with a message if the queue is full. */
+enum message_async_policy {
+    MESSAGE_ASYNC_DROP, /* Discard the message and count it as dropped. */
+    MESSAGE_ASYNC_BLOCK /* Wait for the writer thread to make room. */
+};
+
+BEGIN_DECLS
+
+/* Default to a hidden visibility for all util functions. */
+#pragma GCC visibility push(hidden)
+
+/*
+ * Start the background writer thread with a queue that holds the given number
+ * of messages (rounded up to a power of two, or a default if zero).  Returns
+ * false and sets errno if the thread couldn't be started, including if
+ * asynchronous logging isn't supported on this platform, in which case the
+ * asynchronous handlers log synchronously.  Registers message_async_flush
+ * with atexit the first time it is called so that queued messages are written
+ * before exit, including after die.
+ */
+bool message_async_start(size_t slots, enum message_async_policy);
+
+/*
+ * Write all queued messages and stop the writer thread.  After this, the
+ * asynchronous handlers log synchronously until message_async_start is called
+ * again.  Other threads may still be logging; this waits for any that are in
+ * the middle of queuing a message.  Does nothing if the thread isn't running.
+ */
+void message_async_stop(void);
+
+/* Wait until every message queued so far has been written. */
+void message_async_flush(void);
+
+/* Return the number of messages dropped because the queue was full. */
+unsigned long message_async_dropped(void);
+
+/*
+ * Set a function for the writer thread to call whenever it has written every
+ * queued message, before waiting for more, or NULL for none.  This allows
+ * handlers that batch their output, such as the datagram syslog handlers, to
+ * send the batch once the writer has caught up.
+ */
+void message_async_idle(void (*)(void));
+
+/*
+ * Queue a message to be passed to the given handler by the writer thread.
+ * The message is formatted on the calling thread.  This is the building block
+ * for asynchronous versions of other handlers, which can be written as:
+ *
+ *     static void
+ *     my_handler_async(size_t len, const char *fmt, va_list args, int err)
+ *     {
+ *         message_async_vlog(my_handler, len, fmt, args, err);
+ *     }
+ */
+void message_async_vlog(message_handler_func, size_t, const char *, va_list,
+                        int) __attribute__((__format__(printf, 3, 0)));
+
+/*
+ * Asynchronous versions of the handlers provided by util/messages, intended
+ * to be passed to message_handlers_*.
+ */
+void message_log_async_stdout(size_t, const char *, va_list, int)
+    __attribute__((__format__(printf, 2, 0), __nonnull__));
+void message_log_async_stderr(size_t, const char *, va_list, int)
+    __attribute__((__format__(printf, 2, 0), __nonnull__));
+void message_log_async_syslog_debug(size_t, const char *, va_list, int)
+    __attribute__((__format__(printf, 2, 0), __nonnull__));
+void message_log_async_syslog_info(size_t, const char *, va_list, int)
+    __attribute__((__format__(printf, 2, 0), __nonnull__));
+void message_log_async_syslog_notice(size_t, const char *, va_list, int)
+    __attribute__((__format__(printf, 2, 0), __nonnull__));
+void message_log_async_syslog_warning(size_t, const char *, va_list, int)
+    __attribute__((__format__(printf, 2, 0), __nonnull__));
+void message_log_async_syslog_err(size_t, const char *, va_list, int)
+    __attribute__((__format__(printf, 2, 0), __nonnull__));
+void message_log_async_syslog_crit(size_t, const char *, va_list, int)
+    __attribute__((__format__(printf, 2, 0), __nonnull__));
+
+/* Undo default visibility change. */
+#pragma GCC visibility pop
+
+END_DECLS
+
+#endif /* UTIL_MESSAGES_ASYNC_H */
@@ -0,0 +1,613 @@
+/*
+ * Structured key/value event logging.
+ *
+ * Usage:
+ *
+ *     message_handlers_event(1, message_event_logfmt);
+ *     message_event(MESSAGE_WARNING, "connection failed", 2,
+ *                   kv_string("host", host), kv_int("port", port));
+ *
+ * The message functions in util/messages only accept a printf-style format,
+ * so programs that want to index their logs have to parse the text again.
+ * Events instead carry a fixed message and a list of typed fields, which are
+ * collected into an array without any formatting.  Each handler formats the
+ * event in its own way, and if the event's level is filtered out or there are
+ * no handlers, nothing is formatted at all.
+ *
+ * The handlers build their output in a buffer on the stack, falling back on
+ * malloc if the event doesn't fit, so that each event is written with a
+ * single system call.  If malloc fails, the output is truncated.
+ *
+ * The canonical version of this file is maintained in the rra-c-util package,
+ * which can be found at <https://www.eyrie.org/~eagle/software/rra-c-util/>.
+ *
+ * Written by Russ Allbery <eagle@eyrie.org>
+ * Copyright 2024 Russ Allbery <eagle@eyrie.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <config.h>
+#include <portable/socket.h>
+#include <portable/socket-unix.h>
+#include <portable/system.h>
+
+#include <ctype.h>
+#include <errno.h>
+#include <math.h>
+#ifdef HAVE_C11_ATOMICS
+#    include <stdatomic.h>
+#endif
+
+#include <util/fdflag.h>
+#include <util/messages-kv.h>
+#include <util/messages.h>
+#include <util/xmalloc.h>
+#include <util/xwrite.h>
+
+/* The default path to the journald native protocol socket. */
+#define JOURNALD_PATH "/run/systemd/journal/socket"
+
+/* Size of the output buffer on the stack. */
+#define KV_BUFSIZ 1024
+
+/*
+ * The handler list, replaced with the MESSAGE_LIST_* macros from
+ * util/messages so that it can be changed while other threads are logging.
+ */
+#ifdef HAVE_C11_ATOMICS
+static _Atomic(message_event_func *) event_handlers = NULL;
+static atomic_int event_level = MESSAGE_INFO;
+#    define LEVEL_LOAD() \
+        atomic_load_explicit(&event_level, memory_order_relaxed)
+#else
+static message_event_func *event_handlers = NULL;
+static int event_level = MESSAGE_INFO;
+#    define LEVEL_LOAD() event_level
+#endif
+
+/* The journald socket, opened by message_event_journald_open. */
+static int journald_fd = -1;
+
+/* Output being built by a handler. */
+struct kv_output {
+    char *data;
+    size_t used;
+    size_t size;
+    char stack[KV_BUFSIZ];
+};
+
+/* The key of a field, with a NULL key treated as a single underscore. */
+#define FIELD_KEY(field) ((field)->key == NULL ? "_" : (field)->key)
+
+/* Names of the levels, indexed by level. */
+static const char *const level_names[] = {
+    "emerg", "alert", "crit", "err", "warning", "notice", "info", "debug"};
+
+
+/*
+ * Set the event handlers.
+ */
+void
+message_handlers_event(unsigned int count, ...)
+{
+    message_event_func *handlers;
+    va_list args;
+    unsigned int i;
+
+    handlers = message_table_new((count + 1) * sizeof(message_event_func));
+    va_start(args, count);
+    for (i = 0; i < count; i++)
+        handlers[i] = va_arg(args, message_event_func);
+    va_end(args);
+    handlers[count] = NULL;
+    MESSAGE_LIST_REPLACE(event_handlers, handlers);
+}
+
+
+/*
+ * Remove all event handlers and free all replaced handler lists.
+ */
+void
+message_handlers_event_reset(void)
+{
+    MESSAGE_LIST_REPLACE(event_handlers, NULL);
+    message_tables_free();
+}
+
+
+/*
+ * Set the least severe level that is logged.
+ */
+enum message_level
+message_event_level(enum message_level level)
+{
+#ifdef HAVE_C11_ATOMICS
+    return (enum message_level) atomic_exchange(&event_level, (int) level);
+#else
+    enum message_level old = (enum message_level) event_level;
+
+    event_level = (int) level;
+    return old;
+#endif
+}
+
+
+/*
+ * Return the handlers to call for an event at the given level, or NULL if the
+ * event should be discarded.  If handlers are returned, the handler tables
+ * are held, and the caller must call message_tables_release when done.
+ */
+static message_event_func *
+event_wanted(enum message_level level)
+{
+    message_event_func *list;
+
+    if ((int) level > LEVEL_LOAD())
+        return NULL;
+    message_tables_hold();
+    list = MESSAGE_LIST_LOAD(event_handlers);
+    if (list == NULL || list[0] == NULL) {
+        message_tables_release();
+        return NULL;
+    }
+    return list;
+}
+
+
+/*
+ * Log an event with an array of fields.
+ */
+void
+message_eventv(enum message_level level, const char *message,
+               const struct message_kv *fields, size_t count)
+{
+    message_event_func *list;
+
+    list = event_wanted(level);
+    if (list == NULL)
+        return;
+    for (; *list != NULL; list++)
+        (*list)(level, message, fields, count);
+    message_tables_release();
+}
+
+
+/*
+ * Log an event with fields passed as arguments, collecting them into an
+ * array on the stack.
+ */
+void
+message_event(enum message_level level, const char *message,
+              unsigned int count, ...)
+{
+    struct message_kv fields[MESSAGE_EVENT_MAX_FIELDS];
+    struct message_kv field;
+    message_event_func *list;
+    va_list args;
+    size_t i, n = 0;
+
+    list = event_wanted(level);
+    if (list == NULL)
+        return;
+    va_start(args, count);
+    for (i = 0; i < count; i++) {
+        field = va_arg(args, struct message_kv);
+        if (n < MESSAGE_EVENT_MAX_FIELDS)
+            fields[n++] = field;
+    }
+    va_end(args);
+    for (; *list != NULL; list++)
+        (*list)(level, message, fields, n);
+    message_tables_release();
+}
+
+
+/*
+ * Initialize and free an output buffer.
+ */
+static void
+out_init(struct kv_output *out)
+{
+    out->data = out->stack;
+    out->used = 0;
+    out->size = sizeof(out->stack);
+}
+
+static void
+out_free(struct kv_output *out)
+{
+    if (out->data != out->stack)
+        free(out->data);
+}
+
+
+/*
+ * Append data to an output buffer, moving it to the heap if it doesn't fit.
+ * Uses malloc rather than xmalloc since failures would be reported through
+ * the logging functions.  If the allocation fails, the output is truncated.
+ */
+static void
+out_append(struct kv_output *out, const char *data, size_t length)
+{
+    size_t size;
+    char *p;
+
+    if (length > out->size - out->used) {
+        size = out->size * 2;
+        if (size < out->used + length)
+            size = out->used + length;
+        if (out->data == out->stack) {
+            p = malloc(size);
+            if (p != NULL)
+                memcpy(p, out->data, out->used);
+        } else
+            p = realloc(out->data, size);
+        if (p == NULL)
+            length = out->size - out->used;
+        else {
+            out->data = p;
+            out->size = size;
+        }
+    }
+    memcpy(out->data + out->used, data, length);
+    out->used += length;
+}
+
+static void
+out_string(struct kv_output *out, const char *string)
+{
+    out_append(out, string, strlen(string));
+}
+
+static void
+out_char(struct kv_output *out, char c)
+{
+    out_append(out, &c, 1);
+}
+
+
+/*
+ * Append a number or boolean value.  Non-finite doubles are written as null
+ * for JSON and as their usual printf representation otherwise.
+ */
+static void
+out_value(struct kv_output *out, const struct message_kv *field, bool json)
+{
+    char buffer[64];
+
+    switch (field->type) {
+    case MESSAGE_KV_INT:
+        snprintf(buffer, sizeof(buffer), "%lld", field->value.integer);
+        break;
+    case MESSAGE_KV_UINT:
+        snprintf(buffer, sizeof(buffer), "%llu", field->value.uinteger);
+        break;
+    case MESSAGE_KV_DOUBLE:
+        if (json && !isfinite(field->value.number))
+            strcpy(buffer, "null");
+        else
+            snprintf(buffer, sizeof(buffer), "%.17g", field->value.number);
+        break;
+    case MESSAGE_KV_BOOL:
+        strcpy(buffer, field->value.boolean ? "true" : "false");
+        break;
+    case MESSAGE_KV_STRING:
+    default:
+        buffer[0] = '\0';
+        break;
+    }
+    out_string(out, buffer);
+}
+
+
+/*
+ * Append a string in double quotes, escaping quotes, backslashes, and control
+ * characters the way JSON does.  logfmt uses the same escapes.
+ */
+static void
+out_quoted(struct kv_output *out, const char *string)
+{
+    const unsigned char *p;
+    char buffer[8];
+
+    out_char(out, '"');
+    for (p = (const unsigned char *) string; *p != '\0'; p++) {
+        switch (*p) {
+        case '"':
+            out_append(out, "\\\"", 2);
+            break;
+        case '\\':
+            out_append(out, "\\\\", 2);
+            break;
+        case '\n':
+            out_append(out, "\\n", 2);
+            break;
+        case '\r':
+            out_append(out, "\\r", 2);
+            break;
+        case '\t':
+            out_append(out, "\\t", 2);
+            break;
+        default:
+            if (*p < 0x20) {
+                snprintf(buffer, sizeof(buffer), "\\u%04x", *p);
+                out_string(out, buffer);
+            } else
+                out_char(out, (char) *p);
+            break;
+        }
+    }
+    out_char(out, '"');
+}
+
+
+/*
+ * Append a logfmt value, quoting it only if needed.
+ */
+static void
+out_logfmt_string(struct kv_output *out, const char *string)
+{
+    const unsigned char *p;
+
+    if (string == NULL)
+        return;
+    if (string[0] == '\0') {
+        out_append(out, "\"\"", 2);
+        return;
+    }
+    for (p = (const unsigned char *) string; *p != '\0'; p++)
+        if (*p <= ' ' || *p == '=' || *p == '"' || *p == '\\' || *p == 0x7f) {
+            out_quoted(out, string);
+            return;
+        }
+    out_string(out, string);
+}
+
+
+/*
+ * Append a logfmt key.  Keys can't be quoted, so replace any character that
+ * would need quoting in a value with an underscore.
+ */
+static void
+out_logfmt_key(struct kv_output *out, const char *key)
+{
+    const unsigned char *p = (const unsigned char *) key;
+
+    if (key[0] == '\0') {
+        out_char(out, '_');
+        return;
+    }
+    for (; *p != '\0'; p++)
+        if (*p <= ' ' || *p == '=' || *p == '"' || *p == '\\' || *p == 0x7f)
+            out_char(out, '_');
+        else
+            out_char(out, (char) *p);
+}
+
+
+/*
+ * Write a line to standard error and free the output buffer.
+ */
+static void
+out_write(struct kv_output *out)
+{
+    out_char(out, '\n');
+    xwrite(STDERR_FILENO, out->data, out->used);
+    out_free(out);
+}
+
+
+/*
+ * Log an event in logfmt format.
+ */
+void
+message_event_logfmt(enum message_level level, const char *message,
+                     const struct message_kv *fields, size_t count)
+{
+    struct kv_output out;
+    size_t i;
+
+    out_init(&out);
+    out_string(&out, "level=");
+    out_string(&out, level_names[level & 7]);
+    out_string(&out, " msg=");
+    out_logfmt_string(&out, message);
+    for (i = 0; i < count; i++) {
+        out_char(&out, ' ');
+        out_logfmt_key(&out, FIELD_KEY(&fields[i]));
+        out_char(&out, '=');
+        if (fields[i].type == MESSAGE_KV_STRING)
+            out_logfmt_string(&out, fields[i].value.string);
+        else
+            out_value(&out, &fields[i], false);
+    }
+    out_write(&out);
+}
+
+
+/*
+ * Log an event as a JSON object on one line.
+ */
+void
+message_event_json(enum message_level level, const char *message,
+                   const struct message_kv *fields, size_t count)
+{
+    struct kv_output out;
+    size_t i;
+
+    out_init(&out);
+    out_string(&out, "{\"level\":\"");
+    out_string(&out, level_names[level & 7]);
+    out_string(&out, "\",\"msg\":");
+    out_quoted(&out, message);
+    for (i = 0; i < count; i++) {
+        out_char(&out, ',');
+        out_quoted(&out, FIELD_KEY(&fields[i]));
+        out_char(&out, ':');
+        if (fields[i].type != MESSAGE_KV_STRING)
+            out_value(&out, &fields[i], true);
+        else if (fields[i].value.string == NULL)
+            out_string(&out, "null");
+        else
+            out_quoted(&out, fields[i].value.string);
+    }
+    out_char(&out, '}');
+    out_write(&out);
+}
+
+
+/*
+ * Connect to the journald socket.
+ */
+bool
+message_event_journald_open(const char *path)
+{
+    struct sockaddr_un addr;
+    int fd, oerrno;
+
+    if (path == NULL)
+        path = JOURNALD_PATH;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return false;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, path, strlen(path) + 1);
+    fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+    if (fd < 0)
+        return false;
+    fdflag_close_exec(fd, true);
+    if (connect(fd, (struct sockaddr *) &addr, (socklen_t) SUN_LEN(&addr))
+        < 0) {
+        oerrno = errno;
+        close(fd);
+        errno = oerrno;
+        return false;
+    }
+    message_event_journald_close();
+    journald_fd = fd;
+    return true;
+}
+
+
+/*
+ * Close the journald socket.
+ */
+void
+message_event_journald_close(void)
+{
+    if (journald_fd >= 0) {
+        close(journald_fd);
+        journald_fd = -1;
+    }
+}
+
+
+/*
+ * Append a journald field name, converting the key to upper case, replacing
+ * invalid characters with underscores, and removing leading underscores and
+ * digits (leading underscores are reserved for trusted fields).  Returns
+ * false if nothing is left of the key.
+ */
+static bool
+out_journald_key(struct kv_output *out, const char *key)
+{
+    const unsigned char *p = (const unsigned char *) key;
+
+    while (*p == '_' || isdigit(*p))
+        p++;
+    if (*p == '\0')
+        return false;
+    for (; *p != '\0'; p++)
+        if (isalnum(*p))
+            out_char(out, (char) toupper(*p));
+        else
+            out_char(out, '_');
+    return true;
+}
+
+
+/*
+ * Append a journald field value.  Values containing newlines use the binary
+ * form: a newline, the length as a little-endian 64-bit number, the value,
+ * and a newline.  Other values follow an equal sign and end in a newline.
+ */
+static void
+out_journald_value(struct kv_output *out, const char *value)
+{
+    unsigned char length[8];
+    uint64_t size;
+    size_t i;
+
+    if (strchr(value, '\n') == NULL) {
+        out_char(out, '=');
+        out_string(out, value);
+    } else {
+        size = strlen(value);
+        for (i = 0; i < 8; i++)
+            length[i] = (unsigned char) ((size >> (8 * i)) & 0xff);
+        out_char(out, '\n');
+        out_append(out, (const char *) length, sizeof(length));
+        out_string(out, value);
+    }
+    out_char(out, '\n');
+}
+
+
+/*
+ * Send an event to journald.  Errors are ignored.
+ */
+void
+message_event_journald(enum message_level level, const char *message,
+                       const struct message_kv *fields, size_t count)
+{
+    struct kv_output out, value;
+    char buffer[16];
+    size_t i;
+
+    if (journald_fd < 0)
+        return;
+    out_init(&out);
+    out_string(&out, "MESSAGE");
+    out_journald_value(&out, message);
+    snprintf(buffer, sizeof(buffer), "%d", (int) level);
+    out_string(&out, "PRIORITY");
+    out_journald_value(&out, buffer);
+    for (i = 0; i < count; i++) {
+        if (!out_journald_key(&out, FIELD_KEY(&fields[i])))
+            continue;
+        if (fields[i].type == MESSAGE_KV_STRING)
+            out_journald_value(&out, fields[i].value.string == NULL
+                                         ? ""
+                                         : fields[i].value.string);
+        else {
+            out_init(&value);
+            out_value(&value, &fields[i], false);
+            out_char(&value, '\0');
+            out_journald_value(&out, value.data);
+            out_free(&value);
+        }
+    }
+    send(journald_fd, out.data, out.used, 0);
+    out_free(&out);
+}
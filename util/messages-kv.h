@@ -0,0 +1,171 @@
+/*
+ * Prototypes for structured key/value event logging.
+ *
+ * The canonical version of this file is maintained in the rra-c-util package,
+ * which can be found at <https://www.eyrie.org/~eagle/software/rra-c-util/>.
+ *
+ * Written by Russ Allbery <eagle@eyrie.org>
+ * Copyright 2024 Russ Allbery <eagle@eyrie.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef UTIL_MESSAGES_KV_H
+#define UTIL_MESSAGES_KV_H 1
+
+#include <config.h>
+#include <portable/macros.h>
+#include <portable/stdbool.h>
+
+#include <stddef.h>
+
+/*
+ * Event levels.  These have the same values as the corresponding syslog
+ * priorities, so lower values are more severe.
+ */
+enum message_level {
+    MESSAGE_CRIT = 2,
+    MESSAGE_ERR = 3,
+    MESSAGE_WARNING = 4,
+    MESSAGE_NOTICE = 5,
+    MESSAGE_INFO = 6,
+    MESSAGE_DEBUG = 7
+};
+
+/* The type of the value of a field. */
+enum message_kv_type {
+    MESSAGE_KV_STRING,
+    MESSAGE_KV_INT,
+    MESSAGE_KV_UINT,
+    MESSAGE_KV_DOUBLE,
+    MESSAGE_KV_BOOL
+};
+
+/*
+ * A field of an event.  The key and any string value are not copied and must
+ * remain valid until the event function returns.  A NULL key is treated as a
+ * single underscore by every handler.  A NULL string value is logged as an
+ * empty string in logfmt and as null in JSON.
+ */
+struct message_kv {
+    const char *key;
+    enum message_kv_type type;
+    union {
+        const char *string;
+        long long integer;
+        unsigned long long uinteger;
+        double number;
+        bool boolean;
+    } value;
+};
+
+/* Construct fields for passing to message_event. */
+#define kv_string(k, v) \
+    ((struct message_kv){(k), MESSAGE_KV_STRING, {.string = (v)}})
+#define kv_int(k, v) \
+    ((struct message_kv){(k), MESSAGE_KV_INT, {.integer = (v)}})
+#define kv_uint(k, v) \
+    ((struct message_kv){(k), MESSAGE_KV_UINT, {.uinteger = (v)}})
+#define kv_double(k, v) \
+    ((struct message_kv){(k), MESSAGE_KV_DOUBLE, {.number = (v)}})
+#define kv_bool(k, v) \
+    ((struct message_kv){(k), MESSAGE_KV_BOOL, {.boolean = (v)}})
+
+/*
+ * The type of an event handler.  Takes the level, the message, and an array
+ * of fields with its length.
+ */
+typedef void (*message_event_func)(enum message_level, const char *,
+                                   const struct message_kv *, size_t);
+
+/* The maximum number of fields that can be passed to message_event. */
+#define MESSAGE_EVENT_MAX_FIELDS 32
+
+BEGIN_DECLS
+
+/* Default to a hidden visibility for all util functions. */
+#pragma GCC visibility push(hidden)
+
+/*
+ * Log an event with a level, a message (which is not a format), and count
+ * fields constructed with the kv_* macros.  If the level is less severe than
+ * the level set with message_event_level or there are no handlers, returns
+ * immediately without looking at the fields.  Fields past
+ * MESSAGE_EVENT_MAX_FIELDS are ignored.
+ */
+void message_event(enum message_level, const char *message, unsigned int count,
+                   ...) __attribute__((__nonnull__(2)));
+
+/* The same, but with an array of fields. */
+void message_eventv(enum message_level, const char *message,
+                    const struct message_kv *, size_t count)
+    __attribute__((__nonnull__(2)));
+
+/*
+ * Set the least severe level that is logged.  The default is MESSAGE_INFO.
+ * Returns the previous setting.
+ */
+enum message_level message_event_level(enum message_level);
+
+/*
+ * Set the event handlers, taking a count and then that many handlers.  As
+ * with message_handlers_*, handlers are swapped atomically where C11 atomics
+ * are available and replaced lists are freed by message_handlers_event_reset.
+ * That also frees the lists replaced by message_handlers_* and must not be
+ * called while other threads may be logging.  There are no event handlers by
+ * default.
+ */
+void message_handlers_event(unsigned int count, ...);
+void message_handlers_event_reset(void);
+
+/*
+ * Handlers that write one line per event to standard error in logfmt format
+ * (level=warning msg="..." key=value) or as a JSON object.  Each line is
+ * written with a single write.  In logfmt, spaces, equal signs, quotes,
+ * backslashes, and control characters in keys are replaced with underscores
+ * and an empty key is written as a single underscore.
+ */
+void message_event_logfmt(enum message_level, const char *,
+                          const struct message_kv *, size_t);
+void message_event_json(enum message_level, const char *,
+                        const struct message_kv *, size_t);
+
+/*
+ * Connect to the journald native protocol socket at path (the standard
+ * systemd path if NULL), returning false and setting errno on failure, and
+ * close it again.  message_event_journald sends events to that socket with
+ * the message as MESSAGE, the level as PRIORITY, and each field with its key
+ * converted to upper case, any characters other than letters, digits, and
+ * underscores replaced with underscores, and leading underscores and digits
+ * removed.  Fields whose keys are left empty, including NULL keys, are
+ * skipped.
+ */
+bool message_event_journald_open(const char *path);
+void message_event_journald_close(void);
+void message_event_journald(enum message_level, const char *,
+                            const struct message_kv *, size_t);
+
+/* Undo default visibility change. */
+#pragma GCC visibility pop
+
+END_DECLS
+
+#endif /* UTIL_MESSAGES_KV_H */
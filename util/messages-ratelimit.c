@@ -0,0 +1,364 @@
+/*
+ * Rate-limited message handlers.
+ *
+ * Usage:
+ *
+ *     message_ratelimit_config(5, 10000);
+ *     message_handlers_warn(1, message_log_ratelimit_syslog_warning);
+ *     for (i = 0; i < 1000; i++)
+ *         warn("client sent garbage");
+ *
+ * A misbehaving client can make a daemon log the same warning thousands of
+ * times a second.  These handlers sit in front of any other handler and pass
+ * each distinct message through a token bucket: a message may be logged a
+ * burst of times, after which it is allowed again at a steady rate and the
+ * rest are counted.  When a suppressed message is next allowed, a summary
+ * with the number of suppressed messages is logged first.
+ *
+ * util/messages passes these handlers the original format and arguments, so
+ * messages are identified by the address of their format string along with
+ * the handler that would log them and the errno value, and suppressed
+ * messages are never formatted.  A message whose format is just "%s" is also
+ * identified by the string argument, since that format is shared by many
+ * unrelated messages.  The state is kept in a fixed-size table indexed by a
+ * hash of that key, checking a few neighboring slots.  If they're all in use
+ * by other messages, the least recently seen one is replaced, logging its
+ * summary if any messages were suppressed.
+ *
+ * If POSIX threads are available, the table is protected by a mutex, which is
+ * not held while calling the real handler.
+ *
+ * The canonical version of this file is maintained in the rra-c-util package,
+ * which can be found at <https://www.eyrie.org/~eagle/software/rra-c-util/>.
+ *
+ * Written by Russ Allbery <eagle@eyrie.org>
+ * Copyright 2024 Russ Allbery <eagle@eyrie.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <config.h>
+#include <portable/system.h>
+
+#ifdef HAVE_PTHREAD
+#    include <pthread.h>
+#endif
+#include <time.h>
+
+#include <util/messages-ratelimit.h>
+#include <util/messages.h>
+
+/* Number of slots in the table of messages. */
+#define RATELIMIT_SLOTS 256
+
+/* Number of slots checked for a message, starting at its hash. */
+#define RATELIMIT_PROBE 4
+
+/* Length of the message text kept for comparison and summaries. */
+#define RATELIMIT_TEXT 128
+
+/* State for one message. */
+struct ratelimit_entry {
+    message_handler_func handler; /* NULL if the slot is unused. */
+    int err;
+    const char *format;
+    unsigned long hash;
+    double tokens;
+    struct timespec last;     /* When tokens was last updated. */
+    unsigned long suppressed; /* Messages suppressed since last allowed. */
+    char text[RATELIMIT_TEXT];  /* Last allowed message, for summaries. */
+};
+
+/* A summary to log after releasing the lock. */
+struct ratelimit_summary {
+    message_handler_func handler;
+    int err;
+    unsigned long count;
+    char text[RATELIMIT_TEXT];
+};
+
+/* The configuration and the table of messages. */
+static unsigned int ratelimit_burst = 10;
+static unsigned long ratelimit_interval = 5000;
+static struct ratelimit_entry ratelimit_table[RATELIMIT_SLOTS];
+
+#ifdef HAVE_PTHREAD
+static pthread_mutex_t ratelimit_lock = PTHREAD_MUTEX_INITIALIZER;
+#    define LOCK()   pthread_mutex_lock(&ratelimit_lock)
+#    define UNLOCK() pthread_mutex_unlock(&ratelimit_lock)
+#else
+#    define LOCK()   /* empty */
+#    define UNLOCK() /* empty */
+#endif
+
+
+/*
+ * Call a handler with a format and arguments.
+ */
+static void __attribute__((__format__(printf, 4, 5)))
+ratelimit_call(message_handler_func handler, size_t len, int err,
+               const char *fmt, ...)
+{
+    va_list args;
+
+    va_start(args, fmt);
+    (*handler)(len, fmt, args, err);
+    va_end(args);
+}
+
+
+/*
+ * Log a summary of suppressed messages, if there were any.
+ */
+static void
+ratelimit_summarize(const struct ratelimit_summary *summary)
+{
+    char buffer[RATELIMIT_TEXT + 64];
+    int length;
+
+    if (summary->count == 0)
+        return;
+    length = snprintf(buffer, sizeof(buffer),
+                      "%lu similar messages suppressed: %s", summary->count,
+                      summary->text);
+    if (length < 0)
+        return;
+    if ((size_t) length >= sizeof(buffer))
+        length = sizeof(buffer) - 1;
+    ratelimit_call(summary->handler, (size_t) length, summary->err, "%s",
+                   buffer);
+}
+
+
+/*
+ * Set the rate limit and discard the current state.
+ */
+void
+message_ratelimit_config(unsigned int burst, unsigned long interval)
+{
+    LOCK();
+    ratelimit_burst = burst;
+    ratelimit_interval = (interval == 0) ? 1 : interval;
+    memset(ratelimit_table, 0, sizeof(ratelimit_table));
+    UNLOCK();
+}
+
+
+/*
+ * Log summaries for all suppressed messages and discard the state.  The lock
+ * can't be held while calling handlers, so copy out one summary at a time.
+ */
+void
+message_ratelimit_flush(void)
+{
+    struct ratelimit_summary summary;
+    size_t i;
+
+    for (i = 0; i < RATELIMIT_SLOTS; i++) {
+        LOCK();
+        summary.handler = ratelimit_table[i].handler;
+        summary.err = ratelimit_table[i].err;
+        summary.count = ratelimit_table[i].suppressed;
+        memcpy(summary.text, ratelimit_table[i].text, RATELIMIT_TEXT);
+        memset(&ratelimit_table[i], 0, sizeof(ratelimit_table[i]));
+        UNLOCK();
+        if (summary.handler != NULL)
+            ratelimit_summarize(&summary);
+    }
+}
+
+
+/*
+ * Hash some bytes into an FNV-1a hash.
+ */
+static unsigned long
+ratelimit_hash(unsigned long hash, const void *data, size_t length)
+{
+    const unsigned char *p = data;
+    size_t i;
+
+    for (i = 0; i < length; i++)
+        hash = ((hash ^ p[i]) * 16777619UL) & 0xffffffffUL;
+    return hash;
+}
+
+
+/*
+ * Find the entry for a message, or take over an unused slot or the least
+ * recently seen one if there isn't one, saving any summary of the previous
+ * message in evicted.  Must be called with the lock held.
+ */
+static struct ratelimit_entry *
+ratelimit_find(message_handler_func handler, int err, const char *format,
+               const char *text, unsigned long hash,
+               struct ratelimit_summary *evicted)
+{
+    struct ratelimit_entry *entry, *oldest;
+    size_t i;
+
+    oldest = NULL;
+    for (i = 0; i < RATELIMIT_PROBE; i++) {
+        entry = &ratelimit_table[(hash + i) % RATELIMIT_SLOTS];
+        if (entry->handler == handler && entry->err == err
+            && entry->format == format && entry->hash == hash
+            && (text == NULL || strcmp(entry->text, text) == 0))
+            return entry;
+        if (entry->handler == NULL) {
+            oldest = entry;
+            break;
+        }
+        if (oldest == NULL || entry->last.tv_sec < oldest->last.tv_sec
+            || (entry->last.tv_sec == oldest->last.tv_sec
+                && entry->last.tv_nsec < oldest->last.tv_nsec))
+            oldest = entry;
+    }
+    entry = oldest;
+    evicted->handler = entry->handler;
+    evicted->err = entry->err;
+    evicted->count = entry->suppressed;
+    memcpy(evicted->text, entry->text, RATELIMIT_TEXT);
+    entry->handler = handler;
+    entry->err = err;
+    entry->format = format;
+    entry->hash = hash;
+    entry->tokens = (double) ratelimit_burst;
+    entry->suppressed = 0;
+    entry->text[0] = '\0';
+    if (text != NULL) {
+        strncpy(entry->text, text, RATELIMIT_TEXT - 1);
+        entry->text[RATELIMIT_TEXT - 1] = '\0';
+    }
+    return entry;
+}
+
+
+/*
+ * Pass a message to a handler if its rate limit allows.
+ */
+void
+message_ratelimit_vlog(message_handler_func handler, size_t len,
+                       const char *fmt, va_list args, int err)
+{
+    struct ratelimit_entry *entry;
+    struct ratelimit_summary evicted, pending;
+    struct timespec now;
+    va_list args_copy;
+    const char *text = NULL;
+    unsigned long hash;
+    double elapsed;
+    bool allowed;
+    size_t i;
+
+    /*
+     * Identify the message by the handler, the errno value, and the format,
+     * hashed with FNV-1a.  If the format is only "%s", the message is its
+     * argument, so add that.
+     */
+    hash = ratelimit_hash(2166136261UL, &handler, sizeof(handler));
+    hash = ratelimit_hash(hash, &err, sizeof(err));
+    hash = ratelimit_hash(hash, &fmt, sizeof(fmt));
+    if (strcmp(fmt, "%s") == 0) {
+        va_copy(args_copy, args);
+        text = va_arg(args_copy, const char *);
+        va_end(args_copy);
+        if (text == NULL)
+            text = "";
+        for (i = 0; i < RATELIMIT_TEXT - 1 && text[i] != '\0'; i++)
+            ;
+        hash = ratelimit_hash(hash, text, i);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    LOCK();
+    if (ratelimit_burst == 0) {
+        UNLOCK();
+        (*handler)(len, fmt, args, err);
+        return;
+    }
+    evicted.count = 0;
+    entry = ratelimit_find(handler, err, fmt, text, hash, &evicted);
+    if (entry->tokens < (double) ratelimit_burst) {
+        elapsed = (double) (now.tv_sec - entry->last.tv_sec) * 1000.0
+                  + (double) (now.tv_nsec - entry->last.tv_nsec) / 1000000.0;
+        entry->tokens += elapsed * (double) ratelimit_burst
+                         / (double) ratelimit_interval;
+        if (entry->tokens > (double) ratelimit_burst)
+            entry->tokens = (double) ratelimit_burst;
+    }
+    entry->last = now;
+
+    /* Take a token if there is one, and otherwise count the message. */
+    pending.count = 0;
+    allowed = (entry->tokens >= 1.0);
+    if (allowed) {
+        entry->tokens -= 1.0;
+        pending.handler = handler;
+        pending.err = err;
+        pending.count = entry->suppressed;
+        if (pending.count > 0)
+            memcpy(pending.text, entry->text, RATELIMIT_TEXT);
+        entry->suppressed = 0;
+    } else
+        entry->suppressed++;
+    UNLOCK();
+
+    /*
+     * Log any summaries and then the message.  The text of an allowed message
+     * is saved for the summary of any later suppressed ones, which is only
+     * done here so that suppressed messages are never formatted.
+     */
+    ratelimit_summarize(&evicted);
+    if (allowed) {
+        ratelimit_summarize(&pending);
+        if (text == NULL) {
+            va_copy(args_copy, args);
+            if (vsnprintf(pending.text, RATELIMIT_TEXT, fmt, args_copy) < 0)
+                pending.text[0] = '\0';
+            va_end(args_copy);
+            LOCK();
+            if (entry->handler == handler && entry->format == fmt
+                && entry->err == err)
+                memcpy(entry->text, pending.text, RATELIMIT_TEXT);
+            UNLOCK();
+        }
+        (*handler)(len, fmt, args, err);
+    }
+}
+
+
+/*
+ * Generate the rate-limited versions of the standard handlers.
+ */
+/* clang-format off */
+#define RATELIMIT_FUNCTION(name)                                              \
+    void                                                                      \
+    message_log_ratelimit_ ## name(size_t l, const char *f, va_list a, int e) \
+    {                                                                         \
+        message_ratelimit_vlog(message_log_ ## name, l, f, a, e);             \
+    }
+RATELIMIT_FUNCTION(stderr)
+RATELIMIT_FUNCTION(syslog_debug)
+RATELIMIT_FUNCTION(syslog_info)
+RATELIMIT_FUNCTION(syslog_notice)
+RATELIMIT_FUNCTION(syslog_warning)
+RATELIMIT_FUNCTION(syslog_err)
+RATELIMIT_FUNCTION(syslog_crit)
+/* clang-format on */
@@ -0,0 +1,109 @@
+/*
+ * Prototypes for rate-limited message handlers.
+ *
+ * The canonical version of this file is maintained in the rra-c-util package,
+ * which can be found at <https://www.eyrie.org/~eagle/software/rra-c-util/>.
+ *
+ * Written by Russ Allbery <eagle@eyrie.org>
+ * Copyright 2024 Russ Allbery <eagle@eyrie.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef UTIL_MESSAGES_RATELIMIT_H
+#define UTIL_MESSAGES_RATELIMIT_H 1
+
+#include <config.h>
+#include <portable/macros.h>
+
+#include <stdarg.h>
+#include <stddef.h>
+
+#include <util/messages.h>
+
+BEGIN_DECLS
+
+/* Default to a hidden visibility for all util functions. */
+#pragma GCC visibility push(hidden)
+
+/*
+ * Set the rate limit: each distinct message may be logged burst times, after
+ * which it is allowed again at a rate of burst per interval milliseconds.
+ * The default is 10 messages per 5000 milliseconds.  Setting burst to 0 turns
+ * off rate limiting.  Discards the current state without summaries, so call
+ * message_ratelimit_flush first if needed.
+ */
+void message_ratelimit_config(unsigned int burst, unsigned long interval);
+
+/*
+ * Pass a message to the given handler unless it has been logged too often.
+ * Messages are considered the same if the same handler is logging with the
+ * same format string (compared by address) and the same errno value, or, if
+ * the format is "%s", the same text.  Suppressed messages aren't formatted by
+ * this function, but the message functions still compute the length of every
+ * message, and format it once if the list also has one of the handlers in
+ * util/messages.  When a message that had been suppressed is next allowed,
+ * the handler is first passed a summary of the form "N similar messages
+ * suppressed: <message>" using the last message that was allowed.  This is
+ * the building block for rate-limited versions of other handlers, which can
+ * be written as:
+ *
+ *     static void
+ *     my_handler_limited(size_t len, const char *fmt, va_list args, int err)
+ *     {
+ *         message_ratelimit_vlog(my_handler, len, fmt, args, err);
+ *     }
+ */
+void message_ratelimit_vlog(message_handler_func, size_t, const char *,
+                            va_list, int)
+    __attribute__((__format__(printf, 3, 0)));
+
+/*
+ * Log summaries for all messages that have been suppressed since they were
+ * last allowed and forget all rate limiting state.  Useful before exiting.
+ */
+void message_ratelimit_flush(void);
+
+/*
+ * Rate-limited versions of the handlers provided by util/messages, intended
+ * to be passed to message_handlers_*.
+ */
+void message_log_ratelimit_stderr(size_t, const char *, va_list, int)
+    __attribute__((__format__(printf, 2, 0), __nonnull__));
+void message_log_ratelimit_syslog_debug(size_t, const char *, va_list, int)
+    __attribute__((__format__(printf, 2, 0), __nonnull__));
+void message_log_ratelimit_syslog_info(size_t, const char *, va_list, int)
+    __attribute__((__format__(printf, 2, 0), __nonnull__));
+void message_log_ratelimit_syslog_notice(size_t, const char *, va_list, int)
+    __attribute__((__format__(printf, 2, 0), __nonnull__));
+void message_log_ratelimit_syslog_warning(size_t, const char *, va_list, int)
+    __attribute__((__format__(printf, 2, 0), __nonnull__));
+void message_log_ratelimit_syslog_err(size_t, const char *, va_list, int)
+    __attribute__((__format__(printf, 2, 0), __nonnull__));
+void message_log_ratelimit_syslog_crit(size_t, const char *, va_list, int)
+    __attribute__((__format__(printf, 2, 0), __nonnull__));
+
+/* Undo default visibility change. */
+#pragma GCC visibility pop
+
+END_DECLS
+
+#endif /* UTIL_MESSAGES_RATELIMIT_H */
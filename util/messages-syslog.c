@@ -0,0 +1,490 @@
+/*
+ * Datagram syslog message handlers.
+ *
+ * Usage:
+ *
+ *     message_syslog_open(NULL, "program", LOG_DAEMON,
+ *                         MESSAGE_SYSLOG_RFC3164);
+ *     message_handlers_warn(1, message_log_dgram_warning);
+ *     warn("this goes straight to /dev/log");
+ *
+ * The syslog handlers in util/messages call the C library syslog function,
+ * which takes a global lock, formats the timestamp with strftime for each
+ * message, and may reconnect to the syslog socket.  These handlers instead
+ * keep their own connected datagram socket and build each message into a
+ * reusable buffer.  The timestamp is only reformatted when the second
+ * changes, and the rest of the header is built when the socket is opened.
+ *
+ * Messages may optionally be batched and sent with a single sendmmsg call,
+ * which is most useful with the asynchronous handlers in util/messages-async:
+ * the writer thread batches messages while there is a backlog and flushes
+ * the batch when it has caught up.
+ *
+ * If POSIX threads are available, the state is protected by a mutex, which
+ * is uncontended when the handlers are only called from one writer thread.
+ *
+ * The canonical version of this file is maintained in the rra-c-util package,
+ * which can be found at <https://www.eyrie.org/~eagle/software/rra-c-util/>.
+ *
+ * Written by Russ Allbery <eagle@eyrie.org>
+ * Copyright 2024 Russ Allbery <eagle@eyrie.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <config.h>
+#include <portable/socket.h>
+#include <portable/socket-unix.h>
+#include <portable/system.h>
+
+#include <errno.h>
+#ifdef HAVE_PTHREAD
+#    include <pthread.h>
+#endif
+#include <sys/uio.h>
+#ifdef HAVE_SYSLOG_H
+#    include <syslog.h>
+#endif
+#include <time.h>
+
+#include <util/fdflag.h>
+#include <util/messages-syslog.h>
+
+/* The default path to the syslog socket. */
+#define MESSAGE_SYSLOG_PATH "/dev/log"
+
+/* The maximum length of one message, including the header. */
+#define MESSAGE_SYSLOG_MAX 8192
+
+/*
+ * The maximum number of messages and total bytes in a batch.  The number of
+ * messages is kept below the default Linux limit of ten queued datagrams on
+ * a Unix domain socket so that sending a batch rarely blocks.
+ */
+#define MESSAGE_SYSLOG_BATCH 8
+#define MESSAGE_SYSLOG_BYTES (MESSAGE_SYSLOG_BATCH * 4096)
+
+/* Socket and configuration, set by message_syslog_open. */
+static int syslog_fd = -1;
+static char *syslog_path = NULL;
+static enum message_syslog_format syslog_format;
+static int syslog_facility;
+
+/*
+ * The constant part of the header after the timestamp, such as "ident[pid]: "
+ * for RFC 3164 or " host ident pid - - " for RFC 5424.
+ */
+static char *syslog_tail = NULL;
+static size_t syslog_tail_len;
+
+/*
+ * The timestamp to the second, and the second it was formatted for.  The
+ * buffer is large enough for any values of the struct tm fields, so the
+ * timestamp is never truncated.
+ */
+static char syslog_stamp[80];
+static size_t syslog_stamp_len;
+static time_t syslog_stamp_time = -1;
+
+/* Buffer holding the messages of the current batch, one after another. */
+static char *syslog_buffer = NULL;
+static size_t syslog_used = 0;
+static struct iovec syslog_iov[MESSAGE_SYSLOG_BATCH];
+static size_t syslog_count = 0;
+static bool syslog_batching = false;
+
+#ifdef HAVE_PTHREAD
+static pthread_mutex_t syslog_lock = PTHREAD_MUTEX_INITIALIZER;
+#    define LOCK()   pthread_mutex_lock(&syslog_lock)
+#    define UNLOCK() pthread_mutex_unlock(&syslog_lock)
+#else
+#    define LOCK()   /* empty */
+#    define UNLOCK() /* empty */
+#endif
+
+/* Month abbreviations for RFC 3164 timestamps, independent of locale. */
+static const char *const months[] = {"Jan", "Feb", "Mar", "Apr",
+                                     "May", "Jun", "Jul", "Aug",
+                                     "Sep", "Oct", "Nov", "Dec"};
+
+
+/*
+ * Create a socket and connect it to syslog_path.  Returns the file descriptor
+ * or -1 on failure, preserving errno.
+ */
+static int
+syslog_connect(void)
+{
+    struct sockaddr_un addr;
+    int fd, oerrno;
+
+    if (strlen(syslog_path) >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, syslog_path, strlen(syslog_path) + 1);
+    fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+    if (fd < 0)
+        return -1;
+    fdflag_close_exec(fd, true);
+    if (connect(fd, (struct sockaddr *) &addr, (socklen_t) SUN_LEN(&addr))
+        < 0) {
+        oerrno = errno;
+        close(fd);
+        errno = oerrno;
+        return -1;
+    }
+    return fd;
+}
+
+
+/*
+ * Replace the socket after an error that indicates the syslog daemon has gone
+ * away, such as when it has been restarted.  Returns true if the socket was
+ * reconnected and the send should be retried.
+ */
+static bool
+syslog_reconnect(int error)
+{
+    int fd;
+
+    if (error != ECONNREFUSED && error != ENOTCONN && error != ENOENT)
+        return false;
+    fd = syslog_connect();
+    if (fd < 0)
+        return false;
+    close(syslog_fd);
+    syslog_fd = fd;
+    return true;
+}
+
+
+/*
+ * Send the messages in the current batch and empty it.  Messages that can't
+ * be sent are discarded.  Must be called with the lock held.
+ */
+static void
+syslog_send(void)
+{
+    size_t sent = 0;
+    bool retried = false;
+#ifdef HAVE_SENDMMSG
+    struct mmsghdr msgs[MESSAGE_SYSLOG_BATCH];
+    size_t i;
+    int status;
+
+    memset(msgs, 0, sizeof(msgs));
+    for (i = 0; i < syslog_count; i++) {
+        msgs[i].msg_hdr.msg_iov = &syslog_iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    while (sent < syslog_count) {
+        status = sendmmsg(syslog_fd, msgs + sent,
+                          (unsigned int) (syslog_count - sent), 0);
+        if (status > 0)
+            sent += (size_t) status;
+        else if (status < 0 && errno == EINTR)
+            continue;
+        else if (status < 0 && !retried && syslog_reconnect(errno))
+            retried = true;
+        else
+            break;
+    }
+#else
+    ssize_t status;
+
+    while (sent < syslog_count) {
+        status = send(syslog_fd, syslog_iov[sent].iov_base,
+                      syslog_iov[sent].iov_len, 0);
+        if (status >= 0)
+            sent++;
+        else if (errno == EINTR)
+            continue;
+        else if (!retried && syslog_reconnect(errno))
+            retried = true;
+        else
+            sent++;
+    }
+#endif
+    syslog_count = 0;
+    syslog_used = 0;
+}
+
+
+/*
+ * Format the timestamp into syslog_stamp if the second has changed, and
+ * return the number of microseconds for RFC 5424.
+ */
+static long
+syslog_timestamp(void)
+{
+    struct timespec now;
+    struct tm tm;
+    int status;
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    if (now.tv_sec == syslog_stamp_time)
+        return now.tv_nsec / 1000;
+    if (syslog_format == MESSAGE_SYSLOG_RFC5424) {
+        gmtime_r(&now.tv_sec, &tm);
+        status = snprintf(syslog_stamp, sizeof(syslog_stamp),
+                          "%04d-%02d-%02dT%02d:%02d:%02d", tm.tm_year + 1900,
+                          tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min,
+                          tm.tm_sec);
+    } else {
+        localtime_r(&now.tv_sec, &tm);
+        status = snprintf(syslog_stamp, sizeof(syslog_stamp),
+                          "%s %2d %02d:%02d:%02d ", months[tm.tm_mon],
+                          tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec);
+    }
+    if (status < 0 || (size_t) status >= sizeof(syslog_stamp))
+        status = 0;
+    syslog_stamp_len = (size_t) status;
+    syslog_stamp_time = now.tv_sec;
+    return now.tv_nsec / 1000;
+}
+
+
+/*
+ * Close the socket and free the buffers.  Must be called with the lock held.
+ */
+static void
+syslog_close(void)
+{
+    if (syslog_fd < 0)
+        return;
+    if (syslog_count > 0)
+        syslog_send();
+    close(syslog_fd);
+    syslog_fd = -1;
+    free(syslog_path);
+    syslog_path = NULL;
+    free(syslog_tail);
+    syslog_tail = NULL;
+    free(syslog_buffer);
+    syslog_buffer = NULL;
+}
+
+
+/*
+ * Open the syslog socket and build the constant part of the message header.
+ */
+bool
+message_syslog_open(const char *path, const char *ident, int facility,
+                    enum message_syslog_format format)
+{
+    char hostname[256];
+    int status;
+    int oerrno;
+
+    if (path == NULL)
+        path = MESSAGE_SYSLOG_PATH;
+    LOCK();
+    syslog_close();
+    syslog_path = strdup(path);
+    syslog_buffer = malloc(MESSAGE_SYSLOG_BYTES);
+    if (format == MESSAGE_SYSLOG_RFC5424) {
+        if (gethostname(hostname, sizeof(hostname)) < 0)
+            hostname[0] = '\0';
+        hostname[sizeof(hostname) - 1] = '\0';
+        if (hostname[0] == '\0')
+            memcpy(hostname, "-", 2);
+        status = asprintf(&syslog_tail, " %s %s %ld - - ", hostname, ident,
+                          (long) getpid());
+    } else
+        status = asprintf(&syslog_tail, "%s[%ld]: ", ident, (long) getpid());
+    if (status < 0)
+        syslog_tail = NULL;
+    if (syslog_path == NULL || syslog_buffer == NULL || syslog_tail == NULL)
+        goto fail;
+    syslog_tail_len = (size_t) status;
+    syslog_fd = syslog_connect();
+    if (syslog_fd < 0)
+        goto fail;
+    syslog_format = format;
+    syslog_facility = facility;
+    syslog_stamp_time = -1;
+    UNLOCK();
+    return true;
+
+fail:
+    oerrno = errno;
+    free(syslog_path);
+    syslog_path = NULL;
+    free(syslog_buffer);
+    syslog_buffer = NULL;
+    free(syslog_tail);
+    syslog_tail = NULL;
+    UNLOCK();
+    errno = oerrno;
+    return false;
+}
+
+
+/*
+ * Close the socket, sending any batched messages.
+ */
+void
+message_syslog_close(void)
+{
+    LOCK();
+    syslog_close();
+    UNLOCK();
+}
+
+
+/*
+ * Turn batching on or off, sending the batch when turning it off.
+ */
+void
+message_syslog_batch(bool batch)
+{
+    LOCK();
+    syslog_batching = batch;
+    if (!batch && syslog_fd >= 0 && syslog_count > 0)
+        syslog_send();
+    UNLOCK();
+}
+
+
+/*
+ * Send any batched messages.
+ */
+void
+message_syslog_flush(void)
+{
+    LOCK();
+    if (syslog_fd >= 0 && syslog_count > 0)
+        syslog_send();
+    UNLOCK();
+}
+
+
+/*
+ * Log a message to the syslog socket.  This is a helper function used to
+ * implement all of the datagram message handlers.  It takes the same
+ * arguments as a regular message handler function but with an additional
+ * priority argument.  The message is built directly in the batch buffer and
+ * truncated if it's longer than MESSAGE_SYSLOG_MAX.
+ */
+static void __attribute__((__format__(printf, 3, 0)))
+message_log_dgram(int pri, size_t len, const char *fmt, va_list args, int err)
+{
+    char *start, *p;
+    const char *error = NULL;
+    size_t need, left, length;
+    long usec;
+    int status;
+
+    LOCK();
+    if (syslog_fd < 0) {
+        UNLOCK();
+        return;
+    }
+
+    /* Make sure there is room for the message, sending the batch if not. */
+    if (err != 0)
+        error = strerror(err);
+    need = 64 + syslog_stamp_len + syslog_tail_len + len;
+    if (error != NULL)
+        need += 2 + strlen(error);
+    if (need > MESSAGE_SYSLOG_MAX)
+        need = MESSAGE_SYSLOG_MAX;
+    if (syslog_count > 0
+        && (syslog_count == MESSAGE_SYSLOG_BATCH
+            || syslog_used + need > MESSAGE_SYSLOG_BYTES))
+        syslog_send();
+    start = syslog_buffer + syslog_used;
+    left = MESSAGE_SYSLOG_BYTES - syslog_used;
+    if (left > MESSAGE_SYSLOG_MAX)
+        left = MESSAGE_SYSLOG_MAX;
+
+    /*
+     * Build the header.  The timestamp and constant part always fit since the
+     * buffer holds at least one maximum-length message.
+     */
+    usec = syslog_timestamp();
+    p = start;
+    status = snprintf(p, left, "<%d>%s", syslog_facility | pri,
+                      syslog_format == MESSAGE_SYSLOG_RFC5424 ? "1 " : "");
+    p += status;
+    memcpy(p, syslog_stamp, syslog_stamp_len);
+    p += syslog_stamp_len;
+    if (syslog_format == MESSAGE_SYSLOG_RFC5424) {
+        status = snprintf(p, left - (size_t) (p - start), ".%06ldZ", usec);
+        if (status > 0)
+            p += status;
+    }
+    length = syslog_tail_len;
+    if (length > left - (size_t) (p - start) - 1)
+        length = left - (size_t) (p - start) - 1;
+    memcpy(p, syslog_tail, length);
+    p += length;
+
+    /* Add the message and the error, if any. */
+    status = vsnprintf(p, left - (size_t) (p - start), fmt, args);
+    if (status < 0) {
+        UNLOCK();
+        return;
+    }
+    if ((size_t) status >= left - (size_t) (p - start))
+        p = start + left - 1;
+    else
+        p += status;
+    if (error != NULL) {
+        status = snprintf(p, left - (size_t) (p - start), ": %s", error);
+        if (status >= 0 && (size_t) status < left - (size_t) (p - start))
+            p += status;
+        else
+            p = start + left - 1;
+    }
+
+    /* Add the message to the batch and send it unless batching. */
+    syslog_iov[syslog_count].iov_base = start;
+    syslog_iov[syslog_count].iov_len = (size_t) (p - start);
+    syslog_count++;
+    syslog_used += (size_t) (p - start);
+    if (!syslog_batching)
+        syslog_send();
+    UNLOCK();
+}
+
+
+/*
+ * Do the same sort of wrapper to generate all of the separate datagram
+ * logging functions.
+ */
+/* clang-format off */
+#define DGRAM_FUNCTION(name, type)                                        \
+    void                                                                  \
+    message_log_dgram_ ## name(size_t l, const char *f, va_list a, int e) \
+    {                                                                     \
+        message_log_dgram(LOG_ ## type, l, f, a, e);                      \
+    }
+DGRAM_FUNCTION(debug,   DEBUG)
+DGRAM_FUNCTION(info,    INFO)
+DGRAM_FUNCTION(notice,  NOTICE)
+DGRAM_FUNCTION(warning, WARNING)
+DGRAM_FUNCTION(err,     ERR)
+DGRAM_FUNCTION(crit,    CRIT)
+/* clang-format on */
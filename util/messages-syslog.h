@@ -0,0 +1,104 @@
+/*
+ * Prototypes for datagram syslog message handlers.
+ *
+ * The canonical version of this file is maintained in the rra-c-util package,
+ * which can be found at <https://www.eyrie.org/~eagle/software/rra-c-util/>.
+ *
+ * Written by Russ Allbery <eagle@eyrie.org>
+ * Copyright 2024 Russ Allbery <eagle@eyrie.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef UTIL_MESSAGES_SYSLOG_H
+#define UTIL_MESSAGES_SYSLOG_H 1
+
+#include <config.h>
+#include <portable/macros.h>
+#include <portable/stdbool.h>
+
+#include <stdarg.h>
+#include <stddef.h>
+
+/* The format of the messages sent to the syslog socket. */
+enum message_syslog_format {
+    MESSAGE_SYSLOG_RFC3164, /* Traditional BSD format, as used by syslog. */
+    MESSAGE_SYSLOG_RFC5424  /* Structured format with a UTC timestamp. */
+};
+
+BEGIN_DECLS
+
+/* Default to a hidden visibility for all util functions. */
+#pragma GCC visibility push(hidden)
+
+/*
+ * Connect to the syslog datagram socket at path (/dev/log if NULL).  ident is
+ * included in each message in place of the program name, and facility is one
+ * of the LOG_* facility constants, such as LOG_DAEMON.  Returns false and
+ * sets errno on failure.  Replaces any previous connection.
+ *
+ * The process ID and host name are determined here, so this should be called
+ * again in the child after a fork.
+ */
+bool message_syslog_open(const char *path, const char *ident, int facility,
+                         enum message_syslog_format);
+
+/*
+ * Send any batched messages and close the socket.  The datagram handlers
+ * discard messages until message_syslog_open is called again.
+ */
+void message_syslog_close(void);
+
+/*
+ * Turn batching on or off.  While batching is on, messages are collected and
+ * sent together (with sendmmsg where available) when the batch is full or
+ * message_syslog_flush is called, so the caller must flush periodically.
+ * Turning batching off flushes the batch.  message_syslog_flush is suitable
+ * for passing to message_async_idle, which flushes whenever the asynchronous
+ * writer has caught up.
+ */
+void message_syslog_batch(bool);
+void message_syslog_flush(void);
+
+/*
+ * Handlers that send messages to the socket opened by message_syslog_open,
+ * intended to be passed to message_handlers_*.  Errors are ignored, after one
+ * attempt to reconnect if the syslog daemon has been restarted.
+ */
+void message_log_dgram_debug(size_t, const char *, va_list, int)
+    __attribute__((__format__(printf, 2, 0), __nonnull__));
+void message_log_dgram_info(size_t, const char *, va_list, int)
+    __attribute__((__format__(printf, 2, 0), __nonnull__));
+void message_log_dgram_notice(size_t, const char *, va_list, int)
+    __attribute__((__format__(printf, 2, 0), __nonnull__));
+void message_log_dgram_warning(size_t, const char *, va_list, int)
+    __attribute__((__format__(printf, 2, 0), __nonnull__));
+void message_log_dgram_err(size_t, const char *, va_list, int)
+    __attribute__((__format__(printf, 2, 0), __nonnull__));
+void message_log_dgram_crit(size_t, const char *, va_list, int)
+    __attribute__((__format__(printf, 2, 0), __nonnull__));
+
+/* Undo default visibility change. */
+#pragma GCC visibility pop
+
+END_DECLS
+
+#endif /* UTIL_MESSAGES_SYSLOG_H */
@@ -50,11 +50,29 @@
  * generates given the format and arguments), a format, an argument list as a
  * va_list, and the applicable errno value (if any).
  *
+ * The message functions format the message only once, into a buffer on the
+ * stack unless it's too long, and then call the handlers in this file with a
+ * format of "%s" and the formatted message as its only argument, so they
+ * don't need to do any expensive formatting of their own.  Other handlers are
+ * called with the original format and arguments, so that they can recognize a
+ * message by its format.
+ *
+ * Debug messages may be given a category with debug_category, and categories
+ * can be turned on and off at runtime with message_debug_enable and
+ * message_debug_disable.  DEBUG_ENABLED checks whether a category would be
+ * logged with a single load, and debug_category uses it to skip evaluating
+ * its arguments when the message would be discarded, so verbose debugging
+ * can be left in production code.
+ *
+ * The message functions don't take any locks.  Handler lists may be replaced
+ * while other threads are logging, such as from a SIGHUP handler thread, as
+ * long as C11 atomics are available.
+ *
  * The canonical version of this file is maintained in the rra-c-util package,
  * which can be found at <https://www.eyrie.org/~eagle/software/rra-c-util/>.
  *
  * Written by Russ Allbery <eagle@eyrie.org>
- * Copyright 2015-2016, 2020 Russ Allbery <eagle@eyrie.org>
+ * Copyright 2015-2016, 2020, 2024 Russ Allbery <eagle@eyrie.org>
  * Copyright 2008-2010, 2013-2014
  *     The Board of Trustees of the Leland Stanford Junior University
  * Copyright 2004-2006 Internet Systems Consortium, Inc. ("ISC")
@@ -82,6 +100,9 @@
 #include <portable/system.h>
 
 #include <errno.h>
+#ifdef HAVE_C11_ATOMICS
+#    include <stdatomic.h>
+#endif
 #ifdef HAVE_SYSLOG_H
 #    include <syslog.h>
 #endif
@@ -100,15 +121,69 @@
 #include <util/messages.h>
 #include <util/xmalloc.h>
 
+/*
+ * Handler lists are replaced RCU-style so that messages can be logged from
+ * many threads without locking while the handlers are changed.  A new list is
+ * built and then swapped in with a single atomic store, so a thread that is
+ * logging sees either the old list or the new one.  Threads using a list
+ * are counted in message_readers, and the old list is put on a list of
+ * retired tables.  Retired tables are freed the next time the count is
+ * seen to be zero after they were retired, either by the last thread to stop
+ * using a list or by the next replacement, since any thread still using one
+ * of them must have started before it was replaced.  Without C11 atomics,
+ * plain loads and stores are used.
+ *
+ * The same tables are used by other libraries with their own handler lists
+ * through message_table_new and the MESSAGE_LIST_* macros in util/messages.h.
+ */
+#ifdef HAVE_C11_ATOMICS
+typedef _Atomic(message_handler_func *) message_list;
+#else
+typedef message_handler_func *message_list;
+#endif
+
+/*
+ * A handler table allocated by message_table_new, linked once retired.  The
+ * handlers of other libraries are stored in the same space.
+ */
+struct message_table {
+    struct message_table *next;
+    message_handler_func handlers[];
+};
+
 /* The default handler lists. */
 static message_handler_func stdout_handlers[2] = {message_log_stdout, NULL};
 static message_handler_func stderr_handlers[2] = {message_log_stderr, NULL};
 
 /* The list of logging functions currently in effect. */
-static message_handler_func *debug_handlers = NULL;
-static message_handler_func *notice_handlers = stdout_handlers;
-static message_handler_func *warn_handlers = stderr_handlers;
-static message_handler_func *die_handlers = stderr_handlers;
+static message_list debug_handlers = NULL;
+static message_list notice_handlers = stdout_handlers;
+static message_list warn_handlers = stderr_handlers;
+static message_list die_handlers = stderr_handlers;
+
+/*
+ * The debug categories enabled by message_debug_enable, and the categories
+ * actually logged, which is 0 if there are no debug handlers so that
+ * DEBUG_ENABLED is a single load.
+ */
+static unsigned long debug_categories = MESSAGE_DEBUG_ALL;
+#ifdef HAVE_C11_ATOMICS
+_Atomic unsigned long message_debug_mask = 0;
+#else
+unsigned long message_debug_mask = 0;
+#endif
+
+/*
+ * Tables that have been replaced, freed by message_tables_reclaim, and the
+ * number of threads using a handler list.
+ */
+#ifdef HAVE_C11_ATOMICS
+static _Atomic(struct message_table *) retired_tables = NULL;
+static atomic_ulong message_readers = 0;
+#else
+static struct message_table *retired_tables = NULL;
+static unsigned long message_readers = 0;
+#endif
 
 /* If non-NULL, called before exit and its return value passed to exit. */
 int (*message_fatal_cleanup)(void) = NULL;
@@ -116,22 +191,188 @@ int (*message_fatal_cleanup)(void) = NULL;
 /* If non-NULL, prepended (followed by ": ") to messages. */
 const char *message_program_name = NULL;
 
+/*
+ * Messages are formatted into a buffer of this size on the stack, falling
+ * back on a heap allocation only for longer messages.
+ */
+#define MESSAGE_BUFSIZ 1024
+
+/*
+ * The format passed to the handlers in this file along with the
+ * already-formatted message.  They recognize it by address and use the
+ * message string directly instead of formatting it again.
+ */
+static const char message_passthrough[] = "%s";
+
+
+/*
+ * Recompute message_debug_mask after a change to the debug handlers or
+ * categories.
+ */
+static void
+message_debug_update(void)
+{
+    message_handler_func *list;
+    unsigned long mask = 0;
+
+    message_tables_hold();
+    list = MESSAGE_LIST_LOAD(debug_handlers);
+    if (list != NULL && list[0] != NULL)
+        mask = debug_categories;
+    message_tables_release();
+#ifdef HAVE_C11_ATOMICS
+    atomic_store_explicit(&message_debug_mask, mask, memory_order_relaxed);
+#else
+    message_debug_mask = mask;
+#endif
+}
+
+
+/*
+ * Enable or disable debug categories.
+ */
+void
+message_debug_enable(unsigned long categories)
+{
+    debug_categories |= categories;
+    message_debug_update();
+}
+
+void
+message_debug_disable(unsigned long categories)
+{
+    debug_categories &= ~categories;
+    message_debug_update();
+}
+
+
+/*
+ * Allocate a new table with room for size bytes of handlers and return a
+ * pointer to the handlers.
+ */
+void *
+message_table_new(size_t size)
+{
+    struct message_table *table;
+
+    table = xcalloc(1, sizeof(struct message_table) + size);
+    return table->handlers;
+}
+
+
+/*
+ * Free the retired tables if no thread is using a handler list.  The tables
+ * are taken off the retired list before the count is checked, so any thread
+ * still using one of them started before it was replaced and is counted.  If
+ * the count isn't zero, put them back to be freed later.
+ */
+static void
+message_tables_reclaim(void)
+{
+    struct message_table *table, *next;
+#ifdef HAVE_C11_ATOMICS
+    struct message_table *tail;
+
+    table = atomic_exchange(&retired_tables, NULL);
+    if (table == NULL)
+        return;
+    if (atomic_load(&message_readers) != 0) {
+        for (tail = table; tail->next != NULL; tail = tail->next)
+            ;
+        tail->next = atomic_load(&retired_tables);
+        while (!atomic_compare_exchange_weak(&retired_tables, &tail->next,
+                                             table))
+            ;
+        return;
+    }
+#else
+    if (message_readers != 0)
+        return;
+    table = retired_tables;
+    retired_tables = NULL;
+#endif
+    for (; table != NULL; table = next) {
+        next = table->next;
+        free(table);
+    }
+}
+
+
+/*
+ * Mark the start and end of the use of a handler list by this thread.  The
+ * last thread to stop using a handler list frees any retired tables.
+ */
+void
+message_tables_hold(void)
+{
+#ifdef HAVE_C11_ATOMICS
+    atomic_fetch_add(&message_readers, 1);
+#else
+    message_readers++;
+#endif
+}
+
+void
+message_tables_release(void)
+{
+#ifdef HAVE_C11_ATOMICS
+    if (atomic_fetch_sub(&message_readers, 1) == 1
+        && atomic_load(&retired_tables) != NULL)
+        message_tables_reclaim();
+#else
+    if (--message_readers == 0 && retired_tables != NULL)
+        message_tables_reclaim();
+#endif
+}
+
+
+/*
+ * Add a handler list that has been replaced to the retired tables unless it
+ * is one of the static default lists, and then free the retired tables if no
+ * thread is using a handler list.
+ */
+void
+message_table_retire(void *handlers)
+{
+    struct message_table *table;
+
+    if (handlers == NULL || handlers == stdout_handlers
+        || handlers == stderr_handlers)
+        return;
+    table = (struct message_table *) (void *) ((char *) handlers
+                                               - offsetof(struct message_table,
+                                                          handlers));
+#ifdef HAVE_C11_ATOMICS
+    table->next = atomic_load(&retired_tables);
+    while (!atomic_compare_exchange_weak(&retired_tables, &table->next, table))
+        ;
+#else
+    table->next = retired_tables;
+    retired_tables = table;
+#endif
+    message_tables_reclaim();
+}
+
 
 /*
  * Set the handlers for a particular message function.  Takes a pointer to the
- * handler list, the count of handlers, and the argument list.
+ * handler list, the count of handlers, and the argument list.  The new list
+ * is completely built before it is swapped in.
  */
 static void
-message_handlers(message_handler_func **list, unsigned int count, va_list args)
+message_handlers(message_list *list, unsigned int count, va_list args)
 {
+    message_handler_func *handlers;
     unsigned int i;
 
-    if (*list != stdout_handlers && *list != stderr_handlers)
-        free(*list);
-    *list = xcalloc(count + 1, sizeof(message_handler_func));
+    handlers = message_table_new((count + 1) * sizeof(message_handler_func));
     for (i = 0; i < count; i++)
-        (*list)[i] = (message_handler_func) va_arg(args, message_handler_func);
-    (*list)[count] = NULL;
+        handlers[i] =
+            (message_handler_func) va_arg(args, message_handler_func);
+    handlers[count] = NULL;
+    MESSAGE_LIST_REPLACE(*list, handlers);
+    if (list == &debug_handlers)
+        message_debug_update();
 }
 
 
@@ -159,38 +400,81 @@ HANDLER_FUNCTION(die)
 
 
 /*
- * Reset all handlers back to the defaults and free all allocated memory.
- * This is primarily useful for programs that undergo comprehensive memory
- * allocation analysis.
+ * Free all retired handler tables, whether or not they are still in use.  No
+ * other thread may be logging.
  */
 void
-message_handlers_reset(void)
+message_tables_free(void)
 {
-    free(debug_handlers);
-    debug_handlers = NULL;
-    if (notice_handlers != stdout_handlers) {
-        free(notice_handlers);
-        notice_handlers = stdout_handlers;
-    }
-    if (warn_handlers != stderr_handlers) {
-        free(warn_handlers);
-        warn_handlers = stderr_handlers;
-    }
-    if (die_handlers != stderr_handlers) {
-        free(die_handlers);
-        die_handlers = stderr_handlers;
+    struct message_table *table, *next;
+
+#ifdef HAVE_C11_ATOMICS
+    table = atomic_exchange(&retired_tables, NULL);
+#else
+    table = retired_tables;
+    retired_tables = NULL;
+#endif
+    for (; table != NULL; table = next) {
+        next = table->next;
+        free(table);
     }
 }
 
 
+/*
+ * When built for the test suite, provide a count of the retired tables that
+ * haven't been freed yet so that the tests can check that they are freed.
+ */
+#if TESTING
+size_t message_tables_retired(void);
+
+size_t
+message_tables_retired(void)
+{
+    struct message_table *table;
+    size_t count = 0;
+
+#    ifdef HAVE_C11_ATOMICS
+    table = atomic_load(&retired_tables);
+#    else
+    table = retired_tables;
+#    endif
+    for (; table != NULL; table = table->next)
+        count++;
+    return count;
+}
+#endif
+
+
+/*
+ * Reset all handlers back to the defaults and free all allocated memory,
+ * including retired handler tables.  This is primarily useful for programs
+ * that undergo comprehensive memory allocation analysis.  No other thread may
+ * be logging.
+ */
+void
+message_handlers_reset(void)
+{
+    MESSAGE_LIST_REPLACE(debug_handlers, NULL);
+    MESSAGE_LIST_REPLACE(notice_handlers, stdout_handlers);
+    MESSAGE_LIST_REPLACE(warn_handlers, stderr_handlers);
+    MESSAGE_LIST_REPLACE(die_handlers, stderr_handlers);
+    debug_categories = MESSAGE_DEBUG_ALL;
+    message_debug_update();
+    message_tables_free();
+}
+
+
 /*
  * Print a message to stdout, supporting message_program_name.
  */
 void
 message_log_stdout(size_t len UNUSED, const char *fmt, va_list args, int err)
 {
-    if (message_program_name != NULL)
-        fprintf(stdout, "%s: ", message_program_name);
+    const char *name = message_program_name;
+
+    if (name != NULL)
+        fprintf(stdout, "%s: ", name);
     vfprintf(stdout, fmt, args);
     if (err)
         fprintf(stdout, ": %s", strerror(err));
@@ -206,9 +490,11 @@ message_log_stdout(size_t len UNUSED, const char *fmt, va_list args, int err)
 void
 message_log_stderr(size_t len UNUSED, const char *fmt, va_list args, int err)
 {
+    const char *name = message_program_name;
+
     fflush(stdout);
-    if (message_program_name != NULL)
-        fprintf(stderr, "%s: ", message_program_name);
+    if (name != NULL)
+        fprintf(stderr, "%s: ", name);
     vfprintf(stderr, fmt, args);
     if (err)
         fprintf(stderr, ": %s", strerror(err));
@@ -227,20 +513,39 @@ message_log_stderr(size_t len UNUSED, const char *fmt, va_list args, int err)
 static void __attribute__((__format__(printf, 3, 0)))
 message_log_syslog(int pri, size_t len, const char *fmt, va_list args, int err)
 {
-    char *buffer;
+    char buffer[MESSAGE_BUFSIZ];
+    char *allocated = NULL;
+    const char *message;
+    char *formatted;
     int status;
 
-    buffer = malloc(len + 1);
-    if (buffer == NULL) {
-        fprintf(stderr, "failed to malloc %lu bytes at %s line %d: %s",
-                (unsigned long) len + 1, __FILE__, __LINE__, strerror(errno));
-        exit(message_fatal_cleanup ? (*message_fatal_cleanup)() : 1);
-    }
-    status = vsnprintf(buffer, len + 1, fmt, args);
-    if (status < 0 || (size_t) status >= len + 1) {
-        warn("failed to format output with vsnprintf in syslog handler");
-        free(buffer);
-        return;
+    /*
+     * If called from the message functions in this file, the message has
+     * already been formatted.  Otherwise, format it ourselves, on the stack if
+     * it fits.
+     */
+    if (fmt == message_passthrough)
+        message = va_arg(args, const char *);
+    else {
+        if (len < sizeof(buffer))
+            formatted = buffer;
+        else {
+            allocated = malloc(len + 1);
+            if (allocated == NULL) {
+                fprintf(stderr, "failed to malloc %lu bytes at %s line %d: %s",
+                        (unsigned long) len + 1, __FILE__, __LINE__,
+                        strerror(errno));
+                exit(message_fatal_cleanup ? (*message_fatal_cleanup)() : 1);
+            }
+            formatted = allocated;
+        }
+        status = vsnprintf(formatted, len + 1, fmt, args);
+        if (status < 0 || (size_t) status >= len + 1) {
+            warn("failed to format output with vsnprintf in syslog handler");
+            free(allocated);
+            return;
+        }
+        message = formatted;
     }
 #ifdef _WIN32
     {
@@ -248,17 +553,18 @@ message_log_syslog(int pri, size_t len, const char *fmt, va_list args, int err)
 
         eventlog = RegisterEventSource(NULL, message_program_name);
         if (eventlog != NULL) {
-            ReportEvent(eventlog, (WORD) pri, 0, 0, NULL, 1, 0, &buffer, NULL);
+            ReportEvent(eventlog, (WORD) pri, 0, 0, NULL, 1, 0, &message,
+                        NULL);
             CloseEventLog(eventlog);
         }
     }
 #else  /* !_WIN32 */
     if (err == 0)
-        syslog(pri, "%s", buffer);
+        syslog(pri, "%s", message);
     else
-        syslog(pri, "%s: %s", buffer, strerror(err));
+        syslog(pri, "%s: %s", message, strerror(err));
 #endif /* !_WIN32 */
-    free(buffer);
+    free(allocated);
 }
 
 
@@ -283,126 +589,206 @@ SYSLOG_FUNCTION(crit,    CRIT)
 
 
 /*
- * All of the message handlers.  There's a lot of code duplication here too,
- * but each one is still *slightly* different and va_start has to be called
- * multiple times, so it's hard to get rid of the duplication.
+ * Call a handler with a format and arguments.  Used to pass an
+ * already-formatted message to handlers that expect a format and a va_list.
+ */
+static void __attribute__((__format__(printf, 4, 5)))
+message_call(message_handler_func handler, size_t len, int err,
+             const char *fmt, ...)
+{
+    va_list args;
+
+    va_start(args, fmt);
+    (*handler)(len, fmt, args, err);
+    va_end(args);
+}
+
+
+/*
+ * Return whether a handler is one of the handlers in this file, which accept
+ * an already-formatted message.
+ */
+static bool
+message_preformatted(message_handler_func handler)
+{
+    return handler == message_log_stdout || handler == message_log_stderr
+           || handler == message_log_syslog_debug
+           || handler == message_log_syslog_info
+           || handler == message_log_syslog_notice
+           || handler == message_log_syslog_warning
+           || handler == message_log_syslog_err
+           || handler == message_log_syslog_crit;
+}
+
+
+/*
+ * Pass a message to each handler in a list.  If any of the handlers are the
+ * ones in this file, the message is formatted once into a buffer on the stack
+ * if it fits, and otherwise into memory allocated with malloc (not xmalloc,
+ * since xmalloc failures are reported via these functions), and those
+ * handlers are called with a format of "%s" and the formatted message.  This
+ * avoids formatting the message again in each handler.  Other handlers get
+ * the original format and a copy of the arguments, so if no handler can use
+ * the formatted message, only its length is computed.
+ *
+ * If the allocation fails, every handler is passed the truncated message on
+ * the stack, so that the length they're given matches what they log.  Does
+ * nothing if the message can't be formatted.
+ */
+static void __attribute__((__format__(printf, 3, 0)))
+message_dispatch_list(message_handler_func *list, int err, const char *format,
+                      va_list args)
+{
+    char buffer[MESSAGE_BUFSIZ];
+    char *message = NULL;
+    message_handler_func *log;
+    va_list args_copy;
+    bool truncated = false;
+    int length;
+
+    /* Only format the message here if some handler will use the result. */
+    for (log = list; *log != NULL; log++)
+        if (message_preformatted(*log))
+            break;
+    va_copy(args_copy, args);
+    if (*log == NULL)
+        length = vsnprintf(NULL, 0, format, args_copy);
+    else {
+        message = buffer;
+        length = vsnprintf(buffer, sizeof(buffer), format, args_copy);
+    }
+    va_end(args_copy);
+    if (length < 0)
+        return;
+    if (message != NULL && (size_t) length >= sizeof(buffer)) {
+        message = malloc((size_t) length + 1);
+        if (message == NULL) {
+            message = buffer;
+            length = sizeof(buffer) - 1;
+            truncated = true;
+        } else {
+            va_copy(args_copy, args);
+            length =
+                vsnprintf(message, (size_t) length + 1, format, args_copy);
+            va_end(args_copy);
+            if (length < 0) {
+                free(message);
+                return;
+            }
+        }
+    }
+    for (log = list; *log != NULL; log++)
+        if (message != NULL && (truncated || message_preformatted(*log)))
+            message_call(*log, (size_t) length, err, message_passthrough,
+                         message);
+        else {
+            va_copy(args_copy, args);
+            (**log)((size_t) length, format, args_copy, err);
+            va_end(args_copy);
+        }
+    if (message != NULL && message != buffer)
+        free(message);
+}
+
+
+/*
+ * Pass a message to the current handlers in a handler list, holding the
+ * handler tables so that the list isn't freed while it's being used.
+ */
+static void __attribute__((__format__(printf, 3, 0)))
+message_dispatch(message_list *handlers, int err, const char *format,
+                 va_list args)
+{
+    message_handler_func *list;
+
+    message_tables_hold();
+    list = MESSAGE_LIST_LOAD(*handlers);
+    if (list != NULL)
+        message_dispatch_list(list, err, format, args);
+    message_tables_release();
+}
+
+
+/*
+ * All of the message functions.  These are thin wrappers around
+ * message_dispatch, but each one needs its own va_start and the sys*
+ * versions have to capture errno before doing anything else.
  */
 
 void
 debug(const char *format, ...)
 {
     va_list args;
-    message_handler_func *log;
-    ssize_t length;
 
-    if (debug_handlers == NULL)
+    if (!DEBUG_ENABLED(MESSAGE_DEBUG_DEFAULT))
         return;
     va_start(args, format);
-    length = vsnprintf(NULL, 0, format, args);
+    message_dispatch(&debug_handlers, 0, format, args);
     va_end(args);
-    if (length < 0)
+}
+
+void
+message_debug_category(unsigned long category, const char *format, ...)
+{
+    va_list args;
+
+    if (!DEBUG_ENABLED(category))
         return;
-    for (log = debug_handlers; *log != NULL; log++) {
-        va_start(args, format);
-        (**log)((size_t) length, format, args, 0);
-        va_end(args);
-    }
+    va_start(args, format);
+    message_dispatch(&debug_handlers, 0, format, args);
+    va_end(args);
 }
 
 void
 notice(const char *format, ...)
 {
     va_list args;
-    message_handler_func *log;
-    ssize_t length;
 
     va_start(args, format);
-    length = vsnprintf(NULL, 0, format, args);
+    message_dispatch(&notice_handlers, 0, format, args);
     va_end(args);
-    if (length < 0)
-        return;
-    for (log = notice_handlers; *log != NULL; log++) {
-        va_start(args, format);
-        (**log)((size_t) length, format, args, 0);
-        va_end(args);
-    }
 }
 
 void
 sysnotice(const char *format, ...)
 {
     va_list args;
-    message_handler_func *log;
-    ssize_t length;
     int error = errno;
 
     va_start(args, format);
-    length = vsnprintf(NULL, 0, format, args);
+    message_dispatch(&notice_handlers, error, format, args);
     va_end(args);
-    if (length < 0)
-        return;
-    for (log = notice_handlers; *log != NULL; log++) {
-        va_start(args, format);
-        (**log)((size_t) length, format, args, error);
-        va_end(args);
-    }
 }
 
 void
 warn(const char *format, ...)
 {
     va_list args;
-    message_handler_func *log;
-    ssize_t length;
 
     va_start(args, format);
-    length = vsnprintf(NULL, 0, format, args);
+    message_dispatch(&warn_handlers, 0, format, args);
     va_end(args);
-    if (length < 0)
-        return;
-    for (log = warn_handlers; *log != NULL; log++) {
-        va_start(args, format);
-        (**log)((size_t) length, format, args, 0);
-        va_end(args);
-    }
 }
 
 void
 syswarn(const char *format, ...)
 {
     va_list args;
-    message_handler_func *log;
-    ssize_t length;
     int error = errno;
 
     va_start(args, format);
-    length = vsnprintf(NULL, 0, format, args);
+    message_dispatch(&warn_handlers, error, format, args);
     va_end(args);
-    if (length < 0)
-        return;
-    for (log = warn_handlers; *log != NULL; log++) {
-        va_start(args, format);
-        (**log)((size_t) length, format, args, error);
-        va_end(args);
-    }
 }
 
 void
 die(const char *format, ...)
 {
     va_list args;
-    message_handler_func *log;
-    ssize_t length;
 
     va_start(args, format);
-    length = vsnprintf(NULL, 0, format, args);
+    message_dispatch(&die_handlers, 0, format, args);
     va_end(args);
-    if (length >= 0)
-        for (log = die_handlers; *log != NULL; log++) {
-            va_start(args, format);
-            (**log)((size_t) length, format, args, 0);
-            va_end(args);
-        }
     exit(message_fatal_cleanup ? (*message_fatal_cleanup)() : 1);
 }
 
@@ -410,18 +796,10 @@ void
 sysdie(const char *format, ...)
 {
     va_list args;
-    message_handler_func *log;
-    ssize_t length;
     int error = errno;
 
     va_start(args, format);
-    length = vsnprintf(NULL, 0, format, args);
+    message_dispatch(&die_handlers, error, format, args);
     va_end(args);
-    if (length >= 0)
-        for (log = die_handlers; *log != NULL; log++) {
-            va_start(args, format);
-            (**log)((size_t) length, format, args, error);
-            va_end(args);
-        }
     exit(message_fatal_cleanup ? (*message_fatal_cleanup)() : 1);
 }
@@ -37,6 +37,51 @@
 
 #include <stdarg.h>
 #include <stddef.h>
+#ifdef HAVE_C11_ATOMICS
+#    include <stdatomic.h>
+#endif
+
+/*
+ * Debug categories are bits in an unsigned long chosen by the caller.  Plain
+ * debug messages use MESSAGE_DEBUG_DEFAULT.
+ */
+#define MESSAGE_DEBUG_DEFAULT 1UL
+#define MESSAGE_DEBUG_ALL     (~0UL)
+
+/*
+ * Whether debug messages in any of the given categories would be logged.
+ * This is a single load, so it can be used to guard expensive debugging code
+ * that is left compiled into production binaries.
+ */
+#ifdef HAVE_C11_ATOMICS
+#    define DEBUG_ENABLED(c)                                               \
+        ((atomic_load_explicit(&message_debug_mask, memory_order_relaxed) \
+          & (unsigned long) (c))                                          \
+         != 0)
+#else
+#    define DEBUG_ENABLED(c) ((message_debug_mask & (unsigned long) (c)) != 0)
+#endif
+
+/*
+ * Log a debug message in a category.  Where variadic macros are available,
+ * this checks DEBUG_ENABLED first, so the arguments aren't evaluated unless
+ * the message will be logged.
+ */
+#ifdef HAVE_C99_VAMACROS
+#    define debug_category(c, ...)                        \
+        do {                                              \
+            if (DEBUG_ENABLED(c))                         \
+                message_debug_category((c), __VA_ARGS__); \
+        } while (0)
+#elif HAVE_GNU_VAMACROS
+#    define debug_category(c, args...)             \
+        do {                                       \
+            if (DEBUG_ENABLED(c))                  \
+                message_debug_category((c), args); \
+        } while (0)
+#else
+#    define debug_category message_debug_category
+#endif
 
 BEGIN_DECLS
 
@@ -58,6 +103,8 @@ void warn(const char *, ...)
     __attribute__((__nonnull__, __format__(printf, 1, 2)));
 void syswarn(const char *, ...)
     __attribute__((__nonnull__, __format__(printf, 1, 2)));
+void message_debug_category(unsigned long, const char *, ...)
+    __attribute__((__nonnull__, __format__(printf, 2, 3)));
 void die(const char *, ...)
     __attribute__((__nonnull__, __noreturn__, __format__(printf, 1, 2)));
 void sysdie(const char *, ...)
@@ -66,17 +113,29 @@ void sysdie(const char *, ...)
 /*
  * Set the handlers for various message functions.  All of these functions
  * take a count of the number of handlers and then function pointers for each
- * of those handlers.  These functions are not thread-safe; they set global
- * variables.
+ * of those handlers.  If C11 atomics are available, the new handlers are
+ * swapped in atomically, so they may be changed while other threads are
+ * logging.  Replaced handler lists are freed once no thread is logging.
  */
 void message_handlers_debug(unsigned int count, ...);
 void message_handlers_notice(unsigned int count, ...);
 void message_handlers_warn(unsigned int count, ...);
 void message_handlers_die(unsigned int count, ...);
 
+/*
+ * Enable or disable debug categories.  All categories are enabled by default,
+ * but debug messages are only logged if there are debug handlers.  These may
+ * be called while other threads are logging, but not at the same time as each
+ * other or message_handlers_debug.
+ */
+void message_debug_enable(unsigned long categories);
+void message_debug_disable(unsigned long categories);
+
 /*
  * Reset all message handlers back to the defaults and free any memory that
- * was allocated by the other message_handlers_* functions.
+ * was allocated by the other message_handlers_* functions.  Unlike the other
+ * message_handlers_* functions, this must not be called while other threads
+ * may be logging.
  */
 void message_handlers_reset(void);
 
@@ -111,10 +170,50 @@ extern int (*message_fatal_cleanup)(void);
 
 /*
  * If non-NULL, prepended (followed by ": ") to all messages printed by either
- * message_log_stdout or message_log_stderr.
+ * message_log_stdout or message_log_stderr.  This should be set before other
+ * threads start logging.
  */
 extern const char *message_program_name;
 
+/*
+ * The debug categories currently logged: the enabled categories if there are
+ * any debug handlers and 0 otherwise.  Use DEBUG_ENABLED rather than reading
+ * this directly.
+ */
+#ifdef HAVE_C11_ATOMICS
+extern _Atomic unsigned long message_debug_mask;
+#else
+extern unsigned long message_debug_mask;
+#endif
+
+/*
+ * Support for other libraries with their own kinds of handlers, such as
+ * util/messages-kv, that should replace their handler lists the same way.
+ * message_table_new allocates size bytes for a new handler list.
+ * MESSAGE_LIST_LOAD reads a list and MESSAGE_LIST_REPLACE swaps in a new one,
+ * atomically if C11 atomics are available, and retires the old one with
+ * message_table_retire.  A list must only be loaded and used between calls
+ * to message_tables_hold and message_tables_release.  A retired list is freed
+ * once no thread holds the tables, by message_table_retire or by the last
+ * call to message_tables_release.  message_tables_free frees all retired
+ * lists at once and must not be called while other threads may be logging.
+ */
+void *message_table_new(size_t size)
+    __attribute__((__malloc__, __warn_unused_result__));
+void message_table_retire(void *);
+void message_tables_hold(void);
+void message_tables_release(void);
+void message_tables_free(void);
+#ifdef HAVE_C11_ATOMICS
+#    define MESSAGE_LIST_LOAD(l) atomic_load(&(l))
+#    define MESSAGE_LIST_REPLACE(l, n) \
+        message_table_retire(atomic_exchange(&(l), (n)))
+#else
+#    define MESSAGE_LIST_LOAD(l)       (l)
+#    define MESSAGE_LIST_REPLACE(l, n) \
+        (message_table_retire(l), (void) ((l) = (n)))
+#endif
+
 /* Undo default visibility change. */
 #pragma GCC visibility pop
 
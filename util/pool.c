@@ -0,0 +1,383 @@
+/*
+ * Fixed-size object pools.
+ *
+ * Usage:
+ *
+ *      struct pool *pool;
+ *      struct thing *thing;
+ *
+ *      pool = pool_new(sizeof(struct thing));
+ *      thing = pool_get(pool);
+ *      pool_put(pool, thing);
+ *      pool_free(pool);
+ *
+ * Objects are carved out of slabs of POOL_BATCH objects allocated with
+ * xmalloc, and freed objects are kept on a singly-linked free list threaded
+ * through the objects themselves.  Slabs are only returned to the system
+ * when the pool is freed.
+ *
+ * If POSIX threads are available, each thread has its own cache of free
+ * objects, found through thread-specific data.  pool_get and pool_put work
+ * only with that cache unless it is empty or has grown too large, in which
+ * case a batch of objects is moved to or from the shared free list while
+ * holding the pool lock.  When a thread exits, its cached objects are
+ * returned to the shared free list.  Without threads, there is only the
+ * shared free list and no locking.
+ *
+ * Since each pool uses a thread-specific data key, and the number of keys is
+ * limited, pools are meant to be created once and kept for the life of the
+ * program rather than created per request.
+ *
+ * The canonical version of this file is maintained in the rra-c-util package,
+ * which can be found at <https://www.eyrie.org/~eagle/software/rra-c-util/>.
+ *
+ * Written by Russ Allbery <eagle@eyrie.org>
+ * Copyright 2024 Russ Allbery <eagle@eyrie.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <config.h>
+#include <portable/system.h>
+
+#include <errno.h>
+#ifdef HAVE_PTHREAD
+#    include <pthread.h>
+#endif
+
+#include <util/messages.h>
+#include <util/pool.h>
+#include <util/xmalloc.h>
+
+/*
+ * The number of objects in a slab and the number moved between a thread's
+ * cache and the shared free list at a time.  A thread's cache is trimmed
+ * when it reaches twice this size.
+ */
+#define POOL_BATCH 32
+
+/* Used to determine the alignment of objects, which must suit any type. */
+union pool_align {
+    long double ld;
+    long long ll;
+    double d;
+    void *p;
+    void (*f)(void);
+};
+#define POOL_ALIGN sizeof(union pool_align)
+#define POOL_ROUND(s) (((s) + POOL_ALIGN - 1) & ~(POOL_ALIGN - 1))
+
+/* A free object, linked into a free list. */
+struct pool_object {
+    struct pool_object *next;
+};
+
+/* A slab of objects.  The objects start POOL_ROUND(sizeof) bytes in. */
+struct pool_slab {
+    struct pool_slab *next;
+};
+
+#ifdef HAVE_PTHREAD
+/*
+ * A per-thread cache of free objects.  All caches for a pool are kept on a
+ * doubly-linked list so that pool_free can find them.
+ */
+struct pool_cache {
+    struct pool *pool;
+    struct pool_object *head;
+    size_t count;
+    struct pool_cache *prev;
+    struct pool_cache *next;
+};
+#endif
+
+struct pool {
+    size_t size;              /* Rounded object size. */
+    struct pool_object *free; /* Shared free list. */
+    struct pool_slab *slabs;  /* All slabs allocated for the pool. */
+#ifdef HAVE_PTHREAD
+    pthread_mutex_t lock;      /* Protects free, slabs, and caches. */
+    pthread_key_t key;         /* Key for the per-thread cache. */
+    struct pool_cache *caches; /* All per-thread caches. */
+#endif
+};
+
+
+/*
+ * Take a batch of up to POOL_BATCH objects from the shared free list,
+ * allocating a new slab if it's empty, and return them as a NULL-terminated
+ * chain, storing the number of objects in count.  The caller must hold the
+ * pool lock if threads are in use.
+ */
+static struct pool_object *
+pool_take(struct pool *pool, size_t *count)
+{
+    struct pool_object *head, *object;
+    struct pool_slab *slab;
+    char *start;
+    size_t i;
+
+    if (pool->free == NULL) {
+        slab = xmalloc(POOL_ROUND(sizeof(struct pool_slab))
+                       + POOL_BATCH * pool->size);
+        slab->next = pool->slabs;
+        pool->slabs = slab;
+        start = (char *) slab + POOL_ROUND(sizeof(struct pool_slab));
+        head = NULL;
+        for (i = POOL_BATCH; i > 0; i--) {
+            object = (struct pool_object *) (void *) (start
+                                                      + (i - 1) * pool->size);
+            object->next = head;
+            head = object;
+        }
+        *count = POOL_BATCH;
+        return head;
+    }
+    head = pool->free;
+    object = head;
+    for (i = 1; i < POOL_BATCH && object->next != NULL; i++)
+        object = object->next;
+    pool->free = object->next;
+    object->next = NULL;
+    *count = i;
+    return head;
+}
+
+
+#ifdef HAVE_PTHREAD
+
+/*
+ * Return a chain of objects to the shared free list.  tail must be the last
+ * object in the chain.  The caller must hold the pool lock.
+ */
+static void
+pool_give(struct pool *pool, struct pool_object *head,
+          struct pool_object *tail)
+{
+    tail->next = pool->free;
+    pool->free = head;
+}
+
+
+/*
+ * Lock and unlock the pool, dying on failure since that indicates a bug
+ * rather than a condition that can be handled.
+ */
+static void
+pool_lock(struct pool *pool)
+{
+    errno = pthread_mutex_lock(&pool->lock);
+    if (errno != 0)
+        sysdie("cannot lock object pool");
+}
+
+static void
+pool_unlock(struct pool *pool)
+{
+    errno = pthread_mutex_unlock(&pool->lock);
+    if (errno != 0)
+        sysdie("cannot unlock object pool");
+}
+
+
+/*
+ * Destructor for the per-thread cache, called when a thread exits.  Return
+ * all cached objects to the shared free list and remove the cache from the
+ * pool.
+ */
+static void
+cache_release(void *data)
+{
+    struct pool_cache *cache = data;
+    struct pool *pool = cache->pool;
+    struct pool_object *tail;
+
+    pool_lock(pool);
+    if (cache->head != NULL) {
+        for (tail = cache->head; tail->next != NULL; tail = tail->next)
+            ;
+        pool_give(pool, cache->head, tail);
+    }
+    if (cache->prev == NULL)
+        pool->caches = cache->next;
+    else
+        cache->prev->next = cache->next;
+    if (cache->next != NULL)
+        cache->next->prev = cache->prev;
+    pool_unlock(pool);
+    free(cache);
+}
+
+
+/*
+ * Get the cache for the current thread, creating it if needed.
+ */
+static struct pool_cache *
+cache_get(struct pool *pool)
+{
+    struct pool_cache *cache;
+
+    cache = pthread_getspecific(pool->key);
+    if (cache != NULL)
+        return cache;
+    cache = xcalloc(1, sizeof(struct pool_cache));
+    cache->pool = pool;
+    pool_lock(pool);
+    cache->next = pool->caches;
+    if (pool->caches != NULL)
+        pool->caches->prev = cache;
+    pool->caches = cache;
+    pool_unlock(pool);
+    errno = pthread_setspecific(pool->key, cache);
+    if (errno != 0)
+        sysdie("cannot set object pool cache");
+    return cache;
+}
+
+#endif /* HAVE_PTHREAD */
+
+
+/*
+ * Create a new pool.  Objects must be large enough to hold the free list
+ * pointer and are rounded up to preserve alignment within a slab.
+ */
+struct pool *
+pool_new(size_t size)
+{
+    struct pool *pool;
+
+    if (size < sizeof(struct pool_object))
+        size = sizeof(struct pool_object);
+    pool = xcalloc(1, sizeof(struct pool));
+    pool->size = POOL_ROUND(size);
+#ifdef HAVE_PTHREAD
+    errno = pthread_mutex_init(&pool->lock, NULL);
+    if (errno != 0)
+        sysdie("cannot initialize object pool lock");
+    errno = pthread_key_create(&pool->key, cache_release);
+    if (errno != 0)
+        sysdie("cannot create object pool key");
+#endif
+    return pool;
+}
+
+
+/*
+ * Free a pool.  Thread-specific data destructors aren't run by
+ * pthread_key_delete, so free the caches of all threads here.
+ */
+void
+pool_free(struct pool *pool)
+{
+    struct pool_slab *slab, *next_slab;
+#ifdef HAVE_PTHREAD
+    struct pool_cache *cache, *next_cache;
+#endif
+
+    if (pool == NULL)
+        return;
+#ifdef HAVE_PTHREAD
+    pthread_key_delete(pool->key);
+    for (cache = pool->caches; cache != NULL; cache = next_cache) {
+        next_cache = cache->next;
+        free(cache);
+    }
+    pthread_mutex_destroy(&pool->lock);
+#endif
+    for (slab = pool->slabs; slab != NULL; slab = next_slab) {
+        next_slab = slab->next;
+        free(slab);
+    }
+    free(pool);
+}
+
+
+/*
+ * Get an object from the pool, refilling the thread cache (or the free list
+ * if threads aren't available) with a batch of objects if needed.
+ */
+void *
+pool_get(struct pool *pool)
+{
+    struct pool_object *object;
+#ifdef HAVE_PTHREAD
+    struct pool_cache *cache;
+
+    cache = cache_get(pool);
+    if (cache->head == NULL) {
+        pool_lock(pool);
+        cache->head = pool_take(pool, &cache->count);
+        pool_unlock(pool);
+    }
+    object = cache->head;
+    cache->head = object->next;
+    cache->count--;
+#else
+    size_t count;
+
+    if (pool->free == NULL)
+        pool->free = pool_take(pool, &count);
+    object = pool->free;
+    pool->free = object->next;
+#endif
+    memset(object, 0, pool->size);
+    return object;
+}
+
+
+/*
+ * Return an object to the pool.  If the thread cache has grown too large,
+ * move a batch of objects back to the shared free list so that a thread that
+ * only frees objects doesn't hoard them.
+ */
+void
+pool_put(struct pool *pool, void *data)
+{
+    struct pool_object *object = data;
+#ifdef HAVE_PTHREAD
+    struct pool_cache *cache;
+    struct pool_object *head, *tail;
+    size_t i;
+#endif
+
+    if (object == NULL)
+        return;
+#ifdef HAVE_PTHREAD
+    cache = cache_get(pool);
+    object->next = cache->head;
+    cache->head = object;
+    cache->count++;
+    if (cache->count >= 2 * POOL_BATCH) {
+        head = cache->head;
+        tail = head;
+        for (i = 1; i < POOL_BATCH; i++)
+            tail = tail->next;
+        cache->head = tail->next;
+        cache->count -= POOL_BATCH;
+        pool_lock(pool);
+        pool_give(pool, head, tail);
+        pool_unlock(pool);
+    }
+#else
+    object->next = pool->free;
+    pool->free = object;
+#endif
+}
@@ -0,0 +1,81 @@
+/*
+ * Prototypes for fixed-size object pools.
+ *
+ * A pool hands out objects of a single size, keeping freed objects on a free
+ * list for reuse instead of returning them to malloc.  It is intended for
+ * small structs that are created and destroyed at a high rate, such as the
+ * header structs of buffers and vectors used while handling a request.
+ *
+ * Pools are safe to use from multiple threads if POSIX threads are available.
+ * Each thread keeps a small cache of free objects so that most calls don't
+ * need to take the pool lock.
+ *
+ * The canonical version of this file is maintained in the rra-c-util package,
+ * which can be found at <https://www.eyrie.org/~eagle/software/rra-c-util/>.
+ *
+ * Written by Russ Allbery <eagle@eyrie.org>
+ * Copyright 2024 Russ Allbery <eagle@eyrie.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef UTIL_POOL_H
+#define UTIL_POOL_H 1
+
+#include <config.h>
+#include <portable/macros.h>
+
+#include <stddef.h>
+
+/* Opaque struct holding the pool state. */
+struct pool;
+
+BEGIN_DECLS
+
+/* Default to a hidden visibility for all util functions. */
+#pragma GCC visibility push(hidden)
+
+/*
+ * Free a pool and all objects allocated from it, whether or not they have
+ * been returned to the pool.  No other thread may be using the pool.
+ */
+void pool_free(struct pool *);
+
+/* Create a new pool for objects of the given size. */
+struct pool *pool_new(size_t size)
+    __attribute__((__warn_unused_result__, __malloc__(pool_free)));
+
+/*
+ * Get an object from the pool.  The object is zeroed, like memory returned by
+ * xcalloc.  Never returns NULL; allocation failures are handled as with
+ * xmalloc.
+ */
+void *pool_get(struct pool *) __attribute__((__nonnull__));
+
+/* Return an object to the pool.  The object may be NULL. */
+void pool_put(struct pool *, void *) __attribute__((__nonnull__(1)));
+
+/* Undo default visibility change. */
+#pragma GCC visibility pop
+
+END_DECLS
+
+#endif /* UTIL_POOL_H */
@@ -40,10 +40,25 @@
 #include <portable/system.h>
 
 #include <assert.h>
-
+#include <errno.h>
+#ifdef HAVE_SPAWN_H
+#    include <spawn.h>
+#endif
+#include <sys/wait.h>
+
+#include <util/fdflag.h>
+#include <util/pool.h>
 #include <util/vector.h>
 #include <util/xmalloc.h>
 
+/*
+ * posix_spawn requires an explicit environment.  unistd.h declares environ on
+ * some systems when extensions are enabled.
+ */
+#if defined(HAVE_POSIX_SPAWN) && !HAVE_DECL_ENVIRON
+extern char **environ;
+#endif
+
 
 /*
  * Allocate a new, empty vector.
@@ -71,6 +86,32 @@ cvector_new(void)
 }
 
 
+/*
+ * Allocate a new, empty vector from an object pool.
+ */
+struct vector *
+vector_pool_get(struct pool *pool)
+{
+    struct vector *vector;
+
+    vector = pool_get(pool);
+    vector->allocated = 1;
+    vector->strings = xcalloc(1, sizeof(char *));
+    return vector;
+}
+
+struct cvector *
+cvector_pool_get(struct pool *pool)
+{
+    struct cvector *vector;
+
+    vector = pool_get(pool);
+    vector->allocated = 1;
+    vector->strings = xcalloc(1, sizeof(const char *));
+    return vector;
+}
+
+
 /*
  * Resize a vector (using reallocarray to resize the table).  Maintain a
  * minimum allocated size of 1 so that the strings data element is never NULL.
@@ -196,6 +237,30 @@ cvector_free(struct cvector *vector)
 }
 
 
+/*
+ * Free a vector allocated from an object pool, returning the struct to the
+ * pool.
+ */
+void
+vector_pool_put(struct pool *pool, struct vector *vector)
+{
+    if (vector == NULL)
+        return;
+    vector_clear(vector);
+    free(vector->strings);
+    pool_put(pool, vector);
+}
+
+void
+cvector_pool_put(struct pool *pool, struct cvector *vector)
+{
+    if (vector == NULL)
+        return;
+    cvector_clear(vector);
+    free(vector->strings);
+    pool_put(pool, vector);
+}
+
 /*
  * Given a vector that we may be reusing, clear it out.  If the argument is
  * NULL, allocate a new vector.  Helper function for vector_split*.
@@ -560,3 +625,171 @@ cvector_exec(const char *path, struct cvector *vector)
     vector->strings[vector->count] = NULL;
     return execv(path, (char *const *) vector->strings);
 }
+
+
+#ifdef HAVE_POSIX_SPAWN
+
+/*
+ * Helper function for vector_spawn and cvector_spawn that does the work once
+ * the argument list is NULL-terminated.  Translate the file descriptor
+ * actions into posix_spawn file actions and start the child.  posix_spawn
+ * returns an error code rather than setting errno, so convert.
+ */
+static pid_t
+spawn(const char *path, char *const argv[], const char *const env[],
+      const struct vector_fd_action actions[], size_t count)
+{
+    posix_spawn_file_actions_t file_actions;
+    pid_t pid;
+    size_t i;
+    int status;
+
+    status = posix_spawn_file_actions_init(&file_actions);
+    if (status != 0) {
+        errno = status;
+        return -1;
+    }
+    for (i = 0; i < count && status == 0; i++)
+        switch (actions[i].type) {
+        case VECTOR_FD_DUP2:
+            status = posix_spawn_file_actions_adddup2(
+                &file_actions, actions[i].fd, actions[i].target);
+            break;
+        case VECTOR_FD_CLOSE:
+            status = posix_spawn_file_actions_addclose(&file_actions,
+                                                       actions[i].fd);
+            break;
+        default:
+            status = EINVAL;
+            break;
+        }
+    if (status == 0) {
+        if (env == NULL)
+            env = (const char *const *) environ;
+        status = posix_spawn(&pid, path, &file_actions, NULL, argv,
+                             (char *const *) env);
+    }
+    posix_spawn_file_actions_destroy(&file_actions);
+    if (status != 0) {
+        errno = status;
+        return -1;
+    }
+    return pid;
+}
+
+#else /* !HAVE_POSIX_SPAWN */
+
+/*
+ * Helper function for vector_spawn and cvector_spawn when posix_spawn isn't
+ * available.  Fork, perform the file descriptor actions, and exec.  Failure
+ * in the child is reported back to the parent via a close-on-exec pipe so
+ * that we can return -1 with the correct errno as posix_spawn would.
+ */
+static pid_t
+spawn(const char *path, char *const argv[], const char *const env[],
+      const struct vector_fd_action actions[], size_t count)
+{
+    int fds[2];
+    int error, oerrno;
+    size_t i;
+    ssize_t status;
+    pid_t pid;
+
+    if (pipe(fds) < 0)
+        return -1;
+    if (!fdflag_close_exec(fds[1], true)) {
+        oerrno = errno;
+        close(fds[0]);
+        close(fds[1]);
+        errno = oerrno;
+        return -1;
+    }
+    pid = fork();
+    if (pid < 0) {
+        oerrno = errno;
+        close(fds[0]);
+        close(fds[1]);
+        errno = oerrno;
+        return -1;
+    }
+
+    /* In the child, do the file descriptor actions and run the program. */
+    if (pid == 0) {
+        close(fds[0]);
+        for (i = 0; i < count; i++) {
+            if (actions[i].type == VECTOR_FD_DUP2) {
+                if (actions[i].fd == actions[i].target) {
+                    if (!fdflag_close_exec(actions[i].fd, false))
+                        break;
+                } else if (dup2(actions[i].fd, actions[i].target) < 0)
+                    break;
+            } else if (actions[i].type == VECTOR_FD_CLOSE) {
+                if (close(actions[i].fd) < 0)
+                    break;
+            } else {
+                errno = EINVAL;
+                break;
+            }
+        }
+        if (i == count) {
+            if (env == NULL)
+                execv(path, argv);
+            else
+                execve(path, argv, (char *const *) env);
+        }
+        error = errno;
+        do
+            status = write(fds[1], &error, sizeof(error));
+        while (status < 0 && errno == EINTR);
+        _exit(127);
+    }
+
+    /*
+     * In the parent, wait for the pipe to be closed by exec or for the child
+     * to report an error.
+     */
+    close(fds[1]);
+    do
+        status = read(fds[0], &error, sizeof(error));
+    while (status < 0 && errno == EINTR);
+    close(fds[0]);
+    if (status == sizeof(error)) {
+        waitpid(pid, NULL, 0);
+        errno = error;
+        return -1;
+    }
+    return pid;
+}
+
+#endif /* !HAVE_POSIX_SPAWN */
+
+
+/*
+ * Given a vector and a path to a program, run that program in a new process
+ * with the vector as its arguments, optionally with a new environment and a
+ * list of file descriptor actions to perform in the child.  This requires
+ * adding a NULL terminator to the vector, just as with vector_exec.  Returns
+ * the process ID of the child or -1 on failure.
+ */
+pid_t
+vector_spawn(const char *path, struct vector *vector, const char *const env[],
+             const struct vector_fd_action actions[], size_t count)
+{
+    assert(vector != NULL);
+    if (vector->allocated == vector->count)
+        vector_resize(vector, vector->count + 1);
+    vector->strings[vector->count] = NULL;
+    return spawn(path, (char *const *) vector->strings, env, actions, count);
+}
+
+pid_t
+cvector_spawn(const char *path, struct cvector *vector,
+              const char *const env[],
+              const struct vector_fd_action actions[], size_t count)
+{
+    assert(vector != NULL);
+    if (vector->allocated == vector->count)
+        cvector_resize(vector, vector->count + 1);
+    vector->strings[vector->count] = NULL;
+    return spawn(path, (char *const *) vector->strings, env, actions, count);
+}
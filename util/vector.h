@@ -32,6 +32,10 @@
 
 #include <stddef.h>
 #include <stdlib.h>
+#include <sys/types.h>
+
+/* Forward declaration to avoid an include. */
+struct pool;
 
 struct vector {
     size_t count;
@@ -45,6 +49,22 @@ struct cvector {
     const char **strings;
 };
 
+/*
+ * An action to perform on file descriptors in the child process before
+ * running the program with vector_spawn.  VECTOR_FD_DUP2 duplicates fd onto
+ * target, and VECTOR_FD_CLOSE closes fd (target is ignored).  Actions are
+ * performed in the order given.
+ */
+enum vector_fd_type {
+    VECTOR_FD_DUP2,
+    VECTOR_FD_CLOSE
+};
+struct vector_fd_action {
+    enum vector_fd_type type;
+    int fd;
+    int target;
+};
+
 BEGIN_DECLS
 
 /* Default to a hidden visibility for all util functions. */
@@ -63,6 +83,21 @@ struct vector *vector_new(void)
 struct cvector *cvector_new(void)
     __attribute__((__warn_unused_result__, __malloc__(cvector_free)));
 
+/*
+ * Create a new, empty vector from an object pool created with pool_new for
+ * objects of size sizeof(struct vector) or sizeof(struct cvector), and free a
+ * vector obtained that way.  These avoid a malloc and free of the vector
+ * struct for callers that create and discard vectors at a high rate.
+ */
+struct vector *vector_pool_get(struct pool *)
+    __attribute__((__nonnull__, __warn_unused_result__));
+struct cvector *cvector_pool_get(struct pool *)
+    __attribute__((__nonnull__, __warn_unused_result__));
+void vector_pool_put(struct pool *, struct vector *)
+    __attribute__((__nonnull__(1)));
+void cvector_pool_put(struct pool *, struct cvector *)
+    __attribute__((__nonnull__(1)));
+
 /* Add a string to a vector.  Resizes the vector if necessary. */
 void vector_add(struct vector *, const char *string)
     __attribute__((__nonnull__));
@@ -140,6 +175,24 @@ int vector_exec(const char *path, struct vector *)
 int cvector_exec(const char *path, struct cvector *)
     __attribute__((__nonnull__));
 
+/*
+ * Run the given program with the vector as its arguments in a new process
+ * without replacing the current one, using posix_spawn if available (which
+ * avoids copying the page tables of a large process).  env is the
+ * environment for the program, or NULL to pass the current environment.
+ * The count file descriptor actions in actions are performed in the child
+ * before the program is run; actions may be NULL if count is 0.  Returns the
+ * process ID of the child, or -1 with errno set if the program could not be
+ * run.  The caller is responsible for waiting for the child.
+ */
+pid_t vector_spawn(const char *path, struct vector *, const char *const env[],
+                   const struct vector_fd_action actions[], size_t count)
+    __attribute__((__nonnull__(1, 2)));
+pid_t cvector_spawn(const char *path, struct cvector *,
+                    const char *const env[],
+                    const struct vector_fd_action actions[], size_t count)
+    __attribute__((__nonnull__(1, 2)));
+
 /* Undo default visibility change. */
 #pragma GCC visibility pop
 
@@ -0,0 +1,216 @@
+/*
+ * Buffered writer on top of xwrite.
+ *
+ * Usage:
+ *
+ *     struct writer *writer = writer_new(fd, 0, 0, WRITER_SYNC_CLOSE);
+ *     for (i = 0; i < count; i++)
+ *         if (writer_write(writer, records[i], sizes[i]) < 0)
+ *             sysdie("cannot write record");
+ *     if (writer_close(writer) < 0)
+ *         sysdie("cannot close output");
+ *
+ * Callers that write many small records with xwrite make a system call for
+ * each one.  A writer instead copies small records into a buffer and writes
+ * the buffer once it reaches a threshold.  A record that doesn't fit in the
+ * buffer is written together with the buffered data using xwritev, so it is
+ * not copied and there is still only one write.
+ *
+ * The canonical version of this file is maintained in the rra-c-util package,
+ * which can be found at <https://www.eyrie.org/~eagle/software/rra-c-util/>.
+ *
+ * Written by Russ Allbery <eagle@eyrie.org>
+ * Copyright 2024 Russ Allbery <eagle@eyrie.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <config.h>
+#include <portable/system.h>
+#include <portable/uio.h>
+
+#include <errno.h>
+
+#include <util/writer.h>
+#include <util/xmalloc.h>
+#include <util/xwrite.h>
+
+/* Use fsync if fdatasync isn't available. */
+#if !HAVE_DECL_FDATASYNC
+#    define fdatasync(fd) fsync(fd)
+#endif
+
+/* The default buffer size. */
+#define WRITER_SIZE (64 * 1024)
+
+struct writer {
+    int fd;
+    enum writer_sync sync;
+    size_t size;      /* Size of the buffer. */
+    size_t threshold; /* Write the buffer once this much is buffered. */
+    size_t used;      /* Amount of data buffered. */
+    int error;        /* errno value from a failed write, or 0. */
+    char *data;
+};
+
+
+/*
+ * Record a failure, discarding the buffered data, and return -1.  xwrite
+ * doesn't set errno if it gives up because no progress is being made, so use
+ * EIO if errno isn't set.
+ */
+static int
+writer_fail(struct writer *writer)
+{
+    writer->error = (errno == 0) ? EIO : errno;
+    writer->used = 0;
+    return -1;
+}
+
+
+/*
+ * Create a new writer.
+ */
+struct writer *
+writer_new(int fd, size_t size, size_t threshold, enum writer_sync sync)
+{
+    struct writer *writer;
+
+    if (size == 0)
+        size = WRITER_SIZE;
+    if (threshold == 0 || threshold > size)
+        threshold = size;
+    writer = xcalloc(1, sizeof(struct writer));
+    writer->fd = fd;
+    writer->sync = sync;
+    writer->size = size;
+    writer->threshold = threshold;
+    writer->data = xmalloc(size);
+    return writer;
+}
+
+
+/*
+ * Free a writer without writing anything.
+ */
+void
+writer_free(struct writer *writer)
+{
+    if (writer == NULL)
+        return;
+    free(writer->data);
+    free(writer);
+}
+
+
+/*
+ * Write the buffered data, if any.
+ */
+ssize_t
+writer_flush(struct writer *writer)
+{
+    size_t used = writer->used;
+
+    if (writer->error != 0) {
+        errno = writer->error;
+        return -1;
+    }
+    if (used == 0)
+        return 0;
+    errno = 0;
+    if (xwrite(writer->fd, writer->data, used) < 0)
+        return writer_fail(writer);
+    writer->used = 0;
+    if (writer->sync == WRITER_SYNC_FLUSH && fdatasync(writer->fd) < 0)
+        return writer_fail(writer);
+    return (ssize_t) used;
+}
+
+
+/*
+ * Buffer some data, writing it along with the buffered data if it doesn't
+ * fit.
+ */
+ssize_t
+writer_write(struct writer *writer, const void *data, size_t size)
+{
+    struct iovec iov[2];
+
+    if (writer->error != 0) {
+        errno = writer->error;
+        return -1;
+    }
+    if (size == 0)
+        return 0;
+
+    /* The common case: copy the data and write once over the threshold. */
+    if (size <= writer->size - writer->used) {
+        memcpy(writer->data + writer->used, data, size);
+        writer->used += size;
+        if (writer->used >= writer->threshold && writer_flush(writer) < 0)
+            return -1;
+        return (ssize_t) size;
+    }
+
+    /* Otherwise, write the buffer and the data together. */
+    iov[0].iov_base = writer->data;
+    iov[0].iov_len = writer->used;
+    iov[1].iov_base = (void *) data;
+    iov[1].iov_len = size;
+    errno = 0;
+    if (xwritev(writer->fd, iov, 2) < 0)
+        return writer_fail(writer);
+    writer->used = 0;
+    if (writer->sync == WRITER_SYNC_FLUSH && fdatasync(writer->fd) < 0)
+        return writer_fail(writer);
+    return (ssize_t) size;
+}
+
+
+/*
+ * Write any buffered data, sync, close the file descriptor, and free the
+ * writer, reporting the first error.  With WRITER_SYNC_FLUSH, everything
+ * written has already been synced by writer_flush.
+ */
+int
+writer_close(struct writer *writer)
+{
+    int status = 0;
+    int error = 0;
+
+    if (writer_flush(writer) < 0) {
+        status = -1;
+        error = errno;
+    }
+    if (status == 0 && writer->sync == WRITER_SYNC_CLOSE)
+        if (fdatasync(writer->fd) < 0) {
+            status = -1;
+            error = errno;
+        }
+    if (close(writer->fd) < 0 && status == 0) {
+        status = -1;
+        error = errno;
+    }
+    writer_free(writer);
+    if (status < 0)
+        errno = error;
+    return status;
+}
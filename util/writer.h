@@ -0,0 +1,101 @@
+/*
+ * Prototypes for the buffered writer.
+ *
+ * The canonical version of this file is maintained in the rra-c-util package,
+ * which can be found at <https://www.eyrie.org/~eagle/software/rra-c-util/>.
+ *
+ * Written by Russ Allbery <eagle@eyrie.org>
+ * Copyright 2024 Russ Allbery <eagle@eyrie.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef UTIL_WRITER_H
+#define UTIL_WRITER_H 1
+
+#include <config.h>
+#include <portable/macros.h>
+
+#include <sys/types.h>
+
+/* When to call fdatasync on the file descriptor. */
+enum writer_sync {
+    WRITER_SYNC_NONE,  /* Never. */
+    WRITER_SYNC_FLUSH, /* After each time buffered data is written. */
+    WRITER_SYNC_CLOSE  /* Only in writer_close. */
+};
+
+/* Opaque struct for the buffered writer. */
+struct writer;
+
+BEGIN_DECLS
+
+/* Default to a hidden visibility for all util functions. */
+#pragma GCC visibility push(hidden)
+
+/*
+ * Free a writer without writing any buffered data or closing the file
+ * descriptor.  Intended for error handling.
+ */
+void writer_free(struct writer *);
+
+/*
+ * Create a new writer for a file descriptor with a buffer of the given size
+ * (64KB if 0).  Buffered data is written once there is at least threshold
+ * bytes of it, or when the buffer is full if threshold is 0.
+ */
+struct writer *writer_new(int fd, size_t size, size_t threshold,
+                          enum writer_sync)
+    __attribute__((__warn_unused_result__, __malloc__(writer_free)));
+
+/*
+ * Buffer data to be written, writing the buffer if it reaches the threshold.
+ * If the data doesn't fit in the buffer, the buffered data and the new data
+ * are written together with xwritev.  Returns size on success or -1 on error
+ * with errno set, like xwrite.
+ *
+ * Once a write fails, the buffered data is discarded and all later calls
+ * fail with the same errno value, since it's not known how much data was
+ * written.
+ */
+ssize_t writer_write(struct writer *, const void *data, size_t size)
+    __attribute__((__nonnull__));
+
+/*
+ * Write any buffered data, returning the number of bytes written or -1 on
+ * error with errno set.
+ */
+ssize_t writer_flush(struct writer *) __attribute__((__nonnull__));
+
+/*
+ * Write any buffered data, sync the file descriptor if the sync policy is
+ * not WRITER_SYNC_NONE, close the file descriptor, and free the writer.
+ * Returns 0 on success or -1 with errno set from the first failure.  The
+ * file descriptor is closed and the writer freed even on failure.
+ */
+int writer_close(struct writer *) __attribute__((__nonnull__));
+
+/* Undo default visibility change. */
+#pragma GCC visibility pop
+
+END_DECLS
+
+#endif /* UTIL_WRITER_H */
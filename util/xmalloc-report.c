@@ -0,0 +1,71 @@
+/*
+ * Reporting of xmalloc allocation statistics.
+ *
+ * Usage:
+ *
+ *      xmalloc_stats_enable(true);
+ *      ... program runs ...
+ *      xmalloc_stats_report(STDERR_FILENO);
+ *
+ * Writes the statistics gathered by xmalloc, sorted with the largest total
+ * first, one call site per line.  This is separate from util/xmalloc.c so
+ * that xmalloc doesn't depend on xwrite.
+ *
+ * The canonical version of this file is maintained in the rra-c-util package,
+ * which can be found at <https://www.eyrie.org/~eagle/software/rra-c-util/>.
+ *
+ * Written by Russ Allbery <eagle@eyrie.org>
+ * Copyright 2024 Russ Allbery <eagle@eyrie.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <config.h>
+#include <portable/system.h>
+
+#include <util/xmalloc.h>
+#include <util/xwrite.h>
+
+
+/*
+ * Write the sorted statistics to a file descriptor.
+ */
+void
+xmalloc_stats_report(int fd)
+{
+    struct xmalloc_site *sites;
+    size_t count, i;
+    char line[BUFSIZ];
+    int length;
+
+    sites = xmalloc_stats(&count);
+    for (i = 0; i < count; i++) {
+        length = snprintf(line, sizeof(line), "%s:%d: %lu calls, %lu bytes,"
+                          " largest %lu\n", sites[i].file, sites[i].line,
+                          sites[i].calls, sites[i].bytes, sites[i].largest);
+        if (length < 0)
+            continue;
+        if ((size_t) length >= sizeof(line))
+            length = sizeof(line) - 1;
+        xwrite(fd, line, length);
+    }
+    free(sites);
+}
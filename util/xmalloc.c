@@ -55,6 +55,17 @@
  * bytes, ensuring this by allocating space for one character instead of 0
  * bytes.
  *
+ * If enabled with xmalloc_stats_enable, every allocation also records the
+ * number of calls, total bytes requested, and largest request for its call
+ * site, using the file and line number that are otherwise only used for error
+ * reporting.  Each thread records into its own table without locking, and
+ * the tables are merged when the statistics are retrieved with xmalloc_stats,
+ * written out with xmalloc_stats_report, or dumped from a signal handler
+ * installed with xmalloc_stats_signal.  When a thread exits, its table is
+ * kept, so that its counts are still reported, and reused by the next new
+ * thread.  Since memory from these functions is released with plain free,
+ * live or peak memory usage can't be tracked.
+ *
  * The functions defined here are actually x_malloc, x_realloc, etc.  The
  * header file defines macros named xmalloc, etc. that pass the file name and
  * line number to these functions.
@@ -63,7 +74,7 @@
  * which can be found at <https://www.eyrie.org/~eagle/software/rra-c-util/>.
  *
  * Written by Russ Allbery <eagle@eyrie.org>
- * Copyright 2015, 2023 Russ Allbery <eagle@eyrie.org>
+ * Copyright 2015, 2023-2024 Russ Allbery <eagle@eyrie.org>
  * Copyright 2012-2014
  *     The Board of Trustees of the Leland Stanford Junior University
  * Copyright 2004-2006 Internet Systems Consortium, Inc. ("ISC")
@@ -90,9 +101,83 @@
 #include <config.h>
 #include <portable/system.h>
 
+#include <errno.h>
+#ifdef HAVE_PTHREAD
+#    include <pthread.h>
+#endif
+#include <signal.h>
+#if defined(HAVE_C11_ATOMICS) && defined(HAVE_THREAD_LOCAL)
+#    include <stdatomic.h>
+#endif
+
+#include <util/macros.h>
 #include <util/messages.h>
 #include <util/xmalloc.h>
 
+/*
+ * Allocation statistics need atomics so that other threads can read the
+ * per-thread counters and thread-local storage to find the table for the
+ * current thread.  Without them, recording is a no-op.
+ */
+#if defined(HAVE_C11_ATOMICS) && defined(HAVE_THREAD_LOCAL)
+#    define XMALLOC_STATS 1
+#    define STATS_RECORD(size, file, line)                                   \
+        do {                                                                 \
+            if (atomic_load_explicit(&stats_enabled, memory_order_relaxed)) \
+                stats_record((size), (file), (line));                        \
+        } while (0)
+#else
+#    define STATS_RECORD(size, file, line) /* empty */
+#endif
+
+#ifdef XMALLOC_STATS
+
+/* Number of call sites each thread can track.  Must be a power of two. */
+#    define STATS_SITES 1024
+
+/*
+ * A per-thread table of call sites, hashed on file and line with linear
+ * probing.  Only the owning thread writes to a table, so the counters can be
+ * updated with plain relaxed loads and stores, but they're atomic so that
+ * other threads can read them while merging.  file is set last and is NULL
+ * for unused entries.  A table belongs to at most one thread at a time, and
+ * in_use is cleared when that thread exits so that another thread can take
+ * it over, keeping the counts.
+ */
+struct stats_entry {
+    _Atomic(const char *) file;
+    int line;
+    atomic_ulong calls;
+    atomic_ulong bytes;
+    atomic_ulong largest;
+};
+
+struct stats_table {
+    struct stats_table *next;
+    atomic_bool in_use;   /* Whether a running thread owns the table. */
+    atomic_ulong dropped; /* Calls from sites that didn't fit. */
+    struct stats_entry entries[STATS_SITES];
+};
+
+/* Whether recording is enabled, the list of all tables, and ours. */
+static atomic_bool stats_enabled;
+static _Atomic(struct stats_table *) stats_tables;
+static THREAD_LOCAL struct stats_table *stats_local;
+
+/* Key whose destructor releases the table of an exiting thread. */
+#    ifdef HAVE_PTHREAD
+static pthread_once_t stats_once = PTHREAD_ONCE_INIT;
+static pthread_key_t stats_key;
+static bool stats_key_valid;
+#    endif
+
+/* State for the signal handler, which can't allocate memory. */
+static int stats_signal_fd = -1;
+static volatile sig_atomic_t stats_signal_active;
+static struct xmalloc_site stats_signal_sites[STATS_SITES];
+
+#endif /* XMALLOC_STATS */
+
 
 /*
  * The default error handler.
@@ -112,6 +197,369 @@ xmalloc_fail(const char *function, size_t size, const char *file, int line)
 xmalloc_handler_type xmalloc_error_handler = xmalloc_fail;
 
 
+#ifdef XMALLOC_STATS
+
+/*
+ * Add one unit to a per-thread counter.  Only the owning thread writes, so a
+ * locked read-modify-write isn't needed.
+ */
+static void
+stats_add(atomic_ulong *counter, unsigned long value)
+{
+    unsigned long old;
+
+    old = atomic_load_explicit(counter, memory_order_relaxed);
+    atomic_store_explicit(counter, old + value, memory_order_relaxed);
+}
+
+
+#    ifdef HAVE_PTHREAD
+
+/*
+ * Release the table of an exiting thread so that a new thread can use it.
+ * The counts stay in the table and so are still included in the reports.  If
+ * a later destructor in this thread allocates memory, it gets another table.
+ */
+static void
+stats_release(void *table)
+{
+    struct stats_table *released = table;
+
+    stats_local = NULL;
+    atomic_store(&released->in_use, false);
+}
+
+
+/*
+ * Create the key used to release tables when threads exit.  If this fails,
+ * tables are never reused.
+ */
+static void
+stats_key_create(void)
+{
+    stats_key_valid = (pthread_key_create(&stats_key, stats_release) == 0);
+}
+
+#    endif /* HAVE_PTHREAD */
+
+
+/*
+ * Get a table for the current thread, taking over one released by a thread
+ * that exited if possible and otherwise allocating and registering a new one.
+ * Returns NULL if a table can't be allocated.
+ */
+static struct stats_table *
+stats_table_get(void)
+{
+    struct stats_table *table;
+    bool in_use;
+
+    table = atomic_load(&stats_tables);
+    for (; table != NULL; table = table->next) {
+        in_use = false;
+        if (atomic_compare_exchange_strong(&table->in_use, &in_use, true))
+            break;
+    }
+    if (table == NULL) {
+        table = calloc(1, sizeof(struct stats_table));
+        if (table == NULL)
+            return NULL;
+        atomic_init(&table->in_use, true);
+        table->next = atomic_load(&stats_tables);
+        while (!atomic_compare_exchange_weak(&stats_tables, &table->next,
+                                             table))
+            ;
+    }
+#    ifdef HAVE_PTHREAD
+    pthread_once(&stats_once, stats_key_create);
+    if (stats_key_valid)
+        pthread_setspecific(stats_key, table);
+#    endif
+    return table;
+}
+
+
+/*
+ * Record an allocation of the given size at the given call site in the table
+ * for the current thread, getting a table on first use.  If there is no
+ * table, the allocation just isn't recorded.
+ */
+static void
+stats_record(size_t size, const char *file, int line)
+{
+    struct stats_table *table = stats_local;
+    struct stats_entry *entry = NULL;
+    const char *key;
+    size_t hash, i;
+
+    if (table == NULL) {
+        table = stats_table_get();
+        if (table == NULL)
+            return;
+        stats_local = table;
+    }
+    hash = ((uintptr_t) file >> 3) ^ ((size_t) line * 2654435761U);
+    for (i = 0; i < STATS_SITES; i++) {
+        entry = &table->entries[(hash + i) & (STATS_SITES - 1)];
+        key = atomic_load_explicit(&entry->file, memory_order_relaxed);
+        if (key == NULL) {
+            entry->line = line;
+            atomic_store_explicit(&entry->file, file, memory_order_release);
+            break;
+        }
+        if (key == file && entry->line == line)
+            break;
+    }
+    if (i == STATS_SITES) {
+        stats_add(&table->dropped, 1);
+        return;
+    }
+    stats_add(&entry->calls, 1);
+    stats_add(&entry->bytes, size);
+    if (size > atomic_load_explicit(&entry->largest, memory_order_relaxed))
+        atomic_store_explicit(&entry->largest, size, memory_order_relaxed);
+}
+
+
+/*
+ * Merge the tables from all threads into the provided array, which can hold
+ * at most max sites, and return the number of sites.  The same file may have
+ * different string addresses in different objects, so compare by contents.
+ * Only uses async-signal-safe operations so that it can be called from the
+ * signal handler.
+ */
+static size_t
+stats_merge(struct xmalloc_site *sites, size_t max)
+{
+    struct stats_table *table;
+    struct stats_entry *entry;
+    struct xmalloc_site *site;
+    const char *file;
+    unsigned long largest;
+    size_t i, j, count = 0;
+
+    table = atomic_load_explicit(&stats_tables, memory_order_acquire);
+    for (; table != NULL; table = table->next)
+        for (i = 0; i < STATS_SITES; i++) {
+            entry = &table->entries[i];
+            file = atomic_load_explicit(&entry->file, memory_order_acquire);
+            if (file == NULL)
+                continue;
+            for (j = 0; j < count; j++)
+                if (sites[j].line == entry->line
+                    && (sites[j].file == file
+                        || strcmp(sites[j].file, file) == 0))
+                    break;
+            if (j == count) {
+                if (count == max)
+                    continue;
+                site = &sites[count++];
+                site->file = file;
+                site->line = entry->line;
+                site->calls = 0;
+                site->bytes = 0;
+                site->largest = 0;
+            }
+            site = &sites[j];
+            site->calls += atomic_load_explicit(&entry->calls,
+                                                memory_order_relaxed);
+            site->bytes += atomic_load_explicit(&entry->bytes,
+                                                memory_order_relaxed);
+            largest = atomic_load_explicit(&entry->largest,
+                                           memory_order_relaxed);
+            if (largest > site->largest)
+                site->largest = largest;
+        }
+    return count;
+}
+
+
+/*
+ * Sort sites by total bytes, largest first, and then by calls and by file
+ * and line so that the order is stable.
+ */
+static int
+stats_compare(const void *a, const void *b)
+{
+    const struct xmalloc_site *first = a;
+    const struct xmalloc_site *second = b;
+    int status;
+
+    if (first->bytes != second->bytes)
+        return (first->bytes > second->bytes) ? -1 : 1;
+    if (first->calls != second->calls)
+        return (first->calls > second->calls) ? -1 : 1;
+    status = strcmp(first->file, second->file);
+    if (status != 0)
+        return status;
+    return first->line - second->line;
+}
+
+
+/*
+ * Append a string or a number to a buffer, truncating if it doesn't fit.
+ * These exist because snprintf isn't async-signal-safe.
+ */
+static void
+stats_append(char *buffer, size_t size, size_t *offset, const char *string)
+{
+    for (; *string != '\0' && *offset < size; string++)
+        buffer[(*offset)++] = *string;
+}
+
+static void
+stats_append_number(char *buffer, size_t size, size_t *offset,
+                    unsigned long number)
+{
+    char digits[32];
+    size_t i = sizeof(digits) - 1;
+
+    digits[i] = '\0';
+    do {
+        digits[--i] = (char) ('0' + number % 10);
+        number /= 10;
+    } while (number > 0);
+    stats_append(buffer, size, offset, digits + i);
+}
+
+
+/*
+ * Format one site as a line of the report into the provided buffer, which
+ * must be at least 2 bytes, and return the length.  The line is always
+ * newline-terminated but is not nul-terminated.
+ */
+static size_t
+stats_format(char *buffer, size_t size, const struct xmalloc_site *site)
+{
+    size_t offset = 0;
+
+    size--;
+    stats_append(buffer, size, &offset, site->file);
+    stats_append(buffer, size, &offset, ":");
+    stats_append_number(buffer, size, &offset, (unsigned long) site->line);
+    stats_append(buffer, size, &offset, ": ");
+    stats_append_number(buffer, size, &offset, site->calls);
+    stats_append(buffer, size, &offset, " calls, ");
+    stats_append_number(buffer, size, &offset, site->bytes);
+    stats_append(buffer, size, &offset, " bytes, largest ");
+    stats_append_number(buffer, size, &offset, site->largest);
+    buffer[offset++] = '\n';
+    return offset;
+}
+
+
+/*
+ * Signal handler that writes the unsorted statistics to the configured file
+ * descriptor.  Guard against the signal arriving again while a report is
+ * being written, since the sites array is static.
+ */
+static void
+stats_signal_handler(int sig UNUSED)
+{
+    char buffer[BUFSIZ];
+    size_t count, i, length, offset;
+    ssize_t status;
+    int saved_errno = errno;
+
+    if (stats_signal_active)
+        return;
+    stats_signal_active = 1;
+    count = stats_merge(stats_signal_sites, STATS_SITES);
+    for (i = 0; i < count; i++) {
+        length = stats_format(buffer, sizeof(buffer), &stats_signal_sites[i]);
+        for (offset = 0; offset < length; offset += status) {
+            status = write(stats_signal_fd, buffer + offset, length - offset);
+            if (status < 0 && errno == EINTR)
+                status = 0;
+            else if (status <= 0)
+                break;
+        }
+    }
+    stats_signal_active = 0;
+    errno = saved_errno;
+}
+
+
+/*
+ * Turn recording on or off.
+ */
+bool
+xmalloc_stats_enable(bool enable)
+{
+    atomic_store(&stats_enabled, enable);
+    return true;
+}
+
+
+/*
+ * Return the merged statistics.  The number of sites may grow between
+ * counting them and merging, in which case the newest are left out.
+ */
+struct xmalloc_site *
+xmalloc_stats(size_t *count)
+{
+    struct stats_table *table;
+    struct xmalloc_site *sites;
+    size_t i, max = 0;
+
+    table = atomic_load_explicit(&stats_tables, memory_order_acquire);
+    for (; table != NULL; table = table->next)
+        for (i = 0; i < STATS_SITES; i++)
+            if (atomic_load_explicit(&table->entries[i].file,
+                                     memory_order_relaxed)
+                != NULL)
+                max++;
+    *count = 0;
+    if (max == 0)
+        return NULL;
+    sites = xcalloc(max, sizeof(struct xmalloc_site));
+    *count = stats_merge(sites, max);
+    qsort(sites, *count, sizeof(struct xmalloc_site), stats_compare);
+    return sites;
+}
+
+
+/*
+ * Install the signal handler.
+ */
+bool
+xmalloc_stats_signal(int sig, int fd)
+{
+    struct sigaction sa;
+
+    stats_signal_fd = fd;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = stats_signal_handler;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    return sigaction(sig, &sa, NULL) == 0;
+}
+
+#else /* !XMALLOC_STATS */
+
+bool
+xmalloc_stats_enable(bool enable UNUSED)
+{
+    return false;
+}
+
+struct xmalloc_site *
+xmalloc_stats(size_t *count)
+{
+    *count = 0;
+    return NULL;
+}
+
+bool
+xmalloc_stats_signal(int sig UNUSED, int fd UNUSED)
+{
+    errno = ENOSYS;
+    return false;
+}
+
+#endif /* !XMALLOC_STATS */
+
+
 void *
 x_malloc(size_t size, const char *file, int line)
 {
@@ -124,6 +572,7 @@ x_malloc(size_t size, const char *file, int line)
         xmalloc_error_handler("malloc", size, file, line);
         p = malloc(real_size);
     }
+    STATS_RECORD(size, file, line);
     return p;
 }
 
@@ -140,6 +589,7 @@ x_calloc(size_t n, size_t size, const char *file, int line)
         xmalloc_error_handler("calloc", n * size, file, line);
         p = calloc(n, size);
     }
+    STATS_RECORD(n * size, file, line);
     return p;
 }
 
@@ -152,6 +602,7 @@ x_realloc(void *p, size_t size, const char *file, int line)
     newp = realloc(p, size);
     if (size == 0)
         return newp;
+    STATS_RECORD(size, file, line);
 
         /*
          * GCC 13.2.0 (and some earlier versions) misdiagnose this error
@@ -182,6 +633,7 @@ x_reallocarray(void *p, size_t n, size_t size, const char *file, int line)
     newp = reallocarray(p, n, size);
     if (size == 0 || n == 0)
         return newp;
+    STATS_RECORD(n * size, file, line);
 
         /*
          * GCC 13.2.0 (and some earlier versions) misdiagnose this error
@@ -217,6 +669,7 @@ x_strdup(const char *s, const char *file, int line)
         xmalloc_error_handler("strdup", len, file, line);
         p = malloc(len);
     }
+    STATS_RECORD(len, file, line);
     memcpy(p, s, len);
     return p;
 }
@@ -243,6 +696,7 @@ x_strndup(const char *s, size_t size, const char *file, int line)
         xmalloc_error_handler("strndup", length + 1, file, line);
         copy = malloc(length + 1);
     }
+    STATS_RECORD(length + 1, file, line);
     memcpy(copy, s, length);
     copy[length] = '\0';
     return copy;
@@ -269,6 +723,7 @@ x_vasprintf(char **strp, const char *fmt, va_list args, const char *file,
         status = vasprintf(strp, fmt, args_copy);
         va_end(args_copy);
     }
+    STATS_RECORD((size_t) status + 1, file, line);
 }
 
 
@@ -294,6 +749,7 @@ x_asprintf(char **strp, const char *file, int line, const char *fmt, ...)
         va_end(args_copy);
     }
     va_end(args);
+    STATS_RECORD((size_t) status + 1, file, line);
 }
 #else  /* !(HAVE_C99_VAMACROS || HAVE_GNU_VAMACROS) */
 void
@@ -317,5 +773,6 @@ x_asprintf(char **strp, const char *fmt, ...)
         va_end(args_copy);
     }
     va_end(args);
+    STATS_RECORD((size_t) status + 1, __FILE__, __LINE__);
 }
 #endif /* !(HAVE_C99_VAMACROS || HAVE_GNU_VAMACROS) */
@@ -34,6 +34,7 @@
 
 #include <config.h>
 #include <portable/macros.h>
+#include <portable/stdbool.h>
 
 #include <stdarg.h>
 #include <stddef.h>
@@ -121,6 +122,49 @@ void xmalloc_fail(const char *, size_t, const char *, int)
  */
 extern xmalloc_handler_type xmalloc_error_handler;
 
+/*
+ * Allocation statistics for one call site, as returned by xmalloc_stats.
+ * bytes is the total requested over all calls and largest is the biggest
+ * single request.
+ */
+struct xmalloc_site {
+    const char *file;
+    int line;
+    unsigned long calls;
+    unsigned long bytes;
+    unsigned long largest;
+};
+
+/*
+ * Turn recording of per-call-site allocation statistics on or off.  Returns
+ * false if statistics are not supported on this platform (they require C11
+ * atomics and thread-local storage).  Statistics already recorded are kept
+ * when recording is turned off.
+ */
+bool xmalloc_stats_enable(bool);
+
+/*
+ * Merge the statistics from all threads and return them in a newly-allocated
+ * array, sorted by total bytes with the largest first, storing the number of
+ * sites in the second argument.  The array should be freed with free.
+ * Returns NULL and sets the count to zero if nothing was recorded.
+ */
+struct xmalloc_site *xmalloc_stats(size_t *) __attribute__((__nonnull__));
+
+/*
+ * Write a sorted report of the statistics, one site per line, to a file.
+ * This is in util/xmalloc-report.c, which also requires util/xwrite.c.
+ */
+void xmalloc_stats_report(int);
+
+/*
+ * Install a handler for the given signal that writes the statistics to the
+ * given file descriptor.  The handler is async-signal-safe, so the report is
+ * not sorted.  Returns false and sets errno if the handler couldn't be
+ * installed.
+ */
+bool xmalloc_stats_signal(int, int);
+
 /* Undo default visibility change. */
 #pragma GCC visibility pop
 
@@ -7,6 +7,14 @@
  *     ssize_t xpwrite(int fildes, const void *buf, size_t nbyte,
  *                     off_t offset);
  *     ssize_t xwritev(int fildes, const struct iovec *iov, int iovcnt);
+ *     ssize_t xwritev_consume(int fildes, struct iovec *iov, int iovcnt);
+ *     void xwritev_advance(struct iovec **iov, int *iovcnt, size_t bytes);
+ *
+ *     struct xwrite_batch *batch = xwrite_batch_new(0);
+ *     xwrite_batch_pwrite(batch, fd, buf, nbyte, offset);
+ *     xwrite_batch_writev(batch, fd, iov, iovcnt);
+ *     ssize_t total = xwrite_batch_submit(batch);
+ *     xwrite_batch_free(batch);
  *
  * xwrite, xpwrite, and xwritev behave exactly like their C library
  * counterparts except that, if write or writev succeeds but returns a number
@@ -21,6 +29,22 @@
  * written, on the subsequent additional write; in that case, these functions
  * will return -1 and the number of bytes actually written will be lost.
  *
+ * xwritev can't modify the caller's iovec array, so after a partial write it
+ * copies the rest of the array once and hands it to xwritev_consume.  That
+ * function instead modifies the array it's given, using xwritev_advance to
+ * move past whatever was written without allocating memory, so callers that
+ * own their array can avoid the copy.  Both pass at most IOV_MAX entries to
+ * each writev call, so arrays larger than the system limit can be written.
+ *
+ * A batch collects many writes so that they can be done together.  On Linux,
+ * they are submitted with a single io_uring_enter system call, and the
+ * completions are then checked in order.  Any write that was short,
+ * interrupted, or cancelled because an earlier linked write was short is
+ * finished with the synchronous loops above, so batches have the same
+ * semantics as the individual calls.  Writes at the current file position are
+ * linked so that the kernel does them in order.  If io_uring can't be used,
+ * the synchronous loops do all the work.
+ *
  * The canonical version of this file is maintained in the rra-c-util package,
  * which can be found at <https://www.eyrie.org/~eagle/software/rra-c-util/>.
  *
@@ -54,9 +78,65 @@
 
 #include <assert.h>
 #include <errno.h>
+#ifdef HAVE_LINUX_IO_URING_H
+#    include <linux/io_uring.h>
+#    include <sys/mman.h>
+#    include <sys/syscall.h>
+#endif
 
+#include <util/xmalloc.h>
 #include <util/xwrite.h>
 
+/*
+ * Use io_uring for batches if it's available, but not when running the test
+ * suite, since the kernel won't call the testing versions of the functions.
+ */
+#if defined(HAVE_LINUX_IO_URING_H) && defined(SYS_io_uring_setup) \
+    && !TESTING
+#    define XWRITE_URING 1
+#endif
+
+/* The default number of operations in flight at once in a batch. */
+#define XWRITE_BATCH_SIZE 64
+
+/* One queued write. */
+struct xwrite_op {
+    int fd;
+    bool positional;         /* Whether this is a pwrite. */
+    const struct iovec *iov; /* Data for writes at the file position. */
+    int iovcnt;
+    struct iovec single; /* Data for positional writes. */
+    off_t offset;
+    size_t size;    /* Total bytes to write. */
+    bool submitted; /* Whether io_uring attempted the write. */
+    ssize_t result; /* Bytes written or negative errno value. */
+};
+
+/* A batch of writes, and the io_uring rings if one is in use. */
+struct xwrite_batch {
+    unsigned int size;
+    struct xwrite_op *ops;
+    size_t count;
+    size_t allocated;
+#ifdef XWRITE_URING
+    int ring;     /* -1 if io_uring isn't being used. */
+    bool current; /* Whether offset -1 is supported. */
+    void *sq_map;
+    size_t sq_map_size;
+    void *cq_map;
+    size_t cq_map_size;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+    unsigned int *sq_tail;
+    unsigned int *sq_mask;
+    unsigned int *sq_array;
+    unsigned int *cq_head;
+    unsigned int *cq_tail;
+    unsigned int *cq_mask;
+    struct io_uring_cqe *cqes;
+#endif
+};
+
 /*
  * If we're running the test suite, call testing versions of the write
  * functions.  #undef the functions first since large file support may define
@@ -133,18 +213,74 @@ xpwrite(int fd, const void *buffer, size_t size, off_t offset)
 #endif
 
 
+/*
+ * Advance an iovec array in place past bytes that have been written, skipping
+ * any entries that are now empty.  This only looks at the entries that are
+ * consumed, so the total work for writing an array is linear in its length
+ * no matter how many partial writes there are.
+ */
+void
+xwritev_advance(struct iovec **iov, int *iovcnt, size_t bytes)
+{
+    while (*iovcnt > 0 && bytes >= (size_t) (*iov)->iov_len) {
+        bytes -= (*iov)->iov_len;
+        (*iov)++;
+        (*iovcnt)--;
+    }
+    if (*iovcnt > 0) {
+        (*iov)->iov_base = (char *) (*iov)->iov_base + bytes;
+        (*iov)->iov_len -= bytes;
+    }
+}
+
+
+ssize_t
+xwritev_consume(int fd, struct iovec iov[], int iovcnt)
+{
+    ssize_t total = 0, status;
+    unsigned int count = 0;
+
+    if (iovcnt < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    /*
+     * Write at most IOV_MAX entries at a time, advancing the array past what
+     * was written after each write.  Abort the write if we try ten times with
+     * no forward progress.
+     */
+    xwritev_advance(&iov, &iovcnt, 0);
+    while (iovcnt > 0) {
+        if (++count > 10)
+            return -1;
+        status = writev(fd, iov, (iovcnt > IOV_MAX) ? IOV_MAX : iovcnt);
+        if (status < 0) {
+            if (errno != EINTR)
+                return -1;
+            continue;
+        }
+        if (status > 0)
+            count = 0;
+        total += status;
+        xwritev_advance(&iov, &iovcnt, (size_t) status);
+    }
+    return total;
+}
+
+
 ssize_t
 xwritev(int fd, const struct iovec iov[], int iovcnt)
 {
     ssize_t total, status = 0;
-    size_t left, offset;
+    size_t offset;
     unsigned int iovleft, i, count;
     struct iovec *tmpiov;
 
     /*
      * Bounds-check the iovcnt argument.  This is just for our safety.  The
-     * system will probably impose a lower limit on iovcnt, causing the later
-     * writev to fail with an error we'll return.
+     * system may impose a lower limit on iovcnt, but larger arrays are
+     * written IOV_MAX entries at a time.
      */
     if (iovcnt == 0)
         return 0;
@@ -160,31 +296,30 @@ xwritev(int fd, const struct iovec iov[], int iovcnt)
         return 0;
 
     /*
-     * First, try just writing it all out.  Most of the time this will succeed
-     * and save us lots of work.  Abort the write if we try ten times with no
-     * forward progress.
+     * First, try just writing it all out if the system allows that many
+     * entries.  Most of the time this will succeed and save us lots of work.
      */
-    count = 0;
-    do {
-        if (++count > 10)
-            break;
-        status = writev(fd, iov, iovcnt);
-        if (status > 0)
-            count = 0;
-    } while (status < 0 && errno == EINTR);
-    if (status < 0)
-        return -1;
-    if (status == total)
-        return total;
+    offset = 0;
+    if (iovcnt <= IOV_MAX) {
+        count = 0;
+        do {
+            if (++count > 10)
+                break;
+            status = writev(fd, iov, iovcnt);
+        } while (status < 0 && errno == EINTR);
+        if (status < 0)
+            return -1;
+        if (status == total)
+            return total;
+        offset = status;
+    }
 
     /*
-     * If we fell through to here, the first write partially succeeded.
-     * Figure out how far through the iov array we got, and then duplicate the
-     * rest of it so that we can modify it to reflect how much we manage to
-     * write on successive tries.
+     * If we fell through to here, either the first write partially succeeded
+     * or the array was too large to write at once.  Duplicate the part of the
+     * array that's left so that xwritev_consume can modify it to reflect how
+     * much we manage to write on successive tries.
      */
-    offset = status;
-    left = total - offset;
     for (i = 0; offset >= (size_t) iov[i].iov_len; i++)
         offset -= iov[i].iov_len;
     iovleft = iovcnt - i;
@@ -193,38 +328,411 @@ xwritev(int fd, const struct iovec iov[], int iovcnt)
     if (tmpiov == NULL)
         return -1;
     memcpy(tmpiov, iov + i, iovleft * sizeof(struct iovec));
+    tmpiov[0].iov_base = (char *) tmpiov[0].iov_base + offset;
+    tmpiov[0].iov_len -= offset;
+    status = xwritev_consume(fd, tmpiov, iovleft);
+    free(tmpiov);
+    return (status < 0) ? -1 : total;
+}
 
-    /*
-     * status now contains the offset into the first iovec struct in tmpiov.
-     * Go into the write loop, trying to write out everything remaining at
-     * each point.  At the top of the loop, status will contain a count of
-     * bytes written out at the beginning of the set of iovec structs.
-     */
-    i = 0;
-    do {
-        if (++count > 10)
+
+#ifndef _WIN32
+
+#    ifdef XWRITE_URING
+/*
+ * Close the io_uring of a batch, after which all writes are done with the
+ * synchronous loops.
+ */
+static void
+ring_close(struct xwrite_batch *batch)
+{
+    if (batch->ring < 0)
+        return;
+    munmap(batch->sqes, batch->sqes_size);
+    if (batch->cq_map != batch->sq_map)
+        munmap(batch->cq_map, batch->cq_map_size);
+    munmap(batch->sq_map, batch->sq_map_size);
+    close(batch->ring);
+    batch->ring = -1;
+}
+
+
+/*
+ * Set up an io_uring for a batch.  If this fails, the batch falls back on the
+ * synchronous loops, so errors are ignored.
+ */
+static void
+ring_open(struct xwrite_batch *batch)
+{
+    struct io_uring_params params;
+    char *sq, *cq;
+    int fd;
+
+    batch->ring = -1;
+    memset(&params, 0, sizeof(params));
+    fd = (int) syscall(SYS_io_uring_setup, batch->size, &params);
+    if (fd < 0)
+        return;
+
+    /* Map the rings, which may share a mapping on newer kernels. */
+    batch->sq_map_size = params.sq_off.array;
+    batch->sq_map_size += params.sq_entries * sizeof(unsigned int);
+    batch->cq_map_size = params.cq_off.cqes;
+    batch->cq_map_size += params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (batch->cq_map_size > batch->sq_map_size)
+            batch->sq_map_size = batch->cq_map_size;
+        batch->cq_map_size = batch->sq_map_size;
+    }
+    batch->sq_map = mmap(NULL, batch->sq_map_size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (batch->sq_map == MAP_FAILED)
+        goto fail;
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+        batch->cq_map = batch->sq_map;
+    else {
+        batch->cq_map =
+            mmap(NULL, batch->cq_map_size, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (batch->cq_map == MAP_FAILED)
+            goto fail_sq;
+    }
+    batch->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    batch->sqes = mmap(NULL, batch->sqes_size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (batch->sqes == MAP_FAILED)
+        goto fail_cq;
+
+    /* Find the ring fields in the mappings. */
+    sq = batch->sq_map;
+    cq = batch->cq_map;
+    batch->sq_tail = (unsigned int *) (void *) (sq + params.sq_off.tail);
+    batch->sq_mask = (unsigned int *) (void *) (sq + params.sq_off.ring_mask);
+    batch->sq_array = (unsigned int *) (void *) (sq + params.sq_off.array);
+    batch->cq_head = (unsigned int *) (void *) (cq + params.cq_off.head);
+    batch->cq_tail = (unsigned int *) (void *) (cq + params.cq_off.tail);
+    batch->cq_mask = (unsigned int *) (void *) (cq + params.cq_off.ring_mask);
+    batch->cqes = (struct io_uring_cqe *) (void *) (cq + params.cq_off.cqes);
+    batch->size = params.sq_entries;
+    batch->current = (params.features & IORING_FEAT_RW_CUR_POS) != 0;
+    batch->ring = fd;
+    return;
+
+fail_cq:
+    if (batch->cq_map != batch->sq_map)
+        munmap(batch->cq_map, batch->cq_map_size);
+fail_sq:
+    munmap(batch->sq_map, batch->sq_map_size);
+fail:
+    close(fd);
+}
+
+
+/*
+ * Submit as many of the given operations as fit in the ring and wait for
+ * them to complete, storing their results.  Consecutive writes at the file
+ * position are linked so that they're done in order, and the kernel cancels
+ * the rest of the chain if one is short.  Returns the number of operations
+ * submitted, which is 0 if io_uring can't be used for the first one.
+ */
+static size_t
+ring_submit(struct xwrite_batch *batch, struct xwrite_op **ops, size_t n)
+{
+    struct io_uring_sqe *sqe;
+    struct io_uring_cqe *cqe;
+    struct xwrite_op *op;
+    unsigned int head, tail, index;
+    size_t count, submitted, reaped;
+    long status;
+
+    if (batch->ring < 0)
+        return 0;
+    if (n > batch->size)
+        n = batch->size;
+
+    /* Fill in the submission queue entries. */
+    tail = *batch->sq_tail;
+    for (count = 0; count < n; count++) {
+        op = ops[count];
+        if (!op->positional && !batch->current)
             break;
+        index = tail & *batch->sq_mask;
+        sqe = &batch->sqes[index];
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = IORING_OP_WRITEV;
+        sqe->fd = op->fd;
+        if (op->positional) {
+            sqe->addr = (uintptr_t) &op->single;
+            sqe->len = 1;
+            sqe->off = (uint64_t) op->offset;
+        } else {
+            sqe->addr = (uintptr_t) op->iov;
+            sqe->len = (unsigned int) op->iovcnt;
+            sqe->off = (uint64_t) -1;
+            if (count + 1 < n && !ops[count + 1]->positional)
+                sqe->flags = IOSQE_IO_LINK;
+        }
+        sqe->user_data = count;
+        batch->sq_array[index] = index;
+        op->submitted = false;
+        tail++;
+    }
+    if (count == 0)
+        return 0;
+    __atomic_store_n(batch->sq_tail, tail, __ATOMIC_RELEASE);
 
-        /* Skip any leading data that has been written out. */
-        for (; offset >= (size_t) tmpiov[i].iov_len && iovleft > 0; i++) {
-            offset -= tmpiov[i].iov_len;
-            iovleft--;
+    /*
+     * Submit and wait for the completions.  If io_uring_enter fails, stop
+     * using io_uring.  Writes that weren't submitted are left for the
+     * synchronous loops, but writes that were submitted and not reaped may
+     * or may not have happened, so they have to be reported as failures.
+     */
+    submitted = 0;
+    reaped = 0;
+    while (reaped < count) {
+        status = syscall(SYS_io_uring_enter, batch->ring, count - submitted,
+                         count - reaped, IORING_ENTER_GETEVENTS, NULL, 0);
+        if (status < 0) {
+            if (errno == EINTR)
+                continue;
+            for (index = 0; index < submitted; index++)
+                if (!ops[index]->submitted) {
+                    ops[index]->submitted = true;
+                    ops[index]->result = -errno;
+                }
+            ring_close(batch);
+            return submitted;
         }
-        tmpiov[i].iov_base = (char *) tmpiov[i].iov_base + offset;
-        tmpiov[i].iov_len -= offset;
-
-        /* Write out what's left and return success if it's all written. */
-        status = writev(fd, tmpiov + i, iovleft);
-        if (status <= 0)
-            offset = 0;
-        else {
-            offset = status;
-            left -= offset;
-            count = 0;
+        submitted += (size_t) status;
+        head = *batch->cq_head;
+        tail = __atomic_load_n(batch->cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++, reaped++) {
+            cqe = &batch->cqes[head & *batch->cq_mask];
+            op = ops[cqe->user_data];
+            op->submitted = true;
+            op->result = cqe->res;
         }
-    } while (left > 0 && (status >= 0 || errno == EINTR));
+        __atomic_store_n(batch->cq_head, head, __ATOMIC_RELEASE);
+    }
+    return count;
+}
+#    endif /* XWRITE_URING */
+
+
+/*
+ * Write the part of a write at the current file position that's left after
+ * done bytes have been written.  Returns the bytes written by this call or
+ * -1 on error.
+ */
+static ssize_t
+writev_remaining(const struct xwrite_op *op, size_t done)
+{
+    struct iovec *tmpiov, *iov;
+    ssize_t status;
+    int iovcnt;
 
-    /* We're either done or got an error; if we're done, left is now 0. */
+    if (done == 0)
+        return xwritev(op->fd, op->iov, op->iovcnt);
+    tmpiov = calloc(op->iovcnt, sizeof(struct iovec));
+    if (tmpiov == NULL)
+        return -1;
+    memcpy(tmpiov, op->iov, op->iovcnt * sizeof(struct iovec));
+    iov = tmpiov;
+    iovcnt = op->iovcnt;
+    xwritev_advance(&iov, &iovcnt, done);
+    status = xwritev_consume(op->fd, iov, iovcnt);
     free(tmpiov);
-    return (left == 0) ? total : -1;
+    return status;
+}
+
+
+/*
+ * Finish a queued write, using the synchronous loops for whatever io_uring
+ * didn't do.  Returns the size of the write or -1 on error.
+ */
+static ssize_t
+finish_op(const struct xwrite_op *op)
+{
+    size_t done = 0;
+    ssize_t status;
+
+    if (op->submitted) {
+        if (op->result >= 0)
+            done = (size_t) op->result;
+        else if (op->result != -EINTR && op->result != -EAGAIN
+                 && op->result != -ECANCELED) {
+            errno = (int) -op->result;
+            return -1;
+        }
+        if (done >= op->size)
+            return (ssize_t) op->size;
+    }
+    if (op->positional)
+        status = xpwrite(op->fd, (const char *) op->single.iov_base + done,
+                         op->size - done, op->offset + (off_t) done);
+    else
+        status = writev_remaining(op, done);
+    return (status < 0) ? -1 : (ssize_t) op->size;
+}
+
+
+/*
+ * Create a new batch.
+ */
+struct xwrite_batch *
+xwrite_batch_new(unsigned int size)
+{
+    struct xwrite_batch *batch;
+
+    batch = xcalloc(1, sizeof(struct xwrite_batch));
+    batch->size = (size == 0) ? XWRITE_BATCH_SIZE : size;
+#    ifdef XWRITE_URING
+    ring_open(batch);
+#    endif
+    return batch;
+}
+
+
+/*
+ * Free a batch without doing any queued writes.
+ */
+void
+xwrite_batch_free(struct xwrite_batch *batch)
+{
+    if (batch == NULL)
+        return;
+#    ifdef XWRITE_URING
+    ring_close(batch);
+#    endif
+    free(batch->ops);
+    free(batch);
 }
+
+
+/*
+ * Add a new operation to a batch and return it.
+ */
+static struct xwrite_op *
+batch_add(struct xwrite_batch *batch, int fd)
+{
+    struct xwrite_op *op;
+
+    if (batch->count == batch->allocated) {
+        batch->allocated =
+            (batch->allocated == 0) ? batch->size : batch->allocated * 2;
+        batch->ops = xreallocarray(batch->ops, batch->allocated,
+                                   sizeof(struct xwrite_op));
+    }
+    op = &batch->ops[batch->count++];
+    memset(op, 0, sizeof(*op));
+    op->fd = fd;
+    return op;
+}
+
+
+/*
+ * Queue a positional write.
+ */
+void
+xwrite_batch_pwrite(struct xwrite_batch *batch, int fd, const void *buffer,
+                    size_t size, off_t offset)
+{
+    struct xwrite_op *op;
+
+    if (size == 0)
+        return;
+    op = batch_add(batch, fd);
+    op->positional = true;
+    op->single.iov_base = (void *) buffer;
+    op->single.iov_len = size;
+    op->offset = offset;
+    op->size = size;
+}
+
+
+/*
+ * Queue a write at the current file position.  Bad counts are queued so that
+ * the error is reported by xwrite_batch_submit.
+ */
+void
+xwrite_batch_writev(struct xwrite_batch *batch, int fd,
+                    const struct iovec iov[], int iovcnt)
+{
+    struct xwrite_op *op;
+    size_t size = 0;
+    int i;
+
+    for (i = 0; i < iovcnt; i++)
+        size += iov[i].iov_len;
+    if (iovcnt >= 0 && size == 0)
+        return;
+    op = batch_add(batch, fd);
+    op->iov = iov;
+    op->iovcnt = iovcnt;
+    op->size = size;
+}
+
+
+/*
+ * Do all the queued writes.  Positional writes go first, followed by the
+ * writes at the current file position in order.  Each group of operations
+ * that fits in the ring is submitted and then finished before the next, so
+ * that the remainder of a short write at the file position is written before
+ * anything after it.
+ */
+ssize_t
+xwrite_batch_submit(struct xwrite_batch *batch)
+{
+    struct xwrite_op **order;
+    size_t i, n, start, end;
+    ssize_t status, total = 0;
+    int error = 0;
+    bool failed = false;
+
+    if (batch->count == 0)
+        return 0;
+    order = xcalloc(batch->count, sizeof(struct xwrite_op *));
+    n = 0;
+    for (i = 0; i < batch->count; i++)
+        if (batch->ops[i].positional)
+            order[n++] = &batch->ops[i];
+    for (i = 0; i < batch->count; i++)
+        if (!batch->ops[i].positional)
+            order[n++] = &batch->ops[i];
+
+    /* Stop at the first failed write at the file position. */
+    for (start = 0; start < n; start = end) {
+        end = start;
+#    ifdef XWRITE_URING
+        end += ring_submit(batch, order + start, n - start);
+#    endif
+        if (end == start)
+            end = start + 1;
+        for (i = start; i < end; i++) {
+            status = finish_op(order[i]);
+            if (status >= 0) {
+                total += status;
+                continue;
+            }
+            if (!failed) {
+                failed = true;
+                error = errno;
+            }
+            if (!order[i]->positional) {
+                end = n;
+                break;
+            }
+        }
+    }
+
+    /* Empty the batch for reuse. */
+    free(order);
+    batch->count = 0;
+    if (failed) {
+        errno = error;
+        return -1;
+    }
+    return total;
+}
+
+#endif /* !_WIN32 */
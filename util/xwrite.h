@@ -36,8 +36,9 @@
 
 #include <sys/types.h>
 
-/* Forward declaration to avoid an include. */
+/* Forward declarations to avoid includes. */
 struct iovec;
+struct xwrite_batch;
 
 BEGIN_DECLS
 
@@ -56,6 +57,56 @@ ssize_t xwrite(int fd, const void *buffer, size_t size)
 ssize_t xwritev(int fd, const struct iovec *iov, int iovcnt)
     __attribute__((__nonnull__));
 
+/*
+ * Like xwritev, but modifies the iovec array as data is written instead of
+ * copying it after a partial write, so never allocates memory.  The contents
+ * of the array are unspecified afterwards.
+ */
+ssize_t xwritev_consume(int fd, struct iovec *iov, int iovcnt)
+    __attribute__((__nonnull__));
+
+/*
+ * Advance a cursor into an iovec array in place past bytes that have been
+ * written.  iov is updated to point to the first entry with data left, which
+ * has its base and length adjusted, and iovcnt to the number of entries left
+ * (0 once everything has been written).
+ */
+void xwritev_advance(struct iovec **iov, int *iovcnt, size_t bytes)
+    __attribute__((__nonnull__));
+
+/*
+ * Batched writes.  Create a batch with room for the given number of
+ * operations in flight at once (a default is used if 0), queue writes with
+ * xwrite_batch_pwrite and xwrite_batch_writev, and then do them all with
+ * xwrite_batch_submit.  The buffers and iovec arrays must remain valid until
+ * xwrite_batch_submit returns.
+ *
+ * On Linux, the writes are submitted together with io_uring and any partial
+ * or interrupted writes are finished with the xpwrite and xwritev loops, so
+ * the semantics are the same as calling those functions in turn.  Elsewhere,
+ * or if io_uring isn't available, xwrite_batch_submit just calls them.
+ * Positional writes may be done in any order and before the writes at the
+ * current file position, which are done in the order they were queued.
+ *
+ * xwrite_batch_submit returns the total bytes written or -1 with errno set
+ * from the first write that failed, and empties the batch so that it can be
+ * reused.  After a failed xwrite_batch_writev write, later writes at the
+ * current file position are not attempted.
+ */
+#ifndef _WIN32
+void xwrite_batch_free(struct xwrite_batch *);
+struct xwrite_batch *xwrite_batch_new(unsigned int size)
+    __attribute__((__warn_unused_result__, __malloc__(xwrite_batch_free)));
+void xwrite_batch_pwrite(struct xwrite_batch *, int fd, const void *buffer,
+                         size_t size, off_t offset)
+    __attribute__((__nonnull__));
+void xwrite_batch_writev(struct xwrite_batch *, int fd,
+                         const struct iovec *iov, int iovcnt)
+    __attribute__((__nonnull__));
+ssize_t xwrite_batch_submit(struct xwrite_batch *)
+    __attribute__((__nonnull__));
+#endif
+
 /* Undo default visibility change. */
 #pragma GCC visibility pop
 